@@ -4,6 +4,9 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+// The config file selects the sector buffered version of the synchronous and
+// asynchronous modes with the values 3 and 4. Records are then collected in two
+// sector aligned buffers that are written alternately as whole sectors.
 enum usddeckLoggingMode_e
 {
   usddeckLoggingMode_Disabled = 0,
@@ -11,6 +14,15 @@ enum usddeckLoggingMode_e
   usddeckLoggingMode_Asyncronous,
 };
 
+// Events that start a capture of the event triggered group, see config.txt
+enum usddeckEvent_e
+{
+  usddeckEvent_EmergencyStop = 0,
+  usddeckEvent_Tumbled,
+  usddeckEvent_EstimatorReset,
+  usddeckEventCount,
+};
+
 // returns true if logging is enabled
 bool usddeckLoggingEnabled(void);
 
@@ -23,6 +35,10 @@ int usddeckFrequency(void);
 // For synchronous logging: add a new log entry
 void usddeckTriggerLogging(void);
 
+// Log an event and write the pre-trigger buffer of the event triggered group,
+// if configured. Can be called from any task.
+void usddeckTriggerEvent(enum usddeckEvent_e event);
+
 // returns size of current file if logging is stopped (0 otherwise)
 uint32_t usddeckFileSize(void);
 
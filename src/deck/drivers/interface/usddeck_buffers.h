@@ -0,0 +1,89 @@
+/**
+ * ,---------,       ____  _ __
+ * |  ,-^-,  |      / __ )(_) /_______________ _____  ___
+ * | (  O  ) |     / __  / / __/ ___/ ___/ __ `/_  / / _ \
+ * | / ,--´  |    / /_/ / / /_/ /__/ /  / /_/ / / /_/  __/
+ *    +------`   /_____/_/\__/\___/_/   \__,_/ /___/\___/
+ *
+ * Crazyflie control firmware
+ *
+ * Copyright (C) 2020 Bitcraze AB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, in version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * usddeck_buffers.h - Ping-pong record buffers of the sector buffered uSD logging modes
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// A buffer starts with the number of records it holds and ends with the crc of the records
+#define USD_BUFFER_HEADER_SIZE 2
+#define USD_BUFFER_CRC_SIZE 4
+
+typedef struct usdSectorBuffer_s {
+  uint8_t* data;
+  uint16_t length;
+  uint16_t records;
+  volatile bool isFull;
+} usdSectorBuffer_t;
+
+/**
+ * Two buffers, filled by the logger and written by the writer task. The logger fills the active buffer and hands it
+ * over to the writer when the next record does not fit, then continues in the other one. Records are dropped while
+ * both buffers are full.
+ *
+ * The buffers are filled in alternating order, starting with the first one, and are written in the same order. The
+ * writer always writes the oldest full buffer first.
+ */
+typedef struct usdSectorBufferPair_s {
+  usdSectorBuffer_t buffers[2];
+  uint16_t size;
+  volatile uint8_t active; // Filled by the logger
+  uint8_t next;            // Next one to write
+} usdSectorBufferPair_t;
+
+void usdSectorBufferPairInit(usdSectorBufferPair_t* pair, uint8_t* data0, uint8_t* data1, const uint16_t size);
+
+/**
+ * Empty both buffers, the next record goes to the first one. Only call when the logger is not using the buffers.
+ */
+void usdSectorBufferPairReset(usdSectorBufferPair_t* pair);
+
+/**
+ * Reserve space for a record, called by the logger
+ *
+ * @param size The size of the record
+ * @param isHandedOver Set to true if a buffer was handed over to the writer, which should then be woken up
+ * @return Where to store the record, or NULL if the record must be dropped
+ */
+uint8_t* usdSectorBufferPairReserve(usdSectorBufferPair_t* pair, const uint16_t size, bool* isHandedOver);
+
+/**
+ * @return The oldest full buffer, or NULL if no buffer is full. Call usdSectorBufferPairWritten() when it is written.
+ */
+usdSectorBuffer_t* usdSectorBufferPairGetFull(usdSectorBufferPair_t* pair);
+
+/**
+ * Empty the buffer returned by usdSectorBufferPairGetFull() and give it back to the logger
+ */
+void usdSectorBufferPairWritten(usdSectorBufferPair_t* pair);
+
+/**
+ * Hand over the active buffer to the writer if it holds any records, when logging stops. Only call when the logger
+ * is not using the buffers.
+ */
+void usdSectorBufferPairCloseActive(usdSectorBufferPair_t* pair);
@@ -146,11 +146,23 @@ typedef union frame_u {
   char data[7];
 } __attribute__((packed)) frame_t;
 
+// Frames lost in UART RX DMA overruns or skipped while resynchronizing, and the number of overruns
+static uint32_t serialFramesDropped;
+static uint32_t serialOverruns;
+
 static bool getFrame(frame_t *frame)
 {
+  uint32_t droppedBytes = uart1GetBytesWithDma((uint8_t*)frame->data, sizeof(frame->data));
+  if (droppedBytes > 0) {
+    // The frame boundaries are lost, do not interpret the data as a sync frame
+    frame->sync = 0;
+    serialOverruns++;
+    serialFramesDropped += (droppedBytes + sizeof(frame->data) - 1) / sizeof(frame->data);
+    return false;
+  }
+
   int syncCounter = 0;
   for(int i=0; i<7; i++) {
-    uart1Getchar(&frame->data[i]);
     if (frame->data[i] != 0) {
       syncCounter += 1;
     }
@@ -172,36 +184,43 @@ static float sweepStd = 0.0004;
 static void estimatePosition(pulseProcessorResult_t* angles, int baseStation) {
   #ifndef FF_EXPERIMENTAL
   memset(&ext_pos, 0, sizeof(ext_pos));
-  int sensorsUsed = 0;
   float delta;
 
-  // Average over all sensors with valid data
-  for (size_t sensor = 0; sensor < PULSE_PROCESSOR_N_SENSORS; sensor++) {
-      pulseProcessorBaseStationMeasuremnt_t* bs0Measurement = &angles->sensorMeasurements[sensor].baseStatonMeasurements[0];
-      pulseProcessorBaseStationMeasuremnt_t* bs1Measurement = &angles->sensorMeasurements[sensor].baseStatonMeasurements[1];
-
-      if (bs0Measurement->validCount == PULSE_PROCESSOR_N_SWEEPS && bs1Measurement->validCount == PULSE_PROCESSOR_N_SWEEPS) {
-        lighthouseGeometryGetPositionFromRayIntersection(lighthouseBaseStationsGeometry, bs0Measurement->correctedAngles, bs1Measurement->correctedAngles, position, &delta);
-
-        deltaLog = delta;
-
-        ext_pos.x += position[0];
-        ext_pos.y += position[1];
-        ext_pos.z += position[2];
-        sensorsUsed++;
+  // Sensor positions relative to the deck center, rotated with the current attitude estimate
+  float R[3][3];
+  estimatorKalmanGetEstimatedRot((float*)R);
+  arm_matrix_instance_f32 RR = {3, 3, (float*)R};
+  const vec3d origin = {0, 0, 0};
 
-        STATS_CNT_RATE_EVENT(&positionRate);
+  // Use all sensors and base stations with valid data, a sensor does not have to see all base stations
+  static lighthouseGeometrySweepPair_t sweepPairs[PULSE_PROCESSOR_N_SENSORS * PULSE_PROCESSOR_N_BASE_STATIONS];
+  int count = 0;
+  for (size_t sensor = 0; sensor < PULSE_PROCESSOR_N_SENSORS; sensor++) {
+    for (int bs = 0; bs < PULSE_PROCESSOR_N_BASE_STATIONS; bs++) {
+      pulseProcessorBaseStationMeasuremnt_t* bsMeasurement = &angles->sensorMeasurements[sensor].baseStatonMeasurements[bs];
+      if (bsMeasurement->validCount == PULSE_PROCESSOR_N_SWEEPS) {
+        lighthouseGeometrySweepPair_t* sweepPair = &sweepPairs[count++];
+        sweepPair->baseStation = &lighthouseBaseStationsGeometry[bs];
+        sweepPair->angles[0] = bsMeasurement->correctedAngles[0];
+        sweepPair->angles[1] = bsMeasurement->correctedAngles[1];
+        lighthouseGeometryGetSensorPosition(origin, &RR, sensorDeckPositions[sensor], sweepPair->sensorOffset);
       }
+    }
   }
 
-  ext_pos.x /= sensorsUsed;
-  ext_pos.y /= sensorsUsed;
-  ext_pos.z /= sensorsUsed;
+  if (lighthouseGeometryGetPositionFromSweepPairs(sweepPairs, count, position, &delta)) {
+    deltaLog = delta;
+
+    ext_pos.x = position[0];
+    ext_pos.y = position[1];
+    ext_pos.z = position[2];
 
-  // Make sure we feed sane data into the estimator
-  if (isfinite(ext_pos.pos[0]) && isfinite(ext_pos.pos[1]) && isfinite(ext_pos.pos[2])) {
-    ext_pos.stdDev = 0.01;
-    estimatorEnqueuePosition(&ext_pos);
+    // Make sure we feed sane data into the estimator
+    if (isfinite(ext_pos.pos[0]) && isfinite(ext_pos.pos[1]) && isfinite(ext_pos.pos[2])) {
+      ext_pos.stdDev = 0.01;
+      estimatorEnqueuePosition(&ext_pos);
+      STATS_CNT_RATE_EVENT(&positionRate);
+    }
   }
   #else
   // Experimental code for pushing sweep angles into the kalman filter
@@ -310,11 +329,40 @@ static void estimatePose(pulseProcessorResult_t* angles, int baseStation) {
   estimateYaw(angles, baseStation);
 }
 
+#ifndef FF_EXPERIMENTAL
+// The latest complete cycle of each base station. A position is solved every time a base station completes a cycle,
+// using that cycle and the latest cycle of the other base station. The data of a base station is dropped if the other
+// base station completes more than LATEST_CYCLE_MAX_AGE cycles without it.
+#define LATEST_CYCLE_MAX_AGE 1
+static pulseProcessorResult_t latestCycles;
+static int latestCycleAge[PULSE_PROCESSOR_N_BASE_STATIONS];
+
+static void storeCompletedCycle(pulseProcessor_t* ppState, int baseStation) {
+  pulseProcessorApplyCalibration(ppState, &angles, baseStation);
+
+  for (size_t sensor = 0; sensor < PULSE_PROCESSOR_N_SENSORS; sensor++) {
+    latestCycles.sensorMeasurements[sensor].baseStatonMeasurements[baseStation] = angles.sensorMeasurements[sensor].baseStatonMeasurements[baseStation];
+  }
+  pulseProcessorClear(&angles, baseStation);
+
+  for (int bs = 0; bs < PULSE_PROCESSOR_N_BASE_STATIONS; bs++) {
+    if (bs == baseStation) {
+      latestCycleAge[bs] = 0;
+    } else if (latestCycleAge[bs] < LATEST_CYCLE_MAX_AGE) {
+      latestCycleAge[bs]++;
+    } else {
+      pulseProcessorClear(&latestCycles, bs);
+    }
+  }
+}
+#endif
+
 static void lighthouseTask(void *param)
 {
   bool synchronized = false;
   int syncCounter = 0;
-  char c;
+  uint32_t skippedBytes;
+  uint8_t c;
   static frame_t frame;
   static pulseProcessor_t ppState = {};
 
@@ -339,9 +387,11 @@ static void lighthouseTask(void *param)
   while(1) {
     // Synchronize
     syncCounter = 0;
+    skippedBytes = 0;
     while (!synchronized) {
 
-      uart1Getchar(&c);
+      uart1GetBytesWithDma(&c, 1);
+      skippedBytes++;
       if (c != 0) {
         syncCounter += 1;
       } else {
@@ -349,6 +399,8 @@ static void lighthouseTask(void *param)
       }
       synchronized = syncCounter == 7;
     }
+    // The last 7 bytes are the sync frame
+    serialFramesDropped += (skippedBytes - 7) / sizeof(frame.data);
 
     comSynchronized = true;
     DEBUG_PRINT("Synchronized!\n");
@@ -369,14 +421,11 @@ static void lighthouseTask(void *param)
       if (pulseProcessorProcessPulse(&ppState, frame.sensor, frame.timestamp, frame.width, &angles, &basestation, &axis)) {
         STATS_CNT_RATE_EVENT(&frameRate);
         #ifndef FF_EXPERIMENTAL
-        if (basestation == 1 && axis == 1) {
+        if (axis == 1) {
           STATS_CNT_RATE_EVENT(&cycleRate);
 
-          pulseProcessorApplyCalibration(&ppState, &angles, 0);
-          pulseProcessorApplyCalibration(&ppState, &angles, 1);
-          estimatePose(&angles, 1);
-          pulseProcessorClear(&angles, 0);
-          pulseProcessorClear(&angles, 1);
+          storeCompletedCycle(&ppState, basestation);
+          estimatePose(&latestCycles, basestation);
         }
         #else
         if (axis == 1) {
@@ -453,6 +502,7 @@ static void lighthouseInit(DeckInfo *info)
   if (isInit) return;
 
   uart1Init(230400);
+  uart1EnableRxDma();
   lhblInit(I2C1_DEV);
 
   xTaskCreate(lighthouseTask, LIGHTHOUSE_TASK_NAME,
@@ -526,6 +576,8 @@ LOG_ADD(LOG_UINT16, width3, &pulseWidth[3])
 #endif
 
 LOG_ADD(LOG_UINT8, comSync, &comSynchronized)
+LOG_ADD(LOG_UINT32, serDrop, &serialFramesDropped)
+LOG_ADD(LOG_UINT32, serOvr, &serialOverruns)
 LOG_GROUP_STOP(lighthouse)
 
 #endif // DISABLE_LIGHTHOUSE_DRIVER
@@ -39,8 +39,10 @@
 #include "estimator.h"
 
 #include "physicalConstants.h"
+#include "clockCorrectionEngine.h"
 
 #define MEASUREMENT_NOISE_STD 0.15f
+#define METERS_PER_TICK ((float)(SPEED_OF_LIGHT / LOCODECK_TS_FREQ))
 #define STATS_INTERVAL 500
 #define ANCHOR_OK_TIMEOUT 1500
 
@@ -83,7 +85,9 @@ static lpsTdoa2AlgoOptions_t* options = &defaultOptions;
 typedef struct {
   rangePacket2_t packet;
   dwTime_t arrival;
-  double clockCorrection_T_To_A;
+  // The clock correction minus 1, to keep the resolution in a float
+  float clockCorrectionDeviation_T_To_A;
+  bool isClockCorrectionOk;
 
   uint32_t anchorStatusTimeout;
 } history_t;
@@ -141,7 +145,7 @@ static uint64_t truncateToAnchorTimeStamp(uint64_t fullTimeStamp) {
   return fullTimeStamp & 0x00FFFFFFFFul;
 }
 
-static void enqueueTDOA(uint8_t anchorA, uint8_t anchorB, double distanceDiff) {
+static void enqueueTDOA(uint8_t anchorA, uint8_t anchorB, float distanceDiff) {
   tdoaMeasurement_t tdoa = {
     .stdDev = MEASUREMENT_NOISE_STD,
     .distanceDiff = distanceDiff,
@@ -173,7 +177,7 @@ static bool isSeqNrConsecutive(uint8_t prevSeqNr, uint8_t currentSeqNr) {
 // rxAr_by_An_in_cl_An should be interpreted as "The time when packet was received from the Reference
 // Anchor by Anchor N expressed in the clock of Anchor N"
 
-static bool calcClockCorrection(double* clockCorrection, const uint8_t anchor, const rangePacket2_t* packet, const dwTime_t* arrival) {
+static bool calcClockCorrectionDeviation(float* clockCorrectionDeviation, const uint8_t anchor, const rangePacket2_t* packet, const dwTime_t* arrival) {
 
   if (! isSeqNrConsecutive(history[anchor].packet.sequenceNrs[anchor], packet->sequenceNrs[anchor])) {
     return false;
@@ -184,10 +188,7 @@ static bool calcClockCorrection(double* clockCorrection, const uint8_t anchor, c
   const int64_t latest_rxAn_by_T_in_cl_T = history[anchor].arrival.full;
   const int64_t latest_txAn_in_cl_An = history[anchor].packet.timestamps[anchor];
 
-  const double frameTime_in_cl_An = truncateToAnchorTimeStamp(txAn_in_cl_An - latest_txAn_in_cl_An);
-  const double frameTime_in_T = truncateToLocalTimeStamp(rxAn_by_T_in_cl_T - latest_rxAn_by_T_in_cl_T);
-
-  *clockCorrection = frameTime_in_cl_An / frameTime_in_T;
+  *clockCorrectionDeviation = clockCorrectionEngineCalculateDeviation(txAn_in_cl_An, latest_txAn_in_cl_An, rxAn_by_T_in_cl_T, latest_rxAn_by_T_in_cl_T, 0x00FFFFFFFFul);
   return true;
 }
 
@@ -202,11 +203,11 @@ static bool calcDistanceDiff(float* tdoaDistDiff, const uint8_t previousAnchor,
   const int64_t rxAn_by_T_in_cl_T  = arrival->full;
   const int64_t rxAr_by_An_in_cl_An = packet->timestamps[previousAnchor];
   const int64_t tof_Ar_to_An_in_cl_An = packet->distances[previousAnchor];
-  const double clockCorrection = history[anchor].clockCorrection_T_To_A;
+  const float clockCorrectionDeviation = history[anchor].clockCorrectionDeviation_T_To_A;
 
   const bool isAnchorDistanceOk = isValidTimeStamp(tof_Ar_to_An_in_cl_An);
   const bool isRxTimeInTagOk = isValidTimeStamp(rxAr_by_An_in_cl_An);
-  const bool isClockCorrectionOk = (clockCorrection != 0.0);
+  const bool isClockCorrectionOk = history[anchor].isClockCorrectionOk;
 
   if (! (isAnchorDistanceOk && isRxTimeInTagOk && isClockCorrectionOk)) {
     return false;
@@ -217,9 +218,13 @@ static bool calcDistanceDiff(float* tdoaDistDiff, const uint8_t previousAnchor,
   const int64_t rxAr_by_T_in_cl_T = history[previousAnchor].arrival.full;
 
   const int64_t delta_txAr_to_txAn_in_cl_An = (tof_Ar_to_An_in_cl_An + truncateToAnchorTimeStamp(txAn_in_cl_An - rxAr_by_An_in_cl_An));
-  const int64_t timeDiffOfArrival_in_cl_An =  truncateToAnchorTimeStamp(rxAn_by_T_in_cl_T - rxAr_by_T_in_cl_T) * clockCorrection - delta_txAr_to_txAn_in_cl_An;
+  const int64_t delta_rxAr_to_rxAn_in_cl_T = truncateToAnchorTimeStamp(rxAn_by_T_in_cl_T - rxAr_by_T_in_cl_T);
+
+  // rxDelta * clockCorrection is split into rxDelta + rxDelta * deviation, the uncorrected part is calculated with integers
+  const int64_t uncorrectedTimeDiffOfArrival = delta_rxAr_to_rxAn_in_cl_T - delta_txAr_to_txAn_in_cl_An;
+  const float timeDiffOfArrival_in_cl_An = (float)uncorrectedTimeDiffOfArrival + (float)delta_rxAr_to_rxAn_in_cl_T * clockCorrectionDeviation;
 
-  *tdoaDistDiff = SPEED_OF_LIGHT * timeDiffOfArrival_in_cl_An / LOCODECK_TS_FREQ;
+  *tdoaDistDiff = timeDiffOfArrival_in_cl_An * METERS_PER_TICK;
 
   return true;
 }
@@ -312,8 +317,10 @@ static bool rxcallback(dwDevice_t *dev) {
       }
 #endif
 
-      calcClockCorrection(&history[anchor].clockCorrection_T_To_A, anchor, packet, &arrival);
-      logClockCorrection[anchor] = history[anchor].clockCorrection_T_To_A;
+      if (calcClockCorrectionDeviation(&history[anchor].clockCorrectionDeviation_T_To_A, anchor, packet, &arrival)) {
+        history[anchor].isClockCorrectionOk = true;
+        logClockCorrection[anchor] = 1.0f + history[anchor].clockCorrectionDeviation_T_To_A;
+      }
 
       if (anchor != previousAnchor) {
         float tdoaDistDiff = 0.0;
@@ -262,8 +262,8 @@ static uint32_t onEvent(dwDevice_t *dev, uwbEvent_t event) {
   return MAX_TIMEOUT;
 }
 
-static void sendTdoaToEstimatorCallback(tdoaMeasurement_t* tdoaMeasurement) {
-  estimatorEnqueueTDOA(tdoaMeasurement);
+static void sendTdoaToEstimatorCallback(const tdoaMeasurement_t tdoaMeasurements[], const int count) {
+  estimatorEnqueueTDOABatch(tdoaMeasurements, count);
 
   #ifdef LPS_2D_POSITION_HEIGHT
   // If LPS_2D_POSITION_HEIGHT is defined we assume that we are doing 2D positioning.
@@ -348,4 +348,5 @@ LOG_GROUP_STOP(tdoa3)
 PARAM_GROUP_START(tdoa3)
 PARAM_ADD(PARAM_UINT8, logId, &engineState.stats.newAnchorId)
 PARAM_ADD(PARAM_UINT8, logOthrId, &engineState.stats.newRemoteAnchorId)
+PARAM_ADD(PARAM_UINT8, pairs, &engineState.pairsPerPacket)
 PARAM_GROUP_STOP(tdoa3)
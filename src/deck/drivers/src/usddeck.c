@@ -49,6 +49,7 @@
 
 #include "deck.h"
 #include "usddeck.h"
+#include "usddeck_buffers.h"
 #include "deck_spi.h"
 #include "system.h"
 #include "sensors.h"
@@ -62,6 +63,44 @@
 // Hardware defines
 #define USD_CS_PIN    DECK_GPIO_IO4
 
+// Size of each of the two buffers used in the sector buffered modes, in sectors
+#ifndef USD_BUFFER_SECTORS
+#define USD_BUFFER_SECTORS 4
+#endif
+
+#define USD_SECTOR_SIZE 512
+#define USD_BUFFER_SIZE (USD_BUFFER_SECTORS * USD_SECTOR_SIZE)
+
+// Variable groups, started by "rate=" and "event=" lines in the config file.
+// With groups, the file header starts with a 0 and the number of groups,
+// followed by the usual header of each group. Every record starts with the
+// index of its group, or USD_EVENT_RECORD for a record of the tick and the
+// usddeckEvent_e of an event.
+#define USD_MAX_GROUPS 8
+#define USD_EVENT_RECORD 0xFF
+
+typedef struct usdLogGroup_s {
+  uint16_t frequency;
+  uint16_t divider; // of the base frequency
+  uint16_t firstSlot;
+  uint16_t numSlots;
+  uint16_t numBytes;
+  bool isEventTriggered;
+  uint16_t preTriggerMs;
+  uint16_t postTriggerMs;
+} usdLogGroup_t;
+
+// Pre-trigger ring of the event triggered group. The logger stops writing to
+// it on an event, until the writer has dumped it to the file.
+typedef struct usdEventRing_s {
+  uint8_t* data; // dynamically allocated
+  uint16_t capacity;
+  uint16_t recordSize;
+  uint16_t head;
+  uint16_t count;
+  volatile bool isFrozen;
+} usdEventRing_t;
+
 typedef struct usdLogConfig_s {
   char filename[13];
   uint8_t items;
@@ -72,6 +111,11 @@ typedef struct usdLogConfig_s {
   int* varIds; // dynamically allocated
   bool enableOnStartup;
   enum usddeckLoggingMode_e mode;
+  bool sectorBuffered;
+  bool grouped;
+  uint8_t numGroups;
+  int8_t eventGroup; // -1 if none
+  usdLogGroup_t groups[USD_MAX_GROUPS];
 } usdLogConfig_t;
 
 #define USD_WRITE(FILE, MESSAGE, BYTES, BYTES_WRITTEN, CRC_VALUE, CRC_FINALXOR, CRC_TABLE) \
@@ -90,6 +134,14 @@ static void csLow(void);
 
 static void usdLogTask(void* prm);
 static void usdWriteTask(void* prm);
+static bool parseGroupLine(char* line);
+static int encodeRecord(uint8_t* dest, const usdLogGroup_t* group);
+static uint8_t* reserveRecord(uint16_t size);
+static void logGroups(void);
+static crc writeGroupHeader(const usdLogGroup_t* group, crc crcValue);
+static void writeSectorBuffer(usdSectorBuffer_t* buffer);
+static void dumpEventRing(void);
+static void updateWriteStats(uint32_t bytes, TickType_t duration);
 
 static crc crcTable[256];
 
@@ -113,6 +165,23 @@ static uint8_t* usdLogBufferStart;
 static uint8_t* usdLogBuffer;
 static TaskHandle_t xHandleWriteTask;
 
+// Buffers of the sector buffered modes, filled by usddeckTriggerLogging() and written by usdWriteTask
+static usdSectorBufferPair_t usdSectorBuffers;
+
+static uint32_t triggerCount;
+static usdEventRing_t eventRing;
+static TickType_t eventCaptureEnd;
+static volatile bool eventPending[usddeckEventCount];
+static uint16_t eventCount;
+
+// Write statistics, exported as log variables
+static uint32_t bytesWrittenTotal;
+static uint32_t writeThroughput; // bytes/s
+static uint16_t maxWriteTime; // ms
+static uint32_t droppedRecords;
+static uint32_t throughputWindowStart;
+static uint32_t throughputWindowBytes;
+
 static bool enableLogging;
 static uint32_t lastFileSize = 0;
 
@@ -299,13 +368,33 @@ static void usdInit(DeckInfo *info)
 
         line = f_gets_without_comments(readBuffer, sizeof(readBuffer), &logFile);
         if (!line) break;
-        usdLogConfig.mode = strtol(line, &endptr, 10);
+        int mode = strtol(line, &endptr, 10);
+        if (mode < usddeckLoggingMode_Disabled || mode > 2 * usddeckLoggingMode_Asyncronous) {
+          DEBUG_PRINT("Unknown logging mode %d, using %d\n", mode, usddeckLoggingMode_SynchronousStabilizer);
+          mode = usddeckLoggingMode_SynchronousStabilizer;
+        }
+        // Modes 3 and 4 are the sector buffered versions of modes 1 and 2
+        usdLogConfig.sectorBuffered = (mode > usddeckLoggingMode_Asyncronous);
+        if (usdLogConfig.sectorBuffered) {
+          mode -= usddeckLoggingMode_Asyncronous;
+        }
+        usdLogConfig.mode = mode;
 
         usdLogConfig.numSlots = 0;
         usdLogConfig.numBytes = 0;
+        /* variables before the first group line are logged at the base frequency */
+        usdLogConfig.numGroups = 1;
+        usdLogConfig.eventGroup = -1;
+        usdLogConfig.groups[0] = (usdLogGroup_t){
+          .frequency = usdLogConfig.frequency,
+          .divider = 1,
+        };
         while (line) {
           line = f_gets_without_comments(readBuffer, sizeof(readBuffer), &logFile);
           if (!line) break;
+          if (parseGroupLine(line)) {
+            continue;
+          }
           char* group = line;
           char* name = 0;
           for (int i = 0; i < strlen(line); ++i) {
@@ -322,17 +411,34 @@ static void usdInit(DeckInfo *info)
             continue;
           }
 
+          usdLogGroup_t* currentGroup = &usdLogConfig.groups[usdLogConfig.numGroups - 1];
+          ++currentGroup->numSlots;
+          currentGroup->numBytes += logVarSize(logGetType(varid));
           ++usdLogConfig.numSlots;
           usdLogConfig.numBytes += logVarSize(logGetType(varid));
         }
         f_close(&logFile);
 
+        /* groups need the record format and the writer of the sector buffered modes */
+        if (usdLogConfig.grouped) {
+          usdLogConfig.sectorBuffered = true;
+        }
+
         DEBUG_PRINT("Config read [OK].\n");
         DEBUG_PRINT("Frequency: %dHz. Buffer size: %d\n",
                     usdLogConfig.frequency, usdLogConfig.bufferSize);
         DEBUG_PRINT("Filename: %s\n", usdLogConfig.filename);
-        DEBUG_PRINT("enOnStartup: %d. mode: %d\n", usdLogConfig.enableOnStartup, usdLogConfig.mode);
+        DEBUG_PRINT("enOnStartup: %d. mode: %d. sector buffered: %d\n",
+                    usdLogConfig.enableOnStartup, usdLogConfig.mode, usdLogConfig.sectorBuffered);
         DEBUG_PRINT("slots: %d, %d\n", usdLogConfig.numSlots, usdLogConfig.numBytes);
+        if (usdLogConfig.grouped) {
+          for (int i = 0; i < usdLogConfig.numGroups; i++) {
+            usdLogGroup_t* group = &usdLogConfig.groups[i];
+            DEBUG_PRINT("group %d: %dHz, slots: %d, %d%s\n", i,
+                        usdLogConfig.frequency / group->divider, group->numSlots, group->numBytes,
+                        group->isEventTriggered ? ", event triggered" : "");
+          }
+        }
 
         /* create usd-log task */
         xTaskCreate(usdLogTask, USDLOG_TASK_NAME,
@@ -354,6 +460,69 @@ static void usdInit(DeckInfo *info)
   isInit = true;
 }
 
+// Handles the "rate=<Hz>" and "event=<Hz>,<pre-trigger ms>,<post-trigger ms>"
+// lines of the config file, that start a new group of variables. Returns false
+// for any other line.
+static bool parseGroupLine(char* line)
+{
+  char* value = strchr(line, '=');
+  if (!value) {
+    return false;
+  }
+  *value++ = 0;
+
+  char* endptr;
+  usdLogGroup_t group = {
+    .frequency = strtol(value, &endptr, 10),
+    .firstSlot = usdLogConfig.numSlots,
+  };
+  if (strcmp(line, "event") == 0) {
+    group.isEventTriggered = true;
+    if (*endptr == ',') {
+      group.preTriggerMs = strtol(endptr + 1, &endptr, 10);
+    }
+    if (*endptr == ',') {
+      group.postTriggerMs = strtol(endptr + 1, &endptr, 10);
+    }
+  } else if (strcmp(line, "rate") != 0) {
+    DEBUG_PRINT("Unknown config line %s\n", line);
+    return true;
+  }
+
+  if (group.frequency == 0 || group.frequency > usdLogConfig.frequency) {
+    DEBUG_PRINT("Group rate must be 1-%dHz\n", usdLogConfig.frequency);
+    group.frequency = usdLogConfig.frequency;
+  }
+  group.divider = usdLogConfig.frequency / group.frequency;
+
+  /* an empty group is replaced by the new one */
+  uint8_t index = usdLogConfig.numGroups;
+  if (usdLogConfig.groups[index - 1].numSlots == 0) {
+    index--;
+  }
+
+  if (index >= USD_MAX_GROUPS) {
+    DEBUG_PRINT("Too many groups, max %d\n", USD_MAX_GROUPS);
+    return true;
+  }
+  if (group.isEventTriggered && usdLogConfig.eventGroup >= 0 && usdLogConfig.eventGroup != index) {
+    DEBUG_PRINT("Only one event group is supported\n");
+    return true;
+  }
+
+  if (usdLogConfig.eventGroup == index) {
+    usdLogConfig.eventGroup = -1;
+  }
+  if (group.isEventTriggered) {
+    usdLogConfig.eventGroup = index;
+  }
+
+  usdLogConfig.groups[index] = group;
+  usdLogConfig.numGroups = index + 1;
+  usdLogConfig.grouped = true;
+  return true;
+}
+
 static void usdLogTask(void* prm)
 {
   TickType_t lastWakeTime = xTaskGetTickCount();
@@ -387,6 +556,10 @@ static void usdLogTask(void* prm)
       while (line) {
         line = f_gets_without_comments(readBuffer, sizeof(readBuffer), &logFile);
         if (!line) break;
+        /* group lines were parsed by usdInit() */
+        if (strchr(line, '=')) {
+          continue;
+        }
         char* group = line;
         char* name = 0;
         for (int i = 0; i < strlen(line); ++i) {
@@ -415,15 +588,33 @@ static void usdLogTask(void* prm)
   /* allocate memory for buffer */
   DEBUG_PRINT("malloc buffer ...\n");
   // vTaskDelay(10); // small delay to allow debug message to be send
-  usdLogBufferStart =
-      pvPortMalloc(usdLogConfig.bufferSize * (4 + usdLogConfig.numBytes));
-  usdLogBuffer = usdLogBufferStart;
+  if (usdLogConfig.sectorBuffered) {
+    ASSERT(USD_BUFFER_HEADER_SIZE + 1 + 4 + usdLogConfig.numBytes + USD_BUFFER_CRC_SIZE <= USD_BUFFER_SIZE);
+    usdSectorBufferPairInit(&usdSectorBuffers, pvPortMalloc(USD_BUFFER_SIZE), pvPortMalloc(USD_BUFFER_SIZE),
+                            USD_BUFFER_SIZE);
+
+    if (usdLogConfig.eventGroup >= 0) {
+      usdLogGroup_t* group = &usdLogConfig.groups[usdLogConfig.eventGroup];
+      uint32_t capacity = (uint32_t)group->preTriggerMs * (usdLogConfig.frequency / group->divider) / 1000;
+      eventRing.recordSize = 1 + 4 + group->numBytes;
+      eventRing.capacity = capacity > UINT16_MAX ? UINT16_MAX : capacity;
+      eventRing.data = pvPortMalloc(eventRing.capacity * eventRing.recordSize);
+      if (!eventRing.data) {
+        DEBUG_PRINT("No memory for %d pre-trigger records\n", eventRing.capacity);
+        eventRing.capacity = 0;
+      }
+    }
+  } else {
+    usdLogBufferStart =
+        pvPortMalloc(usdLogConfig.bufferSize * (4 + usdLogConfig.numBytes));
+    usdLogBuffer = usdLogBufferStart;
+
+    /* create queue to hand over pointer to usdLogData */
+    usdLogQueue = xQueueCreate(usdLogConfig.bufferSize, sizeof(uint8_t*));
+  }
   DEBUG_PRINT("[OK].\n");
   DEBUG_PRINT("Free heap: %d bytes\n", xPortGetFreeHeapSize());
 
-  /* create queue to hand over pointer to usdLogData */
-  usdLogQueue = xQueueCreate(usdLogConfig.bufferSize, sizeof(uint8_t*));
-
   xHandleWriteTask = 0;
   enableLogging = usdLogConfig.enableOnStartup; // enable logging if desired
 
@@ -436,9 +627,9 @@ static void usdLogTask(void* prm)
   while(1) {
     vTaskDelayUntil(&lastWakeTime, F2T(usdLogConfig.frequency));
 
-    // if logging was just disabled, resume the writer task to give up mutex
+    // if logging was just disabled, wake up the writer task to give up mutex
     if (!enableLogging && lastEnableLogging != enableLogging) {
-      vTaskResume(xHandleWriteTask);
+      xTaskNotifyGive(xHandleWriteTask);
     }
 
     if (enableLogging && usdLogConfig.mode == usddeckLoggingMode_Asyncronous) {
@@ -465,36 +656,71 @@ int usddeckFrequency(void)
 
 void usddeckTriggerLogging(void)
 {
+  if (usdLogConfig.grouped) {
+    logGroups();
+    return;
+  }
+
+  if (usdLogConfig.sectorBuffered) {
+    uint8_t* record = reserveRecord(4 + usdLogConfig.numBytes);
+    if (record) {
+      encodeRecord(record, &usdLogConfig.groups[0]);
+    }
+    return;
+  }
+
   uint8_t queueMessagesWaiting = (uint8_t)uxQueueMessagesWaiting(usdLogQueue);
 
   /* trigger writing once there exists at least one queue item,
    * frequency will result itself */
   if (queueMessagesWaiting) {
-    vTaskResume(xHandleWriteTask);
+    xTaskNotifyGive(xHandleWriteTask);
   }
   /* skip if queue is full, one slot will be spared as mutex */
   if (queueMessagesWaiting == (usdLogConfig.bufferSize - 1)) {
+    droppedRecords++;
     return;
   }
 
   /* write data into buffer */
+  encodeRecord(usdLogBuffer, &usdLogConfig.groups[0]);
+  /* set pointer on latest data and queue */
+  xQueueSend(usdLogQueue, &usdLogBuffer, 0);
+  /* set pointer to next buffer item */
+  usdLogBuffer = usdLogBuffer + 4 + usdLogConfig.numBytes;
+  if (usdLogBuffer >= usdLogBufferStart + usdLogConfig.bufferSize * (4 + usdLogConfig.numBytes)) {
+    usdLogBuffer = usdLogBufferStart;
+  }
+}
+
+void usddeckTriggerEvent(enum usddeckEvent_e event)
+{
+  /* handled by the logger, in logGroups() */
+  if (usdLogConfig.grouped && enableLogging) {
+    eventPending[event] = true;
+  }
+}
+
+// Writes the tick and the values of the variables of a group, returns the number of bytes written
+static int encodeRecord(uint8_t* dest, const usdLogGroup_t* group)
+{
   uint32_t ticks = xTaskGetTickCount();
-  memcpy(usdLogBuffer, &ticks, 4);
+  memcpy(dest, &ticks, 4);
   int offset = 4;
-  for (int i = 0; i < usdLogConfig.numSlots; ++i) {
+  for (int i = group->firstSlot; i < group->firstSlot + group->numSlots; ++i) {
     int varid = usdLogConfig.varIds[i];
     switch (logGetType(varid)) {
       case LOG_UINT8:
       case LOG_INT8:
       {
-        memcpy(usdLogBuffer + offset, logGetAddress(varid), sizeof(uint8_t));
+        memcpy(dest + offset, logGetAddress(varid), sizeof(uint8_t));
         offset += sizeof(uint8_t);
         break;
       }
       case LOG_UINT16:
       case LOG_INT16:
       {
-        memcpy(usdLogBuffer + offset, logGetAddress(varid), sizeof(uint16_t));
+        memcpy(dest + offset, logGetAddress(varid), sizeof(uint16_t));
         offset += sizeof(uint16_t);
         break;
       }
@@ -502,7 +728,7 @@ void usddeckTriggerLogging(void)
       case LOG_INT32:
       case LOG_FLOAT:
       {
-        memcpy(usdLogBuffer + offset, logGetAddress(varid), sizeof(uint32_t));
+        memcpy(dest + offset, logGetAddress(varid), sizeof(uint32_t));
         offset += sizeof(uint32_t);
         break;
       }
@@ -510,13 +736,79 @@ void usddeckTriggerLogging(void)
         ASSERT(false);
     }
   }
-  /* set pointer on latest data and queue */
-  xQueueSend(usdLogQueue, &usdLogBuffer, 0);
-  /* set pointer to next buffer item */
-  usdLogBuffer = usdLogBuffer + 4 + usdLogConfig.numBytes;
-  if (usdLogBuffer >= usdLogBufferStart + usdLogConfig.bufferSize * (4 + usdLogConfig.numBytes)) {
-    usdLogBuffer = usdLogBufferStart;
+  return offset;
+}
+
+// Reserves space for a record in the active sector buffer. A buffer that can
+// not hold the record is handed over to the writer, and the record is dropped
+// if the writer is still busy with both buffers. Returns NULL if dropped.
+static uint8_t* reserveRecord(uint16_t size)
+{
+  bool isHandedOver;
+  uint8_t* record = usdSectorBufferPairReserve(&usdSectorBuffers, size, &isHandedOver);
+  if (isHandedOver) {
+    xTaskNotifyGive(xHandleWriteTask);
+  }
+
+  if (!record) {
+    droppedRecords++;
+  }
+  return record;
+}
+
+// Logs the groups that are due at this trigger. Records of the event triggered
+// group go to the pre-trigger ring, except in the capture window after an event.
+static void logGroups(void)
+{
+  TickType_t now = xTaskGetTickCount();
+
+  for (int event = 0; event < usddeckEventCount; event++) {
+    if (eventPending[event]) {
+      eventPending[event] = false;
+      eventCount++;
+
+      uint8_t* record = reserveRecord(1 + 4 + 1);
+      if (record) {
+        record[0] = USD_EVENT_RECORD;
+        memcpy(&record[1], &now, 4);
+        record[5] = event;
+      }
+
+      if (usdLogConfig.eventGroup >= 0) {
+        usdLogGroup_t* group = &usdLogConfig.groups[usdLogConfig.eventGroup];
+        eventCaptureEnd = now + M2T(group->postTriggerMs);
+        if (!eventRing.isFrozen && eventRing.count) {
+          eventRing.isFrozen = true;
+          xTaskNotifyGive(xHandleWriteTask);
+        }
+      }
+    }
+  }
+
+  for (int i = 0; i < usdLogConfig.numGroups; i++) {
+    usdLogGroup_t* group = &usdLogConfig.groups[i];
+    if (triggerCount % group->divider) {
+      continue;
+    }
+
+    uint8_t* record = NULL;
+    uint16_t size = 1 + 4 + group->numBytes;
+    if (!group->isEventTriggered || (int32_t)(eventCaptureEnd - now) > 0) {
+      record = reserveRecord(size);
+    } else if (!eventRing.isFrozen && eventRing.capacity) {
+      record = eventRing.data + eventRing.head * eventRing.recordSize;
+      eventRing.head = (eventRing.head + 1) % eventRing.capacity;
+      if (eventRing.count < eventRing.capacity) {
+        eventRing.count++;
+      }
+    }
+
+    if (record) {
+      record[0] = i;
+      encodeRecord(record + 1, group);
+    }
   }
+  triggerCount++;
 }
 
 // returns size of current file if logging is stopped (0 otherwise)
@@ -567,12 +859,14 @@ static void usdWriteTask(void* usdLogQueue)
 
   while (true)
   {
-    vTaskSuspend(NULL);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
     if (enableLogging) {
       xSemaphoreTake(logFileMutex, portMAX_DELAY);
       lastFileSize = 0;
-      usdLogBuffer = usdLogBufferStart;
-      xQueueReset(usdLogQueue);
+      if (!usdLogConfig.sectorBuffered) {
+        usdLogBuffer = usdLogBufferStart;
+        xQueueReset(usdLogQueue);
+      }
       /* look for existing files and use first not existent combination
        * of two chars */
       {
@@ -598,69 +892,69 @@ static void usdWriteTask(void* usdLogQueue)
       if (f_open(&logFile, usdLogConfig.filename, FA_CREATE_ALWAYS | FA_WRITE)
           == FR_OK) {
         /* write dataset header */
-        {
-          uint8_t logWidth = 1 + usdLogConfig.numSlots;
-          f_write(&logFile, &logWidth, 1, &bytesWritten);
-          crcValue = crcByByte(&logWidth, 1, INITIAL_REMAINDER, 0, crcTable);
+        crcValue = INITIAL_REMAINDER;
+        if (usdLogConfig.grouped) {
+          uint8_t groupsHeader[2] = {0, usdLogConfig.numGroups};
+          USD_WRITE(&logFile, groupsHeader, 2, &bytesWritten,
+                    crcValue, 0, crcTable)
         }
-        USD_WRITE(&logFile, (uint8_t*)"tick(I),", 8, &bytesWritten,
-                  crcValue, 0, crcTable)
-
-        for (int i = 0; i < usdLogConfig.numSlots; ++i) {
-          char* group;
-          char* name;
-          int varid = usdLogConfig.varIds[i];
-          logGetGroupAndName(varid, &group, &name);
-          USD_WRITE(&logFile, (uint8_t*)group, strlen(group), &bytesWritten,
-            crcValue, 0, crcTable)
-          USD_WRITE(&logFile, (uint8_t*)".", 1, &bytesWritten,
-            crcValue, 0, crcTable)
-          USD_WRITE(&logFile, (uint8_t*)name, strlen(name), &bytesWritten,
-            crcValue, 0, crcTable)
-          USD_WRITE(&logFile, (uint8_t*)"(", 1, &bytesWritten,
-                      crcValue, 0, crcTable)
-          char typeChar;
-          switch (logGetType(varid)) {
-            case LOG_UINT8:
-              typeChar = 'B';
-              break;
-            case LOG_INT8:
-              typeChar = 'b';
-              break;
-            case LOG_UINT16:
-              typeChar = 'H';
-              break;
-            case LOG_INT16:
-              typeChar = 'h';
-              break;
-            case LOG_UINT32:
-              typeChar = 'I';
-              break;
-            case LOG_INT32:
-              typeChar = 'i';
-              break;
-            case LOG_FLOAT:
-              typeChar = 'f';
-              break;
-            default:
-              ASSERT(false);
-          }
-          USD_WRITE(&logFile, (uint8_t*)&typeChar, 1, &bytesWritten,
-                      crcValue, 0, crcTable)
-          USD_WRITE(&logFile, (uint8_t*)"),", 2, &bytesWritten,
-                      crcValue, 0, crcTable)
+        for (int i = 0; i < usdLogConfig.numGroups; ++i) {
+          crcValue = writeGroupHeader(&usdLogConfig.groups[i], crcValue);
         }
 
         /* negate crc value */
         crcValue = ~(crcValue^FINAL_XOR_VALUE);
         f_write(&logFile, &crcValue, 4, &bytesWritten);
+
+        if (usdLogConfig.sectorBuffered) {
+          /* pad the header with zeros up to the next sector, all buffers are
+           * then written as whole sectors */
+          static const uint8_t zeros[USD_SECTOR_SIZE];
+          uint32_t padding = (USD_SECTOR_SIZE - f_size(&logFile) % USD_SECTOR_SIZE) % USD_SECTOR_SIZE;
+          f_write(&logFile, zeros, padding, &bytesWritten);
+        }
         f_close(&logFile);
 
         uint8_t* usdLogQueuePtr;
 
-        while (enableLogging) {
+        if (usdLogConfig.sectorBuffered &&
+            f_open(&logFile, usdLogConfig.filename, FA_OPEN_APPEND | FA_WRITE) == FR_OK) {
+          usdSectorBuffer_t* buffer;
+          while (enableLogging) {
+            /* write the full buffers, oldest first. The buffer that woke the
+             * writer up is already full when it gets here */
+            while ((buffer = usdSectorBufferPairGetFull(&usdSectorBuffers))) {
+              writeSectorBuffer(buffer);
+              usdSectorBufferPairWritten(&usdSectorBuffers);
+            }
+            if (eventRing.isFrozen) {
+              dumpEventRing();
+            }
+            /* sleep until a buffer is full */
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+          }
+          /* write what is left, the active buffer last. The loggers run at a
+           * higher priority and check enableLogging, they are done with the
+           * buffers */
+          usdSectorBufferPairCloseActive(&usdSectorBuffers);
+          while ((buffer = usdSectorBufferPairGetFull(&usdSectorBuffers))) {
+            writeSectorBuffer(buffer);
+            usdSectorBufferPairWritten(&usdSectorBuffers);
+          }
+          usdSectorBufferPairReset(&usdSectorBuffers);
+          if (eventRing.isFrozen) {
+            dumpEventRing();
+          }
+          /* start the next file with an empty pre-trigger ring */
+          eventRing.head = 0;
+          eventRing.count = 0;
+          eventCaptureEnd = 0;
+          f_close(&logFile);
+        }
+
+        while (enableLogging && !usdLogConfig.sectorBuffered) {
           /* sleep */
-          vTaskSuspend(NULL);
+          ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
           /* determine how many sets can be written */
           setsToWrite = (uint8_t)uxQueueMessagesWaiting(usdLogQueue);
           if (setsToWrite > 0) {
@@ -670,6 +964,8 @@ static void usdWriteTask(void* usdLogQueue)
                 != FR_OK) {
               continue;
             }
+            TickType_t writeStart = xTaskGetTickCount();
+            uint32_t bytes = 1 + setsToWrite * (4 + usdLogConfig.numBytes) + 4;
             f_write(&logFile, &setsToWrite, 1, &bytesWritten);
             crcValue = crcByByte(&setsToWrite, 1, INITIAL_REMAINDER, 0, crcTable);
             do {
@@ -684,6 +980,7 @@ static void usdWriteTask(void* usdLogQueue)
             f_write(&logFile, &crcValue, 4, &bytesWritten);
             /* close file */
             f_close(&logFile);
+            updateWriteStats(bytes, xTaskGetTickCount() - writeStart);
           }
         }
 
@@ -705,6 +1002,148 @@ static void usdWriteTask(void* usdLogQueue)
   vTaskDelete(NULL);
 }
 
+// Writes the width of the records of a group and the names and types of its
+// variables, returns the updated crc
+static crc writeGroupHeader(const usdLogGroup_t* group, crc crcValue)
+{
+  unsigned int bytesWritten;
+  uint8_t logWidth = 1 + group->numSlots;
+  USD_WRITE(&logFile, &logWidth, 1, &bytesWritten,
+            crcValue, 0, crcTable)
+  USD_WRITE(&logFile, (uint8_t*)"tick(I),", 8, &bytesWritten,
+            crcValue, 0, crcTable)
+
+  for (int i = group->firstSlot; i < group->firstSlot + group->numSlots; ++i) {
+    char* groupName;
+    char* name;
+    int varid = usdLogConfig.varIds[i];
+    logGetGroupAndName(varid, &groupName, &name);
+    USD_WRITE(&logFile, (uint8_t*)groupName, strlen(groupName), &bytesWritten,
+      crcValue, 0, crcTable)
+    USD_WRITE(&logFile, (uint8_t*)".", 1, &bytesWritten,
+      crcValue, 0, crcTable)
+    USD_WRITE(&logFile, (uint8_t*)name, strlen(name), &bytesWritten,
+      crcValue, 0, crcTable)
+    USD_WRITE(&logFile, (uint8_t*)"(", 1, &bytesWritten,
+                crcValue, 0, crcTable)
+    char typeChar;
+    switch (logGetType(varid)) {
+      case LOG_UINT8:
+        typeChar = 'B';
+        break;
+      case LOG_INT8:
+        typeChar = 'b';
+        break;
+      case LOG_UINT16:
+        typeChar = 'H';
+        break;
+      case LOG_INT16:
+        typeChar = 'h';
+        break;
+      case LOG_UINT32:
+        typeChar = 'I';
+        break;
+      case LOG_INT32:
+        typeChar = 'i';
+        break;
+      case LOG_FLOAT:
+        typeChar = 'f';
+        break;
+      default:
+        ASSERT(false);
+    }
+    USD_WRITE(&logFile, (uint8_t*)&typeChar, 1, &bytesWritten,
+                crcValue, 0, crcTable)
+    USD_WRITE(&logFile, (uint8_t*)"),", 2, &bytesWritten,
+                crcValue, 0, crcTable)
+  }
+
+  return crcValue;
+}
+
+// Computes the crc of the records in a full (or last) buffer and writes the buffer as whole sectors. The file
+// position is always sector aligned, FatFs then hands the data directly to a multi block write of the card.
+static void writeSectorBuffer(usdSectorBuffer_t* buffer)
+{
+  memcpy(buffer->data, &buffer->records, USD_BUFFER_HEADER_SIZE);
+
+  /* final xor and negate crc value, as for the unbuffered modes */
+  crc crcValue = crcByByte(buffer->data, buffer->length, INITIAL_REMAINDER, 0, crcTable);
+  crcValue = ~(crcValue^FINAL_XOR_VALUE);
+  memcpy(buffer->data + buffer->length, &crcValue, USD_BUFFER_CRC_SIZE);
+
+  uint32_t used = buffer->length + USD_BUFFER_CRC_SIZE;
+  uint32_t size = ((used + USD_SECTOR_SIZE - 1) / USD_SECTOR_SIZE) * USD_SECTOR_SIZE;
+  memset(buffer->data + used, 0, size - used);
+
+  TickType_t writeStart = xTaskGetTickCount();
+  unsigned int bytesWritten;
+  f_write(&logFile, buffer->data, size, &bytesWritten);
+  /* update the directory entry to avoid loss of data during/after a crash */
+  f_sync(&logFile);
+  updateWriteStats(bytesWritten, xTaskGetTickCount() - writeStart);
+}
+
+// Writes the pre-trigger ring, oldest record first, in the same format as a
+// sector buffer. The file position is sector aligned again when done. The ring
+// is written after the sector buffers that were full at the time, its records
+// are older than some of the records before it in the file.
+static void dumpEventRing(void)
+{
+  TickType_t writeStart = xTaskGetTickCount();
+  unsigned int bytesWritten;
+  uint32_t bytes = 0;
+
+  crc crcValue = INITIAL_REMAINDER;
+  USD_WRITE(&logFile, (uint8_t*)&eventRing.count, USD_BUFFER_HEADER_SIZE, &bytesWritten,
+            crcValue, 0, crcTable)
+  bytes += bytesWritten;
+
+  uint16_t oldest = (eventRing.head + eventRing.capacity - eventRing.count) % eventRing.capacity;
+  uint16_t first = eventRing.count;
+  if (oldest + first > eventRing.capacity) {
+    first = eventRing.capacity - oldest;
+  }
+  USD_WRITE(&logFile, eventRing.data + oldest * eventRing.recordSize,
+            first * eventRing.recordSize, &bytesWritten, crcValue, 0, crcTable)
+  bytes += bytesWritten;
+  USD_WRITE(&logFile, eventRing.data, (eventRing.count - first) * eventRing.recordSize,
+            &bytesWritten, crcValue, 0, crcTable)
+  bytes += bytesWritten;
+
+  /* final xor and negate crc value */
+  crcValue = ~(crcValue^FINAL_XOR_VALUE);
+  f_write(&logFile, &crcValue, USD_BUFFER_CRC_SIZE, &bytesWritten);
+  bytes += bytesWritten;
+
+  static const uint8_t zeros[USD_SECTOR_SIZE];
+  uint32_t padding = (USD_SECTOR_SIZE - f_size(&logFile) % USD_SECTOR_SIZE) % USD_SECTOR_SIZE;
+  f_write(&logFile, zeros, padding, &bytesWritten);
+  bytes += bytesWritten;
+  f_sync(&logFile);
+  updateWriteStats(bytes, xTaskGetTickCount() - writeStart);
+
+  eventRing.head = 0;
+  eventRing.count = 0;
+  eventRing.isFrozen = false;
+}
+
+static void updateWriteStats(uint32_t bytes, TickType_t duration)
+{
+  bytesWrittenTotal += bytes;
+  if (T2M(duration) > maxWriteTime) {
+    maxWriteTime = T2M(duration);
+  }
+
+  TickType_t now = xTaskGetTickCount();
+  throughputWindowBytes += bytes;
+  if (now - throughputWindowStart >= M2T(1000)) {
+    writeThroughput = (uint64_t)throughputWindowBytes * 1000 / T2M(now - throughputWindowStart);
+    throughputWindowStart = now;
+    throughputWindowBytes = 0;
+  }
+}
+
 static bool usdTest()
 {
   if (!isInit) {
@@ -751,3 +1190,11 @@ PARAM_GROUP_STOP(deck)
 PARAM_GROUP_START(usd)
 PARAM_ADD(PARAM_UINT8, logging, &enableLogging) /* use to start/stop logging*/
 PARAM_GROUP_STOP(usd)
+
+LOG_GROUP_START(usd)
+LOG_ADD(LOG_UINT32, bytes, &bytesWrittenTotal)
+LOG_ADD(LOG_UINT32, throughput, &writeThroughput) /* bytes/s over the last second of writes */
+LOG_ADD(LOG_UINT16, maxWriteMs, &maxWriteTime)
+LOG_ADD(LOG_UINT32, dropped, &droppedRecords) /* records lost because the writer did not keep up */
+LOG_ADD(LOG_UINT16, events, &eventCount)
+LOG_GROUP_STOP(usd)
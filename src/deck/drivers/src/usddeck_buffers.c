@@ -0,0 +1,97 @@
+/**
+ * ,---------,       ____  _ __
+ * |  ,-^-,  |      / __ )(_) /_______________ _____  ___
+ * | (  O  ) |     / __  / / __/ ___/ ___/ __ `/_  / / _ \
+ * | / ,--´  |    / /_/ / / /_/ /__/ /  / /_/ / / /_/  __/
+ *    +------`   /_____/_/\__/\___/_/   \__,_/ /___/\___/
+ *
+ * Crazyflie control firmware
+ *
+ * Copyright (C) 2020 Bitcraze AB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, in version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * usddeck_buffers.c - Ping-pong record buffers of the sector buffered uSD logging modes
+ */
+
+#include <stddef.h>
+
+#include "usddeck_buffers.h"
+
+// isFull is cleared last, the logger may use the buffer as soon as it is not full
+static void emptyBuffer(usdSectorBuffer_t* buffer)
+{
+  buffer->length = USD_BUFFER_HEADER_SIZE;
+  buffer->records = 0;
+  buffer->isFull = false;
+}
+
+void usdSectorBufferPairInit(usdSectorBufferPair_t* pair, uint8_t* data0, uint8_t* data1, const uint16_t size)
+{
+  pair->buffers[0].data = data0;
+  pair->buffers[1].data = data1;
+  pair->size = size;
+  usdSectorBufferPairReset(pair);
+}
+
+void usdSectorBufferPairReset(usdSectorBufferPair_t* pair)
+{
+  emptyBuffer(&pair->buffers[0]);
+  emptyBuffer(&pair->buffers[1]);
+  pair->active = 0;
+  pair->next = 0;
+}
+
+uint8_t* usdSectorBufferPairReserve(usdSectorBufferPair_t* pair, const uint16_t size, bool* isHandedOver)
+{
+  *isHandedOver = false;
+
+  usdSectorBuffer_t* buffer = &pair->buffers[pair->active];
+  if (!buffer->isFull && buffer->length + size + USD_BUFFER_CRC_SIZE > pair->size) {
+    buffer->isFull = true;
+    pair->active ^= 1;
+    *isHandedOver = true;
+    buffer = &pair->buffers[pair->active];
+  }
+
+  if (buffer->isFull) {
+    return NULL;
+  }
+
+  uint8_t* record = buffer->data + buffer->length;
+  buffer->length += size;
+  buffer->records++;
+  return record;
+}
+
+usdSectorBuffer_t* usdSectorBufferPairGetFull(usdSectorBufferPair_t* pair)
+{
+  usdSectorBuffer_t* buffer = &pair->buffers[pair->next];
+  return buffer->isFull ? buffer : NULL;
+}
+
+void usdSectorBufferPairWritten(usdSectorBufferPair_t* pair)
+{
+  emptyBuffer(&pair->buffers[pair->next]);
+  pair->next ^= 1;
+}
+
+void usdSectorBufferPairCloseActive(usdSectorBufferPair_t* pair)
+{
+  usdSectorBuffer_t* buffer = &pair->buffers[pair->active];
+  if (!buffer->isFull && buffer->records > 0) {
+    buffer->isFull = true;
+    pair->active ^= 1;
+  }
+}
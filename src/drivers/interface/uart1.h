@@ -27,6 +27,7 @@
 #define UART1_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "eprintf.h"
 
 #define UART1_BAUDRATE           9600
@@ -44,6 +45,16 @@
 #define UART1_DMA_CH           DMA_Channel_4
 #define UART1_DMA_FLAG_TCIF    DMA_FLAG_TCIF3
 
+// RX uses DMA1 stream 1, the TX stream 3 is shared with the SPI2 RX DMA used by the BMI088 on CF-Bolt
+#define UART1_RX_DMA_IRQ       DMA1_Stream1_IRQn
+#define UART1_RX_DMA_STREAM    DMA1_Stream1
+#define UART1_RX_DMA_CH        DMA_Channel_4
+#define UART1_RX_DMA_IT_HT     DMA_IT_HTIF1
+#define UART1_RX_DMA_IT_TC     DMA_IT_TCIF1
+
+// Size of the circular RX DMA buffer, must be a power of 2
+#define UART1_RX_DMA_BUFFER_SIZE 256
+
 #define UART1_GPIO_PERIF       RCC_AHB1Periph_GPIOC
 #define UART1_GPIO_PORT        GPIOC
 #define UART1_GPIO_TX_PIN      GPIO_Pin_10
@@ -58,6 +69,13 @@
  */
 void uart1Init(const uint32_t baudrate);
 
+/**
+ * Move received bytes with DMA to a circular buffer instead of queueing them one at the time from the RX interrupt.
+ * The bytes must then be read with uart1GetBytesWithDma(), uart1Getchar() and uart1GetDataWithTimout() no longer
+ * receive any data. Call after uart1Init().
+ */
+void uart1EnableRxDma(void);
+
 /**
  * Test the UART status.
  *
@@ -98,6 +116,18 @@ int uart1Putchar(int ch);
 
 void uart1Getchar(char * ch);
 
+/**
+ * Read a block of bytes received with RX DMA, blocks until all of them are received. The calling task is only woken
+ * by the half/full buffer and idle line interrupts, not for each byte.
+ *
+ * If the reader falls too far behind, the unread bytes are dropped and the read continues with the next received
+ * byte.
+ * @param[out] data  Read bytes
+ * @param[in] size  Number of bytes to read, at most UART1_RX_DMA_BUFFER_SIZE / 2
+ * @return The number of bytes dropped before the returned bytes, 0 if none
+ */
+uint32_t uart1GetBytesWithDma(uint8_t* data, uint32_t size);
+
 /**
  * Returns true if an overrun condition has happened since initialization or
  * since the last call to this function.
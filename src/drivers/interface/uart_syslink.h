@@ -31,6 +31,7 @@
 #include "crtp.h"
 #include "eprintf.h"
 #include "syslink.h"
+#include "packetpool.h"
 
 #define UARTSLK_TYPE             USART6
 #define UARTSLK_PERIF            RCC_APB2Periph_USART6
@@ -43,6 +44,12 @@
 #define UARTSLK_DMA_CH           DMA_Channel_5
 #define UARTSLK_DMA_FLAG_TCIF    DMA_FLAG_TCIF7
 
+#define UARTSLK_RX_DMA_IRQ       DMA2_Stream1_IRQn
+#define UARTSLK_RX_DMA_STREAM    DMA2_Stream1
+#define UARTSLK_RX_DMA_CH        DMA_Channel_5
+#define UARTSLK_RX_DMA_IT_HT     DMA_IT_HTIF1
+#define UARTSLK_RX_DMA_IT_TC     DMA_IT_TCIF1
+
 #define UARTSLK_GPIO_PERIF       RCC_AHB1Periph_GPIOC
 #define UARTSLK_GPIO_PORT        GPIOC
 #define UARTSLK_GPIO_TX_PIN      GPIO_Pin_6
@@ -80,9 +87,12 @@ struct crtpLinkOperations * uartslkGetLink();
 
 /**
  * Get data from rx queue. Blocks until data is available.
- * @param[out] slp Pointer to a complete syslink packet
+ *
+ * When UARTSLK_USE_DMA_RX is defined the received bytes are parsed into packets in this function, in the context of
+ * the calling task, instead of in the UART interrupt.
+ * @return Handle to a packet pool buffer with a complete syslink packet, the caller must release it
  */
-void uartslkGetPacketBlocking(SyslinkPacket* slp);
+packetHandle_t uartslkGetPacketBlocking(void);
 
 /**
  * Sends raw data using a lock. Should be used from
@@ -124,6 +134,11 @@ void uartslkIsr(void);
  */
 void uartslkDmaIsr(void);
 
+/**
+ * Interrupt service routine handling UART RX DMA interrupts.
+ */
+void uartslkRxDmaIsr(void);
+
 void uartslkTxenFlowctrlIsr();
 
 #endif /* UART_SYSLINK_H_ */
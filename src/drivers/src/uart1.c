@@ -41,6 +41,7 @@
 #include "cfassert.h"
 #include "config.h"
 #include "nvicconf.h"
+#include "log.h"
 
 /** This uart is conflicting with SPI2 DMA used in sensors_bmi088_spi_bmp388.c
  *  which is used in CF-Bolt. So for other products this can be enabled.
@@ -52,6 +53,20 @@ static xQueueHandle uart1queue;
 static bool isInit = false;
 static bool hasOverrun = false;
 
+#define USART_SR_FLAGS_ERROR (USART_FLAG_ORE | USART_FLAG_NE | USART_FLAG_FE)
+
+static bool isRxDmaEnabled = false;
+static uint8_t rxDmaBuffer[UART1_RX_DMA_BUFFER_SIZE];
+static uint32_t rxDmaBytesRead;
+static volatile uint32_t rxDmaBytesWritten;
+static xSemaphoreHandle rxDataAvailable;
+
+static struct {
+  uint32_t uartErrors;
+  uint32_t dmaOverruns;
+  uint32_t droppedBytes;
+} rxStats;
+
 #ifdef ENABLE_UART1_DMA
 static xSemaphoreHandle uartBusy;
 static xSemaphoreHandle waitUntilSendDone;
@@ -160,6 +175,60 @@ void uart1Init(const uint32_t baudrate)
   isInit = true;
 }
 
+/**
+  * Configures the UART RX DMA to continuously write received bytes to a circular buffer. The data is consumed by
+  * uart1GetBytesWithDma(), which is woken by the half/full buffer interrupts and the UART idle line interrupt.
+  */
+void uart1EnableRxDma(void)
+{
+  DMA_InitTypeDef DMA_InitStructure;
+  NVIC_InitTypeDef NVIC_InitStructure;
+
+  ASSERT(isInit);
+  if (isRxDmaEnabled) {
+    return;
+  }
+
+  rxDataAvailable = xSemaphoreCreateBinary();
+  rxDmaBytesRead = 0;
+  rxDmaBytesWritten = 0;
+
+  RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA1, ENABLE);
+
+  DMA_DeInit(UART1_RX_DMA_STREAM);
+  DMA_StructInit(&DMA_InitStructure);
+  DMA_InitStructure.DMA_Channel = UART1_RX_DMA_CH;
+  DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&UART1_TYPE->DR;
+  DMA_InitStructure.DMA_Memory0BaseAddr = (uint32_t)rxDmaBuffer;
+  DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralToMemory;
+  DMA_InitStructure.DMA_BufferSize = UART1_RX_DMA_BUFFER_SIZE;
+  DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+  DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+  DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+  DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+  DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+  DMA_InitStructure.DMA_Priority = DMA_Priority_Medium;
+  DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;
+  DMA_Init(UART1_RX_DMA_STREAM, &DMA_InitStructure);
+
+  NVIC_InitStructure.NVIC_IRQChannel = UART1_RX_DMA_IRQ;
+  NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = NVIC_MID_PRI;
+  NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+  NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+  NVIC_Init(&NVIC_InitStructure);
+
+  // Bytes are no longer received by the RX interrupt
+  USART_ITConfig(UART1_TYPE, USART_IT_RXNE, DISABLE);
+  isRxDmaEnabled = true;
+
+  DMA_ITConfig(UART1_RX_DMA_STREAM, DMA_IT_HT | DMA_IT_TC, ENABLE);
+  USART_DMACmd(UART1_TYPE, USART_DMAReq_Rx, ENABLE);
+  DMA_Cmd(UART1_RX_DMA_STREAM, ENABLE);
+
+  USART_ITConfig(UART1_TYPE, USART_IT_IDLE, ENABLE);
+  USART_ITConfig(UART1_TYPE, USART_IT_ERR, ENABLE);
+}
+
 bool uart1Test(void)
 {
   return isInit;
@@ -230,6 +299,56 @@ void uart1Getchar(char * ch)
   xQueueReceive(uart1queue, ch, portMAX_DELAY);
 }
 
+uint32_t uart1GetBytesWithDma(uint8_t* data, uint32_t size)
+{
+  uint32_t dropped = 0;
+
+  ASSERT(isRxDmaEnabled);
+  ASSERT(size <= UART1_RX_DMA_BUFFER_SIZE / 2);
+
+  while (true)
+  {
+    // rxDmaBytesWritten is only updated at each half buffer, add the bytes written since then. This is also correct
+    // if a half/full buffer interrupt is pending.
+    uint32_t written = rxDmaBytesWritten;
+    uint32_t writeIndex = UART1_RX_DMA_BUFFER_SIZE - DMA_GetCurrDataCounter(UART1_RX_DMA_STREAM);
+    uint32_t received = written + ((writeIndex - written) & (UART1_RX_DMA_BUFFER_SIZE - 1));
+
+    // The DMA can be up to half a buffer ahead of rxDmaBytesWritten, unread bytes older than that may be overwritten.
+    // The read count may be ahead of rxDmaBytesWritten, hence the signed difference.
+    if ((int32_t)(written - rxDmaBytesRead) > UART1_RX_DMA_BUFFER_SIZE / 2)
+    {
+      dropped += received - rxDmaBytesRead;
+      rxStats.dmaOverruns++;
+      rxStats.droppedBytes += received - rxDmaBytesRead;
+      rxDmaBytesRead = received;
+    }
+
+    if (received - rxDmaBytesRead >= size)
+    {
+      break;
+    }
+
+    // Given from the RX DMA and idle line interrupts
+    xSemaphoreTake(rxDataAvailable, portMAX_DELAY);
+  }
+
+  uint32_t readIndex = rxDmaBytesRead & (UART1_RX_DMA_BUFFER_SIZE - 1);
+  uint32_t firstPart = UART1_RX_DMA_BUFFER_SIZE - readIndex;
+  if (firstPart >= size)
+  {
+    memcpy(data, &rxDmaBuffer[readIndex], size);
+  }
+  else
+  {
+    memcpy(data, &rxDmaBuffer[readIndex], firstPart);
+    memcpy(&data[firstPart], rxDmaBuffer, size - firstPart);
+  }
+  rxDmaBytesRead += size;
+
+  return dropped;
+}
+
 bool uart1DidOverrun()
 {
   bool result = hasOverrun;
@@ -253,12 +372,55 @@ void __attribute__((used)) DMA1_Stream3_IRQHandler(void)
 }
 #endif
 
+void __attribute__((used)) DMA1_Stream1_IRQHandler(void)
+{
+  portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+
+  if (DMA_GetITStatus(UART1_RX_DMA_STREAM, UART1_RX_DMA_IT_HT) == SET)
+  {
+    DMA_ClearITPendingBit(UART1_RX_DMA_STREAM, UART1_RX_DMA_IT_HT);
+    rxDmaBytesWritten += UART1_RX_DMA_BUFFER_SIZE / 2;
+  }
+  if (DMA_GetITStatus(UART1_RX_DMA_STREAM, UART1_RX_DMA_IT_TC) == SET)
+  {
+    DMA_ClearITPendingBit(UART1_RX_DMA_STREAM, UART1_RX_DMA_IT_TC);
+    rxDmaBytesWritten += UART1_RX_DMA_BUFFER_SIZE / 2;
+  }
+
+  xSemaphoreGiveFromISR(rxDataAvailable, &xHigherPriorityTaskWoken);
+  portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
 void __attribute__((used)) USART3_IRQHandler(void)
 {
   uint8_t rxData;
   portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
 
-  if (USART_GetITStatus(UART1_TYPE, USART_IT_RXNE))
+  if (isRxDmaEnabled)
+  {
+    // Received bytes are moved by the DMA, RXNE must not be handled here as reading DR would steal the byte from it
+    uint32_t sr = UART1_TYPE->SR;
+    if (sr & (USART_FLAG_IDLE | USART_SR_FLAGS_ERROR))
+    {
+      // IDLE and error flags are cleared by reading SR followed by DR. The line is idle or the byte is already lost,
+      // there is no byte in DR for the DMA.
+      asm volatile ("" : "=m" (UART1_TYPE->DR) : "r" (UART1_TYPE->DR)); // force non-optimizable read
+      if (sr & USART_SR_FLAGS_ERROR)
+      {
+        rxStats.uartErrors++;
+      }
+      if (sr & USART_FLAG_ORE)
+      {
+        hasOverrun = true;
+      }
+      if (sr & USART_FLAG_IDLE)
+      {
+        xSemaphoreGiveFromISR(rxDataAvailable, &xHigherPriorityTaskWoken);
+      }
+    }
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+  }
+  else if (USART_GetITStatus(UART1_TYPE, USART_IT_RXNE))
   {
     rxData = USART_ReceiveData(UART1_TYPE) & 0x00FF;
     xQueueSendFromISR(uart1queue, &rxData, &xHigherPriorityTaskWoken);
@@ -274,3 +436,12 @@ void __attribute__((used)) USART3_IRQHandler(void)
     hasOverrun = true;
   }
 }
+
+/**
+ * UART1 receive statistics when the RX DMA is enabled, see uart1EnableRxDma()
+ */
+LOG_GROUP_START(uart1)
+LOG_ADD(LOG_UINT32, uartErr, &rxStats.uartErrors)
+LOG_ADD(LOG_UINT32, dmaOvr, &rxStats.dmaOverruns)
+LOG_ADD(LOG_UINT32, dropped, &rxStats.droppedBytes)
+LOG_GROUP_STOP(uart1)
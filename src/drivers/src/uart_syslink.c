@@ -42,12 +42,24 @@
 #include "nvicconf.h"
 #include "config.h"
 #include "queuemonitor.h"
+#include "packetpool.h"
+#include "log.h"
+#include "statsCnt.h"
 
 
 #define UARTSLK_DATA_TIMEOUT_MS 1000
 #define UARTSLK_DATA_TIMEOUT_TICKS (UARTSLK_DATA_TIMEOUT_MS / portTICK_RATE_MS)
 #define CCR_ENABLE_SET  ((uint32_t)0x00000001)
 
+// Size of the circular RX DMA buffer, must be a power of 2. The DMA interrupts at each half, the worst case delay
+// before parsing is the time to receive half of the buffer (1.3 ms at 1 Mbaud).
+#define UARTSLK_RX_DMA_BUFFER_SIZE 256
+// Max time the syslink task waits for a free packet pool buffer before dropping the packet. The RX DMA buffer is
+// full after 2.6 ms, a longer wait would overrun it.
+#define UARTSLK_POOL_WAIT_MS 1
+
+#define USART_SR_FLAGS_ERROR (USART_FLAG_ORE | USART_FLAG_NE | USART_FLAG_FE)
+
 static bool isInit = false;
 
 static xSemaphoreHandle waitUntilSendDone;
@@ -68,7 +80,30 @@ static volatile SyslinkPacket slp = {0};
 static volatile SyslinkRxState rxState = waitForFirstStart;
 static volatile uint8_t dataIndex = 0;
 static volatile uint8_t cksum[2] = {0};
+static bool uartslkParseByte(uint8_t c);
+
+#ifdef UARTSLK_USE_DMA_RX
+static uint8_t rxDmaBuffer[UARTSLK_RX_DMA_BUFFER_SIZE];
+static uint32_t rxDmaReadIndex;
+static uint32_t rxDmaBytesRead;
+static volatile uint32_t rxDmaBytesWritten;
+static xSemaphoreHandle rxDataAvailable;
+static void uartslkRxDmaInit(void);
+#else
 static void uartslkHandleDataFromISR(uint8_t c, BaseType_t * const pxHigherPriorityTaskWoken);
+#endif
+static void uartslkHandleTxFromISR(BaseType_t * const pxHigherPriorityTaskWoken);
+
+static struct {
+  uint32_t framingErrors;
+  uint32_t uartErrors;
+  uint32_t dmaOverruns;
+  uint32_t queueOverflows;
+  uint32_t poolDrops;
+} rxStats;
+
+static STATS_CNT_RATE_DEFINE(interruptCounter, 1000);
+static STATS_CNT_RATE_DEFINE(packetCounter, 1000);
 
 static void uartslkPauseDma();
 static void uartslkResumeDma();
@@ -109,15 +144,64 @@ void uartslkDmaInit(void)
   isUartDmaInitialized = true;
 }
 
+#ifdef UARTSLK_USE_DMA_RX
+/**
+  * Configures the UART RX DMA to continuously write received bytes to a circular buffer. The data is consumed by
+  * uartslkGetPacketBlocking(), which is woken by the half/full buffer interrupts and the UART idle line interrupt.
+  */
+static void uartslkRxDmaInit(void)
+{
+  DMA_InitTypeDef DMA_InitStructure;
+  NVIC_InitTypeDef NVIC_InitStructure;
+
+  RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA2, ENABLE);
+
+  DMA_DeInit(UARTSLK_RX_DMA_STREAM);
+  DMA_StructInit(&DMA_InitStructure);
+  DMA_InitStructure.DMA_Channel = UARTSLK_RX_DMA_CH;
+  DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&UARTSLK_TYPE->DR;
+  DMA_InitStructure.DMA_Memory0BaseAddr = (uint32_t)rxDmaBuffer;
+  DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralToMemory;
+  DMA_InitStructure.DMA_BufferSize = UARTSLK_RX_DMA_BUFFER_SIZE;
+  DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+  DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+  DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+  DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+  DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+  DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+  DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;
+  DMA_Init(UARTSLK_RX_DMA_STREAM, &DMA_InitStructure);
+
+  NVIC_InitStructure.NVIC_IRQChannel = UARTSLK_RX_DMA_IRQ;
+  NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = NVIC_SYSLINK_PRI;
+  NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+  NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+  NVIC_Init(&NVIC_InitStructure);
+
+  rxDmaReadIndex = 0;
+  rxDmaBytesRead = 0;
+  rxDmaBytesWritten = 0;
+
+  DMA_ITConfig(UARTSLK_RX_DMA_STREAM, DMA_IT_HT | DMA_IT_TC, ENABLE);
+  USART_DMACmd(UARTSLK_TYPE, USART_DMAReq_Rx, ENABLE);
+  DMA_Cmd(UARTSLK_RX_DMA_STREAM, ENABLE);
+}
+#endif
+
 void uartslkInit(void)
 {
   // initialize the FreeRTOS structures first, to prevent null pointers in interrupts
+  packetPoolInit();
   waitUntilSendDone = xSemaphoreCreateBinary(); // initialized as blocking
   uartBusy = xSemaphoreCreateBinary(); // initialized as blocking
   xSemaphoreGive(uartBusy); // but we give it because the uart isn't busy at initialization
 
-  syslinkPacketDelivery = xQueueCreate(8, sizeof(SyslinkPacket));
+#ifdef UARTSLK_USE_DMA_RX
+  rxDataAvailable = xSemaphoreCreateBinary();
+#else
+  syslinkPacketDelivery = xQueueCreate(8, sizeof(packetHandle_t));
   DEBUG_QUEUE_MONITOR_REGISTER(syslinkPacketDelivery);
+#endif
 
   USART_InitTypeDef USART_InitStructure;
   GPIO_InitTypeDef GPIO_InitStructure;
@@ -167,7 +251,13 @@ void uartslkInit(void)
   NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
   NVIC_Init(&NVIC_InitStructure);
 
+#ifdef UARTSLK_USE_DMA_RX
+  uartslkRxDmaInit();
+  USART_ITConfig(UARTSLK_TYPE, USART_IT_IDLE, ENABLE);
+  USART_ITConfig(UARTSLK_TYPE, USART_IT_ERR, ENABLE);
+#else
   USART_ITConfig(UARTSLK_TYPE, USART_IT_RXNE, ENABLE);
+#endif
 
   //Setting up TXEN pin (NRF flow control)
   RCC_AHB1PeriphClockCmd(UARTSLK_TXEN_PERIF, ENABLE);
@@ -197,10 +287,45 @@ bool uartslkTest(void)
   return isInit;
 }
 
-void uartslkGetPacketBlocking(SyslinkPacket* packet)
+#ifdef UARTSLK_USE_DMA_RX
+packetHandle_t uartslkGetPacketBlocking(void)
+{
+  while (true)
+  {
+    uint32_t writeIndex = UARTSLK_RX_DMA_BUFFER_SIZE - DMA_GetCurrDataCounter(UARTSLK_RX_DMA_STREAM);
+    writeIndex &= (UARTSLK_RX_DMA_BUFFER_SIZE - 1);
+
+    while (rxDmaReadIndex != writeIndex)
+    {
+      uint8_t c = rxDmaBuffer[rxDmaReadIndex];
+      rxDmaReadIndex = (rxDmaReadIndex + 1) & (UARTSLK_RX_DMA_BUFFER_SIZE - 1);
+      rxDmaBytesRead++;
+
+      if (uartslkParseByte(c))
+      {
+        packetHandle_t handle = packetPoolAlloc(M2T(UARTSLK_POOL_WAIT_MS));
+        if (handle != PACKET_POOL_NO_HANDLE)
+        {
+          memcpy(packetPoolGetSyslinkPacket(handle), (void *)&slp, sizeof(SyslinkPacket));
+          STATS_CNT_RATE_EVENT(&packetCounter);
+          return handle;
+        }
+        rxStats.poolDrops++;
+      }
+    }
+
+    // Given from the RX DMA and idle line interrupts
+    xSemaphoreTake(rxDataAvailable, portMAX_DELAY);
+  }
+}
+#else
+packetHandle_t uartslkGetPacketBlocking(void)
 {
-  xQueueReceive(syslinkPacketDelivery, packet, portMAX_DELAY);
+  packetHandle_t handle;
+  xQueueReceive(syslinkPacketDelivery, &handle, portMAX_DELAY);
+  return handle;
 }
+#endif
 
 void uartslkSendData(uint32_t size, uint8_t* data)
 {
@@ -315,8 +440,15 @@ void uartslkDmaIsr(void)
   xSemaphoreGiveFromISR(waitUntilSendDone, &xHigherPriorityTaskWoken);
 }
 
-void uartslkHandleDataFromISR(uint8_t c, BaseType_t * const pxHigherPriorityTaskWoken)
+/**
+ * Feed one received byte to the syslink framing state machine.
+ *
+ * @return true when the byte completes a packet with a valid checksum, the packet is then in slp
+ */
+static bool uartslkParseByte(uint8_t c)
 {
+  bool isComplete = false;
+
   switch (rxState)
   {
   case waitForFirstStart:
@@ -342,6 +474,7 @@ void uartslkHandleDataFromISR(uint8_t c, BaseType_t * const pxHigherPriorityTask
     }
     else
     {
+      rxStats.framingErrors++;
       rxState = waitForFirstStart;
     }
     break;
@@ -362,6 +495,7 @@ void uartslkHandleDataFromISR(uint8_t c, BaseType_t * const pxHigherPriorityTask
     }
     else
     {
+      rxStats.framingErrors++;
       rxState = waitForFirstStart; //Checksum error
       IF_DEBUG_ASSERT(0);
     }
@@ -369,20 +503,12 @@ void uartslkHandleDataFromISR(uint8_t c, BaseType_t * const pxHigherPriorityTask
   case waitForChksum2:
     if (cksum[1] == c)
     {
-      // Post the packet to the queue if there's room
-      if (!xQueueIsQueueFullFromISR(syslinkPacketDelivery))
-      {
-        xQueueSendFromISR(syslinkPacketDelivery, (void *)&slp, pxHigherPriorityTaskWoken);
-      }
-      else
-      {
-        IF_DEBUG_ASSERT(0); // Queue overflow
-      }
+      isComplete = true;
     }
     else
     {
-      rxState = waitForFirstStart; //Checksum error
-      IF_DEBUG_ASSERT(0);
+      rxStats.framingErrors++;
+      IF_DEBUG_ASSERT(0); //Checksum error
     }
     rxState = waitForFirstStart;
     break;
@@ -390,12 +516,82 @@ void uartslkHandleDataFromISR(uint8_t c, BaseType_t * const pxHigherPriorityTask
     ASSERT(0);
     break;
   }
+
+  return isComplete;
+}
+
+#ifndef UARTSLK_USE_DMA_RX
+void uartslkHandleDataFromISR(uint8_t c, BaseType_t * const pxHigherPriorityTaskWoken)
+{
+  if (uartslkParseByte(c))
+  {
+    // Post the packet to the queue if there's room
+    if (!xQueueIsQueueFullFromISR(syslinkPacketDelivery))
+    {
+      packetHandle_t handle = packetPoolAllocFromISR();
+      if (handle != PACKET_POOL_NO_HANDLE)
+      {
+        memcpy(packetPoolGetSyslinkPacket(handle), (void *)&slp, sizeof(SyslinkPacket));
+        xQueueSendFromISR(syslinkPacketDelivery, &handle, pxHigherPriorityTaskWoken);
+        STATS_CNT_RATE_EVENT(&packetCounter);
+      }
+      else
+      {
+        rxStats.poolDrops++;
+      }
+    }
+    else
+    {
+      rxStats.queueOverflows++;
+      IF_DEBUG_ASSERT(0); // Queue overflow
+    }
+  }
+}
+#endif
+
+static void uartslkHandleTxFromISR(BaseType_t * const pxHigherPriorityTaskWoken)
+{
+  if (outDataIsr && (dataIndexIsr < dataSizeIsr))
+  {
+    USART_SendData(UARTSLK_TYPE, outDataIsr[dataIndexIsr] & 0x00FF);
+    dataIndexIsr++;
+  }
+  else
+  {
+    USART_ITConfig(UARTSLK_TYPE, USART_IT_TXE, DISABLE);
+    xSemaphoreGiveFromISR(waitUntilSendDone, pxHigherPriorityTaskWoken);
+  }
 }
 
 void uartslkIsr(void)
 {
   portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
 
+  STATS_CNT_RATE_EVENT(&interruptCounter);
+
+#ifdef UARTSLK_USE_DMA_RX
+  // Received bytes are moved by the DMA, RXNE must not be handled here and DR must only be read to clear the
+  // IDLE and error flags, any other read would steal a byte from the DMA
+  uint32_t sr = UARTSLK_TYPE->SR;
+  if (sr & (USART_FLAG_IDLE | USART_SR_FLAGS_ERROR))
+  {
+    // IDLE and error flags are cleared by reading SR followed by DR. The line is idle or the byte is already lost,
+    // there is no byte in DR for the DMA.
+    asm volatile ("" : "=m" (UARTSLK_TYPE->DR) : "r" (UARTSLK_TYPE->DR)); // force non-optimizable read
+    if (sr & USART_SR_FLAGS_ERROR)
+    {
+      rxStats.uartErrors++;
+    }
+    if (sr & USART_FLAG_IDLE)
+    {
+      xSemaphoreGiveFromISR(rxDataAvailable, &xHigherPriorityTaskWoken);
+    }
+  }
+  if (USART_GetITStatus(UARTSLK_TYPE, USART_IT_TXE) == SET)
+  {
+    uartslkHandleTxFromISR(&xHigherPriorityTaskWoken);
+  }
+#else
   // the following if statement replaces:
   //   if (USART_GetITStatus(UARTSLK_TYPE, USART_IT_RXNE) == SET)
   // we do this check as fast as possible to minimize the chance of an overrun,
@@ -407,16 +603,7 @@ void uartslkIsr(void)
   }
   else if (USART_GetITStatus(UARTSLK_TYPE, USART_IT_TXE) == SET)
   {
-    if (outDataIsr && (dataIndexIsr < dataSizeIsr))
-    {
-      USART_SendData(UARTSLK_TYPE, outDataIsr[dataIndexIsr] & 0x00FF);
-      dataIndexIsr++;
-    }
-    else
-    {
-      USART_ITConfig(UARTSLK_TYPE, USART_IT_TXE, DISABLE);
-      xSemaphoreGiveFromISR(waitUntilSendDone, &xHigherPriorityTaskWoken);
-    }
+    uartslkHandleTxFromISR(&xHigherPriorityTaskWoken);
   }
   else
   {
@@ -425,13 +612,44 @@ void uartslkIsr(void)
      * - and IDLE (Idle line detected) pending bits are cleared by software sequence:
      * - reading USART_SR register followed reading the USART_DR register.
      */
+    rxStats.uartErrors++;
     asm volatile ("" : "=m" (UARTSLK_TYPE->SR) : "r" (UARTSLK_TYPE->SR)); // force non-optimizable reads
     asm volatile ("" : "=m" (UARTSLK_TYPE->DR) : "r" (UARTSLK_TYPE->DR)); // of these two registers
   }
+#endif
 
   portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
+#ifdef UARTSLK_USE_DMA_RX
+void uartslkRxDmaIsr(void)
+{
+  portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+
+  STATS_CNT_RATE_EVENT(&interruptCounter);
+
+  if (DMA_GetITStatus(UARTSLK_RX_DMA_STREAM, UARTSLK_RX_DMA_IT_HT) == SET)
+  {
+    DMA_ClearITPendingBit(UARTSLK_RX_DMA_STREAM, UARTSLK_RX_DMA_IT_HT);
+    rxDmaBytesWritten += UARTSLK_RX_DMA_BUFFER_SIZE / 2;
+  }
+  if (DMA_GetITStatus(UARTSLK_RX_DMA_STREAM, UARTSLK_RX_DMA_IT_TC) == SET)
+  {
+    DMA_ClearITPendingBit(UARTSLK_RX_DMA_STREAM, UARTSLK_RX_DMA_IT_TC);
+    rxDmaBytesWritten += UARTSLK_RX_DMA_BUFFER_SIZE / 2;
+  }
+
+  // The DMA has written over bytes that were not parsed yet
+  if (rxDmaBytesWritten - rxDmaBytesRead > UARTSLK_RX_DMA_BUFFER_SIZE)
+  {
+    rxStats.dmaOverruns++;
+  }
+
+  xSemaphoreGiveFromISR(rxDataAvailable, &xHigherPriorityTaskWoken);
+  portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+#endif
+
 void uartslkTxenFlowctrlIsr()
 {
   EXTI_ClearFlag(UARTSLK_TXEN_EXTI);
@@ -461,3 +679,25 @@ void __attribute__((used)) DMA2_Stream7_IRQHandler(void)
 {
   uartslkDmaIsr();
 }
+
+#ifdef UARTSLK_USE_DMA_RX
+void __attribute__((used)) DMA2_Stream1_IRQHandler(void)
+{
+  uartslkRxDmaIsr();
+}
+#endif
+
+/**
+ * Syslink UART receive statistics. Compare irqRate with and without UARTSLK_USE_DMA_RX to see the interrupt load
+ * moved out of the UART interrupt. poolDrop is the number of received packets dropped as no packet pool buffer was
+ * free.
+ */
+LOG_GROUP_START(uartslk)
+STATS_CNT_RATE_LOG_ADD(irqRate, &interruptCounter)
+STATS_CNT_RATE_LOG_ADD(pktRate, &packetCounter)
+LOG_ADD(LOG_UINT32, frameErr, &rxStats.framingErrors)
+LOG_ADD(LOG_UINT32, uartErr, &rxStats.uartErrors)
+LOG_ADD(LOG_UINT32, dmaOvr, &rxStats.dmaOverruns)
+LOG_ADD(LOG_UINT32, queueOvr, &rxStats.queueOverflows)
+LOG_ADD(LOG_UINT32, poolDrop, &rxStats.poolDrops)
+LOG_GROUP_STOP(uartslk)
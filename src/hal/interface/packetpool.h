@@ -0,0 +1,103 @@
+/**
+ * ,---------,       ____  _ __
+ * |  ,-^-,  |      / __ )(_) /_______________ _____  ___
+ * | (  O  ) |     / __  / / __/ ___/ ___/ __ `/_  / / _ \
+ * | / ,--´  |    / /_/ / / /_/ /__/ /  / /_/ / / /_/  __/
+ *    +------`   /_____/_/\__/\___/_/   \__,_/ /___/\___/
+ *
+ * Crazyflie control firmware
+ *
+ * Copyright (C) 2020 Bitcraze AB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, in version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * packetpool.h - Pool of reference counted link packet buffers
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "syslink.h"
+
+// crtp.h includes this file for packetHandle_t, the CRTP packet type is only declared here
+struct _CRTPPacket;
+
+/**
+ * Packets on their way between the syslink UART, the radio link and the CRTP ports are stored in a fixed number of
+ * buffers. Only handles to the buffers are passed through the queues, instead of copies of the packets.
+ *
+ * A buffer holds one syslink packet. A CRTP packet is stored at the position of the syslink length byte, that is the
+ * CRTP packet of a received SYSLINK_RADIO_RAW packet is available without copying once the length is adjusted. The
+ * radio link hands the buffer over to the CRTP RX task, which queues it to the port.
+ *
+ * A buffer is reference counted, every queue or task holding the handle owns one reference. The buffer is returned
+ * to the pool when the last reference is released.
+ *
+ * The pool is not sized for all queues to be full at the same time. Outgoing packets are allocated from a reserve
+ * of their own, covering the radio link TX queue, and received packets can never starve them. A CRTP port queue
+ * holds a limited number of buffers and received packets are dropped, rather than waited for, when the pool is
+ * empty for too long.
+ */
+
+#ifndef PACKET_POOL_SIZE
+#define PACKET_POOL_SIZE 40
+#endif
+
+// Buffers only used by packetPoolAllocTx(), the depth of the radio link TX queues plus the packet being queued
+#ifndef PACKET_POOL_TX_RESERVE
+#define PACKET_POOL_TX_RESERVE 10
+#endif
+
+#define PACKET_POOL_NO_HANDLE 0xFF
+
+/**
+ * Handle of a link packet buffer
+ */
+typedef uint8_t packetHandle_t;
+
+void packetPoolInit(void);
+
+/**
+ * Get a buffer for a received packet from the pool, with a reference count of 1
+ *
+ * @param wait Max number of ticks to wait for a free buffer
+ * @return the handle of the buffer, or PACKET_POOL_NO_HANDLE if no buffer is free
+ */
+packetHandle_t packetPoolAlloc(TickType_t wait);
+packetHandle_t packetPoolAllocFromISR(void);
+
+/**
+ * Get a buffer for an outgoing packet from the TX reserve, with a reference count of 1
+ *
+ * @param wait Max number of ticks to wait for a free buffer
+ * @return the handle of the buffer, or PACKET_POOL_NO_HANDLE if no buffer is free
+ */
+packetHandle_t packetPoolAllocTx(TickType_t wait);
+
+/**
+ * Add a reference to a buffer, for instance before passing the handle to a queue while still using it
+ */
+void packetPoolRetain(packetHandle_t handle);
+
+/**
+ * Remove a reference to a buffer, the buffer is returned to the pool when no references are left
+ */
+void packetPoolRelease(packetHandle_t handle);
+void packetPoolReleaseFromISR(packetHandle_t handle);
+
+SyslinkPacket* packetPoolGetSyslinkPacket(packetHandle_t handle);
+struct _CRTPPacket* packetPoolGetCrtpPacket(packetHandle_t handle);
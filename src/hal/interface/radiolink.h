@@ -30,6 +30,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "syslink.h"
+#include "packetpool.h"
 
 #define P2P_MAX_DATA_SIZE 60
 
@@ -54,7 +55,7 @@ void radiolinkSetChannel(uint8_t channel);
 void radiolinkSetDatarate(uint8_t datarate);
 void radiolinkSetAddress(uint64_t address);
 void radiolinkSetPowerDbm(int8_t powerDbm);
-void radiolinkSyslinkDispatch(SyslinkPacket *slp);
+void radiolinkSyslinkDispatch(packetHandle_t handle);
 struct crtpLinkOperations * radiolinkGetLink();
 bool radiolinkSendP2PPacketBroadcast(P2PPacket *p2pp);
 void p2pRegisterCB(P2PCallback cb);
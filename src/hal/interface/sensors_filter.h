@@ -0,0 +1,69 @@
+/**
+ * ,---------,       ____  _ __
+ * |  ,-^-,  |      / __ )(_) /_______________ _____  ___
+ * | (  O  ) |     / __  / / __/ ___/ ___/ __ `/_  / / _ \
+ * | / ,--´  |    / /_/ / / /_/ /__/ /  / /_/ / / /_/  __/
+ *    +------`   /_____/_/\__/\___/_/   \__,_/ /___/\___/
+ *
+ * Crazyflie control firmware
+ *
+ * Copyright (C) 2020 Bitcraze AB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, in version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * sensors_filter.h - Filtering of gyro and accelerometer data, common to the sensor drivers
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "imu_types.h"
+
+#define SENSORS_FILTER_MOTORS 4
+
+/**
+ * The gyro and accelerometer samples are filtered by a filter bank each, see filterBank.h. By default the banks
+ * contain one lowpass stage, more stages (notches or lowpass) can be configured at runtime with the imu_filter
+ * parameters. A stage is set up with a type (0: none, 1: lowpass, 2: notch), a frequency (Hz) and for notches a
+ * Q value (center frequency / bandwidth). Used by the BMI088 drivers.
+ *
+ * The gyro can also be filtered by a dynamic notch stage, with one notch per motor that follows the rotor frequency
+ * estimated from the motor commands. The propeller vibrations are the main source of gyro noise, with the notches
+ * the gyro lowpass cutoff can be raised for less phase lag in the attitude control. The stage is enabled by default
+ * or not by the sensor driver, and can be switched and tuned with the imu_filter.dn* parameters.
+ */
+
+/**
+ * Initialize the filter banks with one lowpass stage each.
+ *
+ * @param sampleFreq The rate of the samples (Hz)
+ * @param gyroCutoffFreq The cutoff frequency of the gyro lowpass stage (Hz)
+ * @param accCutoffFreq The cutoff frequency of the accelerometer lowpass stage (Hz)
+ * @param enableDynamicNotch Enable the dynamic notch stage for the gyro
+ */
+void sensorsFilterInit(float sampleFreq, float gyroCutoffFreq, float accCutoffFreq, bool enableDynamicNotch);
+
+/**
+ * Set the latest motor commands (0 - UINT16_MAX), used by the dynamic notch stage. Called from the power distribution.
+ */
+void sensorsFilterSetMotorRatios(const uint16_t ratios[SENSORS_FILTER_MOTORS]);
+
+/**
+ * Set the cutoff frequency of the first accelerometer stage, and make it a lowpass stage. A frequency at or above the
+ * Nyquist frequency disables the stage.
+ */
+void sensorsFilterSetAccCutoffFreq(float cutoffFreq);
+
+void sensorsFilterGyro(Axis3f* gyro);
+void sensorsFilterAcc(Axis3f* acc);
@@ -0,0 +1,195 @@
+/**
+ * ,---------,       ____  _ __
+ * |  ,-^-,  |      / __ )(_) /_______________ _____  ___
+ * | (  O  ) |     / __  / / __/ ___/ ___/ __ `/_  / / _ \
+ * | / ,--´  |    / /_/ / / /_/ /__/ /  / /_/ / / /_/  __/
+ *    +------`   /_____/_/\__/\___/_/   \__,_/ /___/\___/
+ *
+ * Crazyflie control firmware
+ *
+ * Copyright (C) 2020 Bitcraze AB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, in version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * packetpool.c - Pool of reference counted link packet buffers
+ */
+
+#include <stddef.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+
+#include "packetpool.h"
+#include "crtp.h"
+#include "cfassert.h"
+#include "log.h"
+
+static bool isInit = false;
+
+static SyslinkPacket buffers[PACKET_POOL_SIZE];
+static uint8_t refCount[PACKET_POOL_SIZE];
+static xQueueHandle freeBuffers;
+static xQueueHandle freeTxBuffers;
+
+static uint8_t used;
+static uint8_t maxUsed;
+static uint32_t allocFailures;
+
+// The first PACKET_POOL_TX_RESERVE buffers are the TX reserve
+static xQueueHandle freeQueueOf(packetHandle_t handle) {
+  return (handle < PACKET_POOL_TX_RESERVE) ? freeTxBuffers : freeBuffers;
+}
+
+void packetPoolInit(void)
+{
+  if (isInit) {
+    return;
+  }
+
+  freeBuffers = xQueueCreate(PACKET_POOL_SIZE - PACKET_POOL_TX_RESERVE, sizeof(packetHandle_t));
+  ASSERT(freeBuffers);
+  freeTxBuffers = xQueueCreate(PACKET_POOL_TX_RESERVE, sizeof(packetHandle_t));
+  ASSERT(freeTxBuffers);
+
+  for (packetHandle_t handle = 0; handle < PACKET_POOL_SIZE; handle++) {
+    refCount[handle] = 0;
+    xQueueSend(freeQueueOf(handle), &handle, 0);
+  }
+
+  isInit = true;
+}
+
+// Must be called in a critical section
+static void allocated(packetHandle_t handle) {
+  refCount[handle] = 1;
+  used++;
+  if (used > maxUsed) {
+    maxUsed = used;
+  }
+}
+
+// Must be called in a critical section, returns true if the buffer should be returned to the pool
+static bool released(packetHandle_t handle) {
+  ASSERT(refCount[handle] > 0);
+  refCount[handle]--;
+  if (refCount[handle] == 0) {
+    used--;
+    return true;
+  }
+
+  return false;
+}
+
+static packetHandle_t allocFrom(xQueueHandle queue, TickType_t wait)
+{
+  packetHandle_t handle;
+  if (xQueueReceive(queue, &handle, wait) != pdTRUE) {
+    allocFailures++;
+    return PACKET_POOL_NO_HANDLE;
+  }
+
+  taskENTER_CRITICAL();
+  allocated(handle);
+  taskEXIT_CRITICAL();
+
+  return handle;
+}
+
+packetHandle_t packetPoolAlloc(TickType_t wait)
+{
+  return allocFrom(freeBuffers, wait);
+}
+
+packetHandle_t packetPoolAllocTx(TickType_t wait)
+{
+  return allocFrom(freeTxBuffers, wait);
+}
+
+packetHandle_t packetPoolAllocFromISR(void)
+{
+  packetHandle_t handle;
+  BaseType_t higherPriorityTaskWoken = pdFALSE;
+  if (xQueueReceiveFromISR(freeBuffers, &handle, &higherPriorityTaskWoken) != pdTRUE) {
+    allocFailures++;
+    return PACKET_POOL_NO_HANDLE;
+  }
+
+  UBaseType_t savedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+  allocated(handle);
+  taskEXIT_CRITICAL_FROM_ISR(savedInterruptStatus);
+
+  return handle;
+}
+
+void packetPoolRetain(packetHandle_t handle)
+{
+  ASSERT(handle < PACKET_POOL_SIZE);
+
+  taskENTER_CRITICAL();
+  ASSERT(refCount[handle] > 0);
+  refCount[handle]++;
+  taskEXIT_CRITICAL();
+}
+
+void packetPoolRelease(packetHandle_t handle)
+{
+  ASSERT(handle < PACKET_POOL_SIZE);
+
+  taskENTER_CRITICAL();
+  bool isFree = released(handle);
+  taskEXIT_CRITICAL();
+
+  if (isFree) {
+    xQueueSend(freeQueueOf(handle), &handle, 0);
+  }
+}
+
+void packetPoolReleaseFromISR(packetHandle_t handle)
+{
+  ASSERT(handle < PACKET_POOL_SIZE);
+
+  UBaseType_t savedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+  bool isFree = released(handle);
+  taskEXIT_CRITICAL_FROM_ISR(savedInterruptStatus);
+
+  if (isFree) {
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    xQueueSendFromISR(freeQueueOf(handle), &handle, &higherPriorityTaskWoken);
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
+  }
+}
+
+SyslinkPacket* packetPoolGetSyslinkPacket(packetHandle_t handle)
+{
+  ASSERT(handle < PACKET_POOL_SIZE);
+  return &buffers[handle];
+}
+
+CRTPPacket* packetPoolGetCrtpPacket(packetHandle_t handle)
+{
+  ASSERT(handle < PACKET_POOL_SIZE);
+  return (CRTPPacket*)&buffers[handle].length;
+}
+
+/**
+ * Packet pool usage. used is the number of buffers currently allocated and maxUsed the max since start up, if
+ * maxUsed reaches PACKET_POOL_SIZE packets may have been dropped or delayed, see allocFail. allocFail counts all
+ * allocations that timed out, the TX reserve included.
+ */
+LOG_GROUP_START(pktPool)
+LOG_ADD(LOG_UINT8, used, &used)
+LOG_ADD(LOG_UINT8, maxUsed, &maxUsed)
+LOG_ADD(LOG_UINT32, allocFail, &allocFailures)
+LOG_GROUP_STOP(pktPool)
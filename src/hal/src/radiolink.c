@@ -42,21 +42,31 @@
 #include "led.h"
 #include "ledseq.h"
 #include "queuemonitor.h"
-
-#define RADIOLINK_TX_QUEUE_SIZE (1)
+#include "packetpool.h"
+#include "statsCnt.h"
+
+// Downlink packets can only be sent as the ack of an uplink packet. The queue is deep enough to always have a packet
+// ready when the host polls fast, the CRTP TX task refills it while the syslink task sends. Packets of the high
+// priority CRTP ports go to a queue of their own that is served first, they never wait behind the queued packets of
+// other ports. The queued packets are allocated from the TX reserve of the packet pool, see PACKET_POOL_TX_RESERVE.
+#ifndef RADIOLINK_TX_QUEUE_SIZE
+#define RADIOLINK_TX_QUEUE_SIZE (8)
+#endif
+#define RADIOLINK_TX_HIGH_QUEUE_SIZE (1)
 #define RADIOLINK_CTRP_QUEUE_SIZE (5)
 #define RADIO_ACTIVITY_TIMEOUT_MS (1000)
 
 #define RADIOLINK_P2P_QUEUE_SIZE (5)
 
 static xQueueHandle  txQueue;
+static xQueueHandle  txHighQueue;
 static xQueueHandle crtpPacketDelivery;
 
 static bool isInit;
 
 static int radiolinkSendCRTPPacket(CRTPPacket *p);
 static int radiolinkSetEnable(bool enable);
-static int radiolinkReceiveCRTPPacket(CRTPPacket *p);
+static int radiolinkReceiveCRTPPacket(packetHandle_t *handle);
 
 //Local RSSI variable used to enable logging of RSSI values from Radio
 static uint8_t rssi;
@@ -65,6 +75,11 @@ static uint32_t lastPacketTick;
 
 static volatile P2PCallback p2p_callback;
 
+// Downlink statistics, an empty ack is an uplink packet that arrived when no downlink packet was queued
+static STATS_CNT_RATE_DEFINE(downlinkCounter, 1000);
+static STATS_CNT_RATE_DEFINE(emptyAckCounter, 1000);
+static uint8_t txQueued;
+
 static bool radiolinkIsConnected(void) {
   return (xTaskGetTickCount() - lastPacketTick) < M2T(RADIO_ACTIVITY_TIMEOUT_MS);
 }
@@ -73,7 +88,7 @@ static struct crtpLinkOperations radiolinkOp =
 {
   .setEnable         = radiolinkSetEnable,
   .sendPacket        = radiolinkSendCRTPPacket,
-  .receivePacket     = radiolinkReceiveCRTPPacket,
+  .receivePacketHandle = radiolinkReceiveCRTPPacket,
   .isConnected       = radiolinkIsConnected
 };
 
@@ -82,9 +97,11 @@ void radiolinkInit(void)
   if (isInit)
     return;
 
-  txQueue = xQueueCreate(RADIOLINK_TX_QUEUE_SIZE, sizeof(SyslinkPacket));
+  txQueue = xQueueCreate(RADIOLINK_TX_QUEUE_SIZE, sizeof(packetHandle_t));
   DEBUG_QUEUE_MONITOR_REGISTER(txQueue);
-  crtpPacketDelivery = xQueueCreate(RADIOLINK_CTRP_QUEUE_SIZE, sizeof(CRTPPacket));
+  txHighQueue = xQueueCreate(RADIOLINK_TX_HIGH_QUEUE_SIZE, sizeof(packetHandle_t));
+  DEBUG_QUEUE_MONITOR_REGISTER(txHighQueue);
+  crtpPacketDelivery = xQueueCreate(RADIOLINK_CTRP_QUEUE_SIZE, sizeof(packetHandle_t));
   DEBUG_QUEUE_MONITOR_REGISTER(crtpPacketDelivery);
 
   ASSERT(crtpPacketDelivery);
@@ -144,9 +161,23 @@ void radiolinkSetPowerDbm(int8_t powerDbm)
 }
 
 
-void radiolinkSyslinkDispatch(SyslinkPacket *slp)
+// Queue the CRTP packet of a received radio packet, the queue gets a reference to the buffer
+static void deliverCrtpPacket(packetHandle_t handle)
+{
+  SyslinkPacket *slp = packetPoolGetSyslinkPacket(handle);
+  slp->length--; // Decrease to get CRTP size.
+
+  packetPoolRetain(handle);
+  if (xQueueSend(crtpPacketDelivery, &handle, 0) != pdTRUE)
+  {
+    packetPoolRelease(handle);
+  }
+}
+
+void radiolinkSyslinkDispatch(packetHandle_t handle)
 {
-  static SyslinkPacket txPacket;
+  SyslinkPacket *slp = packetPoolGetSyslinkPacket(handle);
+  packetHandle_t txHandle;
 
   if (slp->type == SYSLINK_RADIO_RAW || slp->type == SYSLINK_RADIO_RAW_BROADCAST) {
     lastPacketTick = xTaskGetTickCount();
@@ -154,19 +185,24 @@ void radiolinkSyslinkDispatch(SyslinkPacket *slp)
 
   if (slp->type == SYSLINK_RADIO_RAW)
   {
-    slp->length--; // Decrease to get CRTP size.
-    xQueueSend(crtpPacketDelivery, &slp->length, 0);
+    deliverCrtpPacket(handle);
     ledseqRun(LINK_LED, seq_linkup);
     // If a radio packet is received, one can be sent
-    if (xQueueReceive(txQueue, &txPacket, 0) == pdTRUE)
+    if (xQueueReceive(txHighQueue, &txHandle, 0) == pdTRUE || xQueueReceive(txQueue, &txHandle, 0) == pdTRUE)
     {
       ledseqRun(LINK_DOWN_LED, seq_linkup);
-      syslinkSendPacket(&txPacket);
+      syslinkSendPacket(packetPoolGetSyslinkPacket(txHandle));
+      packetPoolRelease(txHandle);
+      STATS_CNT_RATE_EVENT(&downlinkCounter);
     }
+    else
+    {
+      STATS_CNT_RATE_EVENT(&emptyAckCounter);
+    }
+    txQueued = uxQueueMessagesWaiting(txQueue);
   } else if (slp->type == SYSLINK_RADIO_RAW_BROADCAST)
   {
-    slp->length--; // Decrease to get CRTP size.
-    xQueueSend(crtpPacketDelivery, &slp->length, 0);
+    deliverCrtpPacket(handle);
     ledseqRun(LINK_LED, seq_linkup);
     // no ack for broadcasts
   } else if (slp->type == SYSLINK_RADIO_RSSI)
@@ -188,9 +224,10 @@ void radiolinkSyslinkDispatch(SyslinkPacket *slp)
   isConnected = radiolinkIsConnected();
 }
 
-static int radiolinkReceiveCRTPPacket(CRTPPacket *p)
+// The reference of the delivery queue is handed over to the caller
+static int radiolinkReceiveCRTPPacket(packetHandle_t *handle)
 {
-  if (xQueueReceive(crtpPacketDelivery, p, M2T(100)) == pdTRUE)
+  if (xQueueReceive(crtpPacketDelivery, handle, M2T(100)) == pdTRUE)
   {
     return 0;
   }
@@ -205,19 +242,26 @@ void p2pRegisterCB(P2PCallback cb)
 
 static int radiolinkSendCRTPPacket(CRTPPacket *p)
 {
-  static SyslinkPacket slp;
-
   ASSERT(p->size <= CRTP_MAX_DATA_SIZE);
 
-  slp.type = SYSLINK_RADIO_RAW;
-  slp.length = p->size + 1;
-  memcpy(slp.data, &p->header, p->size + 1);
+  packetHandle_t handle = packetPoolAllocTx(M2T(100));
+  if (handle == PACKET_POOL_NO_HANDLE)
+  {
+    return false;
+  }
+
+  SyslinkPacket *slp = packetPoolGetSyslinkPacket(handle);
+  slp->type = SYSLINK_RADIO_RAW;
+  slp->length = p->size + 1;
+  memcpy(slp->data, &p->header, p->size + 1);
 
-  if (xQueueSend(txQueue, &slp, M2T(100)) == pdTRUE)
+  xQueueHandle queue = crtpIsHighPriorityPort(p->port) ? txHighQueue : txQueue;
+  if (xQueueSend(queue, &handle, M2T(100)) == pdTRUE)
   {
     return true;
   }
 
+  packetPoolRelease(handle);
   return false;
 }
 
@@ -251,4 +295,7 @@ static int radiolinkSetEnable(bool enable)
 LOG_GROUP_START(radio)
 LOG_ADD(LOG_UINT8, rssi, &rssi)
 LOG_ADD(LOG_UINT8, isConnected, &isConnected)
+STATS_CNT_RATE_LOG_ADD(dlRate, &downlinkCounter)
+STATS_CNT_RATE_LOG_ADD(emptyAck, &emptyAckCounter)
+LOG_ADD(LOG_UINT8, txQueued, &txQueued)
 LOG_GROUP_STOP(radio)
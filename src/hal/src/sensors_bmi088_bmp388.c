@@ -46,6 +46,8 @@
 #include "ledseq.h"
 #include "sound.h"
 #include "filter.h"
+#include "sensors_filter.h"
+#include "num.h"
 #include "i2cdev.h"
 #include "bmi088.h"
 #include "bmp3.h"
@@ -59,6 +61,9 @@
 #define SENSORS_READ_MAG_HZ             20
 #define SENSORS_DELAY_BARO              (SENSORS_READ_RATE_HZ/SENSORS_READ_BARO_HZ)
 #define SENSORS_DELAY_MAG               (SENSORS_READ_RATE_HZ/SENSORS_READ_MAG_HZ)
+// The barometer is read in one 6 byte burst, about 0.25 ms on the 400 kHz I2C bus shared with the BMI088. A read is
+// only started this long after the IMU interrupt, it is then done before the next IMU sample needs the bus.
+#define SENSORS_BARO_SLOT_US            600
 
 #define SENSORS_BMI088_GYRO_FS_CFG      BMI088_GYRO_RANGE_2000_DPS
 #define SENSORS_BMI088_DEG_PER_LSB_CFG  (2.0f *2000.0f) / 65536.0f
@@ -85,6 +90,10 @@
 
 #define SENSORS_ACC_SCALE_SAMPLES  200
 
+// Histogram of the time from the IMU interrupt to the stabilizer getting the data
+#define LATENCY_HISTOGRAM_BINS      8
+#define LATENCY_HISTOGRAM_BIN_US    100
+
 typedef struct
 {
   Axis3f     bias;
@@ -104,6 +113,10 @@ static xQueueHandle accelerometerDataQueue;
 static xQueueHandle gyroDataQueue;
 static xQueueHandle magnetometerDataQueue;
 static xQueueHandle barometerDataQueue;
+static xQueueHandle barometerResultQueue;
+static xSemaphoreHandle barometerReadRequest;
+static volatile bool isBarometerReadDue;
+static uint32_t barometerSlotMisses;
 static xSemaphoreHandle sensorsDataReady;
 static xSemaphoreHandle dataReady;
 
@@ -127,13 +140,38 @@ static uint32_t accScaleSumCount = 0;
 // Low Pass filtering
 #define GYRO_LPF_CUTOFF_FREQ  80
 #define ACCEL_LPF_CUTOFF_FREQ 30
-static lpf2pData accLpf[3];
-static lpf2pData gyroLpf[3];
-static void applyAxis3fLpf(lpf2pData *data, Axis3f* in);
+// Gyro notch filters that follow the motors, see sensors_filter.h
+#ifndef GYRO_DYN_NOTCH_ENABLE
+#define GYRO_DYN_NOTCH_ENABLE false
+#endif
+
+#ifdef SENSORS_BMI088_FIFO
+// The gyro runs at twice SENSORS_READ_RATE_HZ and fills its FIFO, the FIFO watermark interrupt replaces the data ready
+// interrupt. All frames are read in bursts and decimated by 2 with an anti-alias filter.
+#define SENSORS_GYRO_FIFO_ODR_CFG       BMI088_GYRO_BW_230_ODR_2000_HZ
+#define SENSORS_GYRO_FIFO_WATERMARK     2
+#define SENSORS_GYRO_FIFO_FRAME_SIZE    6
+#define SENSORS_GYRO_FIFO_MAX_FRAMES    8 // Frames per I2C burst read
+// Register values from the datasheet, the FIFO part of the bosch driver is not built (USE_FIFO)
+#define SENSORS_GYRO_FIFO_WM_INT_ENABLE 0x88 // INT_EN (0x1E)
+#define SENSORS_GYRO_FIFO_STREAM_MODE   0x80 // FIFO_CONFIG_1 (0x3E), stream mode, x, y and z
+
+static decimator2Data gyroDecimator[GYRO_NBR_OF_AXES];
+static uint8_t gyroFifoBuffer[SENSORS_GYRO_FIFO_MAX_FRAMES * SENSORS_GYRO_FIFO_FRAME_SIZE];
+static uint8_t gyroFifoFrames;
+static uint32_t gyroFifoOverruns;
+#endif
+
 
 static bool isBarometerPresent = false;
 static uint8_t baroMeasDelayMin = SENSORS_DELAY_BARO;
 
+// The last bin holds all latencies that do not fit in the others
+static uint32_t latencyHistogram[LATENCY_HISTOGRAM_BINS];
+static uint16_t latencyMax;
+static uint16_t currentLatencyMax;
+static uint32_t latencyMaxResetTick;
+
 // Pre-calculated values for accelerometer alignment
 float cosPitch;
 float sinPitch;
@@ -208,10 +246,65 @@ static void bmi088_ms_delay(uint32_t period)
   vTaskDelay(M2T(period)); // Delay a while to let the device stabilize
 }
 
+#ifdef SENSORS_BMI088_FIFO
+static void sensorsGyroFifoReset(void)
+{
+  // Writing FIFO_CONFIG_1 clears the FIFO and the overrun flag
+  uint8_t reg = SENSORS_GYRO_FIFO_STREAM_MODE;
+  bmi088_set_gyro_regs(BMI088_GYRO_FIFO_CONFIG_1_REG, &reg, 1, &bmi088Dev);
+}
+
+/**
+ * Reads all complete frame pairs from the gyro FIFO and runs them through the decimator. dataOut is set to the latest
+ * decimated sample, it is left unchanged if there was no complete pair. An odd frame is left in the FIFO for the next
+ * read, which also makes sure the fill level drops below the watermark and the next interrupt is triggered.
+ */
+static void sensorsGyroGet(Axis3i16* dataOut)
+{
+  uint8_t status = 0;
+  bmi088_get_gyro_regs(BMI088_GYRO_FIFO_STAT_REG, &status, 1, &bmi088Dev);
+
+  if (status & BMI088_GYRO_FIFO_OVERRUN_MASK)
+  {
+    gyroFifoOverruns++;
+    gyroFifoFrames = 0;
+    sensorsGyroFifoReset();
+    return;
+  }
+
+  uint8_t frames = (status & BMI088_GYRO_FIFO_COUNTER_MASK) & ~1;
+  gyroFifoFrames = frames;
+
+  while (frames > 0)
+  {
+    uint8_t burst = frames > SENSORS_GYRO_FIFO_MAX_FRAMES ? SENSORS_GYRO_FIFO_MAX_FRAMES : frames;
+    bmi088_get_gyro_regs(BMI088_GYRO_FIFO_DATA_REG, gyroFifoBuffer, burst * SENSORS_GYRO_FIFO_FRAME_SIZE, &bmi088Dev);
+
+    for (int i = 0; i < burst; i += 2)
+    {
+      const uint8_t* frame0 = &gyroFifoBuffer[i * SENSORS_GYRO_FIFO_FRAME_SIZE];
+      const uint8_t* frame1 = frame0 + SENSORS_GYRO_FIFO_FRAME_SIZE;
+      int16_t* out = (int16_t*)dataOut;
+
+      for (int axis = 0; axis < GYRO_NBR_OF_AXES; axis++)
+      {
+        int16_t sample0 = (int16_t)((frame0[2 * axis + 1] << 8) | frame0[2 * axis]);
+        int16_t sample1 = (int16_t)((frame1[2 * axis + 1] << 8) | frame1[2 * axis]);
+        // The filter can overshoot slightly at full scale
+        float decimated = decimator2Apply(&gyroDecimator[axis], sample0, sample1);
+        out[axis] = (int16_t)lroundf(constrain(decimated, INT16_MIN, INT16_MAX));
+      }
+    }
+
+    frames -= burst;
+  }
+}
+#else
 static void sensorsGyroGet(Axis3i16* dataOut)
 {
   bmi088_get_gyro_data((struct bmi088_sensor_data*)dataOut, &bmi088Dev);
 }
+#endif
 
 static void sensorsAccelGet(Axis3i16* dataOut)
 {
@@ -247,8 +340,33 @@ bool sensorsBmi088Bmp388ReadBaro(baro_t *baro)
   return (pdTRUE == xQueueReceive(barometerDataQueue, baro, 0));
 }
 
+static void updateLatencyHistogram(const uint32_t tick)
+{
+  uint32_t latency = usecTimestamp() - sensorData.interruptTimestamp;
+
+  uint32_t bin = latency / LATENCY_HISTOGRAM_BIN_US;
+  if (bin >= LATENCY_HISTOGRAM_BINS)
+  {
+    bin = LATENCY_HISTOGRAM_BINS - 1;
+  }
+  latencyHistogram[bin]++;
+
+  if (latency > currentLatencyMax)
+  {
+    currentLatencyMax = latency > UINT16_MAX ? UINT16_MAX : latency;
+  }
+  if (tick - latencyMaxResetTick >= SENSORS_READ_RATE_HZ)
+  {
+    latencyMax = currentLatencyMax;
+    currentLatencyMax = 0;
+    latencyMaxResetTick = tick;
+  }
+}
+
 void sensorsBmi088Bmp388Acquire(sensorData_t *sensors, const uint32_t tick)
 {
+  updateLatencyHistogram(tick);
+
   sensorsReadGyro(&sensors->gyro);
   sensorsReadAcc(&sensors->acc);
   sensorsReadMag(&sensors->mag);
@@ -294,29 +412,20 @@ static void sensorsTask(void *param)
       sensorData.gyro.x =  (gyroRaw.x - gyroBias.x) * SENSORS_BMI088_DEG_PER_LSB_CFG;
       sensorData.gyro.y =  (gyroRaw.y - gyroBias.y) * SENSORS_BMI088_DEG_PER_LSB_CFG;
       sensorData.gyro.z =  (gyroRaw.z - gyroBias.z) * SENSORS_BMI088_DEG_PER_LSB_CFG;
-      applyAxis3fLpf((lpf2pData*)(&gyroLpf), &sensorData.gyro);
+      sensorsFilterGyro(&sensorData.gyro);
 
       /* Acelerometer */
       accScaled.x = accelRaw.x * SENSORS_BMI088_G_PER_LSB_CFG / accScale;
       accScaled.y = accelRaw.y * SENSORS_BMI088_G_PER_LSB_CFG / accScale;
       accScaled.z = accelRaw.z * SENSORS_BMI088_G_PER_LSB_CFG / accScale;
       sensorsAccAlignToGravity(&accScaled, &sensorData.acc);
-      applyAxis3fLpf((lpf2pData*)(&accLpf), &sensorData.acc);
+      sensorsFilterAcc(&sensorData.acc);
     }
 
     if (isBarometerPresent)
     {
-      static uint8_t baroMeasDelay = SENSORS_DELAY_BARO;
-      if (--baroMeasDelay == 0)
-      {
-        uint8_t sensor_comp = BMP3_PRESS | BMP3_TEMP;
-        struct bmp3_data data;
-        baro_t* baro388 = &sensorData.baro;
-        /* Temperature and Pressure data are read and stored in the bmp3_data instance */
-        bmp3_get_sensor_data(sensor_comp, &data, &bmp388Dev);
-        sensorsScaleBaro(baro388, data.pressure, data.temperature);
-        baroMeasDelay = baroMeasDelayMin;
-      }
+      // Pick up the latest result from the barometer task, if any
+      xQueueReceive(barometerResultQueue, &sensorData.baro, 0);
     }
     xQueueOverwrite(accelerometerDataQueue, &sensorData.acc);
     xQueueOverwrite(gyroDataQueue, &sensorData.gyro);
@@ -326,6 +435,55 @@ static void sensorsTask(void *param)
     }
 
     xSemaphoreGive(dataReady);
+
+    if (isBarometerPresent)
+    {
+      // Request the next barometer read right after the IMU data is published. The request is repeated at every
+      // IMU sample until the barometer task has found a slot for the read, see SENSORS_BARO_SLOT_US.
+      static uint8_t baroMeasDelay = SENSORS_DELAY_BARO;
+      if (--baroMeasDelay == 0)
+      {
+        isBarometerReadDue = true;
+        baroMeasDelay = baroMeasDelayMin;
+      }
+      if (isBarometerReadDue)
+      {
+        xSemaphoreGive(barometerReadRequest);
+      }
+    }
+  }
+}
+
+/**
+ * Reads the barometer outside of the IMU loop. The sensors task requests a read every SENSORS_DELAY_BARO IMU samples,
+ * the result is published to the sensors task when the transfer is done. The task runs at a lower priority than the
+ * sensors task and only starts the transfer in the first part of the IMU sample period, so the bus is free again
+ * when the next IMU sample is read. A read that misses the slot is retried at the next IMU sample.
+ */
+static void sensorsBaroTask(void *param)
+{
+  systemWaitStart();
+
+  while (1)
+  {
+    xSemaphoreTake(barometerReadRequest, portMAX_DELAY);
+
+    if (usecTimestamp() - imuIntTimestamp > SENSORS_BARO_SLOT_US)
+    {
+      barometerSlotMisses++;
+      continue;
+    }
+    isBarometerReadDue = false;
+
+    uint8_t sensor_comp = BMP3_PRESS | BMP3_TEMP;
+    struct bmp3_data data;
+    baro_t baro388;
+    /* Temperature and Pressure data are read and stored in the bmp3_data instance */
+    if (bmp3_get_sensor_data(sensor_comp, &data, &bmp388Dev) == BMP3_OK)
+    {
+      sensorsScaleBaro(&baro388, data.pressure, data.temperature);
+      xQueueOverwrite(barometerResultQueue, &baro388);
+    }
   }
 }
 
@@ -364,9 +522,15 @@ static void sensorsDeviceInit(void)
     bmi088Dev.gyro_cfg.power = BMI088_GYRO_PM_NORMAL;
     rslt |= bmi088_set_gyro_power_mode(&bmi088Dev);
     /* set bandwidth and range of gyro */
+#ifdef SENSORS_BMI088_FIFO
+    bmi088Dev.gyro_cfg.bw = SENSORS_GYRO_FIFO_ODR_CFG;
+    bmi088Dev.gyro_cfg.range = SENSORS_BMI088_GYRO_FS_CFG;
+    bmi088Dev.gyro_cfg.odr = SENSORS_GYRO_FIFO_ODR_CFG;
+#else
     bmi088Dev.gyro_cfg.bw = BMI088_GYRO_BW_116_ODR_1000_HZ;
     bmi088Dev.gyro_cfg.range = SENSORS_BMI088_GYRO_FS_CFG;
     bmi088Dev.gyro_cfg.odr = BMI088_GYRO_BW_116_ODR_1000_HZ;
+#endif
     rslt |= bmi088_set_gyro_meas_conf(&bmi088Dev);
 
     intConfig.gyro_int_channel = BMI088_INT_CHANNEL_3;
@@ -377,6 +541,20 @@ static void sensorsDeviceInit(void)
     /* Setting the interrupt configuration */
     rslt = bmi088_set_gyro_int_config(&intConfig, &bmi088Dev);
 
+#ifdef SENSORS_BMI088_FIFO
+    /* Use the pin configuration from above, but interrupt on the FIFO watermark instead of on data ready */
+    uint8_t reg = BMI088_GYRO_FIFO_EN_MASK;
+    rslt |= bmi088_set_gyro_regs(BMI088_GYRO_INT_CTRL_REG, &reg, 1, &bmi088Dev);
+    reg = BMI088_GYRO_INT1_FIFO_MASK;
+    rslt |= bmi088_set_gyro_regs(BMI088_GYRO_INT3_INT4_IO_MAP_REG, &reg, 1, &bmi088Dev);
+    reg = SENSORS_GYRO_FIFO_WM_INT_ENABLE;
+    rslt |= bmi088_set_gyro_regs(BMI088_GYRO_INT_EN_REG, &reg, 1, &bmi088Dev);
+    reg = SENSORS_GYRO_FIFO_WATERMARK;
+    rslt |= bmi088_set_gyro_regs(BMI088_GYRO_FIFO_CONFIG_0_REG, &reg, 1, &bmi088Dev);
+    reg = SENSORS_GYRO_FIFO_STREAM_MODE;
+    rslt |= bmi088_set_gyro_regs(BMI088_GYRO_FIFO_CONFIG_1_REG, &reg, 1, &bmi088Dev);
+#endif
+
     bmi088Dev.delay_ms(50);
     struct bmi088_sensor_data gyr;
     rslt |= bmi088_get_gyro_data(&gyr, &bmi088Dev);
@@ -481,12 +659,14 @@ static void sensorsDeviceInit(void)
 #endif
   }
 
-  // Init second order filer for accelerometer and gyro
+  // Init the filters for accelerometer and gyro
+  sensorsFilterInit(SENSORS_READ_RATE_HZ, GYRO_LPF_CUTOFF_FREQ, ACCEL_LPF_CUTOFF_FREQ, GYRO_DYN_NOTCH_ENABLE);
+#ifdef SENSORS_BMI088_FIFO
   for (uint8_t i = 0; i < 3; i++)
   {
-    lpf2pInit(&gyroLpf[i], 1000, GYRO_LPF_CUTOFF_FREQ);
-    lpf2pInit(&accLpf[i],  1000, ACCEL_LPF_CUTOFF_FREQ);
+    decimator2Init(&gyroDecimator[i]);
   }
+#endif
 
   cosPitch = cosf(configblockGetCalibPitch() * (float) M_PI / 180);
   sinPitch = sinf(configblockGetCalibPitch() * (float) M_PI / 180);
@@ -502,8 +682,11 @@ static void sensorsTaskInit(void)
   gyroDataQueue = xQueueCreate(1, sizeof(Axis3f));
   magnetometerDataQueue = xQueueCreate(1, sizeof(Axis3f));
   barometerDataQueue = xQueueCreate(1, sizeof(baro_t));
+  barometerResultQueue = xQueueCreate(1, sizeof(baro_t));
+  barometerReadRequest = xSemaphoreCreateBinary();
 
   xTaskCreate(sensorsTask, SENSORS_TASK_NAME, SENSORS_TASK_STACKSIZE, NULL, SENSORS_TASK_PRI, NULL);
+  xTaskCreate(sensorsBaroTask, BARO_TASK_NAME, BARO_TASK_STACKSIZE, NULL, BARO_TASK_PRI, NULL);
 }
 
 static void sensorsInterruptInit(void)
@@ -802,10 +985,7 @@ void sensorsBmi088Bmp388SetAccMode(accModes accMode)
       {
         DEBUG_PRINT("ACC config [FAIL]\n");
       }
-      for (uint8_t i = 0; i < 3; i++)
-      {
-        lpf2pInit(&accLpf[i],  1000, 500);
-      }
+      sensorsFilterSetAccCutoffFreq(500);
       break;
     case ACC_MODE_FLIGHT:
     default:
@@ -817,21 +997,11 @@ void sensorsBmi088Bmp388SetAccMode(accModes accMode)
       {
         DEBUG_PRINT("ACC config [FAIL]\n");
       }
-      for (uint8_t i = 0; i < 3; i++)
-      {
-        lpf2pInit(&accLpf[i],  1000, ACCEL_LPF_CUTOFF_FREQ);
-      }
+      sensorsFilterSetAccCutoffFreq(ACCEL_LPF_CUTOFF_FREQ);
       break;
   }
 }
 
-static void applyAxis3fLpf(lpf2pData *data, Axis3f* in)
-{
-  for (uint8_t i = 0; i < 3; i++) {
-    in->axis[i] = lpf2pApply(&data[i], in->axis[i]);
-  }
-}
-
 void sensorsBmi088Bmp388DataAvailableCallback(void)
 {
   portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
@@ -855,6 +1025,35 @@ LOG_ADD(LOG_FLOAT, zVariance, &gyroBiasRunning.variance.z)
 LOG_GROUP_STOP(gyro)
 #endif
 
+/**
+ * Time from the IMU interrupt to the stabilizer acquiring the sample. Bin n counts the samples with a latency of
+ * n * 100 to (n + 1) * 100 us, bin 7 also counts all longer latencies. max is the longest latency (us) during the
+ * last second. baroMiss counts the barometer reads postponed as they would have overlapped the next IMU read.
+ */
+LOG_GROUP_START(imuLat)
+LOG_ADD(LOG_UINT32, bin0, &latencyHistogram[0])
+LOG_ADD(LOG_UINT32, bin1, &latencyHistogram[1])
+LOG_ADD(LOG_UINT32, bin2, &latencyHistogram[2])
+LOG_ADD(LOG_UINT32, bin3, &latencyHistogram[3])
+LOG_ADD(LOG_UINT32, bin4, &latencyHistogram[4])
+LOG_ADD(LOG_UINT32, bin5, &latencyHistogram[5])
+LOG_ADD(LOG_UINT32, bin6, &latencyHistogram[6])
+LOG_ADD(LOG_UINT32, bin7, &latencyHistogram[7])
+LOG_ADD(LOG_UINT16, max, &latencyMax)
+LOG_ADD(LOG_UINT32, baroMiss, &barometerSlotMisses)
+LOG_GROUP_STOP(imuLat)
+
+#ifdef SENSORS_BMI088_FIFO
+/**
+ * Gyro FIFO. frames is the number of frames read at the last interrupt, normally 2. overrun counts the times the FIFO
+ * was full and had to be cleared.
+ */
+LOG_GROUP_START(gyroFifo)
+LOG_ADD(LOG_UINT8, frames, &gyroFifoFrames)
+LOG_ADD(LOG_UINT32, overrun, &gyroFifoOverruns)
+LOG_GROUP_STOP(gyroFifo)
+#endif
+
 PARAM_GROUP_START(imu_sensors)
 PARAM_ADD(PARAM_UINT8 | PARAM_RONLY, BMP388, &isBarometerPresent)
 PARAM_GROUP_STOP(imu_sensors)
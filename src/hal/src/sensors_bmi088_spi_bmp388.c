@@ -49,6 +49,8 @@
 #include "ledseq.h"
 #include "sound.h"
 #include "filter.h"
+#include "sensors_filter.h"
+#include "num.h"
 #include "i2cdev.h"
 #include "bmi088.h"
 #include "bmp3.h"
@@ -181,9 +183,28 @@ static uint32_t accScaleSumCount = 0;
 // Low Pass filtering
 #define GYRO_LPF_CUTOFF_FREQ  80
 #define ACCEL_LPF_CUTOFF_FREQ 30
-static lpf2pData accLpf[3];
-static lpf2pData gyroLpf[3];
-static void applyAxis3fLpf(lpf2pData *data, Axis3f* in);
+// Gyro notch filters that follow the motors, see sensors_filter.h
+#ifndef GYRO_DYN_NOTCH_ENABLE
+#define GYRO_DYN_NOTCH_ENABLE false
+#endif
+
+#ifdef SENSORS_BMI088_FIFO
+// The gyro runs at twice SENSORS_READ_RATE_HZ and fills its FIFO, the FIFO watermark interrupt replaces the data ready
+// interrupt. All frames are read in bursts and decimated by 2 with an anti-alias filter.
+#define SENSORS_GYRO_FIFO_ODR_CFG       BMI088_GYRO_BW_230_ODR_2000_HZ
+#define SENSORS_GYRO_FIFO_WATERMARK     2
+#define SENSORS_GYRO_FIFO_FRAME_SIZE    6
+#define SENSORS_GYRO_FIFO_MAX_FRAMES    2 // Frames per SPI read, fits in one DMA transaction
+// Register values from the datasheet, the FIFO part of the bosch driver is not built (USE_FIFO)
+#define SENSORS_GYRO_FIFO_WM_INT_ENABLE 0x88 // INT_EN (0x1E)
+#define SENSORS_GYRO_FIFO_STREAM_MODE   0x80 // FIFO_CONFIG_1 (0x3E), stream mode, x, y and z
+
+static decimator2Data gyroDecimator[GYRO_NBR_OF_AXES];
+static uint8_t gyroFifoBuffer[SENSORS_GYRO_FIFO_MAX_FRAMES * SENSORS_GYRO_FIFO_FRAME_SIZE];
+static uint8_t gyroFifoFrames;
+static uint32_t gyroFifoOverruns;
+#endif
+
 
 static bool isBarometerPresent = false;
 static uint8_t baroMeasDelayMin = SENSORS_DELAY_BARO;
@@ -498,10 +519,65 @@ static void spiDMAInit(void)
   spiRxDMAComplete = xSemaphoreCreateBinary();
 }
 
+#ifdef SENSORS_BMI088_FIFO
+static void sensorsGyroFifoReset(void)
+{
+  // Writing FIFO_CONFIG_1 clears the FIFO and the overrun flag
+  uint8_t reg = SENSORS_GYRO_FIFO_STREAM_MODE;
+  bmi088_set_gyro_regs(BMI088_GYRO_FIFO_CONFIG_1_REG, &reg, 1, &bmi088Dev);
+}
+
+/**
+ * Reads all complete frame pairs from the gyro FIFO and runs them through the decimator. dataOut is set to the latest
+ * decimated sample, it is left unchanged if there was no complete pair. An odd frame is left in the FIFO for the next
+ * read, which also makes sure the fill level drops below the watermark and the next interrupt is triggered.
+ */
+static void sensorsGyroGet(Axis3i16* dataOut)
+{
+  uint8_t status = 0;
+  bmi088_get_gyro_regs(BMI088_GYRO_FIFO_STAT_REG, &status, 1, &bmi088Dev);
+
+  if (status & BMI088_GYRO_FIFO_OVERRUN_MASK)
+  {
+    gyroFifoOverruns++;
+    gyroFifoFrames = 0;
+    sensorsGyroFifoReset();
+    return;
+  }
+
+  uint8_t frames = (status & BMI088_GYRO_FIFO_COUNTER_MASK) & ~1;
+  gyroFifoFrames = frames;
+
+  while (frames > 0)
+  {
+    uint8_t burst = frames > SENSORS_GYRO_FIFO_MAX_FRAMES ? SENSORS_GYRO_FIFO_MAX_FRAMES : frames;
+    bmi088_get_gyro_regs(BMI088_GYRO_FIFO_DATA_REG, gyroFifoBuffer, burst * SENSORS_GYRO_FIFO_FRAME_SIZE, &bmi088Dev);
+
+    for (int i = 0; i < burst; i += 2)
+    {
+      const uint8_t* frame0 = &gyroFifoBuffer[i * SENSORS_GYRO_FIFO_FRAME_SIZE];
+      const uint8_t* frame1 = frame0 + SENSORS_GYRO_FIFO_FRAME_SIZE;
+      int16_t* out = (int16_t*)dataOut;
+
+      for (int axis = 0; axis < GYRO_NBR_OF_AXES; axis++)
+      {
+        int16_t sample0 = (int16_t)((frame0[2 * axis + 1] << 8) | frame0[2 * axis]);
+        int16_t sample1 = (int16_t)((frame1[2 * axis + 1] << 8) | frame1[2 * axis]);
+        // The filter can overshoot slightly at full scale
+        float decimated = decimator2Apply(&gyroDecimator[axis], sample0, sample1);
+        out[axis] = (int16_t)lroundf(constrain(decimated, INT16_MIN, INT16_MAX));
+      }
+    }
+
+    frames -= burst;
+  }
+}
+#else
 static void sensorsGyroGet(Axis3i16* dataOut)
 {
   bmi088_get_gyro_data((struct bmi088_sensor_data*)dataOut, &bmi088Dev);
 }
+#endif
 
 static void sensorsAccelGet(Axis3i16* dataOut)
 {
@@ -584,14 +660,14 @@ static void sensorsTask(void *param)
       sensorData.gyro.x =  (gyroRaw.x - gyroBias.x) * SENSORS_BMI088_DEG_PER_LSB_CFG;
       sensorData.gyro.y =  (gyroRaw.y - gyroBias.y) * SENSORS_BMI088_DEG_PER_LSB_CFG;
       sensorData.gyro.z =  (gyroRaw.z - gyroBias.z) * SENSORS_BMI088_DEG_PER_LSB_CFG;
-      applyAxis3fLpf((lpf2pData*)(&gyroLpf), &sensorData.gyro);
+      sensorsFilterGyro(&sensorData.gyro);
 
       /* Acelerometer */
       accScaled.x = accelRaw.x * SENSORS_BMI088_G_PER_LSB_CFG / accScale;
       accScaled.y = accelRaw.y * SENSORS_BMI088_G_PER_LSB_CFG / accScale;
       accScaled.z = accelRaw.z * SENSORS_BMI088_G_PER_LSB_CFG / accScale;
       sensorsAccAlignToGravity(&accScaled, &sensorData.acc);
-      applyAxis3fLpf((lpf2pData*)(&accLpf), &sensorData.acc);
+      sensorsFilterAcc(&sensorData.acc);
     }
 
     if (isBarometerPresent)
@@ -654,9 +730,15 @@ static void sensorsDeviceInit(void)
     bmi088Dev.gyro_cfg.power = BMI088_GYRO_PM_NORMAL;
     rslt |= bmi088_set_gyro_power_mode(&bmi088Dev);
     /* set bandwidth and range of gyro */
+#ifdef SENSORS_BMI088_FIFO
+    bmi088Dev.gyro_cfg.bw = SENSORS_GYRO_FIFO_ODR_CFG;
+    bmi088Dev.gyro_cfg.range = SENSORS_BMI088_GYRO_FS_CFG;
+    bmi088Dev.gyro_cfg.odr = SENSORS_GYRO_FIFO_ODR_CFG;
+#else
     bmi088Dev.gyro_cfg.bw = BMI088_GYRO_BW_116_ODR_1000_HZ;
     bmi088Dev.gyro_cfg.range = SENSORS_BMI088_GYRO_FS_CFG;
     bmi088Dev.gyro_cfg.odr = BMI088_GYRO_BW_116_ODR_1000_HZ;
+#endif
     rslt |= bmi088_set_gyro_meas_conf(&bmi088Dev);
 
     intConfig.gyro_int_channel = BMI088_INT_CHANNEL_3;
@@ -667,6 +749,20 @@ static void sensorsDeviceInit(void)
     /* Setting the interrupt configuration */
     rslt = bmi088_set_gyro_int_config(&intConfig, &bmi088Dev);
 
+#ifdef SENSORS_BMI088_FIFO
+    /* Use the pin configuration from above, but interrupt on the FIFO watermark instead of on data ready */
+    uint8_t reg = BMI088_GYRO_FIFO_EN_MASK;
+    rslt |= bmi088_set_gyro_regs(BMI088_GYRO_INT_CTRL_REG, &reg, 1, &bmi088Dev);
+    reg = BMI088_GYRO_INT1_FIFO_MASK;
+    rslt |= bmi088_set_gyro_regs(BMI088_GYRO_INT3_INT4_IO_MAP_REG, &reg, 1, &bmi088Dev);
+    reg = SENSORS_GYRO_FIFO_WM_INT_ENABLE;
+    rslt |= bmi088_set_gyro_regs(BMI088_GYRO_INT_EN_REG, &reg, 1, &bmi088Dev);
+    reg = SENSORS_GYRO_FIFO_WATERMARK;
+    rslt |= bmi088_set_gyro_regs(BMI088_GYRO_FIFO_CONFIG_0_REG, &reg, 1, &bmi088Dev);
+    reg = SENSORS_GYRO_FIFO_STREAM_MODE;
+    rslt |= bmi088_set_gyro_regs(BMI088_GYRO_FIFO_CONFIG_1_REG, &reg, 1, &bmi088Dev);
+#endif
+
     bmi088Dev.delay_ms(50);
     struct bmi088_sensor_data gyr;
     rslt |= bmi088_get_gyro_data(&gyr, &bmi088Dev);
@@ -772,12 +868,14 @@ static void sensorsDeviceInit(void)
 #endif
   }
 
-  // Init second order filer for accelerometer and gyro
+  // Init the filters for accelerometer and gyro
+  sensorsFilterInit(SENSORS_READ_RATE_HZ, GYRO_LPF_CUTOFF_FREQ, ACCEL_LPF_CUTOFF_FREQ, GYRO_DYN_NOTCH_ENABLE);
+#ifdef SENSORS_BMI088_FIFO
   for (uint8_t i = 0; i < 3; i++)
   {
-    lpf2pInit(&gyroLpf[i], 1000, GYRO_LPF_CUTOFF_FREQ);
-    lpf2pInit(&accLpf[i],  1000, ACCEL_LPF_CUTOFF_FREQ);
+    decimator2Init(&gyroDecimator[i]);
   }
+#endif
 
   cosPitch = cosf(configblockGetCalibPitch() * (float) M_PI / 180);
   sinPitch = sinf(configblockGetCalibPitch() * (float) M_PI / 180);
@@ -1094,10 +1192,7 @@ void sensorsBmi088SpiBmp388SetAccMode(accModes accMode)
       {
         DEBUG_PRINT("ACC config [FAIL]\n");
       }
-      for (uint8_t i = 0; i < 3; i++)
-      {
-        lpf2pInit(&accLpf[i],  1000, 500);
-      }
+      sensorsFilterSetAccCutoffFreq(500);
       break;
     case ACC_MODE_FLIGHT:
     default:
@@ -1109,21 +1204,11 @@ void sensorsBmi088SpiBmp388SetAccMode(accModes accMode)
       {
         DEBUG_PRINT("ACC config [FAIL]\n");
       }
-      for (uint8_t i = 0; i < 3; i++)
-      {
-        lpf2pInit(&accLpf[i],  1000, ACCEL_LPF_CUTOFF_FREQ);
-      }
+      sensorsFilterSetAccCutoffFreq(ACCEL_LPF_CUTOFF_FREQ);
       break;
   }
 }
 
-static void applyAxis3fLpf(lpf2pData *data, Axis3f* in)
-{
-  for (uint8_t i = 0; i < 3; i++) {
-    in->axis[i] = lpf2pApply(&data[i], in->axis[i]);
-  }
-}
-
 void sensorsBmi088SpiBmp388DataAvailableCallback(void)
 {
   portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
@@ -1188,6 +1273,17 @@ void __attribute__((used)) BMI088_SPI_RX_DMA_IRQHandler(void)
   }
 }
 
+#ifdef SENSORS_BMI088_FIFO
+/**
+ * Gyro FIFO. frames is the number of frames read at the last interrupt, normally 2. overrun counts the times the FIFO
+ * was full and had to be cleared.
+ */
+LOG_GROUP_START(gyroFifo)
+LOG_ADD(LOG_UINT8, frames, &gyroFifoFrames)
+LOG_ADD(LOG_UINT32, overrun, &gyroFifoOverruns)
+LOG_GROUP_STOP(gyroFifo)
+#endif
+
 PARAM_GROUP_START(imu_sensors)
 PARAM_ADD(PARAM_UINT8 | PARAM_RONLY, BMP388, &isBarometerPresent)
 PARAM_GROUP_STOP(imu_sensors)
@@ -0,0 +1,196 @@
+/**
+ * ,---------,       ____  _ __
+ * |  ,-^-,  |      / __ )(_) /_______________ _____  ___
+ * | (  O  ) |     / __  / / __/ ___/ ___/ __ `/_  / / _ \
+ * | / ,--´  |    / /_/ / / /_/ /__/ /  / /_/ / / /_/  __/
+ *    +------`   /_____/_/\__/\___/_/   \__,_/ /___/\___/
+ *
+ * Crazyflie control firmware
+ *
+ * Copyright (C) 2020 Bitcraze AB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, in version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * sensors_filter.c - Filtering of gyro and accelerometer data, common to the sensor drivers
+ */
+
+#include <math.h>
+#include <stdbool.h>
+
+#include "sensors_filter.h"
+#include "filterBank.h"
+#include "param.h"
+#include "log.h"
+
+#define GYRO_FILTER_STAGES  FILTER_BANK_MAX_STAGES
+#define ACC_FILTER_STAGES   2
+
+// Default dynamic notch configuration. The rotor frequency is assumed to be proportional to the motor command, the
+// max frequency is the rotor frequency at full command (about 24000 rpm for the Crazyflie 2.X motors and props).
+#define DYN_NOTCH_MAX_FREQ  400.0f
+#define DYN_NOTCH_MIN_FREQ  80.0f
+#define DYN_NOTCH_Q         4.0f
+
+static filterBankData gyroBank;
+static filterBankData accBank;
+static filterBankData gyroNotchBank;
+
+// The stages as set by parameters, the banks are reconfigured when they change
+static filterBankStage_t gyroStages[GYRO_FILTER_STAGES];
+static filterBankStage_t accStages[ACC_FILTER_STAGES];
+
+static volatile uint16_t motorRatios[SENSORS_FILTER_MOTORS];
+static float notchFreqs[SENSORS_FILTER_MOTORS];
+
+static struct {
+  uint8_t enable;
+  // Rotor frequency at full motor command (Hz)
+  float maxFreq;
+  // Lower limit of the notch frequencies, to keep the notches out of the control bandwidth (Hz)
+  float minFreq;
+  float q;
+} dynNotch;
+
+static bool isConfiguredAs(const filterBankData* bank, const filterBankStage_t* stages, int count)
+{
+  for (int i = 0; i < count; i++) {
+    const filterBankStage_t* configured = &bank->stages[i];
+    if (configured->type != stages[i].type || configured->frequency != stages[i].frequency || configured->q != stages[i].q) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static void initBank(filterBankData* bank, filterBankStage_t* stages, int count, float sampleFreq, float cutoffFreq)
+{
+  for (int i = 0; i < count; i++) {
+    stages[i] = (filterBankStage_t){.type = filterBankStageNone};
+  }
+  stages[0] = (filterBankStage_t){.type = filterBankStageLowpass, .frequency = cutoffFreq};
+
+  filterBankInit(bank, sampleFreq);
+  filterBankConfigure(bank, stages, count);
+}
+
+static void apply(filterBankData* bank, const filterBankStage_t* stages, int count, Axis3f* data)
+{
+  if (!isConfiguredAs(bank, stages, count)) {
+    filterBankConfigure(bank, stages, count);
+  }
+
+  filterBankApply(bank, data->axis);
+}
+
+// One notch per motor, at the rotor frequency. The notches are removed when the motors are stopped.
+static void updateDynamicNotch(void)
+{
+  filterBankStage_t stages[SENSORS_FILTER_MOTORS];
+
+  for (int i = 0; i < SENSORS_FILTER_MOTORS; i++) {
+    uint16_t ratio = motorRatios[i];
+    float freq = 0.0f;
+
+    if (ratio > 0) {
+      freq = dynNotch.maxFreq * ratio / UINT16_MAX;
+      if (freq < dynNotch.minFreq) {
+        freq = dynNotch.minFreq;
+      }
+      // Whole Hz only, to not calculate new coefficients for every small change of the motor commands
+      freq = roundf(freq);
+    }
+
+    notchFreqs[i] = freq;
+    stages[i] = (filterBankStage_t){.type = ratio > 0 ? filterBankStageNotch : filterBankStageNone, .frequency = freq, .q = dynNotch.q};
+  }
+
+  if (!isConfiguredAs(&gyroNotchBank, stages, SENSORS_FILTER_MOTORS)) {
+    filterBankConfigure(&gyroNotchBank, stages, SENSORS_FILTER_MOTORS);
+  }
+}
+
+void sensorsFilterInit(float sampleFreq, float gyroCutoffFreq, float accCutoffFreq, bool enableDynamicNotch)
+{
+  initBank(&gyroBank, gyroStages, GYRO_FILTER_STAGES, sampleFreq, gyroCutoffFreq);
+  initBank(&accBank, accStages, ACC_FILTER_STAGES, sampleFreq, accCutoffFreq);
+
+  filterBankInit(&gyroNotchBank, sampleFreq);
+  dynNotch.enable = enableDynamicNotch;
+  dynNotch.maxFreq = DYN_NOTCH_MAX_FREQ;
+  dynNotch.minFreq = DYN_NOTCH_MIN_FREQ;
+  dynNotch.q = DYN_NOTCH_Q;
+}
+
+void sensorsFilterSetMotorRatios(const uint16_t ratios[SENSORS_FILTER_MOTORS])
+{
+  for (int i = 0; i < SENSORS_FILTER_MOTORS; i++) {
+    motorRatios[i] = ratios[i];
+  }
+}
+
+void sensorsFilterSetAccCutoffFreq(float cutoffFreq)
+{
+  accStages[0].type = filterBankStageLowpass;
+  accStages[0].frequency = cutoffFreq;
+}
+
+void sensorsFilterGyro(Axis3f* gyro)
+{
+  if (dynNotch.enable) {
+    updateDynamicNotch();
+    filterBankApply(&gyroNotchBank, gyro->axis);
+  }
+
+  apply(&gyroBank, gyroStages, GYRO_FILTER_STAGES, gyro);
+}
+
+void sensorsFilterAcc(Axis3f* acc)
+{
+  apply(&accBank, accStages, ACC_FILTER_STAGES, acc);
+}
+
+PARAM_GROUP_START(imu_filter)
+PARAM_ADD(PARAM_UINT8, gType0, &gyroStages[0].type)
+PARAM_ADD(PARAM_FLOAT, gFreq0, &gyroStages[0].frequency)
+PARAM_ADD(PARAM_FLOAT, gQ0, &gyroStages[0].q)
+PARAM_ADD(PARAM_UINT8, gType1, &gyroStages[1].type)
+PARAM_ADD(PARAM_FLOAT, gFreq1, &gyroStages[1].frequency)
+PARAM_ADD(PARAM_FLOAT, gQ1, &gyroStages[1].q)
+PARAM_ADD(PARAM_UINT8, gType2, &gyroStages[2].type)
+PARAM_ADD(PARAM_FLOAT, gFreq2, &gyroStages[2].frequency)
+PARAM_ADD(PARAM_FLOAT, gQ2, &gyroStages[2].q)
+PARAM_ADD(PARAM_UINT8, gType3, &gyroStages[3].type)
+PARAM_ADD(PARAM_FLOAT, gFreq3, &gyroStages[3].frequency)
+PARAM_ADD(PARAM_FLOAT, gQ3, &gyroStages[3].q)
+PARAM_ADD(PARAM_UINT8, aType0, &accStages[0].type)
+PARAM_ADD(PARAM_FLOAT, aFreq0, &accStages[0].frequency)
+PARAM_ADD(PARAM_FLOAT, aQ0, &accStages[0].q)
+PARAM_ADD(PARAM_UINT8, aType1, &accStages[1].type)
+PARAM_ADD(PARAM_FLOAT, aFreq1, &accStages[1].frequency)
+PARAM_ADD(PARAM_FLOAT, aQ1, &accStages[1].q)
+PARAM_ADD(PARAM_UINT8, dnEnable, &dynNotch.enable)
+PARAM_ADD(PARAM_FLOAT, dnMaxFreq, &dynNotch.maxFreq)
+PARAM_ADD(PARAM_FLOAT, dnMinFreq, &dynNotch.minFreq)
+PARAM_ADD(PARAM_FLOAT, dnQ, &dynNotch.q)
+PARAM_GROUP_STOP(imu_filter)
+
+/**
+ * Center frequencies of the dynamic gyro notches (Hz), 0 when not active
+ */
+LOG_GROUP_START(imu_filter)
+LOG_ADD(LOG_FLOAT, dnFreq1, &notchFreqs[0])
+LOG_ADD(LOG_FLOAT, dnFreq2, &notchFreqs[1])
+LOG_ADD(LOG_FLOAT, dnFreq3, &notchFreqs[2])
+LOG_ADD(LOG_FLOAT, dnFreq4, &notchFreqs[3])
+LOG_GROUP_STOP(imu_filter)
@@ -39,6 +39,7 @@
 #include "syslink.h"
 #include "radiolink.h"
 #include "uart_syslink.h"
+#include "packetpool.h"
 #include "configblock.h"
 #include "pm.h"
 #include "ow.h"
@@ -46,7 +47,7 @@
 static bool isInit = false;
 static uint8_t sendBuffer[SYSLINK_MTU + 6];
 
-static void syslinkRouteIncommingPacket(SyslinkPacket *slp);
+static void syslinkRouteIncommingPacket(packetHandle_t handle);
 
 static xSemaphoreHandle syslinkAccess;
 
@@ -54,16 +55,17 @@ static xSemaphoreHandle syslinkAccess;
  */
 static void syslinkTask(void *param)
 {
-  SyslinkPacket slp;
   while(1)
   {
-    uartslkGetPacketBlocking(&slp);
-    syslinkRouteIncommingPacket(&slp);
+    packetHandle_t handle = uartslkGetPacketBlocking();
+    syslinkRouteIncommingPacket(handle);
+    packetPoolRelease(handle);
   }
 }
 
-static void syslinkRouteIncommingPacket(SyslinkPacket *slp)
+static void syslinkRouteIncommingPacket(packetHandle_t handle)
 {
+  SyslinkPacket *slp = packetPoolGetSyslinkPacket(handle);
   uint8_t groupType;
 
   groupType = slp->type & SYSLINK_GROUP_MASK;
@@ -71,7 +73,7 @@ static void syslinkRouteIncommingPacket(SyslinkPacket *slp)
   switch (groupType)
   {
     case SYSLINK_RADIO_GROUP:
-      radiolinkSyslinkDispatch(slp);
+      radiolinkSyslinkDispatch(handle);
       break;
     case SYSLINK_PM_GROUP:
       pmSyslinkUpdate(slp);
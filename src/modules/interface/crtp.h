@@ -30,6 +30,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "packetpool.h"
+
 #define CRTP_MAX_DATA_SIZE 30
 
 #define CRTP_HEADER(port, channel) (((port & 0x0F) << 4) | (channel & 0x0F))
@@ -105,7 +107,7 @@ void crtpRegisterPortCB(int port, CrtpCallback cb);
 /**
  * Put a packet in the TX task
  *
- * If the TX stack is full, the oldest lowest priority packet is dropped
+ * Packets are queued per priority class of their port, if the queue of the class is full the packet is dropped
  *
  * @param[in] p CRTPPacket to send
  */
@@ -140,11 +142,21 @@ int crtpReceivePacket(CRTPPort taskId, CRTPPacket *p);
 int crtpReceivePacketWait(CRTPPort taskId, CRTPPacket *p, int wait);
 
 /**
- * Get the number of free tx packets in the queue
+ * Get the number of free tx packets in the queue used by a port
  *
+ * @param[in] portId The port to check the queue for
  * @return Number of free packets
  */
-int crtpGetFreeTxQueuePackets(void);
+int crtpGetFreeTxQueuePackets(CRTPPort portId);
+
+/**
+ * Check if a port is in the high priority TX class. Links that queue packets after the CRTP TX scheduler should
+ * send packets of these ports ahead of the others, to keep the latency bound of the scheduler.
+ *
+ * @param[in] port The port of the packet
+ * @return true if the port is in the high priority class
+ */
+bool crtpIsHighPriorityPort(const uint8_t port);
 
 /**
  * Wait for a packet to arrive for the specified taskID
@@ -165,6 +177,9 @@ struct crtpLinkOperations
   int (*setEnable)(bool enable);
   int (*sendPacket)(CRTPPacket *pk);
   int (*receivePacket)(CRTPPacket *pk);
+  // Optional, used instead of receivePacket. Receives a packet that is already in a packet pool buffer, the reference
+  // to the buffer is handed over to the caller.
+  int (*receivePacketHandle)(packetHandle_t *handle);
   bool (*isConnected)(void);
   int (*reset)(void);
 };
@@ -63,6 +63,9 @@ typedef enum
   KC_STATE_X, KC_STATE_Y, KC_STATE_Z, KC_STATE_PX, KC_STATE_PY, KC_STATE_PZ, KC_STATE_D0, KC_STATE_D1, KC_STATE_D2, KC_STATE_DIM
 } kalmanCoreStateIdx_t;
 
+// The maximum number of measurement rows that are applied together in one batched covariance update
+#define KC_MAX_BATCH_SIZE 6
+
 
 // The data used by the kalman core implementation.
 typedef struct {
@@ -110,6 +113,9 @@ void kalmanCoreUpdateWithAbsoluteHeight(kalmanCoreData_t* this, heightMeasuremen
 // Direct measurements of Crazyflie position
 void kalmanCoreUpdateWithPosition(kalmanCoreData_t* this, positionMeasurement_t *xyz);
 
+// Multiple direct measurements of Crazyflie position, applied in as few covariance updates as possible
+void kalmanCoreUpdateWithPositionBatch(kalmanCoreData_t* this, positionMeasurement_t *xyz, int count);
+
 // Direct measurements of Crazyflie pose
 void kalmanCoreUpdateWithPose(kalmanCoreData_t* this, poseMeasurement_t *pose);
 
@@ -131,6 +137,9 @@ void kalmanCoreUpdateWithYawError(kalmanCoreData_t *this, yawErrorMeasurement_t
 // Measurement of sweep angles from a Lighthouse base station
 void kalmanCoreUpdateWithSweepAngles(kalmanCoreData_t *this, sweepAngleMeasurement_t *angles);
 
+// Multiple measurements of sweep angles, applied in as few covariance updates as possible
+void kalmanCoreUpdateWithSweepAnglesBatch(kalmanCoreData_t *this, sweepAngleMeasurement_t *angles, int count);
+
 /**
  * Primary Kalman filter functions
  *
@@ -0,0 +1,47 @@
+/**
+ * ,---------,       ____  _ __
+ * |  ,-^-,  |      / __ )(_) /_______________ _____  ___
+ * | (  O  ) |     / __  / / __/ ___/ ___/ __ `/_  / / _ \
+ * | / ,--´  |    / /_/ / / /_/ /__/ /  / /_/ / / /_/  __/
+ *    +------`   /_____/_/\__/\___/_/   \__,_/ /___/\___/
+ *
+ * Crazyflie control firmware
+ *
+ * Copyright (C) 2019 Bitcraze AB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, in version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ * log_delta.h - Scheduling of the values of delta log blocks over packets.
+ *
+ * A delta block can hold more values than fit in one packet. The pending values
+ * are picked round-robin, starting with the first value that did not fit in the
+ * previous run, so every value is sent even if other values change on every run.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Select the pending slots of a delta block to send in the next packet.
+ *
+ * @param pendingSlots - mask of the slots with a value to send, bit 0 is the first slot of the block
+ * @param lengths - length of the encoded value of each slot
+ * @param slots - number of slots in the block
+ * @param space - number of bytes available for values in the packet
+ * @param nextSlot - (in/out) slot to start from, updated to the first pending slot that was not selected
+ * @return mask of the selected slots
+ */
+uint32_t logDeltaSelectSlots(const uint32_t pendingSlots, const uint8_t lengths[], const int slots, int space, uint8_t* nextSlot);
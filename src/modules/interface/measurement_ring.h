@@ -0,0 +1,90 @@
+/**
+ * ,---------,       ____  _ __
+ * |  ,-^-,  |      / __ )(_) /_______________ _____  ___
+ * | (  O  ) |     / __  / / __/ ___/ ___/ __ `/_  / / _ \
+ * | / ,--´  |    / /_/ / / /_/ /__/ /  / /_/ / / /_/  __/
+ *    +------`   /_____/_/\__/\___/_/   \__,_/ /___/\___/
+ *
+ * Crazyflie control firmware
+ *
+ * Copyright (C) 2019 Bitcraze AB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, in version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ * measurement_ring.h - Lock free ring buffer carrying measurements of all types
+ * to the estimator, in the order they arrived.
+ *
+ * Any number of producers (tasks or interrupts) can put measurements in the
+ * ring, while one single consumer reads them.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "stabilizer_types.h"
+
+// Number of slots in the ring, must be a power of 2. At least as many as the 90 entries of the per type queues the
+// ring replaced (9 x 10), fast sources (flow, TDoA, sweep angles) must not overflow it during a slow update.
+#ifndef MEASUREMENT_RING_SIZE
+#define MEASUREMENT_RING_SIZE 128
+#endif
+
+typedef struct {
+  uint32_t sequence;
+  measurement_t measurement;
+} measurementRingSlot_t;
+
+typedef struct {
+  measurementRingSlot_t slots[MEASUREMENT_RING_SIZE];
+
+  // Next position to write to, shared by the producers
+  uint32_t head;
+  // Next position to read from, only used by the consumer
+  uint32_t tail;
+
+  // Number of measurements dropped because the ring was full, per measurement type
+  uint32_t dropCount[MeasurementTypeCount];
+} measurementRing_t;
+
+void measurementRingInit(measurementRing_t* ring);
+
+/**
+ * Put a measurement in the ring. Can be called from any task or interrupt.
+ *
+ * @param ring - the ring
+ * @param measurement - the measurement to copy into the ring
+ * @return true if the measurement was added, false if the ring was full and the measurement was dropped
+ */
+bool measurementRingPut(measurementRing_t* ring, const measurement_t* measurement);
+
+/**
+ * Get the oldest measurement from the ring. Must only be called by the consumer.
+ *
+ * @param ring - the ring
+ * @param measurement - (output) the measurement
+ * @return true if a measurement was read, false if the ring was empty
+ */
+bool measurementRingGet(measurementRing_t* ring, measurement_t* measurement);
+
+/**
+ * Check if there are measurements to read, without locking or copying. Must only be called by the consumer.
+ */
+bool measurementRingIsEmpty(const measurementRing_t* ring);
+
+/**
+ * Discard all measurements currently in the ring. Must only be called by the consumer.
+ */
+void measurementRingFlush(measurementRing_t* ring);
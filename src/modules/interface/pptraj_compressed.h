@@ -27,6 +27,7 @@
 #pragma once
 
 #include "pptraj.h"
+#include <stdint.h>
 #include <stdio.h>
 
 enum piecewise_traj_storage_type {
@@ -40,6 +41,24 @@ enum piecewise_traj_storage_type {
 // compressed piecewise polynomial trajectories //
 // ---------------------------------------------//
 
+// Maximum number of pieces in the index of a compressed trajectory. Longer
+// trajectories index every n-th piece only, so that any piece can be reached
+// from the index in less than n steps.
+#define PPTRAJ_COMPRESSED_INDEX_SIZE 32
+
+struct piecewise_traj_compressed_index_entry
+{
+	// raw representation of the piece
+	const void* data;
+
+	// start time of the piece, relative to the start time of the trajectory
+	float t_begin_relative;
+
+	// position and yaw at the start of the piece
+	struct vec start_pos;
+	float start_yaw;
+};
+
 struct piecewise_traj_compressed
 {
 	float t_begin;
@@ -61,6 +80,14 @@ struct piecewise_traj_compressed
 		// poly4d representation of the current piece
 		struct poly4d poly4d;
 	} current_piece;
+
+	// index of the pieces, built when the trajectory is loaded, to find the
+	// piece to evaluate without walking the trajectory from the start
+	struct {
+		struct piecewise_traj_compressed_index_entry entries[PPTRAJ_COMPRESSED_INDEX_SIZE];
+		uint16_t count;
+		uint16_t stride;
+	} index;
 };
 
 // Returns the total duration of a compressed trajectory. The total duration
@@ -0,0 +1,91 @@
+/**
+ * ,---------,       ____  _ __
+ * |  ,-^-,  |      / __ )(_) /_______________ _____  ___
+ * | (  O  ) |     / __  / / __/ ___/ ___/ __ `/_  / / _ \
+ * | / ,--´  |    / /_/ / / /_/ /__/ /  / /_/ / / /_/  __/
+ *    +------`   /_____/_/\__/\___/_/   \__,_/ /___/\___/
+ *
+ * Crazyflie control firmware
+ *
+ * Copyright (C) 2020 Bitcraze AB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, in version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * stabilizer_timing.h - Cycle accurate timing of the stages of the stabilizer loop
+ */
+
+#ifndef __STABILIZER_TIMING_H__
+#define __STABILIZER_TIMING_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * With STABILIZER_STAGE_TIMING defined, each stage of the stabilizer loop is timed with the DWT cycle counter. Min,
+ * max and mean are calculated over one second windows, the histograms count all loops since start up, with bins
+ * relative to the loop period (< 10%, < 25%, < 50%, < 100% and >= 100%). The last bin of the loop histogram is the
+ * number of overruns.
+ *
+ * The results are available in the stabTime log group and through the platform port, see platformservice.c.
+ * Without STABILIZER_STAGE_TIMING all timing macros are empty.
+ */
+
+typedef enum {
+  stabilizerStageEstimator = 0,
+  stabilizerStageCommander,
+  stabilizerStageSitAw,
+  stabilizerStageController,
+  stabilizerStagePowerDistribution,
+  // The whole loop, from the sensor data ready to the end of the loop
+  stabilizerStageLoop,
+  stabilizerStageCount,
+} stabilizerStage_t;
+
+#define STABILIZER_TIMING_HISTOGRAM_BINS 5
+
+typedef struct {
+  // Cycles, over the samples of the last full window, 0 if the stage was not run in the window
+  uint32_t min;
+  uint32_t max;
+  uint32_t mean;
+  // Number of loops since start up per bin
+  uint32_t histogram[STABILIZER_TIMING_HISTOGRAM_BINS];
+} stabilizerTimingStats_t;
+
+#ifdef STABILIZER_STAGE_TIMING
+  #include "stm32fxxx.h"
+
+  void stabilizerTimingInit(void);
+  void stabilizerTimingAdd(stabilizerStage_t stage, uint32_t cycles);
+
+  /**
+   * @return false if the stage is not valid
+   */
+  bool stabilizerTimingGetStats(stabilizerStage_t stage, stabilizerTimingStats_t* stats);
+
+  static inline uint32_t stabilizerTimingNow(void) {
+    return DWT->CYCCNT;
+  }
+
+  #define STABILIZER_TIMING_INIT() stabilizerTimingInit()
+  #define STABILIZER_TIMING_START(start) uint32_t start = stabilizerTimingNow()
+  #define STABILIZER_TIMING_RESTART(start) start = stabilizerTimingNow()
+  #define STABILIZER_TIMING_STOP(stage, start) stabilizerTimingAdd(stage, stabilizerTimingNow() - start)
+#else
+  #define STABILIZER_TIMING_INIT()
+  #define STABILIZER_TIMING_START(start)
+  #define STABILIZER_TIMING_RESTART(start)
+  #define STABILIZER_TIMING_STOP(stage, start)
+#endif // STABILIZER_STAGE_TIMING
+
+#endif // __STABILIZER_TIMING_H__
@@ -251,6 +251,36 @@ typedef struct {
   float sensorPos[3];
 } sweepAngleMeasurement_t;
 
+/** Types of measurements that can be carried by measurement_t */
+typedef enum {
+  MeasurementTypeTDOA,
+  MeasurementTypePosition,
+  MeasurementTypePose,
+  MeasurementTypeDistance,
+  MeasurementTypeTOF,
+  MeasurementTypeAbsoluteHeight,
+  MeasurementTypeFlow,
+  MeasurementTypeYawError,
+  MeasurementTypeSweepAngle,
+  MeasurementTypeCount,
+} measurementType_t;
+
+/** Any measurement, tagged with its type */
+typedef struct {
+  measurementType_t type;
+  union {
+    tdoaMeasurement_t tdoa;
+    positionMeasurement_t position;
+    poseMeasurement_t pose;
+    distanceMeasurement_t distance;
+    tofMeasurement_t tof;
+    heightMeasurement_t height;
+    flowMeasurement_t flow;
+    yawErrorMeasurement_t yawError;
+    sweepAngleMeasurement_t sweepAngle;
+  } data;
+} measurement_t;
+
 // Frequencies to bo used with the RATE_DO_EXECUTE_HZ macro. Do NOT use an arbitrary number.
 #define RATE_1000_HZ 1000
 #define RATE_500_HZ 500
@@ -262,7 +292,29 @@ typedef struct {
 #define RATE_MAIN_LOOP RATE_1000_HZ
 #define ATTITUDE_RATE RATE_500_HZ
 #define POSITION_RATE RATE_100_HZ
+#define ESTIMATOR_ATTITUDE_RATE RATE_250_HZ
+#define ESTIMATOR_POSITION_RATE RATE_100_HZ
 
 #define RATE_DO_EXECUTE(RATE_HZ, TICK) ((TICK % (RATE_MAIN_LOOP / RATE_HZ)) == 0)
 
+/* Rate groups of the stabilizer loop. The rate and phase offset of each group
+ * are declared in one table in stabilizer.c, so that the heavy stages can be
+ * spread over different ticks instead of all running in the same one.
+ */
+typedef enum {
+  rateGroupEstimatorAttitude = 0,
+  rateGroupEstimatorPosition,
+  rateGroupAttitudeControl,
+  rateGroupPositionControl,
+  rateGroupUsdLogging,
+  rateGroupCount,
+} rateGroup_t;
+
+/**
+ * Check if the stages of a rate group should run in a tick of the stabilizer loop.
+ *
+ * @return true if the group is due in this tick
+ */
+bool rateGroupDoExecute(const rateGroup_t group, const uint32_t tick);
+
 #endif
@@ -130,7 +130,7 @@ void controllerMellinger(control_t *control, setpoint_t *setpoint,
   float dt;
   float desiredYaw = 0; //deg
 
-  if (!RATE_DO_EXECUTE(ATTITUDE_RATE, tick)) {
+  if (!rateGroupDoExecute(rateGroupAttitudeControl, tick)) {
     return;
   }
 
@@ -38,7 +38,7 @@ void controllerPid(control_t *control, setpoint_t *setpoint,
                                          const state_t *state,
                                          const uint32_t tick)
 {
-  if (RATE_DO_EXECUTE(ATTITUDE_RATE, tick)) {
+  if (rateGroupDoExecute(rateGroupAttitudeControl, tick)) {
     // Rate-controled YAW is moving YAW angle setpoint
     if (setpoint->mode.yaw == modeVelocity) {
        attitudeDesired.yaw += setpoint->attitudeRate.yaw * ATTITUDE_UPDATE_DT;
@@ -51,11 +51,11 @@ void controllerPid(control_t *control, setpoint_t *setpoint,
     }
   }
 
-  if (RATE_DO_EXECUTE(POSITION_RATE, tick)) {
+  if (rateGroupDoExecute(rateGroupPositionControl, tick)) {
     positionController(&actuatorThrust, &attitudeDesired, setpoint, state);
   }
 
-  if (RATE_DO_EXECUTE(ATTITUDE_RATE, tick)) {
+  if (rateGroupDoExecute(rateGroupAttitudeControl, tick)) {
     // Switch between manual and automatic position control
     if (setpoint->mode.z == modeDisable) {
       actuatorThrust = setpoint->thrust;
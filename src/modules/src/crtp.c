@@ -26,6 +26,7 @@
 
 #include <stdbool.h>
 #include <errno.h>
+#include <string.h>
 
 /*FreeRtos includes*/
 #include "FreeRTOS.h"
@@ -39,6 +40,7 @@
 #include "info.h"
 #include "cfassert.h"
 #include "queuemonitor.h"
+#include "packetpool.h"
 
 #include "log.h"
 
@@ -58,6 +60,7 @@ static struct crtpLinkOperations *link = &nopLink;
 static struct {
   uint32_t rxCount;
   uint32_t txCount;
+  uint32_t rxDrops;
 
   uint16_t rxRate;
   uint16_t txRate;
@@ -66,11 +69,78 @@ static struct {
   uint32_t previousStatisticsTime;
 } stats;
 
-static xQueueHandle  txQueue;
+/**
+ * TX scheduling
+ *
+ * Outgoing packets are queued in one queue per priority class, each port belongs to one class. The TX task serves
+ * the classes in priority order, but a class may only send its budget of packets in a row while packets of lower
+ * classes are waiting. When no class with waiting packets has any budget left, all budgets are refilled. Under full
+ * load the link is shared in the ratio of the budgets, and a packet in the high class never waits for more than the
+ * packets in its own queue plus the budgets of the lower classes, regardless of how many log packets are queued.
+ */
+typedef enum {
+  crtpTxClassHigh,
+  crtpTxClassNormal,
+  crtpTxClassBulk,
+  crtpTxClassCount,
+} crtpTxClass_t;
+
+typedef struct {
+  CRTPPacket packet;
+  uint32_t queuedTick;
+} crtpTxItem_t;
 
 #define CRTP_NBR_OF_PORTS 16
 #define CRTP_TX_QUEUE_SIZE 100
-#define CRTP_RX_QUEUE_SIZE 16
+// The port queues hold packet pool buffers, the depth limits how much of the pool a port that is not read can hold
+#define CRTP_RX_QUEUE_SIZE 8
+// Max time to wait for a pool buffer for a link that receives into buffers of the CRTP RX task
+#define CRTP_RX_POOL_WAIT_MS 10
+
+// Queue size and budget per class, the queue sizes sum up to CRTP_TX_QUEUE_SIZE
+static const uint8_t txQueueSize[crtpTxClassCount] = {
+  [crtpTxClassHigh] = 20,
+  [crtpTxClassNormal] = 30,
+  [crtpTxClassBulk] = 50,
+};
+
+static const uint8_t txBudget[crtpTxClassCount] = {
+  [crtpTxClassHigh] = 8,
+  [crtpTxClassNormal] = 4,
+  [crtpTxClassBulk] = 2,
+};
+
+// Unused ports are in the normal class
+static const uint8_t txClassOfPort[CRTP_NBR_OF_PORTS] = {
+  [CRTP_PORT_CONSOLE] = crtpTxClassNormal,
+  [0x01] = crtpTxClassNormal,
+  [CRTP_PORT_PARAM] = crtpTxClassNormal,
+  [CRTP_PORT_SETPOINT] = crtpTxClassHigh,
+  [CRTP_PORT_MEM] = crtpTxClassNormal,
+  [CRTP_PORT_LOG] = crtpTxClassBulk,
+  [CRTP_PORT_LOCALIZATION] = crtpTxClassHigh,
+  [CRTP_PORT_SETPOINT_GENERIC] = crtpTxClassHigh,
+  [CRTP_PORT_SETPOINT_HL] = crtpTxClassHigh,
+  [0x09] = crtpTxClassNormal,
+  [0x0A] = crtpTxClassNormal,
+  [0x0B] = crtpTxClassNormal,
+  [0x0C] = crtpTxClassNormal,
+  [CRTP_PORT_PLATFORM] = crtpTxClassNormal,
+  [0x0E] = crtpTxClassNormal,
+  [CRTP_PORT_LINK] = crtpTxClassHigh,
+};
+
+static xQueueHandle txQueues[crtpTxClassCount];
+static uint8_t txCredit[crtpTxClassCount];
+static TaskHandle_t txTaskHandle;
+
+static struct {
+  uint32_t drops[CRTP_NBR_OF_PORTS];
+
+  // Max time (ms) from queuing to sending, during the last statistics interval
+  uint16_t maxLatency[CRTP_NBR_OF_PORTS];
+  uint16_t currentMaxLatency[CRTP_NBR_OF_PORTS];
+} portStats;
 
 static void crtpTxTask(void *param);
 static void crtpRxTask(void *param);
@@ -84,11 +154,16 @@ void crtpInit(void)
   if(isInit)
     return;
 
-  txQueue = xQueueCreate(CRTP_TX_QUEUE_SIZE, sizeof(CRTPPacket));
-  DEBUG_QUEUE_MONITOR_REGISTER(txQueue);
+  packetPoolInit();
+
+  for (int i = 0; i < crtpTxClassCount; i++) {
+    txQueues[i] = xQueueCreate(txQueueSize[i], sizeof(crtpTxItem_t));
+    DEBUG_QUEUE_MONITOR_REGISTER(txQueues[i]);
+    txCredit[i] = txBudget[i];
+  }
 
   xTaskCreate(crtpTxTask, CRTP_TX_TASK_NAME,
-              CRTP_TX_TASK_STACKSIZE, NULL, CRTP_TX_TASK_PRI, NULL);
+              CRTP_TX_TASK_STACKSIZE, NULL, CRTP_TX_TASK_PRI, &txTaskHandle);
   xTaskCreate(crtpRxTask, CRTP_RX_TASK_NAME,
               CRTP_RX_TASK_STACKSIZE, NULL, CRTP_RX_TASK_PRI, NULL);
 
@@ -107,56 +182,122 @@ void crtpInitTaskQueue(CRTPPort portId)
 {
   ASSERT(queues[portId] == NULL);
   
-  queues[portId] = xQueueCreate(CRTP_RX_QUEUE_SIZE, sizeof(CRTPPacket));
+  // The queue holds handles to packet pool buffers
+  queues[portId] = xQueueCreate(CRTP_RX_QUEUE_SIZE, sizeof(packetHandle_t));
   DEBUG_QUEUE_MONITOR_REGISTER(queues[portId]);
 }
 
-int crtpReceivePacket(CRTPPort portId, CRTPPacket *p)
+static int receiveFromPortQueue(CRTPPort portId, CRTPPacket *p, TickType_t wait)
 {
   ASSERT(queues[portId]);
   ASSERT(p);
-    
-  return xQueueReceive(queues[portId], p, 0);
+
+  packetHandle_t handle;
+  int result = xQueueReceive(queues[portId], &handle, wait);
+  if (result == pdTRUE)
+  {
+    memcpy(p, packetPoolGetCrtpPacket(handle), sizeof(CRTPPacket));
+    packetPoolRelease(handle);
+  }
+
+  return result;
+}
+
+int crtpReceivePacket(CRTPPort portId, CRTPPacket *p)
+{
+  return receiveFromPortQueue(portId, p, 0);
 }
 
 int crtpReceivePacketBlock(CRTPPort portId, CRTPPacket *p)
 {
-  ASSERT(queues[portId]);
-  ASSERT(p);
-  
-  return xQueueReceive(queues[portId], p, portMAX_DELAY);
+  return receiveFromPortQueue(portId, p, portMAX_DELAY);
 }
 
 
 int crtpReceivePacketWait(CRTPPort portId, CRTPPacket *p, int wait)
 {
-  ASSERT(queues[portId]);
-  ASSERT(p);
-  
-  return xQueueReceive(queues[portId], p, M2T(wait));
+  return receiveFromPortQueue(portId, p, M2T(wait));
+}
+
+static crtpTxClass_t getTxClass(const uint8_t port)
+{
+  return txClassOfPort[port & (CRTP_NBR_OF_PORTS - 1)];
+}
+
+int crtpGetFreeTxQueuePackets(CRTPPort portId)
+{
+  xQueueHandle queue = txQueues[getTxClass(portId)];
+  return uxQueueSpacesAvailable(queue);
+}
+
+bool crtpIsHighPriorityPort(const uint8_t port)
+{
+  return getTxClass(port) == crtpTxClassHigh;
 }
 
-int crtpGetFreeTxQueuePackets(void)
+// Returns the class to send the next packet from, or -1 if all queues are empty
+static int selectTxClass(void)
 {
-  return (CRTP_TX_QUEUE_SIZE - uxQueueMessagesWaiting(txQueue));
+  bool hasPackets = false;
+
+  for (int i = 0; i < crtpTxClassCount; i++) {
+    if (uxQueueMessagesWaiting(txQueues[i]) > 0) {
+      hasPackets = true;
+      if (txCredit[i] > 0) {
+        txCredit[i]--;
+        return i;
+      }
+    }
+  }
+
+  if (!hasPackets) {
+    return -1;
+  }
+
+  // All classes with packets have used their budgets, start a new round
+  for (int i = 0; i < crtpTxClassCount; i++) {
+    txCredit[i] = txBudget[i];
+  }
+
+  return selectTxClass();
+}
+
+static void updateLatency(const crtpTxItem_t* item)
+{
+  uint32_t latency = xTaskGetTickCount() - item->queuedTick;
+  if (latency > UINT16_MAX) {
+    latency = UINT16_MAX;
+  }
+
+  uint8_t port = item->packet.port;
+  if (latency > portStats.currentMaxLatency[port]) {
+    portStats.currentMaxLatency[port] = latency;
+  }
 }
 
 void crtpTxTask(void *param)
 {
-  CRTPPacket p;
+  crtpTxItem_t item;
 
   while (true)
   {
     if (link != &nopLink)
     {
-      if (xQueueReceive(txQueue, &p, portMAX_DELAY) == pdTRUE)
+      int txClass = selectTxClass();
+      if (txClass < 0)
+      {
+        // Wait for the next packet to be queued
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      }
+      else if (xQueueReceive(txQueues[txClass], &item, 0) == pdTRUE)
       {
         // Keep testing, if the link changes to USB it will go though
-        while (link->sendPacket(&p) == false)
+        while (link->sendPacket(&item.packet) == false)
         {
           // Relaxation time
           vTaskDelay(M2T(10));
         }
+        updateLatency(&item);
         stats.txCount++;
         updateStats();
       }
@@ -170,28 +311,55 @@ void crtpTxTask(void *param)
 
 void crtpRxTask(void *param)
 {
-  CRTPPacket p;
+  packetHandle_t handle = PACKET_POOL_NO_HANDLE;
 
   while (true)
   {
     if (link != &nopLink)
     {
-      if (!link->receivePacket(&p))
+      bool isReceived;
+      if (link->receivePacketHandle)
+      {
+        if (handle != PACKET_POOL_NO_HANDLE)
+        {
+          // Allocated for the previous link
+          packetPoolRelease(handle);
+          handle = PACKET_POOL_NO_HANDLE;
+        }
+        isReceived = (link->receivePacketHandle(&handle) == 0);
+      }
+      else
+      {
+        if (handle == PACKET_POOL_NO_HANDLE)
+        {
+          handle = packetPoolAlloc(M2T(CRTP_RX_POOL_WAIT_MS));
+        }
+        // The packet is received directly into the pool buffer
+        isReceived = (handle != PACKET_POOL_NO_HANDLE) && !link->receivePacket(packetPoolGetCrtpPacket(handle));
+      }
+
+      if (isReceived)
       {
-        if (queues[p.port])
+        CRTPPacket *p = packetPoolGetCrtpPacket(handle);
+        if (queues[p->port])
         {
-          if (xQueueSend(queues[p.port], &p, 0) == errQUEUE_FULL)
+          // The port queue gets its own reference
+          packetPoolRetain(handle);
+          if (xQueueSend(queues[p->port], &handle, 0) == errQUEUE_FULL)
           {
-            // We should never drop packet
-            ASSERT(0);
-          }          
+            packetPoolRelease(handle);
+            stats.rxDrops++;
+          }
         }
 
-        if (callbacks[p.port])
+        if (callbacks[p->port])
         {
-          callbacks[p.port](&p);
+          callbacks[p->port](p);
         }
 
+        packetPoolRelease(handle);
+        handle = PACKET_POOL_NO_HANDLE;
+
         stats.rxCount++;
         updateStats();
       }
@@ -211,25 +379,46 @@ void crtpRegisterPortCB(int port, CrtpCallback cb)
   callbacks[port] = cb;
 }
 
-int crtpSendPacket(CRTPPacket *p)
+static int queueTxPacket(CRTPPacket *p, TickType_t wait)
 {
   ASSERT(p); 
   ASSERT(p->size <= CRTP_MAX_DATA_SIZE);
 
-  return xQueueSend(txQueue, p, 0);
+  crtpTxItem_t item;
+  item.packet = *p;
+  item.queuedTick = xTaskGetTickCount();
+
+  int result = xQueueSend(txQueues[getTxClass(p->port)], &item, wait);
+  if (result == pdTRUE)
+  {
+    if (txTaskHandle)
+    {
+      xTaskNotifyGive(txTaskHandle);
+    }
+  }
+  else
+  {
+    portStats.drops[p->port]++;
+  }
+
+  return result;
 }
 
-int crtpSendPacketBlock(CRTPPacket *p)
+int crtpSendPacket(CRTPPacket *p)
 {
-  ASSERT(p); 
-  ASSERT(p->size <= CRTP_MAX_DATA_SIZE);
+  return queueTxPacket(p, 0);
+}
 
-  return xQueueSend(txQueue, p, portMAX_DELAY);
+int crtpSendPacketBlock(CRTPPacket *p)
+{
+  return queueTxPacket(p, portMAX_DELAY);
 }
 
 int crtpReset(void)
 {
-  xQueueReset(txQueue);
+  for (int i = 0; i < crtpTxClassCount; i++) {
+    xQueueReset(txQueues[i]);
+  }
   if (link->reset) {
     link->reset();
   }
@@ -276,6 +465,11 @@ static void updateStats()
     stats.rxRate = (uint16_t)(1000.0f * stats.rxCount / interval);
     stats.txRate = (uint16_t)(1000.0f * stats.txCount / interval);
 
+    for (int i = 0; i < CRTP_NBR_OF_PORTS; i++) {
+      portStats.maxLatency[i] = portStats.currentMaxLatency[i];
+      portStats.currentMaxLatency[i] = 0;
+    }
+
     clearStats();
     stats.previousStatisticsTime = now;
     stats.nextStatisticsTime = now + STATS_INTERVAL;
@@ -285,4 +479,30 @@ static void updateStats()
 LOG_GROUP_START(crtp)
 LOG_ADD(LOG_UINT16, rxRate, &stats.rxRate)
 LOG_ADD(LOG_UINT16, txRate, &stats.txRate)
+LOG_ADD(LOG_UINT32, rxDrop, &stats.rxDrops)
 LOG_GROUP_STOP(tdoa)
+
+/**
+ * Per port TX statistics. Drops are the total number of packets that could not be queued, latency is the max time
+ * (ms) from queuing to sending during the last 500 ms.
+ */
+LOG_GROUP_START(crtpTx)
+LOG_ADD(LOG_UINT32, dropConsole, &portStats.drops[CRTP_PORT_CONSOLE])
+LOG_ADD(LOG_UINT32, dropParam, &portStats.drops[CRTP_PORT_PARAM])
+LOG_ADD(LOG_UINT32, dropMem, &portStats.drops[CRTP_PORT_MEM])
+LOG_ADD(LOG_UINT32, dropLog, &portStats.drops[CRTP_PORT_LOG])
+LOG_ADD(LOG_UINT32, dropLoc, &portStats.drops[CRTP_PORT_LOCALIZATION])
+LOG_ADD(LOG_UINT32, dropSetp, &portStats.drops[CRTP_PORT_SETPOINT_GENERIC])
+LOG_ADD(LOG_UINT32, dropHl, &portStats.drops[CRTP_PORT_SETPOINT_HL])
+LOG_ADD(LOG_UINT32, dropPlatf, &portStats.drops[CRTP_PORT_PLATFORM])
+LOG_ADD(LOG_UINT32, dropLink, &portStats.drops[CRTP_PORT_LINK])
+LOG_ADD(LOG_UINT16, latConsole, &portStats.maxLatency[CRTP_PORT_CONSOLE])
+LOG_ADD(LOG_UINT16, latParam, &portStats.maxLatency[CRTP_PORT_PARAM])
+LOG_ADD(LOG_UINT16, latMem, &portStats.maxLatency[CRTP_PORT_MEM])
+LOG_ADD(LOG_UINT16, latLog, &portStats.maxLatency[CRTP_PORT_LOG])
+LOG_ADD(LOG_UINT16, latLoc, &portStats.maxLatency[CRTP_PORT_LOCALIZATION])
+LOG_ADD(LOG_UINT16, latSetp, &portStats.maxLatency[CRTP_PORT_SETPOINT_GENERIC])
+LOG_ADD(LOG_UINT16, latHl, &portStats.maxLatency[CRTP_PORT_SETPOINT_HL])
+LOG_ADD(LOG_UINT16, latPlatf, &portStats.maxLatency[CRTP_PORT_PLATFORM])
+LOG_ADD(LOG_UINT16, latLink, &portStats.maxLatency[CRTP_PORT_LINK])
+LOG_GROUP_STOP(crtpTx)
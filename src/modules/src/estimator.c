@@ -148,6 +148,18 @@ bool estimatorEnqueueTDOA(const tdoaMeasurement_t *uwb) {
   return false;
 }
 
+bool estimatorEnqueueTDOABatch(const tdoaMeasurement_t uwb[], const int count) {
+  if (estimatorFunctions[currentEstimator].estimatorEnqueueTDOA) {
+    bool result = true;
+    for (int i = 0; i < count; i++) {
+      result = estimatorFunctions[currentEstimator].estimatorEnqueueTDOA(&uwb[i]) && result;
+    }
+    return result;
+  }
+
+  return false;
+}
+
 bool estimatorEnqueueYawError(const yawErrorMeasurement_t* error) {
   if (estimatorFunctions[currentEstimator].estimatorEnqueueYawError) {
     return estimatorFunctions[currentEstimator].estimatorEnqueueYawError(error);
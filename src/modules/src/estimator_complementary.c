@@ -37,10 +37,10 @@
 #include "sensors.h"
 #include "stabilizer_types.h"
 
-#define ATTITUDE_UPDATE_RATE RATE_250_HZ
+#define ATTITUDE_UPDATE_RATE ESTIMATOR_ATTITUDE_RATE
 #define ATTITUDE_UPDATE_DT 1.0/ATTITUDE_UPDATE_RATE
 
-#define POS_UPDATE_RATE RATE_100_HZ
+#define POS_UPDATE_RATE ESTIMATOR_POSITION_RATE
 #define POS_UPDATE_DT 1.0/POS_UPDATE_RATE
 
 static bool latestTofMeasurement(tofMeasurement_t* tofMeasurement);
@@ -68,7 +68,7 @@ bool estimatorComplementaryTest(void)
 void estimatorComplementary(state_t *state, sensorData_t *sensorData, control_t *control, const uint32_t tick)
 {
   sensorsAcquire(sensorData, tick); // Read sensors at full rate (1000Hz)
-  if (RATE_DO_EXECUTE(ATTITUDE_UPDATE_RATE, tick)) {
+  if (rateGroupDoExecute(rateGroupEstimatorAttitude, tick)) {
     sensfusion6UpdateQ(sensorData->gyro.x, sensorData->gyro.y, sensorData->gyro.z,
                        sensorData->acc.x, sensorData->acc.y, sensorData->acc.z,
                        ATTITUDE_UPDATE_DT);
@@ -91,7 +91,7 @@ void estimatorComplementary(state_t *state, sensorData_t *sensorData, control_t
     positionUpdateVelocity(state->acc.z, ATTITUDE_UPDATE_DT);
   }
 
-  if (RATE_DO_EXECUTE(POS_UPDATE_RATE, tick)) {
+  if (rateGroupDoExecute(rateGroupEstimatorPosition, tick)) {
     tofMeasurement_t tofMeasurement;
 
     latestTofMeasurement(&tofMeasurement);
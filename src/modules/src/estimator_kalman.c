@@ -59,11 +59,11 @@
 #include "kalman_core.h"
 #include "estimator_kalman.h"
 #include "kalman_supervisor.h"
+#include "measurement_ring.h"
 
 #include "stm32f4xx.h"
 
 #include "FreeRTOS.h"
-#include "queue.h"
 #include "task.h"
 #include "semphr.h"
 #include "sensors.h"
@@ -74,6 +74,7 @@
 #include "physicalConstants.h"
 
 #include "statsCnt.h"
+#include "usddeck.h"
 
 #define DEBUG_MODULE "ESTKALMAN"
 #include "debug.h"
@@ -93,78 +94,15 @@
  * As well as by the following internal functions and datatypes
  */
 
-// Distance-to-point measurements
-static xQueueHandle distDataQueue;
-#define DIST_QUEUE_LENGTH (10)
+// All measurements, of all types, are passed to the task through one lock free ring.
+// The ring keeps the measurements in the order they arrived and can be filled from interrupts.
+static measurementRing_t measurementRing;
 
-static inline bool stateEstimatorHasDistanceMeasurement(distanceMeasurement_t *dist) {
-  return (pdTRUE == xQueueReceive(distDataQueue, dist, 0));
-}
-
-// Direct measurements of Crazyflie position
-static xQueueHandle posDataQueue;
-#define POS_QUEUE_LENGTH (10)
-
-static inline bool stateEstimatorHasPositionMeasurement(positionMeasurement_t *pos) {
-  return (pdTRUE == xQueueReceive(posDataQueue, pos, 0));
-}
-
-// Direct measurements of Crazyflie pose
-static xQueueHandle poseDataQueue;
-#define POSE_QUEUE_LENGTH (10)
-
-static inline bool stateEstimatorHasPoseMeasurement(poseMeasurement_t *pose) {
-  return (pdTRUE == xQueueReceive(poseDataQueue, pose, 0));
-}
-
-// Measurements of a UWB Tx/Rx
-static xQueueHandle tdoaDataQueue;
-#define UWB_QUEUE_LENGTH (10)
-
-static inline bool stateEstimatorHasTDOAPacket(tdoaMeasurement_t *uwb) {
-  return (pdTRUE == xQueueReceive(tdoaDataQueue, uwb, 0));
-}
-
-
-// Measurements of flow (dnx, dny)
-static xQueueHandle flowDataQueue;
-#define FLOW_QUEUE_LENGTH (10)
-
-static inline bool stateEstimatorHasFlowPacket(flowMeasurement_t *flow) {
-  return (pdTRUE == xQueueReceive(flowDataQueue, flow, 0));
-}
-
-// Measurements of TOF from laser sensor
-static xQueueHandle tofDataQueue;
-#define TOF_QUEUE_LENGTH (10)
-
-static inline bool stateEstimatorHasTOFPacket(tofMeasurement_t *tof) {
-  return (pdTRUE == xQueueReceive(tofDataQueue, tof, 0));
-}
-
-// Absolute height measurement along the room Z
-static xQueueHandle heightDataQueue;
-#define HEIGHT_QUEUE_LENGTH (10)
-
-static inline bool stateEstimatorHasHeightPacket(heightMeasurement_t *height) {
-  return (pdTRUE == xQueueReceive(heightDataQueue, height, 0));
-}
-
-static xQueueHandle yawErrorDataQueue;
-#define YAW_ERROR_QUEUE_LENGTH (10)
-
-static inline bool stateEstimatorHasYawErrorPacket(yawErrorMeasurement_t *error)
-{
-  return (pdTRUE == xQueueReceive(yawErrorDataQueue, error, 0));
-}
+// Set when the ring should be emptied, the flush itself is done by the task as it is the only reader
+static volatile bool flushMeasurementRing = false;
 
-static xQueueHandle sweepAnglesDataQueue;
-#define SWEEP_ANGLES_QUEUE_LENGTH (10)
-
-static inline bool stateEstimatorHasSweepAnglesPacket(sweepAngleMeasurement_t *angles)
-{
-  return (pdTRUE == xQueueReceive(sweepAnglesDataQueue, angles, 0));
-}
+#define POS_BATCH_SIZE (KC_MAX_BATCH_SIZE / 3)
+#define SWEEP_ANGLES_BATCH_SIZE (KC_MAX_BATCH_SIZE / 2)
 
 // Semaphore to signal that we got data from the stabilzer loop to process
 static SemaphoreHandle_t runTaskSemaphore;
@@ -273,15 +211,7 @@ static bool updateQueuedMeasurments(const Axis3f *gyro);
 
 // Called one time during system startup
 void estimatorKalmanTaskInit() {
-  distDataQueue = xQueueCreate(DIST_QUEUE_LENGTH, sizeof(distanceMeasurement_t));
-  posDataQueue = xQueueCreate(POS_QUEUE_LENGTH, sizeof(positionMeasurement_t));
-  poseDataQueue = xQueueCreate(POSE_QUEUE_LENGTH, sizeof(poseMeasurement_t));
-  tdoaDataQueue = xQueueCreate(UWB_QUEUE_LENGTH, sizeof(tdoaMeasurement_t));
-  flowDataQueue = xQueueCreate(FLOW_QUEUE_LENGTH, sizeof(flowMeasurement_t));
-  tofDataQueue = xQueueCreate(TOF_QUEUE_LENGTH, sizeof(tofMeasurement_t));
-  heightDataQueue = xQueueCreate(HEIGHT_QUEUE_LENGTH, sizeof(heightMeasurement_t));
-  yawErrorDataQueue = xQueueCreate(YAW_ERROR_QUEUE_LENGTH, sizeof(yawErrorMeasurement_t));
-  sweepAnglesDataQueue = xQueueCreate(SWEEP_ANGLES_QUEUE_LENGTH, sizeof(sweepAngleMeasurement_t));
+  measurementRingInit(&measurementRing);
 
   vSemaphoreCreateBinary(runTaskSemaphore);
 
@@ -368,6 +298,13 @@ static void kalmanTask(void* parameters) {
       }
     }
 
+    if (flushMeasurementRing) {
+      measurementRingFlush(&measurementRing);
+      flushMeasurementRing = false;
+    }
+
+    // Only take the gyro snapshot when there is something to update with
+    if (! measurementRingIsEmpty(&measurementRing))
     {
       Axis3f gyro;
       xSemaphoreTake(dataMutex, portMAX_DELAY);
@@ -389,6 +326,7 @@ static void kalmanTask(void* parameters) {
       STATS_CNT_RATE_EVENT(&finalizeCounter);
       if (! kalmanSupervisorIsStateWithinBounds(&coreData)) {
         coreData.resetEstimation = true;
+        usddeckTriggerEvent(usddeckEvent_EstimatorReset);
         DEBUG_PRINT("State out of bounds, resetting\n");
       }
     }
@@ -508,67 +446,77 @@ static bool updateQueuedMeasurments(const Axis3f *gyro) {
    * we therefore consume all measurements since the last loop, rather than accumulating
    */
 
-  tofMeasurement_t tof;
-  while (stateEstimatorHasTOFPacket(&tof))
-  {
-    kalmanCoreUpdateWithTof(&coreData, &tof);
-    doneUpdate = true;
-  }
+  // Consecutive position and sweep angle measurements are collected and applied in batches, to reduce the number
+  // of covariance updates. A pending batch is applied before any measurement of another type to keep the arrival order.
+  static positionMeasurement_t pos[POS_BATCH_SIZE];
+  int posCount = 0;
+  static sweepAngleMeasurement_t angles[SWEEP_ANGLES_BATCH_SIZE];
+  int anglesCount = 0;
 
-  yawErrorMeasurement_t yawError;
-  while (stateEstimatorHasYawErrorPacket(&yawError))
+  measurement_t m;
+  while (measurementRingGet(&measurementRing, &m))
   {
-    kalmanCoreUpdateWithYawError(&coreData, &yawError);
-    doneUpdate = true;
-  }
-
-  heightMeasurement_t height;
-  while (stateEstimatorHasHeightPacket(&height))
-  {
-    kalmanCoreUpdateWithAbsoluteHeight(&coreData, &height);
-    doneUpdate = true;
-  }
-
-  distanceMeasurement_t dist;
-  while (stateEstimatorHasDistanceMeasurement(&dist))
-  {
-    kalmanCoreUpdateWithDistance(&coreData, &dist);
-    doneUpdate = true;
-  }
+    if (posCount > 0 && m.type != MeasurementTypePosition) {
+      kalmanCoreUpdateWithPositionBatch(&coreData, pos, posCount);
+      posCount = 0;
+    }
 
-  positionMeasurement_t pos;
-  while (stateEstimatorHasPositionMeasurement(&pos))
-  {
-    kalmanCoreUpdateWithPosition(&coreData, &pos);
-    doneUpdate = true;
-  }
+    if (anglesCount > 0 && m.type != MeasurementTypeSweepAngle) {
+      kalmanCoreUpdateWithSweepAnglesBatch(&coreData, angles, anglesCount);
+      anglesCount = 0;
+    }
 
-  poseMeasurement_t pose;
-  while (stateEstimatorHasPoseMeasurement(&pose))
-  {
-    kalmanCoreUpdateWithPose(&coreData, &pose);
-    doneUpdate = true;
-  }
+    switch (m.type) {
+      case MeasurementTypeTDOA:
+        kalmanCoreUpdateWithTDOA(&coreData, &m.data.tdoa);
+        break;
+      case MeasurementTypePosition:
+        pos[posCount] = m.data.position;
+        posCount++;
+        if (posCount == POS_BATCH_SIZE) {
+          kalmanCoreUpdateWithPositionBatch(&coreData, pos, posCount);
+          posCount = 0;
+        }
+        break;
+      case MeasurementTypePose:
+        kalmanCoreUpdateWithPose(&coreData, &m.data.pose);
+        break;
+      case MeasurementTypeDistance:
+        kalmanCoreUpdateWithDistance(&coreData, &m.data.distance);
+        break;
+      case MeasurementTypeTOF:
+        kalmanCoreUpdateWithTof(&coreData, &m.data.tof);
+        break;
+      case MeasurementTypeAbsoluteHeight:
+        kalmanCoreUpdateWithAbsoluteHeight(&coreData, &m.data.height);
+        break;
+      case MeasurementTypeFlow:
+        kalmanCoreUpdateWithFlow(&coreData, &m.data.flow, gyro);
+        break;
+      case MeasurementTypeYawError:
+        kalmanCoreUpdateWithYawError(&coreData, &m.data.yawError);
+        break;
+      case MeasurementTypeSweepAngle:
+        angles[anglesCount] = m.data.sweepAngle;
+        anglesCount++;
+        if (anglesCount == SWEEP_ANGLES_BATCH_SIZE) {
+          kalmanCoreUpdateWithSweepAnglesBatch(&coreData, angles, anglesCount);
+          anglesCount = 0;
+        }
+        break;
+      default:
+        break;
+    }
 
-  tdoaMeasurement_t tdoa;
-  while (stateEstimatorHasTDOAPacket(&tdoa))
-  {
-    kalmanCoreUpdateWithTDOA(&coreData, &tdoa);
     doneUpdate = true;
   }
 
-  flowMeasurement_t flow;
-  while (stateEstimatorHasFlowPacket(&flow))
-  {
-    kalmanCoreUpdateWithFlow(&coreData, &flow, gyro);
-    doneUpdate = true;
+  if (posCount > 0) {
+    kalmanCoreUpdateWithPositionBatch(&coreData, pos, posCount);
   }
 
-  sweepAngleMeasurement_t angles;
-  while (stateEstimatorHasSweepAnglesPacket(&angles))
-  {
-    kalmanCoreUpdateWithSweepAngles(&coreData, &angles);
-    doneUpdate = true;
+  if (anglesCount > 0) {
+    kalmanCoreUpdateWithSweepAnglesBatch(&coreData, angles, anglesCount);
   }
 
   return doneUpdate;
@@ -576,12 +524,7 @@ static bool updateQueuedMeasurments(const Axis3f *gyro) {
 
 // Called when this estimator is activated
 void estimatorKalmanInit(void) {
-  xQueueReset(distDataQueue);
-  xQueueReset(posDataQueue);
-  xQueueReset(poseDataQueue);
-  xQueueReset(tdoaDataQueue);
-  xQueueReset(flowDataQueue);
-  xQueueReset(tofDataQueue);
+  flushMeasurementRing = true;
 
   xSemaphoreTake(dataMutex, portMAX_DELAY);
   accAccumulator = (Axis3f){.axis={0}};
@@ -598,23 +541,10 @@ void estimatorKalmanInit(void) {
   kalmanCoreInit(&coreData);
 }
 
-static bool appendMeasurement(xQueueHandle queue, void *measurement)
+static bool appendMeasurement(const measurement_t *measurement)
 {
-  portBASE_TYPE result;
-  bool isInInterrupt = (SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk) != 0;
-
-  if (isInInterrupt) {
-    portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
-    result = xQueueSendFromISR(queue, measurement, &xHigherPriorityTaskWoken);
-    if(xHigherPriorityTaskWoken == pdTRUE)
-    {
-      portYIELD();
-    }
-  } else {
-    result = xQueueSend(queue, measurement, 0);
-  }
-
-  if (result == pdTRUE) {
+  // The ring is lock free and does not block, it can be used from tasks as well as interrupts
+  if (measurementRingPut(&measurementRing, measurement)) {
     STATS_CNT_RATE_EVENT(&measurementAppendedCounter);
     return true;
   } else {
@@ -626,58 +556,67 @@ static bool appendMeasurement(xQueueHandle queue, void *measurement)
 bool estimatorKalmanEnqueueTDOA(const tdoaMeasurement_t *uwb)
 {
   ASSERT(isInit);
-  return appendMeasurement(tdoaDataQueue, (void *)uwb);
+  measurement_t m = {.type = MeasurementTypeTDOA, .data.tdoa = *uwb};
+  return appendMeasurement(&m);
 }
 
 bool estimatorKalmanEnqueuePosition(const positionMeasurement_t *pos)
 {
   ASSERT(isInit);
-  return appendMeasurement(posDataQueue, (void *)pos);
+  measurement_t m = {.type = MeasurementTypePosition, .data.position = *pos};
+  return appendMeasurement(&m);
 }
 
 bool estimatorKalmanEnqueuePose(const poseMeasurement_t *pose)
 {
   ASSERT(isInit);
-  return appendMeasurement(poseDataQueue, (void *)pose);
+  measurement_t m = {.type = MeasurementTypePose, .data.pose = *pose};
+  return appendMeasurement(&m);
 }
 
 bool estimatorKalmanEnqueueDistance(const distanceMeasurement_t *dist)
 {
   ASSERT(isInit);
-  return appendMeasurement(distDataQueue, (void *)dist);
+  measurement_t m = {.type = MeasurementTypeDistance, .data.distance = *dist};
+  return appendMeasurement(&m);
 }
 
 bool estimatorKalmanEnqueueFlow(const flowMeasurement_t *flow)
 {
   // A flow measurement (dnx,  dny) [accumulated pixels]
   ASSERT(isInit);
-  return appendMeasurement(flowDataQueue, (void *)flow);
+  measurement_t m = {.type = MeasurementTypeFlow, .data.flow = *flow};
+  return appendMeasurement(&m);
 }
 
 bool estimatorKalmanEnqueueTOF(const tofMeasurement_t *tof)
 {
   // A distance (distance) [m] to the ground along the z_B axis.
   ASSERT(isInit);
-  return appendMeasurement(tofDataQueue, (void *)tof);
+  measurement_t m = {.type = MeasurementTypeTOF, .data.tof = *tof};
+  return appendMeasurement(&m);
 }
 
 bool estimatorKalmanEnqueueAbsoluteHeight(const heightMeasurement_t *height)
 {
   // A distance (height) [m] to the ground along the z axis.
   ASSERT(isInit);
-  return appendMeasurement(heightDataQueue, (void *)height);
+  measurement_t m = {.type = MeasurementTypeAbsoluteHeight, .data.height = *height};
+  return appendMeasurement(&m);
 }
 
 bool estimatorKalmanEnqueueYawError(const yawErrorMeasurement_t* error)
 {
   ASSERT(isInit);
-  return appendMeasurement(yawErrorDataQueue, (void *)error);
+  measurement_t m = {.type = MeasurementTypeYawError, .data.yawError = *error};
+  return appendMeasurement(&m);
 }
 
 bool estimatorKalmanEnqueueSweepAngles(const sweepAngleMeasurement_t *angles)
 {
   ASSERT(isInit);
-  return appendMeasurement(sweepAnglesDataQueue, (void *)angles);
+  measurement_t m = {.type = MeasurementTypeSweepAngle, .data.sweepAngle = *angles};
+  return appendMeasurement(&m);
 }
 
 bool estimatorKalmanTest(void)
@@ -738,6 +677,19 @@ LOG_GROUP_START(kalman)
   STATS_CNT_RATE_LOG_ADD(rtRej, &measurementNotAppendedCounter)
 LOG_GROUP_STOP(kalman)
 
+// Number of measurements dropped because the measurement ring was full, per measurement type
+LOG_GROUP_START(kalman_drop)
+  LOG_ADD(LOG_UINT32, tdoa, &measurementRing.dropCount[MeasurementTypeTDOA])
+  LOG_ADD(LOG_UINT32, pos, &measurementRing.dropCount[MeasurementTypePosition])
+  LOG_ADD(LOG_UINT32, pose, &measurementRing.dropCount[MeasurementTypePose])
+  LOG_ADD(LOG_UINT32, dist, &measurementRing.dropCount[MeasurementTypeDistance])
+  LOG_ADD(LOG_UINT32, tof, &measurementRing.dropCount[MeasurementTypeTOF])
+  LOG_ADD(LOG_UINT32, height, &measurementRing.dropCount[MeasurementTypeAbsoluteHeight])
+  LOG_ADD(LOG_UINT32, flow, &measurementRing.dropCount[MeasurementTypeFlow])
+  LOG_ADD(LOG_UINT32, yawErr, &measurementRing.dropCount[MeasurementTypeYawError])
+  LOG_ADD(LOG_UINT32, sweep, &measurementRing.dropCount[MeasurementTypeSweepAngle])
+LOG_GROUP_STOP(kalman_drop)
+
 PARAM_GROUP_START(kalman)
   PARAM_ADD(PARAM_UINT8, resetEstimation, &coreData.resetEstimation)
   PARAM_ADD(PARAM_UINT8, quadIsFlying, &quadIsFlying)
@@ -65,9 +65,18 @@
 #include "param.h"
 #include "math3d.h"
 #include "debug.h"
+#include "test_support.h"
 
 // #define DEBUG_STATE_CHECK
 
+// The covariance update in scalarUpdate() uses the sparsity of H and the symmetry of P.
+// Define KALMAN_USE_DENSE_UPDATE to use the original (slower) dense matrix implementation instead.
+// #define KALMAN_USE_DENSE_UPDATE
+
+// The covariance propagation in kalmanCorePredict() only computes the non-trivial 3x3 blocks of APA'.
+// Define KALMAN_USE_DENSE_PREDICT to use the original dense matrix implementation instead.
+// #define KALMAN_USE_DENSE_PREDICT
+
 // the reversion of pitch and roll to zero
 #ifdef LPS_2D_POSITION_HEIGHT
 #define ROLLPITCH_ZERO_REVERSION (0.0f)
@@ -220,7 +229,8 @@ void kalmanCoreInit(kalmanCoreData_t* this) {
   this->baroReferenceHeight = 0.0;
 }
 
-static void scalarUpdate(kalmanCoreData_t* this, arm_matrix_instance_f32 *Hm, float error, float stdMeasNoise)
+#if defined(KALMAN_USE_DENSE_UPDATE) || defined(UNIT_TEST_MODE)
+TESTABLE_STATIC void scalarUpdateDense(kalmanCoreData_t* this, arm_matrix_instance_f32 *Hm, float error, float stdMeasNoise)
 {
   // The Kalman gain as a column vector
   static float K[KC_STATE_DIM];
@@ -289,6 +299,232 @@ static void scalarUpdate(kalmanCoreData_t* this, arm_matrix_instance_f32 *Hm, fl
 
   assertStateNotNaN(this);
 }
+#endif
+
+#if !defined(KALMAN_USE_DENSE_UPDATE) || defined(UNIT_TEST_MODE)
+TESTABLE_STATIC void scalarUpdateSparse(kalmanCoreData_t* this, arm_matrix_instance_f32 *Hm, float error, float stdMeasNoise)
+{
+  // The Kalman gain as a column vector
+  static float K[KC_STATE_DIM];
+
+  // PH' as a column vector
+  static float PHTd[KC_STATE_DIM];
+
+  // Indexes of the non-zero elements in H
+  static uint8_t hIdx[KC_STATE_DIM];
+
+  ASSERT(Hm->numRows == 1);
+  ASSERT(Hm->numCols == KC_STATE_DIM);
+
+  const float* h = Hm->pData;
+  int hCount = 0;
+  for (int i=0; i<KC_STATE_DIM; i++) {
+    if (h[i] != 0.0f) {
+      hIdx[hCount++] = i;
+    }
+  }
+
+  // ====== INNOVATION COVARIANCE ======
+  // Only the columns of P where H is non-zero contribute to PH'
+  for (int i=0; i<KC_STATE_DIM; i++) {
+    float v = 0;
+    for (int k=0; k<hCount; k++) {
+      v += this->P[i][hIdx[k]] * h[hIdx[k]];
+    }
+    PHTd[i] = v;
+  }
+
+  float R = stdMeasNoise*stdMeasNoise;
+  float HPHR = R; // HPH' + R
+  for (int k=0; k<hCount; k++) {
+    HPHR += h[hIdx[k]]*PHTd[hIdx[k]];
+  }
+  ASSERT(!isnan(HPHR));
+
+  // ====== MEASUREMENT UPDATE ======
+  // Calculate the Kalman gain and perform the state update
+  for (int i=0; i<KC_STATE_DIM; i++) {
+    K[i] = PHTd[i]/HPHR; // kalman gain = (PH' (HPH' + R )^-1)
+    this->S[i] = this->S[i] + K[i] * error; // state update
+  }
+  assertStateNotNaN(this);
+
+  // ====== COVARIANCE UPDATE ======
+  // The Joseph form (KH - I)*P*(KH - I)' + KRK' expands to a symmetric rank-2 update when H is a single row
+  // and P is symmetric (HP = (PH')'):
+  //   P - K(PH')' - (PH')K' + K(HPH' + R)K'
+  // Only the upper triangle is computed, it is mirrored while ensuring boundedness and symmetry.
+  for (int i=0; i<KC_STATE_DIM; i++) {
+    for (int j=i; j<KC_STATE_DIM; j++) {
+      float p = 0.5f*this->P[i][j] + 0.5f*this->P[j][i] - K[i]*PHTd[j] - PHTd[i]*K[j] + K[i]*HPHR*K[j];
+      if (isnan(p) || p > MAX_COVARIANCE) {
+        this->P[i][j] = this->P[j][i] = MAX_COVARIANCE;
+      } else if ( i==j && p < MIN_COVARIANCE ) {
+        this->P[i][j] = this->P[j][i] = MIN_COVARIANCE;
+      } else {
+        this->P[i][j] = this->P[j][i] = p;
+      }
+    }
+  }
+
+  assertStateNotNaN(this);
+}
+#endif
+
+static void scalarUpdate(kalmanCoreData_t* this, arm_matrix_instance_f32 *Hm, float error, float stdMeasNoise)
+{
+#ifdef KALMAN_USE_DENSE_UPDATE
+  scalarUpdateDense(this, Hm, error, stdMeasNoise);
+#else
+  scalarUpdateSparse(this, Hm, error, stdMeasNoise);
+#endif
+}
+
+
+// Rows of a vector measurement, collected to be applied in one covariance update
+typedef struct {
+  int count;
+  float h[KC_MAX_BATCH_SIZE][KC_STATE_DIM];
+  float error[KC_MAX_BATCH_SIZE];
+  float stdMeasNoise[KC_MAX_BATCH_SIZE];
+} measurementBatch_t;
+
+static measurementBatch_t batch;
+
+static void batchReset(measurementBatch_t* batch)
+{
+  batch->count = 0;
+}
+
+static int batchRowsLeft(const measurementBatch_t* batch)
+{
+  return KC_MAX_BATCH_SIZE - batch->count;
+}
+
+// Adds a row to the batch and returns the (zeroed) measurement jacobian of the row, to be filled in by the caller
+static float* batchAddRow(measurementBatch_t* batch, float error, float stdMeasNoise)
+{
+  ASSERT(batch->count < KC_MAX_BATCH_SIZE);
+
+  float* h = batch->h[batch->count];
+  memset(h, 0, sizeof(batch->h[0]));
+  batch->error[batch->count] = error;
+  batch->stdMeasNoise[batch->count] = stdMeasNoise;
+  batch->count++;
+
+  return h;
+}
+
+/**
+ * Applies all rows of a batch in one update, assuming independent measurement noise for the rows.
+ * For linear measurements this is equal to doing one scalar update per row, but the covariance matrix is
+ * only rewritten once.
+ */
+static void vectorUpdate(kalmanCoreData_t* this, const measurementBatch_t* batch)
+{
+  const int m = batch->count;
+
+  if (m == 0) {
+    return;
+  }
+
+  if (m == 1) {
+    arm_matrix_instance_f32 H = {1, KC_STATE_DIM, (float*)batch->h[0]};
+    scalarUpdate(this, &H, batch->error[0], batch->stdMeasNoise[0]);
+    return;
+  }
+
+  // PH'
+  static float PHT[KC_STATE_DIM][KC_MAX_BATCH_SIZE];
+
+  // Innovation covariance HPH' + R, and its inverse
+  static float Sd[KC_MAX_BATCH_SIZE * KC_MAX_BATCH_SIZE];
+  static float SInvd[KC_MAX_BATCH_SIZE * KC_MAX_BATCH_SIZE];
+
+  // The Kalman gain, and the Kalman gain multiplied by the innovation covariance
+  static float K[KC_STATE_DIM][KC_MAX_BATCH_SIZE];
+  static float KS[KC_STATE_DIM][KC_MAX_BATCH_SIZE];
+
+  // ====== INNOVATION COVARIANCE ======
+  for (int i=0; i<KC_STATE_DIM; i++) {
+    for (int r=0; r<m; r++) {
+      float v = 0;
+      for (int j=0; j<KC_STATE_DIM; j++) {
+        if (batch->h[r][j] != 0.0f) {
+          v += this->P[i][j] * batch->h[r][j];
+        }
+      }
+      PHT[i][r] = v;
+    }
+  }
+
+  for (int r=0; r<m; r++) {
+    for (int c=0; c<m; c++) {
+      float v = (r == c) ? batch->stdMeasNoise[r] * batch->stdMeasNoise[r] : 0.0f;
+      for (int j=0; j<KC_STATE_DIM; j++) {
+        v += batch->h[r][j] * PHT[j][c];
+      }
+      Sd[r*m + c] = v;
+      ASSERT(!isnan(v));
+    }
+  }
+
+  // The inversion is done in place in the source matrix, keep S for the covariance update
+  static float tmpSd[KC_MAX_BATCH_SIZE * KC_MAX_BATCH_SIZE];
+  memcpy(tmpSd, Sd, m * m * sizeof(float));
+  arm_matrix_instance_f32 tmpSm = {m, m, tmpSd};
+  arm_matrix_instance_f32 SInvm = {m, m, SInvd};
+  mat_inv(&tmpSm, &SInvm);
+
+  // ====== MEASUREMENT UPDATE ======
+  // Calculate the Kalman gain and perform the state update
+  for (int i=0; i<KC_STATE_DIM; i++) {
+    for (int c=0; c<m; c++) {
+      float v = 0;
+      for (int r=0; r<m; r++) {
+        v += PHT[i][r] * SInvd[r*m + c];
+      }
+      K[i][c] = v; // kalman gain = (PH' (HPH' + R )^-1)
+    }
+
+    for (int r=0; r<m; r++) {
+      this->S[i] += K[i][r] * batch->error[r]; // state update
+    }
+  }
+  assertStateNotNaN(this);
+
+  for (int i=0; i<KC_STATE_DIM; i++) {
+    for (int c=0; c<m; c++) {
+      float v = 0;
+      for (int r=0; r<m; r++) {
+        v += K[i][r] * Sd[r*m + c];
+      }
+      KS[i][c] = v;
+    }
+  }
+
+  // ====== COVARIANCE UPDATE ======
+  // Joseph form, expanded in the same way as in scalarUpdateSparse():
+  //   P - K(PH')' - (PH')K' + K(HPH' + R)K'
+  for (int i=0; i<KC_STATE_DIM; i++) {
+    for (int j=i; j<KC_STATE_DIM; j++) {
+      float p = 0.5f*this->P[i][j] + 0.5f*this->P[j][i];
+      for (int r=0; r<m; r++) {
+        p += - K[i][r]*PHT[j][r] - PHT[i][r]*K[j][r] + KS[i][r]*K[j][r];
+      }
+
+      if (isnan(p) || p > MAX_COVARIANCE) {
+        this->P[i][j] = this->P[j][i] = MAX_COVARIANCE;
+      } else if ( i==j && p < MIN_COVARIANCE ) {
+        this->P[i][j] = this->P[j][i] = MIN_COVARIANCE;
+      } else {
+        this->P[i][j] = this->P[j][i] = p;
+      }
+    }
+  }
+
+  assertStateNotNaN(this);
+}
 
 
 void kalmanCoreUpdateWithBaro(kalmanCoreData_t* this, float baroAsl, bool quadIsFlying)
@@ -314,27 +550,41 @@ void kalmanCoreUpdateWithAbsoluteHeight(kalmanCoreData_t* this, heightMeasuremen
   scalarUpdate(this, &H, height->height - this->S[KC_STATE_Z], height->stdDev);
 }
 
-void kalmanCoreUpdateWithPosition(kalmanCoreData_t* this, positionMeasurement_t *xyz)
+static void addPositionToBatch(const kalmanCoreData_t* this, measurementBatch_t* batch, const positionMeasurement_t *xyz)
 {
   // a direct measurement of states x, y, and z
-  // do a scalar update for each state, since this should be faster than updating all together
   for (int i=0; i<3; i++) {
-    float h[KC_STATE_DIM] = {0};
-    arm_matrix_instance_f32 H = {1, KC_STATE_DIM, h};
+    float* h = batchAddRow(batch, xyz->pos[i] - this->S[KC_STATE_X+i], xyz->stdDev);
     h[KC_STATE_X+i] = 1;
-    scalarUpdate(this, &H, xyz->pos[i] - this->S[KC_STATE_X+i], xyz->stdDev);
   }
 }
 
+void kalmanCoreUpdateWithPosition(kalmanCoreData_t* this, positionMeasurement_t *xyz)
+{
+  kalmanCoreUpdateWithPositionBatch(this, xyz, 1);
+}
+
+void kalmanCoreUpdateWithPositionBatch(kalmanCoreData_t* this, positionMeasurement_t *xyz, int count)
+{
+  batchReset(&batch);
+  for (int i=0; i<count; i++) {
+    if (batchRowsLeft(&batch) < 3) {
+      vectorUpdate(this, &batch);
+      batchReset(&batch);
+    }
+    addPositionToBatch(this, &batch, &xyz[i]);
+  }
+  vectorUpdate(this, &batch);
+}
+
 void kalmanCoreUpdateWithPose(kalmanCoreData_t* this, poseMeasurement_t *pose)
 {
   // a direct measurement of states x, y, and z, and orientation
-  // do a scalar update for each state, since this should be faster than updating all together
+  // all six states are updated together
+  batchReset(&batch);
   for (int i=0; i<3; i++) {
-    float h[KC_STATE_DIM] = {0};
-    arm_matrix_instance_f32 H = {1, KC_STATE_DIM, h};
+    float* h = batchAddRow(&batch, pose->pos[i] - this->S[KC_STATE_X+i], pose->stdDevPos);
     h[KC_STATE_X+i] = 1;
-    scalarUpdate(this, &H, pose->pos[i] - this->S[KC_STATE_X+i], pose->stdDevPos);
   }
 
   // compute orientation error
@@ -344,21 +594,14 @@ void kalmanCoreUpdateWithPose(kalmanCoreData_t* this, poseMeasurement_t *pose)
   // small angle approximation, see eq. 141 in http://mars.cs.umn.edu/tr/reports/Trawny05b.pdf
   struct vec const err_quat = vscl(2.0f / q_residual.w, quatimagpart(q_residual));
 
-  // do a scalar update for each state
-  {
-    float h[KC_STATE_DIM] = {0};
-    arm_matrix_instance_f32 H = {1, KC_STATE_DIM, h};
-    h[KC_STATE_D0] = 1;
-    scalarUpdate(this, &H, err_quat.x, pose->stdDevQuat);
-    h[KC_STATE_D0] = 0;
-
-    h[KC_STATE_D1] = 1;
-    scalarUpdate(this, &H, err_quat.y, pose->stdDevQuat);
-    h[KC_STATE_D1] = 0;
+  float* h = batchAddRow(&batch, err_quat.x, pose->stdDevQuat);
+  h[KC_STATE_D0] = 1;
+  h = batchAddRow(&batch, err_quat.y, pose->stdDevQuat);
+  h[KC_STATE_D1] = 1;
+  h = batchAddRow(&batch, err_quat.z, pose->stdDevQuat);
+  h[KC_STATE_D2] = 1;
 
-    h[KC_STATE_D2] = 1;
-    scalarUpdate(this, &H, err_quat.z, pose->stdDevQuat);
-  }
+  vectorUpdate(this, &batch);
 }
 
 void kalmanCoreUpdateWithDistance(kalmanCoreData_t* this, distanceMeasurement_t *d)
@@ -568,7 +811,7 @@ void kalmanCoreUpdateWithYawError(kalmanCoreData_t *this, yawErrorMeasurement_t
     scalarUpdate(this, &H, this->S[KC_STATE_D2] - error->yawError, error->stdDev);
 }
 
-static void scalarUpdateForSweep(kalmanCoreData_t *this, float measuredSweepAngle, float dp, float dx, kalmanCoreStateIdx_t state_p, float stdDev, arm_matrix_instance_f32* R) {
+static void addSweepToBatch(measurementBatch_t* batch, float measuredSweepAngle, float dp, float dx, kalmanCoreStateIdx_t state_p, float stdDev, arm_matrix_instance_f32* R) {
   if(dx != 0) {
     float predictedSweepAngle = atan2(dp, dx);
 
@@ -576,8 +819,7 @@ static void scalarUpdateForSweep(kalmanCoreData_t *this, float measuredSweepAngl
     float hx = -dp / n;
     float hp = dx / n;
 
-    float h[KC_STATE_DIM] = {0};
-    arm_matrix_instance_f32 H = {1, KC_STATE_DIM, h};
+    float* h = batchAddRow(batch, measuredSweepAngle - predictedSweepAngle, stdDev);
 
     if (roth) {
       // Rotate back to global coordinate system
@@ -598,12 +840,10 @@ static void scalarUpdateForSweep(kalmanCoreData_t *this, float measuredSweepAngl
       h[KC_STATE_X] = hx;
       h[state_p] = hp;
     }
-
-    scalarUpdate(this, &H, measuredSweepAngle - predictedSweepAngle, stdDev);
   }
 }
 
-void kalmanCoreUpdateWithSweepAngles(kalmanCoreData_t *this, sweepAngleMeasurement_t *angles)
+static void addSweepAnglesToBatch(const kalmanCoreData_t *this, measurementBatch_t* batch, sweepAngleMeasurement_t *angles)
 {
     // Get rotation matrix and invert it (to get the global to local rotation matrix)
     arm_matrix_instance_f32 basestation_rotation_matrix = {3, 3, (float32_t *)angles->geometry.mat};
@@ -649,10 +889,154 @@ void kalmanCoreUpdateWithSweepAngles(kalmanCoreData_t *this, sweepAngleMeasureme
     float measuredSweepAngleVertical = angles->angleY;
 
 
-    scalarUpdateForSweep(this, measuredSweepAngleHorizontal, dy_rot, dx_rot, KC_STATE_Y, angles->stdDevX, &basestation_rotation_matrix);
-    scalarUpdateForSweep(this, measuredSweepAngleVertical, dz_rot, dx_rot, KC_STATE_Z, angles->stdDevY, &basestation_rotation_matrix);
+    addSweepToBatch(batch, measuredSweepAngleHorizontal, dy_rot, dx_rot, KC_STATE_Y, angles->stdDevX, &basestation_rotation_matrix);
+    addSweepToBatch(batch, measuredSweepAngleVertical, dz_rot, dx_rot, KC_STATE_Z, angles->stdDevY, &basestation_rotation_matrix);
 }
 
+void kalmanCoreUpdateWithSweepAngles(kalmanCoreData_t *this, sweepAngleMeasurement_t *angles)
+{
+  kalmanCoreUpdateWithSweepAnglesBatch(this, angles, 1);
+}
+
+void kalmanCoreUpdateWithSweepAnglesBatch(kalmanCoreData_t *this, sweepAngleMeasurement_t *angles, int count)
+{
+  batchReset(&batch);
+  for (int i=0; i<count; i++) {
+    if (batchRowsLeft(&batch) < 2) {
+      vectorUpdate(this, &batch);
+      batchReset(&batch);
+    }
+    addSweepAnglesToBatch(this, &batch, &angles[i]);
+  }
+  vectorUpdate(this, &batch);
+}
+
+
+#if defined(KALMAN_USE_DENSE_PREDICT) || defined(UNIT_TEST_MODE)
+TESTABLE_STATIC void predictCovarianceDense(kalmanCoreData_t* this, arm_matrix_instance_f32 *Am)
+{
+  // Temporary matrices for the covariance updates
+  static float tmpNN1d[KC_STATE_DIM * KC_STATE_DIM];
+  static arm_matrix_instance_f32 tmpNN1m = { KC_STATE_DIM, KC_STATE_DIM, tmpNN1d};
+
+  static float tmpNN2d[KC_STATE_DIM * KC_STATE_DIM];
+  static arm_matrix_instance_f32 tmpNN2m = { KC_STATE_DIM, KC_STATE_DIM, tmpNN2d};
+
+  mat_mult(Am, &this->Pm, &tmpNN1m); // A P
+  mat_trans(Am, &tmpNN2m); // A'
+  mat_mult(&tmpNN1m, &tmpNN2m, &this->Pm); // A P A'
+}
+#endif
+
+#if !defined(KALMAN_USE_DENSE_PREDICT) || defined(UNIT_TEST_MODE)
+// c[cr.., cc..] += a[ar.., ac..] * b[br.., bc..] for 3x3 blocks
+static void blockMultAdd(float c[][KC_STATE_DIM], int cr, int cc, const float a[][KC_STATE_DIM], int ar, int ac, const float b[][KC_STATE_DIM], int br, int bc)
+{
+  for (int i=0; i<3; i++) {
+    for (int j=0; j<3; j++) {
+      c[cr+i][cc+j] += a[ar+i][ac+0]*b[br+0][bc+j] + a[ar+i][ac+1]*b[br+1][bc+j] + a[ar+i][ac+2]*b[br+2][bc+j];
+    }
+  }
+}
+
+// c[cr.., cc..] += a[ar.., ac..] * b[br.., bc..]' for 3x3 blocks
+static void blockMultTransAdd(float c[][KC_STATE_DIM], int cr, int cc, const float a[][KC_STATE_DIM], int ar, int ac, const float b[][KC_STATE_DIM], int br, int bc)
+{
+  for (int i=0; i<3; i++) {
+    for (int j=0; j<3; j++) {
+      c[cr+i][cc+j] += a[ar+i][ac+0]*b[br+j][bc+0] + a[ar+i][ac+1]*b[br+j][bc+1] + a[ar+i][ac+2]*b[br+j][bc+2];
+    }
+  }
+}
+
+// c[cr.., cc..] = a[ar.., ac..] for 3x3 blocks
+static void blockCopy(float c[][KC_STATE_DIM], int cr, int cc, const float a[][KC_STATE_DIM], int ar, int ac)
+{
+  for (int i=0; i<3; i++) {
+    for (int j=0; j<3; j++) {
+      c[cr+i][cc+j] = a[ar+i][ac+j];
+    }
+  }
+}
+
+// c[cr.., cc..] = 0 for 3x3 blocks
+static void blockZero(float c[][KC_STATE_DIM], int cr, int cc)
+{
+  for (int i=0; i<3; i++) {
+    for (int j=0; j<3; j++) {
+      c[cr+i][cc+j] = 0;
+    }
+  }
+}
+
+/**
+ * Computes P = A P A' using the block structure of the linearized dynamics
+ *
+ *       | I  Axv Axd |
+ *   A = | 0  Avv Avd |
+ *       | 0  0   Add |
+ *
+ * where the blocks are 3x3 and the block rows/columns are position (X), body velocity (V) and attitude error (D).
+ * Only the upper blocks of A P A' are computed, the lower blocks are mirrored since P is symmetric.
+ */
+TESTABLE_STATIC void predictCovarianceBlock(kalmanCoreData_t* this, const float A[][KC_STATE_DIM])
+{
+  const int X = KC_STATE_X;
+  const int V = KC_STATE_PX;
+  const int D = KC_STATE_D0;
+
+  // The needed (upper) blocks of A P
+  static float AP[KC_STATE_DIM][KC_STATE_DIM];
+
+  // AP_xx = P_xx + Axv P_vx + Axd P_dx, and likewise for the xv and xd blocks
+  for (int c=X; c<KC_STATE_DIM; c+=3) {
+    blockCopy(AP, X, c, this->P, X, c);
+    blockMultAdd(AP, X, c, A, X, V, this->P, V, c);
+    blockMultAdd(AP, X, c, A, X, D, this->P, D, c);
+  }
+
+  // AP_vv = Avv P_vv + Avd P_dv, and likewise for the vd block
+  for (int c=V; c<KC_STATE_DIM; c+=3) {
+    blockZero(AP, V, c);
+    blockMultAdd(AP, V, c, A, V, V, this->P, V, c);
+    blockMultAdd(AP, V, c, A, V, D, this->P, D, c);
+  }
+
+  // AP_dd = Add P_dd
+  blockZero(AP, D, D);
+  blockMultAdd(AP, D, D, A, D, D, this->P, D, D);
+
+  // (A P) A', the upper blocks only
+  blockCopy(this->P, X, X, AP, X, X);
+  blockMultTransAdd(this->P, X, X, AP, X, V, A, X, V);
+  blockMultTransAdd(this->P, X, X, AP, X, D, A, X, D);
+
+  blockZero(this->P, X, V);
+  blockMultTransAdd(this->P, X, V, AP, X, V, A, V, V);
+  blockMultTransAdd(this->P, X, V, AP, X, D, A, V, D);
+
+  blockZero(this->P, X, D);
+  blockMultTransAdd(this->P, X, D, AP, X, D, A, D, D);
+
+  blockZero(this->P, V, V);
+  blockMultTransAdd(this->P, V, V, AP, V, V, A, V, V);
+  blockMultTransAdd(this->P, V, V, AP, V, D, A, V, D);
+
+  blockZero(this->P, V, D);
+  blockMultTransAdd(this->P, V, D, AP, V, D, A, D, D);
+
+  blockZero(this->P, D, D);
+  blockMultTransAdd(this->P, D, D, AP, D, D, A, D, D);
+
+  // Mirror the upper triangle
+  for (int i=0; i<KC_STATE_DIM; i++) {
+    for (int j=i+1; j<KC_STATE_DIM; j++) {
+      this->P[j][i] = this->P[i][j];
+    }
+  }
+}
+#endif
+
 void kalmanCorePredict(kalmanCoreData_t* this, float cmdThrust, Axis3f *acc, Axis3f *gyro, float dt, bool quadIsFlying)
 {
   /* Here we discretize (euler forward) and linearise the quadrocopter dynamics in order
@@ -678,14 +1062,9 @@ void kalmanCorePredict(kalmanCoreData_t* this, float cmdThrust, Axis3f *acc, Axi
 
   // The linearized update matrix
   static float A[KC_STATE_DIM][KC_STATE_DIM];
+#ifdef KALMAN_USE_DENSE_PREDICT
   static arm_matrix_instance_f32 Am = { KC_STATE_DIM, KC_STATE_DIM, (float *)A}; // linearized dynamics for covariance update;
-
-  // Temporary matrices for the covariance updates
-  static float tmpNN1d[KC_STATE_DIM * KC_STATE_DIM];
-  static arm_matrix_instance_f32 tmpNN1m = { KC_STATE_DIM, KC_STATE_DIM, tmpNN1d};
-
-  static float tmpNN2d[KC_STATE_DIM * KC_STATE_DIM];
-  static arm_matrix_instance_f32 tmpNN2m = { KC_STATE_DIM, KC_STATE_DIM, tmpNN2d};
+#endif
 
   float dt2 = dt*dt;
 
@@ -789,9 +1168,11 @@ void kalmanCorePredict(kalmanCoreData_t* this, float cmdThrust, Axis3f *acc, Axi
 
 
   // ====== COVARIANCE UPDATE ======
-  mat_mult(&Am, &this->Pm, &tmpNN1m); // A P
-  mat_trans(&Am, &tmpNN2m); // A'
-  mat_mult(&tmpNN1m, &tmpNN2m, &this->Pm); // A P A'
+#ifdef KALMAN_USE_DENSE_PREDICT
+  predictCovarianceDense(this, &Am); // A P A'
+#else
+  predictCovarianceBlock(this, A); // A P A'
+#endif
   // Process noise is added after the return from the prediction step
 
   // ====== PREDICTION STEP ======
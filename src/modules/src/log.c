@@ -42,6 +42,8 @@
 #include "crtp.h"
 #include "log.h"
 #include "crc.h"
+#include "tocIndex.h"
+#include "log_delta.h"
 #include "worker.h"
 #include "num.h"
 
@@ -82,18 +84,36 @@ typedef enum {
 /* Log packet parameters storage */
 #define LOG_MAX_OPS 128
 #define LOG_MAX_BLOCKS 16
+
+// Maximum number of variables in a delta block, one bit per variable in the changed mask
+#define LOG_MAX_DELTA_SLOTS 32
+// Number of runs between two full updates of a delta block, if not given by the client
+#define LOG_DEFAULT_KEYFRAME_PERIOD 10
+
+typedef enum {
+  blockType_full = 0,
+  blockType_delta = 1,
+} blockType_t;
+
 struct log_ops {
   struct log_ops * next;
   uint8_t storageType : 4;
   uint8_t logType     : 4;
   void * variable;
   acquisitionType_t acquisitionType;
+  uint32_t lastValue; // Last value sent, in log type encoding (delta blocks only)
 };
 
 struct log_block {
   int id;
   xTimerHandle timer;
   struct log_ops * ops;
+  blockType_t type;
+  // Delta blocks only
+  uint8_t keyframePeriod;
+  uint8_t runsToKeyframe;
+  uint32_t pendingSlots;
+  uint8_t nextSlot;
 };
 
 static struct log_ops logOps[LOG_MAX_OPS];
@@ -128,6 +148,7 @@ struct ops_setting_v2 {
 #define CONTROL_RESET           5
 #define CONTROL_CREATE_BLOCK_V2 6
 #define CONTROL_APPEND_BLOCK_V2 7
+#define CONTROL_CREATE_DELTA_BLOCK 8 // like v2, with keyframe period, see logRunDeltaBlock()
 
 #define BLOCK_ID_FREE -1
 
@@ -149,6 +170,9 @@ static int logsLen;
 static uint32_t logsCrc;
 static uint16_t logsCount = 0;
 
+// Index of the TOC, built at init to avoid linear scans
+static tocIndex_t tocIndex;
+
 static CRTPPacket p;
 
 static bool isInit = false;
@@ -158,11 +182,13 @@ static int logAppendBlock(int id, struct ops_setting * settings, int len);
 static int logAppendBlockV2(int id, struct ops_setting_v2 * settings, int len);
 static int logCreateBlock(unsigned char id, struct ops_setting * settings, int len);
 static int logCreateBlockV2(unsigned char id, struct ops_setting_v2 * settings, int len);
+static int logCreateDeltaBlock(unsigned char id, uint8_t keyframePeriod, struct ops_setting_v2 * settings, int len);
 static int logDeleteBlock(int id);
 static int logStartBlock(int id, unsigned int period);
 static int logStopBlock(int id);
 static void logReset();
 static acquisitionType_t acquisitionTypeFromLogType(uint8_t logType);
+static tocIndexEntryType_t getTocEntry(const int index, char** name);
 
 void logInit(void)
 {
@@ -212,6 +238,9 @@ void logInit(void)
       logsCount++;
   }
 
+  tocIndexInit(&tocIndex, getTocEntry, logsLen, logsCount);
+  DEBUG_PRINT("TOC index of %d log variables uses %d bytes\n", logsCount, (int)(logsCount * TOC_INDEX_BYTES_PER_VARIABLE));
+
   //Manually free all log blocks
   for(i=0; i<LOG_MAX_BLOCKS; i++)
     logBlocks[i].id = BLOCK_ID_FREE;
@@ -408,6 +437,11 @@ void logControlProcess()
                             (struct ops_setting_v2*)&p.data[2],
                             (p.size-2)/sizeof(struct ops_setting_v2) );
       break;
+    case CONTROL_CREATE_DELTA_BLOCK:
+      ret = logCreateDeltaBlock( p.data[1], p.data[2],
+                            (struct ops_setting_v2*)&p.data[3],
+                            (p.size-3)/sizeof(struct ops_setting_v2) );
+      break;
   }
 
   //Commands answer
@@ -433,6 +467,7 @@ static int logCreateBlock(unsigned char id, struct ops_setting * settings, int l
   logBlocks[i].timer = xTimerCreate( "logTimer", M2T(1000),
                                      pdTRUE, &logBlocks[i], logBlockTimed );
   logBlocks[i].ops = NULL;
+  logBlocks[i].type = blockType_full;
 
   if (logBlocks[i].timer == NULL)
   {
@@ -462,6 +497,7 @@ static int logCreateBlockV2(unsigned char id, struct ops_setting_v2 * settings,
   logBlocks[i].timer = xTimerCreate( "logTimer", M2T(1000),
                                      pdTRUE, &logBlocks[i], logBlockTimed );
   logBlocks[i].ops = NULL;
+  logBlocks[i].type = blockType_full;
 
   if (logBlocks[i].timer == NULL)
   {
@@ -474,7 +510,35 @@ static int logCreateBlockV2(unsigned char id, struct ops_setting_v2 * settings,
   return logAppendBlockV2(id, settings, len);
 }
 
+static int logCreateDeltaBlock(unsigned char id, uint8_t keyframePeriod, struct ops_setting_v2 * settings, int len)
+{
+  int i;
+
+  for (i=0; i<LOG_MAX_BLOCKS; i++)
+    if (id == logBlocks[i].id) break;
+
+  if (i < LOG_MAX_BLOCKS)
+    return EEXIST;
+
+  int ret = logCreateBlockV2(id, NULL, 0);
+  if (ret != 0)
+    return ret;
+
+  for (i=0; i<LOG_MAX_BLOCKS; i++)
+    if (id == logBlocks[i].id) break;
+
+  logBlocks[i].type = blockType_delta;
+  logBlocks[i].keyframePeriod = keyframePeriod ? keyframePeriod : LOG_DEFAULT_KEYFRAME_PERIOD;
+  logBlocks[i].runsToKeyframe = 0;
+  logBlocks[i].pendingSlots = 0;
+  logBlocks[i].nextSlot = 0;
+
+  return logAppendBlockV2(id, settings, len);
+}
+
 static int blockCalcLength(struct log_block * block);
+static int blockCalcSlots(struct log_block * block);
+static bool blockIsFull(struct log_block * block, uint8_t logType);
 static struct log_ops * opsMalloc();
 static void opsFree(struct log_ops * ops);
 static void blockAppendOps(struct log_block * block, struct log_ops * ops);
@@ -499,11 +563,10 @@ static int logAppendBlock(int id, struct ops_setting * settings, int len)
 
   for (i=0; i<len; i++)
   {
-    int currentLength = blockCalcLength(block);
     struct log_ops * ops;
     int varId;
 
-    if ((currentLength + typeLength[settings[i].logType & TYPE_MASK])>LOG_MAX_LEN) {
+    if (blockIsFull(block, settings[i].logType & TYPE_MASK)) {
       LOG_ERROR("Trying to append a full block. Block id %d.\n", id);
       return E2BIG;
     }
@@ -567,11 +630,10 @@ static int logAppendBlockV2(int id, struct ops_setting_v2 * settings, int len)
 
   for (i=0; i<len; i++)
   {
-    int currentLength = blockCalcLength(block);
     struct log_ops * ops;
     int varId;
 
-    if ((currentLength + typeLength[settings[i].logType & TYPE_MASK])>LOG_MAX_LEN) {
+    if (blockIsFull(block, settings[i].logType & TYPE_MASK)) {
       LOG_ERROR("Trying to append a full block. Block id %d.\n", id);
       return E2BIG;
     }
@@ -662,6 +724,10 @@ static int logStartBlock(int id, unsigned int period)
 
   LOG_DEBUG("Starting block %d with period %dms\n", id, period);
 
+  // Delta blocks start with a full update
+  logBlocks[i].runsToKeyframe = 0;
+  logBlocks[i].nextSlot = 0;
+
   if (period>0)
   {
     xTimerChangePeriod(logBlocks[i].timer, M2T(period), 100);
@@ -708,6 +774,196 @@ static bool appendToPacket(CRTPPacket * pk, const void * data, size_t n) {
   else return false;
 }
 
+/*
+ * Reads the value of a variable and encodes it in its log type.
+ * Returns the length of the encoded value.
+ */
+static int opsEncodeValue(struct log_ops * ops, unsigned int timestamp, void * buffer)
+{
+  int valuei = 0;
+  float valuef = 0;
+
+  // FPU instructions must run on aligned data.
+  // We first copy the data to an (aligned) local variable, before assigning it
+  switch(ops->storageType)
+  {
+    case LOG_UINT8:
+    {
+      uint8_t v;
+      if (ops->acquisitionType == acqType_function) {
+        logByFunction_t* logByFunction = (logByFunction_t*)ops->variable;
+        v = logByFunction->acquireUInt8(timestamp, logByFunction->data);
+      } else {
+        memcpy(&v, ops->variable, sizeof(v));
+      }
+      valuei = v;
+      break;
+    }
+    case LOG_INT8:
+    {
+      int8_t v;
+      if (ops->acquisitionType == acqType_function) {
+        logByFunction_t* logByFunction = (logByFunction_t*)ops->variable;
+        v = logByFunction->acquireInt8(timestamp, logByFunction->data);
+      } else {
+        memcpy(&v, ops->variable, sizeof(v));
+      }
+      valuei = v;
+      break;
+    }
+    case LOG_UINT16:
+    {
+      uint16_t v;
+      if (ops->acquisitionType == acqType_function) {
+        logByFunction_t* logByFunction = (logByFunction_t*)ops->variable;
+        v = logByFunction->acquireUInt16(timestamp, logByFunction->data);
+      } else {
+        memcpy(&v, ops->variable, sizeof(v));
+      }
+      valuei = v;
+      break;
+    }
+    case LOG_INT16:
+    {
+      int16_t v;
+      if (ops->acquisitionType == acqType_function) {
+        logByFunction_t* logByFunction = (logByFunction_t*)ops->variable;
+        v = logByFunction->acquireInt16(timestamp, logByFunction->data);
+      } else {
+        memcpy(&v, ops->variable, sizeof(v));
+      }
+      valuei = v;
+      break;
+    }
+    case LOG_UINT32:
+    {
+      uint32_t v;
+      if (ops->acquisitionType == acqType_function) {
+        logByFunction_t* logByFunction = (logByFunction_t*)ops->variable;
+        v = logByFunction->acquireUInt32(timestamp, logByFunction->data);
+      } else {
+        memcpy(&v, ops->variable, sizeof(v));
+      }
+      valuei = v;
+      break;
+    }
+    case LOG_INT32:
+    {
+      int32_t v;
+      if (ops->acquisitionType == acqType_function) {
+        logByFunction_t* logByFunction = (logByFunction_t*)ops->variable;
+        v = logByFunction->acquireInt32(timestamp, logByFunction->data);
+      } else {
+        memcpy(&v, ops->variable, sizeof(v));
+      }
+      valuei = v;
+      break;
+    }
+    case LOG_FLOAT:
+    {
+      float v;
+      if (ops->acquisitionType == acqType_function) {
+        logByFunction_t* logByFunction = (logByFunction_t*)ops->variable;
+        v = logByFunction->aquireFloat(timestamp, logByFunction->data);
+      } else {
+        memcpy(&v, ops->variable, sizeof(valuef));
+      }
+      valuei = v;
+      valuef = v;
+      break;
+    }
+  }
+
+  if (ops->logType == LOG_FLOAT || ops->logType == LOG_FP16)
+  {
+    if (ops->storageType != LOG_FLOAT)
+    {
+      valuef = valuei;
+    }
+
+    if (ops->logType == LOG_FLOAT)
+    {
+      memcpy(buffer, &valuef, 4);
+      return 4;
+    }
+    else
+    {
+      valuei = single2half(valuef);
+      memcpy(buffer, &valuei, 2);
+      return 2;
+    }
+  }
+  else  //logType is an integer
+  {
+    memcpy(buffer, &valuei, typeLength[ops->logType]);
+    return typeLength[ops->logType];
+  }
+}
+
+/*
+ * Fills the packet of a delta block. After the block id and timestamp, the packet
+ * holds a mask with one bit per variable of the block, in block order (bit 0 of the
+ * first byte is the first variable), followed by the values of the variables with
+ * their bit set, in block order.
+ *
+ * A variable is sent when its value has changed since it was last sent. Every
+ * keyframePeriod runs, all variables are sent again. Variables that do not fit in the
+ * packet are sent in the following runs, the pending variables are picked round-robin
+ * so that all of them are sent even if some change on every run.
+ *
+ * Returns false if there is nothing to send.
+ */
+static bool logRunDeltaBlock(struct log_block * blk, unsigned int timestamp, CRTPPacket * pk)
+{
+  // Only used with the log lock taken
+  static uint32_t values[LOG_MAX_DELTA_SLOTS];
+  static uint8_t lengths[LOG_MAX_DELTA_SLOTS];
+
+  struct log_ops * ops;
+  int slots = blockCalcSlots(blk);
+  int maskLength = (slots + 7) / 8;
+  uint8_t * mask = &pk->data[pk->size];
+  bool hasData = false;
+  int slot;
+
+  memset(mask, 0, maskLength);
+  pk->size += maskLength;
+
+  if (blk->runsToKeyframe == 0)
+  {
+    blk->pendingSlots = 0xFFFFFFFFul;
+    blk->runsToKeyframe = blk->keyframePeriod;
+  }
+  blk->runsToKeyframe--;
+
+  for (ops = blk->ops, slot = 0; ops; ops = ops->next, slot++)
+  {
+    values[slot] = 0;
+    lengths[slot] = opsEncodeValue(ops, timestamp, &values[slot]);
+
+    if (values[slot] != ops->lastValue)
+      blk->pendingSlots |= 1ul << slot;
+  }
+
+  uint32_t selectedSlots = logDeltaSelectSlots(blk->pendingSlots, lengths, slots, CRTP_MAX_DATA_SIZE - pk->size, &blk->nextSlot);
+
+  // The values are always in block order in the packet
+  for (ops = blk->ops, slot = 0; ops; ops = ops->next, slot++)
+  {
+    uint32_t slotBit = 1ul << slot;
+
+    if ((selectedSlots & slotBit) && appendToPacket(pk, &values[slot], lengths[slot]))
+    {
+      mask[slot / 8] |= 1 << (slot % 8);
+      blk->pendingSlots &= ~slotBit;
+      ops->lastValue = values[slot];
+      hasData = true;
+    }
+  }
+
+  return hasData;
+}
+
 /* This function is usually called by the worker subsystem */
 void logRunBlock(void * arg)
 {
@@ -715,6 +971,7 @@ void logRunBlock(void * arg)
   struct log_ops *ops = blk->ops;
   static CRTPPacket pk;
   unsigned int timestamp;
+  bool hasData = true;
 
   xSemaphoreTake(logLock, portMAX_DELAY);
 
@@ -727,127 +984,23 @@ void logRunBlock(void * arg)
   pk.data[2] = (timestamp>>8)&0x0ff;
   pk.data[3] = (timestamp>>16)&0x0ff;
 
-  while (ops)
+  if (blk->type == blockType_delta)
   {
-    int valuei = 0;
-    float valuef = 0;
-
-    // FPU instructions must run on aligned data.
-    // We first copy the data to an (aligned) local variable, before assigning it
-    switch(ops->storageType)
-    {
-      case LOG_UINT8:
-      {
-        uint8_t v;
-        if (ops->acquisitionType == acqType_function) {
-          logByFunction_t* logByFunction = (logByFunction_t*)ops->variable;
-          v = logByFunction->acquireUInt8(timestamp, logByFunction->data);
-        } else {
-          memcpy(&v, ops->variable, sizeof(v));
-        }
-        valuei = v;
-        break;
-      }
-      case LOG_INT8:
-      {
-        int8_t v;
-        if (ops->acquisitionType == acqType_function) {
-          logByFunction_t* logByFunction = (logByFunction_t*)ops->variable;
-          v = logByFunction->acquireInt8(timestamp, logByFunction->data);
-        } else {
-          memcpy(&v, ops->variable, sizeof(v));
-        }
-        valuei = v;
-        break;
-      }
-      case LOG_UINT16:
-      {
-        uint16_t v;
-        if (ops->acquisitionType == acqType_function) {
-          logByFunction_t* logByFunction = (logByFunction_t*)ops->variable;
-          v = logByFunction->acquireUInt16(timestamp, logByFunction->data);
-        } else {
-          memcpy(&v, ops->variable, sizeof(v));
-        }
-        valuei = v;
-        break;
-      }
-      case LOG_INT16:
-      {
-        int16_t v;
-        if (ops->acquisitionType == acqType_function) {
-          logByFunction_t* logByFunction = (logByFunction_t*)ops->variable;
-          v = logByFunction->acquireInt16(timestamp, logByFunction->data);
-        } else {
-          memcpy(&v, ops->variable, sizeof(v));
-        }
-        valuei = v;
-        break;
-      }
-      case LOG_UINT32:
-      {
-        uint32_t v;
-        if (ops->acquisitionType == acqType_function) {
-          logByFunction_t* logByFunction = (logByFunction_t*)ops->variable;
-          v = logByFunction->acquireUInt32(timestamp, logByFunction->data);
-        } else {
-          memcpy(&v, ops->variable, sizeof(v));
-        }
-        valuei = v;
-        break;
-      }
-      case LOG_INT32:
-      {
-        int32_t v;
-        if (ops->acquisitionType == acqType_function) {
-          logByFunction_t* logByFunction = (logByFunction_t*)ops->variable;
-          v = logByFunction->acquireInt32(timestamp, logByFunction->data);
-        } else {
-          memcpy(&v, ops->variable, sizeof(v));
-        }
-        valuei = v;
-        break;
-      }
-      case LOG_FLOAT:
-      {
-        float v;
-        if (ops->acquisitionType == acqType_function) {
-          logByFunction_t* logByFunction = (logByFunction_t*)ops->variable;
-          v = logByFunction->aquireFloat(timestamp, logByFunction->data);
-        } else {
-          memcpy(&v, ops->variable, sizeof(valuef));
-        }
-        valuei = v;
-        valuef = v;
-        break;
-      }
-    }
-
-    if (ops->logType == LOG_FLOAT || ops->logType == LOG_FP16)
+    hasData = logRunDeltaBlock(blk, timestamp, &pk);
+  }
+  else
+  {
+    while (ops)
     {
-      if (ops->storageType != LOG_FLOAT)
-      {
-        valuef = valuei;
-      }
+      uint32_t value;
+      int length = opsEncodeValue(ops, timestamp, &value);
 
       // Try to append the next item to the packet.  If we run out of space,
       // drop this and subsequent items.
-      if (ops->logType == LOG_FLOAT)
-      {
-        if (!appendToPacket(&pk, &valuef, 4)) break;
-      }
-      else
-      {
-        valuei = single2half(valuef);
-        if (!appendToPacket(&pk, &valuei, 2)) break;
-      }
-    }
-    else  //logType is an integer
-    {
-      if (!appendToPacket(&pk, &valuei, typeLength[ops->logType])) break;
-    }
+      if (!appendToPacket(&pk, &value, length)) break;
 
-    ops = ops->next;
+      ops = ops->next;
+    }
   }
 
   xSemaphoreGive(logLock);
@@ -859,7 +1012,7 @@ void logRunBlock(void * arg)
     logReset();
     crtpReset();
   }
-  else
+  else if (hasData)
   {
     crtpSendPacket(&pk);
   }
@@ -867,23 +1020,21 @@ void logRunBlock(void * arg)
 
 static int variableGetIndex(int id)
 {
-  int i;
-  int n=0;
+  return tocIndexGetTocIndex(&tocIndex, id);
+}
 
-  for (i=0; i<logsLen; i++)
-  {
-    if(!(logs[i].type & LOG_GROUP))
-    {
-      if(n==id)
-        break;
-      n++;
-    }
-  }
+static tocIndexEntryType_t getTocEntry(const int index, char** name)
+{
+  *name = logs[index].name;
 
-  if (i>=logsLen)
-    return -1;
+  if (logs[index].type & LOG_GROUP) {
+    if (logs[index].type & LOG_START)
+      return tocIndexEntryGroupStart;
+    else
+      return tocIndexEntryGroupStop;
+  }
 
-  return i;
+  return tocIndexEntryVariable;
 }
 
 static struct log_ops * opsMalloc()
@@ -915,6 +1066,28 @@ static int blockCalcLength(struct log_block * block)
   return len;
 }
 
+static int blockCalcSlots(struct log_block * block)
+{
+  struct log_ops * ops;
+  int slots = 0;
+
+  for (ops = block->ops; ops; ops = ops->next)
+    slots++;
+
+  return slots;
+}
+
+static bool blockIsFull(struct log_block * block, uint8_t logType)
+{
+  if (block->type == blockType_delta) {
+    // Values are sent over several packets if needed, each value must fit in a packet with the mask
+    int slots = blockCalcSlots(block) + 1;
+    return slots > LOG_MAX_DELTA_SLOTS || (slots + 7) / 8 + typeLength[logType] > LOG_MAX_LEN;
+  }
+
+  return (blockCalcLength(block) + typeLength[logType]) > LOG_MAX_LEN;
+}
+
 void blockAppendOps(struct log_block * block, struct log_ops * ops)
 {
   struct log_ops * o;
@@ -958,19 +1131,7 @@ static void logReset(void)
 /* Public API to access log TOC from within the copter */
 int logGetVarId(char* group, char* name)
 {
-  int i;
-  char * currgroup = "";
-
-  for(i=0; i<logsLen; i++)
-  {
-    if (logs[i].type & LOG_GROUP) {
-      if (logs[i].type & LOG_START)
-        currgroup = logs[i].name;
-    } if ((!strcmp(group, currgroup)) && (!strcmp(name, logs[i].name)))
-      return i;
-  }
-
-  return -1;
+  return tocIndexFindByName(&tocIndex, group, name);
 }
 
 int logGetType(int varid)
@@ -980,22 +1141,12 @@ int logGetType(int varid)
 
 void logGetGroupAndName(int varid, char** group, char** name)
 {
-  char * currgroup = "";
   *group = 0;
   *name = 0;
 
-  for(int i=0; i<logsLen; i++) {
-    if (logs[i].type & LOG_GROUP) {
-      if (logs[i].type & LOG_START) {
-        currgroup = logs[i].name;
-      }
-    }
-
-    if (i == varid) {
-      *group = currgroup;
-      *name = logs[i].name;
-      break;
-    }
+  if (varid >= 0 && varid < logsLen) {
+    *group = tocIndexGetGroupName(&tocIndex, varid);
+    *name = logs[varid].name;
   }
 }
 
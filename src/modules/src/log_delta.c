@@ -0,0 +1,61 @@
+/**
+ * ,---------,       ____  _ __
+ * |  ,-^-,  |      / __ )(_) /_______________ _____  ___
+ * | (  O  ) |     / __  / / __/ ___/ ___/ __ `/_  / / _ \
+ * | / ,--´  |    / /_/ / / /_/ /__/ /  / /_/ / / /_/  __/
+ *    +------`   /_____/_/\__/\___/_/   \__,_/ /___/\___/
+ *
+ * Crazyflie control firmware
+ *
+ * Copyright (C) 2019 Bitcraze AB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, in version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ * log_delta.c - Scheduling of the values of delta log blocks over packets.
+ */
+
+#include "log_delta.h"
+
+uint32_t logDeltaSelectSlots(const uint32_t pendingSlots, const uint8_t lengths[], const int slots, int space, uint8_t* nextSlot)
+{
+  uint32_t selected = 0;
+  int firstSkipped = -1;
+  int start = (*nextSlot < slots) ? *nextSlot : 0;
+
+  for (int i = 0; i < slots; i++)
+  {
+    int slot = (start + i) % slots;
+    uint32_t slotBit = 1ul << slot;
+
+    if (pendingSlots & slotBit)
+    {
+      if (lengths[slot] <= space)
+      {
+        selected |= slotBit;
+        space -= lengths[slot];
+      }
+      else if (firstSkipped < 0)
+      {
+        firstSkipped = slot;
+      }
+    }
+  }
+
+  // The first value that did not fit goes first in the next run
+  if (firstSkipped >= 0)
+    *nextSlot = firstSkipped;
+
+  return selected;
+}
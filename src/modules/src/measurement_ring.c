@@ -0,0 +1,119 @@
+/**
+ * ,---------,       ____  _ __
+ * |  ,-^-,  |      / __ )(_) /_______________ _____  ___
+ * | (  O  ) |     / __  / / __/ ___/ ___/ __ `/_  / / _ \
+ * | / ,--´  |    / /_/ / / /_/ /__/ /  / /_/ / / /_/  __/
+ *    +------`   /_____/_/\__/\___/_/   \__,_/ /___/\___/
+ *
+ * Crazyflie control firmware
+ *
+ * Copyright (C) 2019 Bitcraze AB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, in version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ * measurement_ring.c - Lock free ring buffer carrying measurements of all types
+ * to the estimator, in the order they arrived.
+ *
+ * The implementation is a bounded multi producer queue where each slot holds a
+ * sequence number that tells whether it is free to write or ready to read.
+ * Producers reserve a slot by atomically advancing the head, and publish the
+ * slot by updating its sequence number once the data is written. A producer
+ * that is interrupted between the two steps only delays the consumer, it never
+ * blocks other producers.
+ */
+
+#include <string.h>
+#include "measurement_ring.h"
+
+#define RING_MASK (MEASUREMENT_RING_SIZE - 1)
+
+_Static_assert((MEASUREMENT_RING_SIZE & RING_MASK) == 0, "MEASUREMENT_RING_SIZE must be a power of 2");
+
+void measurementRingInit(measurementRing_t* ring) {
+  for (uint32_t i = 0; i < MEASUREMENT_RING_SIZE; i++) {
+    ring->slots[i].sequence = i;
+  }
+
+  ring->head = 0;
+  ring->tail = 0;
+  memset(ring->dropCount, 0, sizeof(ring->dropCount));
+}
+
+bool measurementRingPut(measurementRing_t* ring, const measurement_t* measurement) {
+  measurementRingSlot_t* slot;
+  uint32_t pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+  while (true) {
+    slot = &ring->slots[pos & RING_MASK];
+    uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    int32_t diff = (int32_t)(sequence - pos);
+
+    if (diff == 0) {
+      // The slot is free, try to reserve it. On failure pos is updated to the current head.
+      if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // The slot still holds a measurement from the previous lap, the ring is full
+      if (measurement->type < MeasurementTypeCount) {
+        __atomic_fetch_add(&ring->dropCount[measurement->type], 1, __ATOMIC_RELAXED);
+      }
+      return false;
+    } else {
+      // Another producer reserved the slot, try again with the new head
+      pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    }
+  }
+
+  memcpy(&slot->measurement, measurement, sizeof(measurement_t));
+  __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+
+  return true;
+}
+
+static bool isSlotReady(const measurementRing_t* ring, const measurementRingSlot_t* slot) {
+  uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+  return sequence == ring->tail + 1;
+}
+
+bool measurementRingGet(measurementRing_t* ring, measurement_t* measurement) {
+  measurementRingSlot_t* slot = &ring->slots[ring->tail & RING_MASK];
+
+  if (!isSlotReady(ring, slot)) {
+    return false;
+  }
+
+  memcpy(measurement, &slot->measurement, sizeof(measurement_t));
+
+  // Hand the slot back to the producers, for the next lap
+  __atomic_store_n(&slot->sequence, ring->tail + MEASUREMENT_RING_SIZE, __ATOMIC_RELEASE);
+  ring->tail++;
+
+  return true;
+}
+
+bool measurementRingIsEmpty(const measurementRing_t* ring) {
+  return !isSlotReady(ring, &ring->slots[ring->tail & RING_MASK]);
+}
+
+void measurementRingFlush(measurementRing_t* ring) {
+  measurementRingSlot_t* slot = &ring->slots[ring->tail & RING_MASK];
+
+  while (isSlotReady(ring, slot)) {
+    __atomic_store_n(&slot->sequence, ring->tail + MEASUREMENT_RING_SIZE, __ATOMIC_RELEASE);
+    ring->tail++;
+    slot = &ring->slots[ring->tail & RING_MASK];
+  }
+}
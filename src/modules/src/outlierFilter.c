@@ -102,7 +102,14 @@ bool outlierFilterValidateTdoaSteps(const tdoaMeasurement_t* tdoa, const float e
 }
 
 void outlierFilterReset() {
-  // Nothing here
+  for (int i = 0; i < FILTER_LEVELS; i++) {
+    filterLevels[i].bucket = 0;
+  }
+
+  acceptanceLevel = 0.0;
+  errorDistance = 0.0;
+  filterCloseDelayCounter = 0;
+  previousFilterIndex = 0;
 }
 
 static bool isDistanceDiffSmallerThanDistanceBetweenAnchors(const tdoaMeasurement_t* tdoa) {
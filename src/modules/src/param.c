@@ -34,6 +34,7 @@
 #include "crtp.h"
 #include "param.h"
 #include "crc.h"
+#include "tocIndex.h"
 #include "console.h"
 #include "debug.h"
 
@@ -84,6 +85,7 @@ extern struct param_s _param_stop;
 static void paramWriteProcess();
 static void paramReadProcess();
 static int variableGetIndex(int id);
+static tocIndexEntryType_t getTocEntry(const int index, char** name);
 static char paramWriteByNameProcess(char* group, char* name, int type, void *valptr);
 
 //Pointer to the parameters list and length of it
@@ -91,6 +93,10 @@ static struct param_s * params;
 static int paramsLen;
 static uint32_t paramsCrc;
 static uint16_t paramsCount = 0;
+
+// Index of the TOC, built at init to avoid linear scans
+static tocIndex_t tocIndex;
+
 // indicates if read/write operation use V2 (i.e., 16-bit index)
 // This is set to true, if a client uses TOC_CH in V2
 static bool useV2 = false;
@@ -145,6 +151,9 @@ void paramInit(void)
       paramsCount++;
   }
 
+  tocIndexInit(&tocIndex, getTocEntry, paramsLen, paramsCount);
+  DEBUG_PRINT("TOC index of %d parameters uses %d bytes\n", paramsCount, (int)(paramsCount * TOC_INDEX_BYTES_PER_VARIABLE));
+
 
   //Start the param task
 	xTaskCreate(paramTask, PARAM_TASK_NAME,
@@ -396,26 +405,9 @@ static void paramWriteProcess()
 }
 
 static char paramWriteByNameProcess(char* group, char* name, int type, void *valptr) {
-  int ptr;
-  char *pgroup = "";
-
-  for (ptr=0; ptr<paramsLen; ptr++) //Ptr points a group
-  {
-    if (params[ptr].type & PARAM_GROUP)
-    {
-      if (params[ptr].type & PARAM_START)
-        pgroup = params[ptr].name;
-      else
-        pgroup = "";
-    }
-    else                          //Ptr points a variable
-    {
-      if (!strcmp(params[ptr].name, name) && !strcmp(pgroup, group))
-        break;
-    }
-  }
+  int ptr = tocIndexFindByName(&tocIndex, group, name);
 
-  if (ptr >= paramsLen) {
+  if (ptr < 0) {
     return ENOENT;
   }
 
@@ -523,41 +515,27 @@ static void paramReadProcess()
 
 static int variableGetIndex(int id)
 {
-  int i;
-  int n=0;
+  return tocIndexGetTocIndex(&tocIndex, id);
+}
 
-  for (i=0; i<paramsLen; i++)
-  {
-    if(!(params[i].type & PARAM_GROUP))
-    {
-      if(n==id)
-        break;
-      n++;
-    }
-  }
+static tocIndexEntryType_t getTocEntry(const int index, char** name)
+{
+  *name = params[index].name;
 
-  if (i>=paramsLen)
-    return -1;
+  if (params[index].type & PARAM_GROUP) {
+    if (params[index].type & PARAM_START)
+      return tocIndexEntryGroupStart;
+    else
+      return tocIndexEntryGroupStop;
+  }
 
-  return i;
+  return tocIndexEntryVariable;
 }
 
 /* Public API to access param TOC from within the copter */
 int paramGetVarId(char* group, char* name)
 {
-  int i;
-  char * currgroup = "";
-
-  for(i=0; i<paramsLen; i++)
-  {
-    if (params[i].type & PARAM_GROUP) {
-      if (params[i].type & PARAM_START)
-        currgroup = params[i].name;
-    } if ((!strcmp(group, currgroup)) && (!strcmp(name, params[i].name)))
-      return i;
-  }
-
-  return -1;
+  return tocIndexFindByName(&tocIndex, group, name);
 }
 
 int paramGetType(int varid)
@@ -567,22 +545,12 @@ int paramGetType(int varid)
 
 void paramGetGroupAndName(int varid, char** group, char** name)
 {
-  char * currgroup = "";
   *group = 0;
   *name = 0;
 
-  for(int i=0; i<paramsLen; i++) {
-    if (params[i].type & PARAM_GROUP) {
-      if (params[i].type & PARAM_START) {
-        currgroup = params[i].name;
-      }
-    }
-
-    if (i == varid) {
-      *group = currgroup;
-      *name = params[i].name;
-      break;
-    }
+  if (varid >= 0 && varid < paramsLen) {
+    *group = tocIndexGetGroupName(&tocIndex, varid);
+    *name = params[varid].name;
   }
 }
 
@@ -37,6 +37,7 @@
 #include "syslink.h"
 #include "version.h"
 #include "platform.h"
+#include "stabilizer_timing.h"
 
 static bool isInit=false;
 
@@ -47,6 +48,8 @@ typedef enum {
 
 typedef enum {
   setContinousWave   = 0x00,
+  getStabilizerTiming = 0x01,
+  getStabilizerTimingHistogram = 0x02,
 } PlatformCommand;
 
 typedef enum {
@@ -56,7 +59,7 @@ typedef enum {
 } VersionCommand;
 
 void platformserviceHandler(CRTPPacket *p);
-static void platformCommandProcess(uint8_t command, uint8_t *data);
+static void platformCommandProcess(CRTPPacket *p);
 static void versionCommandProcess(CRTPPacket *p);
 
 void platformserviceInit(void)
@@ -80,7 +83,7 @@ void platformserviceHandler(CRTPPacket *p)
   switch (p->channel)
   {
     case platformCommand:
-      platformCommandProcess(p->data[0], &p->data[1]);
+      platformCommandProcess(p);
       crtpSendPacket(p);
       break;
     case versionCommand:
@@ -90,8 +93,39 @@ void platformserviceHandler(CRTPPacket *p)
   }
 }
 
-static void platformCommandProcess(uint8_t command, uint8_t *data)
+#ifdef STABILIZER_STAGE_TIMING
+/**
+ * Request: command, stage (see stabilizer_timing.h)
+ * getStabilizerTiming answer: command, stage, min, max, mean (uint32, cycles)
+ * getStabilizerTimingHistogram answer: command, stage, histogram bins (uint32)
+ * The answer is only the command and 0xFF for an invalid stage.
+ */
+static void stabilizerTimingProcess(CRTPPacket *p)
 {
+  stabilizerTimingStats_t stats;
+
+  if (!stabilizerTimingGetStats(p->data[1], &stats)) {
+    p->data[1] = 0xFF;
+    p->size = 2;
+    return;
+  }
+
+  if (p->data[0] == getStabilizerTiming) {
+    memcpy(&p->data[2], &stats.min, sizeof(uint32_t));
+    memcpy(&p->data[6], &stats.max, sizeof(uint32_t));
+    memcpy(&p->data[10], &stats.mean, sizeof(uint32_t));
+    p->size = 14;
+  } else {
+    memcpy(&p->data[2], stats.histogram, sizeof(stats.histogram));
+    p->size = 2 + sizeof(stats.histogram);
+  }
+}
+#endif
+
+static void platformCommandProcess(CRTPPacket *p)
+{
+  uint8_t command = p->data[0];
+  uint8_t *data = &p->data[1];
   SyslinkPacket slp;
 
   switch (command) {
@@ -101,6 +135,12 @@ static void platformCommandProcess(uint8_t command, uint8_t *data)
       slp.data[0] = data[0];
       syslinkSendPacket(&slp);
       break;
+#ifdef STABILIZER_STAGE_TIMING
+    case getStabilizerTiming:
+    case getStabilizerTimingHistogram:
+      stabilizerTimingProcess(p);
+      break;
+#endif
     default:
       break;
   }
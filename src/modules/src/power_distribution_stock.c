@@ -33,6 +33,7 @@
 #include "num.h"
 #include "platform.h"
 #include "motors.h"
+#include "sensors_filter.h"
 #include "debug.h"
 
 static bool motorSetEnable = false;
@@ -73,6 +74,9 @@ void powerStop()
   motorsSetRatio(MOTOR_M2, 0);
   motorsSetRatio(MOTOR_M3, 0);
   motorsSetRatio(MOTOR_M4, 0);
+
+  const uint16_t ratios[SENSORS_FILTER_MOTORS] = {0};
+  sensorsFilterSetMotorRatios(ratios);
 }
 
 void powerDistribution(const control_t *control)
@@ -95,20 +99,29 @@ void powerDistribution(const control_t *control)
                                control->yaw);
   #endif
 
+  uint16_t ratios[SENSORS_FILTER_MOTORS];
   if (motorSetEnable)
   {
-    motorsSetRatio(MOTOR_M1, motorPowerSet.m1);
-    motorsSetRatio(MOTOR_M2, motorPowerSet.m2);
-    motorsSetRatio(MOTOR_M3, motorPowerSet.m3);
-    motorsSetRatio(MOTOR_M4, motorPowerSet.m4);
+    ratios[0] = motorPowerSet.m1;
+    ratios[1] = motorPowerSet.m2;
+    ratios[2] = motorPowerSet.m3;
+    ratios[3] = motorPowerSet.m4;
   }
   else
   {
-    motorsSetRatio(MOTOR_M1, motorPower.m1);
-    motorsSetRatio(MOTOR_M2, motorPower.m2);
-    motorsSetRatio(MOTOR_M3, motorPower.m3);
-    motorsSetRatio(MOTOR_M4, motorPower.m4);
+    ratios[0] = motorPower.m1;
+    ratios[1] = motorPower.m2;
+    ratios[2] = motorPower.m3;
+    ratios[3] = motorPower.m4;
   }
+
+  motorsSetRatio(MOTOR_M1, ratios[0]);
+  motorsSetRatio(MOTOR_M2, ratios[1]);
+  motorsSetRatio(MOTOR_M3, ratios[2]);
+  motorsSetRatio(MOTOR_M4, ratios[3]);
+
+  // The rotor frequencies follow the motor commands, let the gyro notch filters track them
+  sensorsFilterSetMotorRatios(ratios);
 }
 
 PARAM_GROUP_START(motorPowerSet)
@@ -69,8 +69,12 @@ static inline float end_time_of_current_piece(const struct piecewise_traj_compre
 static inline float start_time_of_current_piece(const struct piecewise_traj_compressed *traj);
 static inline float time_relative_to_start_of_current_piece(const struct piecewise_traj_compressed *traj, float t);
 
+static compressed_piece_ptr parse_start_position(compressed_piece_ptr ptr, struct traj_eval* start);
+
 static void piecewise_compressed_advance_playhead(struct piecewise_traj_compressed *traj);
+static void piecewise_compressed_build_index(struct piecewise_traj_compressed *traj);
 static void piecewise_compressed_rewind(struct piecewise_traj_compressed *traj);
+static void piecewise_compressed_seek(struct piecewise_traj_compressed *traj, float t);
 static void piecewise_compressed_update_current_poly4d(
   struct piecewise_traj_compressed *traj, const struct traj_eval *end_of_previous_piece);
 
@@ -212,10 +216,18 @@ struct traj_eval piecewise_compressed_eval(
    * a different value while the poly4d is already pre-calculated, and we
    * have no way of detecting it */
 
+  /* Step to the next piece during playback, look the piece up in the index
+   * for any other jump */
   if (t < start_time_of_current_piece(traj)) {
-    piecewise_compressed_rewind(traj);
+    piecewise_compressed_seek(traj, t);
+  } else if (traj->current_piece.data && t >= end_time_of_current_piece(traj)) {
+    piecewise_compressed_advance_playhead(traj);
+    if (traj->current_piece.data && t >= end_time_of_current_piece(traj)) {
+      piecewise_compressed_seek(traj, t);
+    }
   }
 
+  /* Less than index.stride steps from the indexed piece */
   while (traj->current_piece.data && t >= end_time_of_current_piece(traj)) {
     piecewise_compressed_advance_playhead(traj);
   }
@@ -238,27 +250,109 @@ void piecewise_compressed_load(struct piecewise_traj_compressed *traj, const voi
   piecewise_compressed_rewind(traj);
 
   traj->duration = calculate_total_duration(traj->current_piece.data);
+  piecewise_compressed_build_index(traj);
+}
+
+// Parses the header that stores the start coordinates of the trajectory and
+// returns a pointer to the first piece
+static compressed_piece_ptr parse_start_position(compressed_piece_ptr ptr, struct traj_eval* start)
+{
+  compressed_piece_coordinate value;
+
+  bzero(start, sizeof(*start));
+  ptr = next_coordinate(ptr, &value); start->pos.x = value / STORED_DISTANCE_SCALE;
+  ptr = next_coordinate(ptr, &value); start->pos.y = value / STORED_DISTANCE_SCALE;
+  ptr = next_coordinate(ptr, &value); start->pos.z = value / STORED_DISTANCE_SCALE;
+  ptr = next_coordinate(ptr, &value); start->yaw = value / STORED_ANGLE_SCALE;
+  return ptr;
 }
 
 static void piecewise_compressed_rewind(struct piecewise_traj_compressed *traj)
 {
   struct traj_eval stopped;
-  compressed_piece_coordinate value;
-  compressed_piece_ptr ptr;
 
-  /* Parse header that stores the start coordinates */
-  bzero(&stopped, sizeof(stopped));
-  ptr = traj->data;
-  ptr = next_coordinate(ptr, &value); stopped.pos.x = value / STORED_DISTANCE_SCALE;
-  ptr = next_coordinate(ptr, &value); stopped.pos.y = value / STORED_DISTANCE_SCALE;
-  ptr = next_coordinate(ptr, &value); stopped.pos.z = value / STORED_DISTANCE_SCALE;
-  ptr = next_coordinate(ptr, &value); stopped.yaw = value / STORED_ANGLE_SCALE;
+  traj->current_piece.data = parse_start_position(traj->data, &stopped);
   traj->current_piece.t_begin_relative = 0;
-  traj->current_piece.data = ptr;
 
   piecewise_compressed_update_current_poly4d(traj, &stopped);
 }
 
+// Walks the trajectory once, the same way as piecewise_compressed_advance_playhead()
+// does, and stores the start time and start position of every index.stride-th
+// piece. Pieces built from the index are then identical to the ones built during
+// playback. Leaves the playhead at the start of the trajectory.
+static void piecewise_compressed_build_index(struct piecewise_traj_compressed *traj)
+{
+  struct traj_eval start;
+  compressed_piece_ptr ptr;
+  uint16_t pieces = 0;
+  int i;
+
+  ptr = parse_start_position(traj->data, &start);
+  for (compressed_piece_ptr piece = ptr; piece; piece = next_piece(piece)) {
+    pieces++;
+  }
+
+  traj->index.stride = (pieces + PPTRAJ_COMPRESSED_INDEX_SIZE - 1) / PPTRAJ_COMPRESSED_INDEX_SIZE;
+  if (traj->index.stride == 0) {
+    traj->index.stride = 1;
+  }
+  traj->index.count = 0;
+
+  traj->current_piece.data = ptr;
+  traj->current_piece.t_begin_relative = 0;
+  for (i = 0; traj->current_piece.data; i++) {
+    piecewise_compressed_update_current_poly4d(traj, &start);
+
+    if (i % traj->index.stride == 0) {
+      struct piecewise_traj_compressed_index_entry *entry = &traj->index.entries[traj->index.count++];
+      entry->data = traj->current_piece.data;
+      entry->t_begin_relative = traj->current_piece.t_begin_relative;
+      entry->start_pos = start.pos;
+      entry->start_yaw = start.yaw;
+    }
+
+    float duration = traj->current_piece.poly4d.duration;
+    start = poly4d_eval(&traj->current_piece.poly4d, duration);
+    traj->current_piece.t_begin_relative += duration;
+    traj->current_piece.data = next_piece(traj->current_piece.data);
+  }
+
+  piecewise_compressed_rewind(traj);
+}
+
+// Moves the playhead to the last indexed piece that starts at or before the
+// given time, or to the first piece if the time is before the start
+static void piecewise_compressed_seek(struct piecewise_traj_compressed *traj, float t)
+{
+  const struct piecewise_traj_compressed_index_entry *entry;
+  struct traj_eval start;
+  int low = 0, high = traj->index.count - 1;
+
+  if (high < 0) {
+    piecewise_compressed_rewind(traj);
+    return;
+  }
+
+  while (low < high) {
+    int mid = (low + high + 1) / 2;
+    if (traj->t_begin + traj->index.entries[mid].t_begin_relative <= t) {
+      low = mid;
+    } else {
+      high = mid - 1;
+    }
+  }
+
+  entry = &traj->index.entries[low];
+  bzero(&start, sizeof(start));
+  start.pos = entry->start_pos;
+  start.yaw = entry->start_yaw;
+
+  traj->current_piece.data = entry->data;
+  traj->current_piece.t_begin_relative = entry->t_begin_relative;
+  piecewise_compressed_update_current_poly4d(traj, &start);
+}
+
 static void piecewise_compressed_update_current_poly4d(
   struct piecewise_traj_compressed *traj, const struct traj_eval *prev_end)
 {
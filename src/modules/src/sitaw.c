@@ -35,6 +35,7 @@
 #include "commander.h"
 #include "stabilizer.h"
 #include "motors.h"
+#include "usddeck.h"
 
 /* Trigger object used to detect Free Fall situation. */
 static trigger_t sitAwFFAccWZ;
@@ -144,6 +145,7 @@ static void sitAwPreThrustUpdateCallOut(setpoint_t *setpoint)
       if(sitAwTuDetected()) {
         /* Kill the thrust to the motors if a Tumbled situation is detected. */
         stabilizerSetEmergencyStop();
+        usddeckTriggerEvent(usddeckEvent_Tumbled);
       }
 #endif
 
@@ -50,9 +50,11 @@
 #include "usddeck.h"
 #include "quatcompress.h"
 #include "statsCnt.h"
+#include "stabilizer_timing.h"
 
 static bool isInit;
 static bool emergencyStop = false;
+static bool lastEmergencyStop = false;
 static int emergencyStopTimeout = EMERGENCY_STOP_TIMEOUT_DISABLED;
 
 #define PROPTEST_NBR_OF_VARIANCE_VALUES   100
@@ -78,6 +80,36 @@ typedef enum { configureAcc, measureNoiseFloor, measureProp, testBattery, restar
 
 static STATS_CNT_RATE_DEFINE(stabilizerRate, 500);
 
+/* Rates and phase offsets of the rate groups. A group runs in the ticks where
+ * tick % (RATE_MAIN_LOOP / rate) == phase % (RATE_MAIN_LOOP / rate).
+ *
+ * Attitude estimation and control share the even ticks, the attitude estimate
+ * is updated just before it is used. Position estimation, position control
+ * and uSD logging use separate odd ticks, so they run neither together nor in
+ * the same tick as the attitude stages:
+ *
+ *   tick % 10           0  1  2  3  4  5  6  7  8  9
+ *   estimator attitude  x           x           x     (every 4th tick)
+ *   attitude control    x     x     x     x     x
+ *   estimator position     x
+ *   position control             x
+ *   uSD logging (100Hz)                  x
+ *
+ * The uSD logging rate is set from the deck configuration.
+ */
+typedef struct {
+  uint16_t rate;
+  uint16_t phase;
+} rateGroupSchedule_t;
+
+static rateGroupSchedule_t rateGroups[rateGroupCount] = {
+  [rateGroupEstimatorAttitude] = {.rate = ESTIMATOR_ATTITUDE_RATE, .phase = 0},
+  [rateGroupEstimatorPosition] = {.rate = ESTIMATOR_POSITION_RATE, .phase = 1},
+  [rateGroupAttitudeControl] = {.rate = ATTITUDE_RATE, .phase = 0},
+  [rateGroupPositionControl] = {.rate = POSITION_RATE, .phase = 3},
+  [rateGroupUsdLogging] = {.rate = 0, .phase = 5},
+};
+
 static struct {
   // position - mm
   int16_t x;
@@ -189,6 +221,7 @@ void stabilizerInit(StateEstimatorType estimator)
   sitAwInit();
   estimatorType = getStateEstimator();
   controllerType = getControllerType();
+  STABILIZER_TIMING_INIT();
 
   xTaskCreate(stabilizerTask, STABILIZER_TASK_NAME,
               STABILIZER_TASK_STACKSIZE, NULL, STABILIZER_TASK_PRI, NULL);
@@ -221,7 +254,8 @@ static void checkEmergencyStopTimeout()
 
 /* The stabilizer loop runs at 1kHz (stock) or 500Hz (kalman). It is the
  * responsibility of the different functions to run slower by skipping call
- * (ie. returning without modifying the output structure).
+ * (ie. returning without modifying the output structure), using the rate
+ * groups above to pick the ticks they run in.
  */
 
 static void stabilizerTask(void* param)
@@ -248,6 +282,7 @@ static void stabilizerTask(void* param)
   while(1) {
     // The sensor should unlock at 1kHz
     sensorsWaitDataReady();
+    STABILIZER_TIMING_START(loopStart);
 
     if (startPropTest != false) {
       // TODO: What happens with estimator when we run tests after startup?
@@ -270,37 +305,65 @@ static void stabilizerTask(void* param)
         controllerType = getControllerType();
       }
 
+      STABILIZER_TIMING_START(stageStart);
       stateEstimator(&state, &sensorData, &control, tick);
+      STABILIZER_TIMING_STOP(stabilizerStageEstimator, stageStart);
       compressState();
 
+      STABILIZER_TIMING_RESTART(stageStart);
       commanderGetSetpoint(&setpoint, &state);
+      STABILIZER_TIMING_STOP(stabilizerStageCommander, stageStart);
       compressSetpoint();
 
+      STABILIZER_TIMING_RESTART(stageStart);
       sitAwUpdateSetpoint(&setpoint, &sensorData, &state);
+      STABILIZER_TIMING_STOP(stabilizerStageSitAw, stageStart);
 
+      STABILIZER_TIMING_RESTART(stageStart);
       controller(&control, &setpoint, &sensorData, &state, tick);
+      STABILIZER_TIMING_STOP(stabilizerStageController, stageStart);
 
       checkEmergencyStopTimeout();
 
+      if (emergencyStop && !lastEmergencyStop) {
+        usddeckTriggerEvent(usddeckEvent_EmergencyStop);
+      }
+      lastEmergencyStop = emergencyStop;
+
+      STABILIZER_TIMING_RESTART(stageStart);
       if (emergencyStop) {
         powerStop();
       } else {
         powerDistribution(&control);
       }
+      STABILIZER_TIMING_STOP(stabilizerStagePowerDistribution, stageStart);
 
       // Log data to uSD card if configured
+      rateGroups[rateGroupUsdLogging].rate = usddeckFrequency();
       if (   usddeckLoggingEnabled()
           && usddeckLoggingMode() == usddeckLoggingMode_SynchronousStabilizer
-          && RATE_DO_EXECUTE(usddeckFrequency(), tick)) {
+          && rateGroupDoExecute(rateGroupUsdLogging, tick)) {
         usddeckTriggerLogging();
       }
     }
     calcSensorToOutputLatency(&sensorData);
+    STABILIZER_TIMING_STOP(stabilizerStageLoop, loopStart);
     tick++;
     STATS_CNT_RATE_EVENT(&stabilizerRate);
   }
 }
 
+bool rateGroupDoExecute(const rateGroup_t group, const uint32_t tick)
+{
+  const rateGroupSchedule_t* schedule = &rateGroups[group];
+  if (schedule->rate == 0 || schedule->rate > RATE_MAIN_LOOP) {
+    return false;
+  }
+
+  const uint32_t period = RATE_MAIN_LOOP / schedule->rate;
+  return (tick % period) == (schedule->phase % period);
+}
+
 void stabilizerSetEmergencyStop()
 {
   emergencyStop = true;
@@ -0,0 +1,156 @@
+/**
+ * ,---------,       ____  _ __
+ * |  ,-^-,  |      / __ )(_) /_______________ _____  ___
+ * | (  O  ) |     / __  / / __/ ___/ ___/ __ `/_  / / _ \
+ * | / ,--´  |    / /_/ / / /_/ /__/ /  / /_/ / / /_/  __/
+ *    +------`   /_____/_/\__/\___/_/   \__,_/ /___/\___/
+ *
+ * Crazyflie control firmware
+ *
+ * Copyright (C) 2020 Bitcraze AB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, in version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * stabilizer_timing.c - Cycle accurate timing of the stages of the stabilizer loop
+ */
+
+#ifdef STABILIZER_STAGE_TIMING
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "stabilizer_timing.h"
+#include "stabilizer_types.h"
+#include "log.h"
+
+typedef struct {
+  // Current window
+  uint32_t min;
+  uint32_t max;
+  uint64_t sum;
+  // Number of samples, stages such as the controller are not run in every loop
+  uint32_t count;
+
+  // Last full window and histogram since start up, see stabilizerTimingStats_t
+  stabilizerTimingStats_t stats;
+} stageTiming_t;
+
+static stageTiming_t stages[stabilizerStageCount];
+static uint32_t windowCount;
+static uint32_t histogramLimits[STABILIZER_TIMING_HISTOGRAM_BINS - 1];
+
+static void resetWindow(stageTiming_t* stage)
+{
+  stage->min = UINT32_MAX;
+  stage->max = 0;
+  stage->sum = 0;
+  stage->count = 0;
+}
+
+static void closeWindow(void)
+{
+  for (int i = 0; i < stabilizerStageCount; i++) {
+    stageTiming_t* stage = &stages[i];
+    if (stage->count > 0) {
+      stage->stats.min = stage->min;
+      stage->stats.max = stage->max;
+      stage->stats.mean = stage->sum / stage->count;
+    } else {
+      stage->stats.min = 0;
+      stage->stats.max = 0;
+      stage->stats.mean = 0;
+    }
+    resetWindow(stage);
+  }
+
+  windowCount = 0;
+}
+
+void stabilizerTimingInit(void)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  const uint32_t period = SystemCoreClock / RATE_MAIN_LOOP;
+  histogramLimits[0] = period / 10;
+  histogramLimits[1] = period / 4;
+  histogramLimits[2] = period / 2;
+  histogramLimits[3] = period;
+
+  memset(stages, 0, sizeof(stages));
+  for (int i = 0; i < stabilizerStageCount; i++) {
+    resetWindow(&stages[i]);
+  }
+  windowCount = 0;
+}
+
+void stabilizerTimingAdd(stabilizerStage_t stage, uint32_t cycles)
+{
+  stageTiming_t* timing = &stages[stage];
+
+  if (cycles < timing->min) {
+    timing->min = cycles;
+  }
+  if (cycles > timing->max) {
+    timing->max = cycles;
+  }
+  timing->sum += cycles;
+  timing->count++;
+
+  int bin = 0;
+  while (bin < STABILIZER_TIMING_HISTOGRAM_BINS - 1 && cycles >= histogramLimits[bin]) {
+    bin++;
+  }
+  timing->stats.histogram[bin]++;
+
+  // The loop is the last stage to be added in each loop
+  if (stage == stabilizerStageLoop) {
+    windowCount++;
+    if (windowCount >= RATE_MAIN_LOOP) {
+      closeWindow();
+    }
+  }
+}
+
+bool stabilizerTimingGetStats(stabilizerStage_t stage, stabilizerTimingStats_t* stats)
+{
+  if (stage >= stabilizerStageCount) {
+    return false;
+  }
+
+  memcpy(stats, &stages[stage].stats, sizeof(stabilizerTimingStats_t));
+  return true;
+}
+
+/**
+ * Mean and max time (cycles) of the stages of the stabilizer loop, over the last second. loopOver is the number of
+ * loops since start up that took longer than the loop period.
+ */
+LOG_GROUP_START(stabTime)
+LOG_ADD(LOG_UINT32, estMean, &stages[stabilizerStageEstimator].stats.mean)
+LOG_ADD(LOG_UINT32, estMax, &stages[stabilizerStageEstimator].stats.max)
+LOG_ADD(LOG_UINT32, cmdMean, &stages[stabilizerStageCommander].stats.mean)
+LOG_ADD(LOG_UINT32, cmdMax, &stages[stabilizerStageCommander].stats.max)
+LOG_ADD(LOG_UINT32, sitMean, &stages[stabilizerStageSitAw].stats.mean)
+LOG_ADD(LOG_UINT32, sitMax, &stages[stabilizerStageSitAw].stats.max)
+LOG_ADD(LOG_UINT32, ctrlMean, &stages[stabilizerStageController].stats.mean)
+LOG_ADD(LOG_UINT32, ctrlMax, &stages[stabilizerStageController].stats.max)
+LOG_ADD(LOG_UINT32, pwrMean, &stages[stabilizerStagePowerDistribution].stats.mean)
+LOG_ADD(LOG_UINT32, pwrMax, &stages[stabilizerStagePowerDistribution].stats.max)
+LOG_ADD(LOG_UINT32, loopMean, &stages[stabilizerStageLoop].stats.mean)
+LOG_ADD(LOG_UINT32, loopMax, &stages[stabilizerStageLoop].stats.max)
+LOG_ADD(LOG_UINT32, loopOver, &stages[stabilizerStageLoop].stats.histogram[STABILIZER_TIMING_HISTOGRAM_BINS - 1])
+LOG_GROUP_STOP(stabTime)
+
+#endif // STABILIZER_STAGE_TIMING
@@ -7,10 +7,18 @@
 typedef struct {
   double clockCorrection;
   unsigned int clockCorrectionBucket;
+
+  // Used by the single precision functions, the clock correction minus 1
+  float clockCorrectionDeviation;
+  bool hasClockCorrectionDeviation;
 } clockCorrectionStorage_t;
 
 double clockCorrectionEngineGet(const clockCorrectionStorage_t* storage);
 double clockCorrectionEngineCalculate(const uint64_t new_t_in_cl_reference, const uint64_t old_t_in_cl_reference, const uint64_t new_t_in_cl_x, const uint64_t old_t_in_cl_x, const uint64_t mask);
 bool clockCorrectionEngineUpdate(clockCorrectionStorage_t* storage, const double clockCorrectionCandidate);
 
+bool clockCorrectionEngineGetDeviation(const clockCorrectionStorage_t* storage, float* clockCorrectionDeviation);
+float clockCorrectionEngineCalculateDeviation(const uint64_t new_t_in_cl_reference, const uint64_t old_t_in_cl_reference, const uint64_t new_t_in_cl_x, const uint64_t old_t_in_cl_x, const uint64_t mask);
+bool clockCorrectionEngineUpdateDeviation(clockCorrectionStorage_t* storage, const float clockCorrectionDeviationCandidate);
+
 #endif /* clockCorrectionEngine_h */
@@ -46,5 +46,23 @@ void lpf2pSetCutoffFreq(lpf2pData* lpfData, float sample_freq, float cutoff_freq
 float lpf2pApply(lpf2pData* lpfData, float sample);
 float lpf2pReset(lpf2pData* lpfData, float sample);
 
+/**
+ * Half band FIR filter that decimates a signal by 2. The pass band is flat up to 0.3 * the output rate and
+ * the aliasing band (above 0.7 * the output rate, in input terms) is attenuated by more than 20 dB, more than 40 dB
+ * above 0.8 * the output rate. The group delay is 2.5 output samples.
+ */
+#define DECIMATOR2_TAPS 11
+
+typedef struct {
+  float delay[DECIMATOR2_TAPS];
+} decimator2Data;
+
+void decimator2Init(decimator2Data* data);
+
+/**
+ * Feed two consecutive input samples, oldest first, and get one output sample.
+ */
+float decimator2Apply(decimator2Data* data, float sample0, float sample1);
+
 
 #endif //FILTER_H_
@@ -0,0 +1,85 @@
+/**
+ * ,---------,       ____  _ __
+ * |  ,-^-,  |      / __ )(_) /_______________ _____  ___
+ * | (  O  ) |     / __  / / __/ ___/ ___/ __ `/_  / / _ \
+ * | / ,--´  |    / /_/ / / /_/ /__/ /  / /_/ / / /_/  __/
+ *    +------`   /_____/_/\__/\___/_/   \__,_/ /___/\___/
+ *
+ * Crazyflie control firmware
+ *
+ * Copyright (C) 2020 Bitcraze AB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, in version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * filterBank.h - Cascaded biquad filters for multi axis sensor data
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "cf_math.h"
+
+/**
+ * A filter bank runs the same cascade of second order sections (lowpass and notch stages) on each axis of a sensor.
+ * The cascade is processed by the CMSIS-DSP transposed direct form II biquad implementation, one call per axis for all
+ * stages.
+ */
+
+#define FILTER_BANK_AXES        3
+#define FILTER_BANK_MAX_STAGES  4
+
+typedef enum {
+  filterBankStageNone = 0,
+  // Second order Butterworth lowpass, same response as lpf2p
+  filterBankStageLowpass,
+  // Notch with unity gain outside of the notch
+  filterBankStageNotch,
+  filterBankStageTypeCount,
+} filterBankStageType_t;
+
+typedef struct {
+  uint8_t type;
+  // Cutoff frequency for lowpass stages, center frequency for notch stages (Hz)
+  float frequency;
+  // Center frequency / bandwidth of notch stages, not used for lowpass stages
+  float q;
+} filterBankStage_t;
+
+typedef struct {
+  float sampleFreq;
+  // The stages as configured, including stages of type none
+  filterBankStage_t stages[FILTER_BANK_MAX_STAGES];
+  // Number of active stages in the cascade
+  uint8_t activeStages;
+
+  arm_biquad_cascade_df2T_instance_f32 instance[FILTER_BANK_AXES];
+  float coeffs[5 * FILTER_BANK_MAX_STAGES];
+  float state[FILTER_BANK_AXES][2 * FILTER_BANK_MAX_STAGES];
+} filterBankData;
+
+/**
+ * Initialize a filter bank with no stages, it passes samples through unchanged
+ */
+void filterBankInit(filterBankData* bank, float sampleFreq);
+
+/**
+ * Set the stages of the cascade. Stages of type none are skipped, and so are stages with a frequency that is not
+ * between 0 and the Nyquist frequency. The filter state is kept if the number of active stages does not change,
+ * which makes it possible to move a notch while running.
+ */
+void filterBankConfigure(filterBankData* bank, const filterBankStage_t* stages, int count);
+
+/**
+ * Filter one sample of each axis, in place.
+ */
+void filterBankApply(filterBankData* bank, float samples[FILTER_BANK_AXES]);
@@ -29,6 +29,31 @@ typedef struct baseStationEulerAngles_s {
  */
 bool lighthouseGeometryGetPositionFromRayIntersection(baseStationGeometry_t baseStations[2], float angles1[2], float angles2[2], vec3d position, float *position_delta);
 
+/**
+ * A pair of sweep angles measured by one sensor from one base station
+ */
+typedef struct {
+  const baseStationGeometry_t* baseStation;
+  float angles[2];
+  vec3d sensorOffset;  // Position of the sensor relative to the Crazyflie, in the world reference frame
+} lighthouseGeometrySweepPair_t;
+
+/**
+ * @brief Find the position that fits the sweep planes of any number of sensors and base stations best, in a least
+ * squares sense. Each sweep angle defines a plane through the base station that the sensor is in, the position of
+ * the Crazyflie is the point with the smallest sum of squared distances from the sensors to the planes.
+ *
+ * At least two base stations, or one base station and a very large separation of the sensors, are needed to
+ * determine the position.
+ *
+ * @param sweepPairs - the measured sweep angles
+ * @param count - number of sweep pairs
+ * @param position - (output) the position of the Crazyflie
+ * @param position_delta - (output) the RMS distance from the sensors to the sweep planes at the position
+ * @return true if the position could be calculated, false if the sweeps do not determine the position
+ */
+bool lighthouseGeometryGetPositionFromSweepPairs(const lighthouseGeometrySweepPair_t sweepPairs[], const int count, vec3d position, float *position_delta);
+
 /**
  * @brief Get the base station position from the base station geometry in world reference frame. This position can be seen as the
  * point where the lazers originate from.
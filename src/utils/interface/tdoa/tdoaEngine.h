@@ -4,7 +4,13 @@
 #include "tdoaStorage.h"
 #include "tdoaStats.h"
 
-typedef void (*tdoaEngineSendTdoaToEstimator)(tdoaMeasurement_t* tdoaMeasurement);
+// Upper limit for the number of anchor pairs (TDoA measurements) generated from one received packet
+#ifndef TDOA_ENGINE_MAX_PAIRS_PER_PACKET
+#define TDOA_ENGINE_MAX_PAIRS_PER_PACKET 4
+#endif
+
+// Called once per received packet with all the measurements generated from it
+typedef void (*tdoaEngineSendTdoaToEstimator)(const tdoaMeasurement_t tdoaMeasurements[], const int count);
 
 typedef struct {
   // State
@@ -14,6 +20,13 @@ typedef struct {
   // Configuration
   tdoaEngineSendTdoaToEstimator sendTdoaToEstimator;
   double locodeckTsFreq;
+  float metersPerTick;
+
+  // Number of anchor pairs to generate for each received packet, 1 to TDOA_ENGINE_MAX_PAIRS_PER_PACKET.
+  // With 1 pair a random suitable remote anchor is used, with more pairs the remote anchors with the most recent
+  // data are used. The measurement noise of a batch is scaled with the square root of the number of pairs, as the
+  // pairs share the reception time of the packet.
+  uint8_t pairsPerPacket;
 } tdoaEngineState_t;
 
 void tdoaEngineInit(tdoaEngineState_t* state, const uint32_t now_ms, tdoaEngineSendTdoaToEstimator sendTdoaToEstimator, const double locodeckTsFreq);
@@ -0,0 +1,93 @@
+/**
+ * ,---------,       ____  _ __
+ * |  ,-^-,  |      / __ )(_) /_______________ _____  ___
+ * | (  O  ) |     / __  / / __/ ___/ ___/ __ `/_  / / _ \
+ * | / ,--´  |    / /_/ / / /_/ /__/ /  / /_/ / / /_/  __/
+ *    +------`   /_____/_/\__/\___/_/   \__,_/ /___/\___/
+ *
+ * Crazyflie control firmware
+ *
+ * Copyright (C) 2020 Bitcraze AB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, in version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ * tocIndex.h - Index of a log or param TOC, for lookups by id and by name
+ * without scanning the TOC.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// RAM used by the index, per variable in the TOC
+#define TOC_INDEX_BYTES_PER_VARIABLE (2 * sizeof(uint16_t) + sizeof(uint32_t))
+
+typedef enum {
+  tocIndexEntryVariable,
+  tocIndexEntryGroupStart,
+  tocIndexEntryGroupStop,
+} tocIndexEntryType_t;
+
+/**
+ * Accessor for the entries of the TOC, implemented by the owner of the TOC (log or param)
+ *
+ * @param tocIndex - position of the entry in the TOC, groups included
+ * @param name - (output) name of the entry
+ * @return the type of the entry
+ */
+typedef tocIndexEntryType_t (*tocIndexGetEntry_t)(const int tocIndex, char** name);
+
+typedef struct {
+  tocIndexGetEntry_t getEntry;
+  int varCount;
+
+  // TOC index of each variable, by public id
+  uint16_t* varIndex;
+  // Hashes of "group.name" of all variables in increasing order
+  uint32_t* nameHashes;
+  // TOC index of the variable for each hash in nameHashes
+  uint16_t* nameIndex;
+} tocIndex_t;
+
+/**
+ * Allocate and build the index. Must be called once, when the TOC is known.
+ *
+ * @param index - the index to initialize
+ * @param getEntry - accessor for the entries of the TOC
+ * @param tocLength - number of entries in the TOC, groups included
+ * @param varCount - number of variables in the TOC
+ */
+void tocIndexInit(tocIndex_t* index, tocIndexGetEntry_t getEntry, const int tocLength, const int varCount);
+
+/**
+ * @return the TOC index of the variable with the public id, or -1 if there is no such variable
+ */
+int tocIndexGetTocIndex(const tocIndex_t* index, const int id);
+
+/**
+ * @return the TOC index of the variable "group.name", or -1 if there is no such variable
+ */
+int tocIndexFindByName(const tocIndex_t* index, const char* group, const char* name);
+
+/**
+ * Name of the group a TOC entry belongs to, groups are short so this is a short backward scan
+ */
+char* tocIndexGetGroupName(const tocIndex_t* index, const int tocIndex);
+
+/**
+ * FNV-1a hash of "group.name"
+ */
+uint32_t tocIndexHashName(const char* group, const char* name);
@@ -8,6 +8,12 @@
 #define CLOCK_CORRECTION_FILTER 0.1
 #define CLOCK_CORRECTION_BUCKET_MAX 4
 
+// Limits for the single precision functions, expressed as a deviation from 1
+#define CLOCK_DEVIATION_SPEC_MIN ((float)(CLOCK_CORRECTION_SPEC_MIN - 1.0))
+#define CLOCK_DEVIATION_SPEC_MAX ((float)(CLOCK_CORRECTION_SPEC_MAX - 1.0))
+#define CLOCK_DEVIATION_ACCEPTED_NOISE ((float)CLOCK_CORRECTION_ACCEPTED_NOISE)
+#define CLOCK_DEVIATION_FILTER ((float)CLOCK_CORRECTION_FILTER)
+
 /**
  Logging all the clock correction information requires scaling the values repeatedly, which is computer intense. Thus, the logging functionality is enabled at compile time with the CLOCK_CORRECTION_ENABLE_LOGGING flag.
  */
@@ -24,6 +30,10 @@ static float logClockCorrectionCandidate = 0;
 static float scaleValueForLogging(double value) {
   return (float)((value - 1) * (1 / MAX_CLOCK_DEVIATION_SPEC) * 1000);
 }
+
+static float scaleDeviationForLogging(float deviation) {
+  return deviation * (float)((1 / MAX_CLOCK_DEVIATION_SPEC) * 1000);
+}
 #endif
 
 /**
@@ -121,6 +131,75 @@ bool clockCorrectionEngineUpdate(clockCorrectionStorage_t* storage, const double
   return sampleIsReliable;
 }
 
+/**
+ Obtains the clock correction, minus 1, from a clockCorrectionStorage_t object updated with clockCorrectionEngineUpdateDeviation().
+ @return True if a clock correction has been accepted, false otherwise.
+ */
+bool clockCorrectionEngineGetDeviation(const clockCorrectionStorage_t* storage, float* clockCorrectionDeviation) {
+  *clockCorrectionDeviation = storage->clockCorrectionDeviation;
+  return storage->hasClockCorrectionDeviation;
+}
+
+/**
+ Single precision version of clockCorrectionEngineCalculate(). The clock correction is very close to 1 and can not be
+ represented with enough resolution in a float, instead the deviation from 1 is calculated. The difference in tick count
+ is calculated with integers and only the small relative deviation is done in floating point.
+
+ @return The clock correction minus 1. Or -1 if it was not possible to perform the computation.
+ */
+float clockCorrectionEngineCalculateDeviation(const uint64_t new_t_in_cl_reference, const uint64_t old_t_in_cl_reference, const uint64_t new_t_in_cl_x, const uint64_t old_t_in_cl_x, const uint64_t mask) {
+  const uint64_t tickCount_in_cl_reference = truncateTimeStamp(new_t_in_cl_reference - old_t_in_cl_reference, mask);
+  const uint64_t tickCount_in_cl_x = truncateTimeStamp(new_t_in_cl_x - old_t_in_cl_x, mask);
+
+  if (tickCount_in_cl_x == 0) {
+    return -1.0f;
+  }
+
+  const int64_t tickCountDifference = (int64_t)(tickCount_in_cl_reference - tickCount_in_cl_x);
+  return (float)tickCountDifference / (float)tickCount_in_cl_x;
+}
+
+/**
+ Single precision version of clockCorrectionEngineUpdate(), working on the deviation from 1. A storage object should
+ only be updated by one of the two functions.
+ @return True if the provided clock correction sample is reliable, false otherwise.
+ */
+bool clockCorrectionEngineUpdateDeviation(clockCorrectionStorage_t* storage, const float clockCorrectionDeviationCandidate) {
+  bool sampleIsReliable = false;
+
+  const float currentDeviation = storage->clockCorrectionDeviation;
+  const float difference = clockCorrectionDeviationCandidate - currentDeviation;
+
+#ifdef CLOCK_CORRECTION_ENABLE_LOGGING
+  logMinAcceptedNoiseLimit = scaleDeviationForLogging(currentDeviation - CLOCK_DEVIATION_ACCEPTED_NOISE);
+  logMaxAcceptedNoiseLimit = scaleDeviationForLogging(currentDeviation + CLOCK_DEVIATION_ACCEPTED_NOISE);
+  logMinSpecLimit = scaleDeviationForLogging(CLOCK_DEVIATION_SPEC_MIN);
+  logMaxSpecLimit = scaleDeviationForLogging(CLOCK_DEVIATION_SPEC_MAX);
+  logClockCorrection = scaleDeviationForLogging(currentDeviation);
+  logClockCorrectionCandidate = scaleDeviationForLogging(clockCorrectionDeviationCandidate);
+#endif
+
+  // A deviation of 0 is a valid value, the noise test is only done when a clock correction has been accepted
+  if (storage->hasClockCorrectionDeviation && -CLOCK_DEVIATION_ACCEPTED_NOISE < difference && difference < CLOCK_DEVIATION_ACCEPTED_NOISE) {
+    // Simple low pass filter
+    const float newDeviation = currentDeviation * CLOCK_DEVIATION_FILTER + clockCorrectionDeviationCandidate * (1.0f - CLOCK_DEVIATION_FILTER);
+
+    sampleIsReliable = true;
+    fillClockCorrectionBucket(storage);
+    storage->clockCorrectionDeviation = newDeviation;
+  } else {
+    const bool shouldAcceptANewClockReference = emptyClockCorrectionBucket(storage);
+    if (shouldAcceptANewClockReference) {
+      if (CLOCK_DEVIATION_SPEC_MIN < clockCorrectionDeviationCandidate && clockCorrectionDeviationCandidate < CLOCK_DEVIATION_SPEC_MAX) {
+        storage->clockCorrectionDeviation = clockCorrectionDeviationCandidate;
+        storage->hasClockCorrectionDeviation = true;
+      }
+    }
+  }
+
+  return sampleIsReliable;
+}
+
 #ifdef CLOCK_CORRECTION_ENABLE_LOGGING
 LOG_GROUP_START(CkCorrection)
 LOG_ADD(LOG_FLOAT, minNoise, &logMinAcceptedNoiseLimit)
@@ -109,3 +109,35 @@ float lpf2pReset(lpf2pData* lpfData, float sample)
   return lpf2pApply(lpfData, sample);
 }
 
+
+/**
+ * Half band decimation by 2. Every other coefficient is zero except the center one, and the coefficients are
+ * symmetric, only the non zero halves are stored. Designed as a Kaiser windowed sinc (beta 5), normalized to unity
+ * DC gain.
+ */
+static const float decimator2Coeffs[] = {0.0023409f, -0.0440941f, 0.2913475f};
+static const float decimator2Center = 0.5008114f;
+
+void decimator2Init(decimator2Data* data)
+{
+  for (int i = 0; i < DECIMATOR2_TAPS; i++) {
+    data->delay[i] = 0.0f;
+  }
+}
+
+float decimator2Apply(decimator2Data* data, float sample0, float sample1)
+{
+  float* d = data->delay;
+
+  // d[0] is the newest sample
+  for (int i = DECIMATOR2_TAPS - 1; i >= 2; i--) {
+    d[i] = d[i - 2];
+  }
+  d[1] = sample0;
+  d[0] = sample1;
+
+  return decimator2Center * d[5] +
+    decimator2Coeffs[2] * (d[4] + d[6]) +
+    decimator2Coeffs[1] * (d[2] + d[8]) +
+    decimator2Coeffs[0] * (d[0] + d[10]);
+}
@@ -0,0 +1,133 @@
+/**
+ * ,---------,       ____  _ __
+ * |  ,-^-,  |      / __ )(_) /_______________ _____  ___
+ * | (  O  ) |     / __  / / __/ ___/ ___/ __ `/_  / / _ \
+ * | / ,--´  |    / /_/ / / /_/ /__/ /  / /_/ / / /_/  __/
+ *    +------`   /_____/_/\__/\___/_/   \__,_/ /___/\___/
+ *
+ * Crazyflie control firmware
+ *
+ * Copyright (C) 2020 Bitcraze AB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, in version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * filterBank.c - Cascaded biquad filters for multi axis sensor data
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "filterBank.h"
+
+#define M_PI_F (float)M_PI
+
+// Coefficients are stored in the CMSIS order {b0, b1, b2, a1, a2}, where the a coefficients have the opposite sign
+// compared to the usual difference equation: y[n] = b0 * x[n] + b1 * x[n-1] + b2 * x[n-2] + a1 * y[n-1] + a2 * y[n-2]
+
+static void setLowpassCoeffs(float* coeffs, float sampleFreq, float cutoffFreq)
+{
+  float ohm = tanf(M_PI_F * cutoffFreq / sampleFreq);
+  float c = 1.0f + 2.0f * cosf(M_PI_F / 4.0f) * ohm + ohm * ohm;
+  coeffs[0] = ohm * ohm / c;
+  coeffs[1] = 2.0f * coeffs[0];
+  coeffs[2] = coeffs[0];
+  coeffs[3] = -2.0f * (ohm * ohm - 1.0f) / c;
+  coeffs[4] = -(1.0f - 2.0f * cosf(M_PI_F / 4.0f) * ohm + ohm * ohm) / c;
+}
+
+static void setNotchCoeffs(float* coeffs, float sampleFreq, float centerFreq, float q)
+{
+  float omega = 2.0f * M_PI_F * centerFreq / sampleFreq;
+  float alpha = sinf(omega) / (2.0f * q);
+  float a0 = 1.0f + alpha;
+  coeffs[0] = 1.0f / a0;
+  coeffs[1] = -2.0f * cosf(omega) / a0;
+  coeffs[2] = coeffs[0];
+  coeffs[3] = -coeffs[1];
+  coeffs[4] = -(1.0f - alpha) / a0;
+}
+
+static bool isStageActive(const filterBankStage_t* stage, float sampleFreq)
+{
+  if (stage->frequency <= 0.0f || stage->frequency >= sampleFreq / 2.0f) {
+    return false;
+  }
+
+  switch (stage->type) {
+    case filterBankStageLowpass:
+      return true;
+    case filterBankStageNotch:
+      return stage->q > 0.0f;
+    default:
+      return false;
+  }
+}
+
+static void resetState(filterBankData* bank)
+{
+  for (int axis = 0; axis < FILTER_BANK_AXES; axis++) {
+    arm_biquad_cascade_df2T_init_f32(&bank->instance[axis], bank->activeStages, bank->coeffs, bank->state[axis]);
+  }
+}
+
+void filterBankInit(filterBankData* bank, float sampleFreq)
+{
+  memset(bank, 0, sizeof(filterBankData));
+  bank->sampleFreq = sampleFreq;
+  resetState(bank);
+}
+
+void filterBankConfigure(filterBankData* bank, const filterBankStage_t* stages, int count)
+{
+  uint8_t activeStages = 0;
+
+  memset(bank->stages, 0, sizeof(bank->stages));
+  for (int i = 0; i < count && i < FILTER_BANK_MAX_STAGES; i++) {
+    const filterBankStage_t* stage = &stages[i];
+    bank->stages[i] = *stage;
+
+    if (isStageActive(stage, bank->sampleFreq)) {
+      float* coeffs = &bank->coeffs[5 * activeStages];
+      if (stage->type == filterBankStageLowpass) {
+        setLowpassCoeffs(coeffs, bank->sampleFreq, stage->frequency);
+      } else {
+        setNotchCoeffs(coeffs, bank->sampleFreq, stage->frequency, stage->q);
+      }
+      activeStages++;
+    }
+  }
+
+  if (activeStages != bank->activeStages) {
+    bank->activeStages = activeStages;
+    resetState(bank);
+  }
+}
+
+void filterBankApply(filterBankData* bank, float samples[FILTER_BANK_AXES])
+{
+  if (bank->activeStages == 0) {
+    return;
+  }
+
+  for (int axis = 0; axis < FILTER_BANK_AXES; axis++) {
+    float sample = samples[axis];
+    arm_biquad_cascade_df2T_f32(&bank->instance[axis], &samples[axis], &samples[axis], 1);
+
+    if (!isfinite(samples[axis])) {
+      // don't allow bad values to propagate via the filter
+      memset(bank->state[axis], 0, sizeof(bank->state[axis]));
+      samples[axis] = sample;
+    }
+  }
+}
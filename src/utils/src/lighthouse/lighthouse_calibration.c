@@ -33,6 +33,15 @@
 #include "lighthouse_calibration.h"
 
 #include <math.h>
+#include "arm_math.h"
+#include "test_support.h"
+
+// The correction in correctUntilConverged() stops when the last step is smaller than LIGHTHOUSE_CALIBRATION_TOLERANCE
+// (rad), or after LIGHTHOUSE_CALIBRATION_MAX_ITERATIONS steps. Define LIGHTHOUSE_CALIBRATION_USE_FIXED_ITERATIONS to
+// use the original (slower) implementation with 10 iterations instead.
+// #define LIGHTHOUSE_CALIBRATION_USE_FIXED_ITERATIONS
+#define LIGHTHOUSE_CALIBRATION_TOLERANCE 1e-6f
+#define LIGHTHOUSE_CALIBRATION_MAX_ITERATIONS 10
 
 void lighthouseCalibrationInitFromFrame(lighthouseCalibration_t *calib, struct ootxDataFrame_s *frame)
 {
@@ -53,6 +62,7 @@ void lighthouseCalibrationInitFromFrame(lighthouseCalibration_t *calib, struct o
 
 // Calibration function inspired from https://github.com/cnlohr/libsurvive/issues/18#issuecomment-386190279
 
+#if defined(LIGHTHOUSE_CALIBRATION_USE_FIXED_ITERATIONS) || defined(UNIT_TEST_MODE)
 // Given a predicted sensor position in the lighthouse frame, predict the perturbed measurements
 static void predict(const lighthouseCalibration_t* calib, float const* xy, float* ang) {
   float tiltX = calib->axis[0].tilt;
@@ -75,7 +85,7 @@ static void predict(const lighthouseCalibration_t* calib, float const* xy, float
 }
 
 // Given the perturbed lighthouse angle, predict the ideal angle
-static void correct(const lighthouseCalibration_t* calib, const float * angle, float * corrected) {
+TESTABLE_STATIC void correctFixedIterations(const lighthouseCalibration_t* calib, const float * angle, float * corrected) {
   float ideal[2], pred[2], xy[2];
   ideal[0] = angle[0];
   ideal[1] = angle[1];
@@ -89,6 +99,70 @@ static void correct(const lighthouseCalibration_t* calib, const float * angle, f
   corrected[0] = ideal[0];
   corrected[1] = ideal[1];
 }
+#endif
+
+#if !defined(LIGHTHOUSE_CALIBRATION_USE_FIXED_ITERATIONS) || defined(UNIT_TEST_MODE)
+// atan() of the small angle correction in predictFast(), a Taylor series is accurate to 1e-10 below the limit
+#define SMALL_ATAN_LIMIT 0.1f
+
+static float atanSmall(const float u) {
+  if (fabsf(u) > SMALL_ATAN_LIMIT) {
+    return atanf(u);
+  }
+
+  const float u2 = u * u;
+  return u * (1.0f - u2 * (1.0f / 3.0f - u2 * (1.0f / 5.0f - u2 * (1.0f / 7.0f))));
+}
+
+// Same as predict(), but as a function of the ideal angles instead of the sensor position. As
+//   tan(a - b) = tan(a) - d  <=>  tan(b) = d * cos(a)^2 / (1 - d * sin(a) * cos(a))
+// the atan(tan(a) - d) in predict() is replaced by a - atan() of a small angle, and the tan/atan pair is not needed.
+// The remaining trig functions only contribute to the small correction terms and use the fast CMSIS versions.
+static void predictFast(const lighthouseCalibration_t* calib, const float* ideal, float* ang) {
+  float s[2], c[2], xy[2];
+  for (int i = 0; i < 2; i++) {
+    s[i] = arm_sin_f32(ideal[i]);
+    c[i] = arm_cos_f32(ideal[i]);
+    xy[i] = s[i] / c[i];
+  }
+
+  for (int i = 0; i < 2; i++) {
+    const int other = 1 - i;
+    const float d = (calib->axis[i].tilt + calib->axis[i].curve * xy[other]) * xy[other];
+    const float a = ideal[i] - atanSmall(d * c[i] * c[i] / (1.0f - d * s[i] * c[i]));
+    ang[i] = a - (calib->axis[i].phase + calib->axis[i].gibmag * arm_sin_f32(a + calib->axis[i].gibphase));
+  }
+}
+
+// The same fixed point iteration as in correctFixedIterations(), stopped when it has converged. The distortion is
+// small, in practice the iteration converges to well below the sensor noise in 3 to 4 steps.
+TESTABLE_STATIC void correctUntilConverged(const lighthouseCalibration_t* calib, const float * angle, float * corrected) {
+  float ideal[2], pred[2];
+  ideal[0] = angle[0];
+  ideal[1] = angle[1];
+  for (int i = 0; i < LIGHTHOUSE_CALIBRATION_MAX_ITERATIONS; i++) {
+    predictFast(calib, ideal, pred);
+    const float delta0 = angle[0] - pred[0];
+    const float delta1 = angle[1] - pred[1];
+    ideal[0] += delta0;
+    ideal[1] += delta1;
+
+    if (fabsf(delta0) < LIGHTHOUSE_CALIBRATION_TOLERANCE && fabsf(delta1) < LIGHTHOUSE_CALIBRATION_TOLERANCE) {
+      break;
+    }
+  }
+  corrected[0] = ideal[0];
+  corrected[1] = ideal[1];
+}
+#endif
+
+static void correct(const lighthouseCalibration_t* calib, const float * angle, float * corrected) {
+#ifdef LIGHTHOUSE_CALIBRATION_USE_FIXED_ITERATIONS
+  correctFixedIterations(calib, angle, corrected);
+#else
+  correctUntilConverged(calib, angle, corrected);
+#endif
+}
 
 void lighthouseCalibrationApply(lighthouseCalibration_t* calib, float rawAngles[2], float correctedAngles[2])
 {
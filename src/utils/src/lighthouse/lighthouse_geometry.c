@@ -36,6 +36,8 @@
 
 #include "lighthouse_geometry.h"
 
+#include <string.h>
+
 static void vec_cross_product(const vec3d a, const vec3d b, vec3d res) {
     res[0] = a[1]*b[2] - a[2]*b[1];
     res[1] = a[2]*b[0] - a[0]*b[2];
@@ -114,6 +116,103 @@ bool lighthouseGeometryGetPositionFromRayIntersection(baseStationGeometry_t base
     return intersect_lines(origin1, ray1, origin2, ray2, position, position_delta);
 }
 
+// Plane equations n . x = d of the two sweeps of a sweep pair, for the position x of the Crazyflie. The normals n are
+// unit vectors in the world reference frame. The planes in the base station reference frame are the ones that are
+// intersected in lighthouseGeometryGetRay().
+static void getSweepPlanes(const lighthouseGeometrySweepPair_t* sweepPair, vec3d normals[2], float distances[2]) {
+    vec3d localNormals[2] = {
+      {arm_sin_f32(sweepPair->angles[0]), -arm_cos_f32(sweepPair->angles[0]), 0},
+      {-arm_sin_f32(sweepPair->angles[1]), 0, arm_cos_f32(sweepPair->angles[1])},
+    };
+
+    // The sensor, not the Crazyflie, is in the plane through the base station origin
+    vec3d origin;
+    vec3d q;
+    lighthouseGeometryGetBaseStationPosition((baseStationGeometry_t*)sweepPair->baseStation, origin);
+    arm_sub_f32(origin, (float32_t *)sweepPair->sensorOffset, q, vec3d_size);
+
+    arm_matrix_instance_f32 rotation = {3, 3, (float32_t *)sweepPair->baseStation->mat};
+    for (int sweep = 0; sweep < 2; sweep++) {
+        arm_matrix_instance_f32 localNormal = {3, 1, localNormals[sweep]};
+        arm_matrix_instance_f32 normal = {3, 1, normals[sweep]};
+        arm_mat_mult_f32(&rotation, &localNormal, &normal);
+        distances[sweep] = vec_dot(normals[sweep], q);
+    }
+}
+
+// The 3x3 systems of the least squares solver are symmetric, but this is not exploited
+static float det3(const float m[3][3]) {
+    return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+         - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+         + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+}
+
+// The position is not determined by the sweeps if the determinant of the normal equations, relative to the cube of
+// the mean eigen value, is below this value. For one base station and the sensors on the deck the ratio is below
+// 1e-4 at 3 m, for two base stations with 90 degrees between the rays it is around 0.6.
+#define SWEEP_PAIRS_MIN_CONDITION 0.01f
+
+bool lighthouseGeometryGetPositionFromSweepPairs(const lighthouseGeometrySweepPair_t sweepPairs[], const int count, vec3d position, float *position_delta) {
+    // Normal equations of the least squares problem, sum(n n^T) x = sum(n d)
+    float ata[3][3] = {{0}};
+    vec3d atb = {0};
+
+    if (count <= 0) {
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        vec3d normals[2];
+        float distances[2];
+        getSweepPlanes(&sweepPairs[i], normals, distances);
+
+        for (int sweep = 0; sweep < 2; sweep++) {
+            const float* n = normals[sweep];
+            for (int row = 0; row < 3; row++) {
+                for (int col = 0; col < 3; col++) {
+                    ata[row][col] += n[row] * n[col];
+                }
+                atb[row] += n[row] * distances[sweep];
+            }
+        }
+    }
+
+    // The normals are unit vectors, the trace is the number of planes
+    const int planes = 2 * count;
+    const float meanEigenValue = planes / 3.0f;
+    const float det = det3(ata);
+    if (det < SWEEP_PAIRS_MIN_CONDITION * meanEigenValue * meanEigenValue * meanEigenValue) {
+        return false;
+    }
+
+    // Cramer's rule
+    for (int axis = 0; axis < 3; axis++) {
+        float m[3][3];
+        memcpy(m, ata, sizeof(m));
+        for (int row = 0; row < 3; row++) {
+            m[row][axis] = atb[row];
+        }
+        position[axis] = det3(m) / det;
+    }
+
+    // The residuals are computed in a second pass, the sum of squares can not be derived from the normal equations
+    // without cancellation in single precision
+    float sumOfSquares = 0.0f;
+    for (int i = 0; i < count; i++) {
+        vec3d normals[2];
+        float distances[2];
+        getSweepPlanes(&sweepPairs[i], normals, distances);
+
+        for (int sweep = 0; sweep < 2; sweep++) {
+            const float residual = vec_dot(normals[sweep], position) - distances[sweep];
+            sumOfSquares += residual * residual;
+        }
+    }
+    arm_sqrt_f32(sumOfSquares / planes, position_delta);
+
+    return true;
+}
+
 void lighthouseGeometryGetBaseStationPosition(baseStationGeometry_t* bs, vec3d baseStationPos) {
     // TODO: Make geometry adjustments within base station.
     vec3d rotated_origin_delta = {};
@@ -41,9 +41,29 @@ The implementation must handle
 3. Dynamically changing visibility of anchors over time
 4. Random TX times from anchors with possible packet collisions and packet loss
 
+The Cortex-M4 FPU only supports single precision and all calculations on a packet
+are done with integers and floats. Time stamps and tick counts are kept as
+integers, the clock correction is stored as its (small) deviation from 1 and the
+conversion from ticks to meters is a precalculated float. The original double
+precision implementation can be used by defining TDOA_ENGINE_USE_DOUBLE_PRECISION.
+
+Every received packet generates one TDoA measurement by default, using a random
+remote anchor from the packet. A packet often carries valid data for several
+remote anchors and more measurements per packet can be generated by setting
+pairsPerPacket (param tdoa3.pairs). The remote anchors with the most recent data
+are then used and the measurements are sent to the estimator in one batch.
+
+The measurements of a batch are not independent. They all use the reception time
+of the packet at the tag and the clock correction of the sending anchor, and
+share their errors. The estimator applies them one by one as independent
+measurements, the standard deviation is therefore scaled by the square root of
+the batch size. A batch then carries about as much information as a single
+measurement with the shared error, while the geometry of all pairs is used.
+
 */
 
 #include <string.h>
+#include <math.h>
 
 #define DEBUG_MODULE "TDOA_ENGINE"
 #include "debug.h"
@@ -52,6 +72,7 @@ The implementation must handle
 #include "tdoaStats.h"
 #include "clockCorrectionEngine.h"
 #include "physicalConstants.h"
+#include "test_support.h"
 
 #define MEASUREMENT_NOISE_STD 0.15f
 
@@ -60,6 +81,8 @@ void tdoaEngineInit(tdoaEngineState_t* engineState, const uint32_t now_ms, tdoaE
   tdoaStatsInit(&engineState->stats, now_ms);
   engineState->sendTdoaToEstimator = sendTdoaToEstimator;
   engineState->locodeckTsFreq = locodeckTsFreq;
+  engineState->metersPerTick = (float)(SPEED_OF_LIGHT / locodeckTsFreq);
+  engineState->pairsPerPacket = 1;
 }
 
 #define TRUNCATE_TO_ANCHOR_TS_BITMAP 0x00FFFFFFFF
@@ -67,17 +90,20 @@ static uint64_t truncateToAnchorTimeStamp(uint64_t fullTimeStamp) {
   return fullTimeStamp & TRUNCATE_TO_ANCHOR_TS_BITMAP;
 }
 
-static void enqueueTDOA(const tdoaAnchorContext_t* anchorACtx, const tdoaAnchorContext_t* anchorBCtx, double distanceDiff, tdoaEngineState_t* engineState) {
+// The tag time stamps are 40 bits and wrap around every 17.2 s
+#define TRUNCATE_TO_TAG_TS_BITMAP 0xFFFFFFFFFF
+static uint64_t truncateToTagTimeStamp(uint64_t fullTimeStamp) {
+  return fullTimeStamp & TRUNCATE_TO_TAG_TS_BITMAP;
+}
+
+static bool createTdoaMeasurement(const tdoaAnchorContext_t* anchorACtx, const tdoaAnchorContext_t* anchorBCtx, float distanceDiff, tdoaEngineState_t* engineState, tdoaMeasurement_t* tdoa) {
   tdoaStats_t* stats = &engineState->stats;
 
-  tdoaMeasurement_t tdoa = {
-    .stdDev = MEASUREMENT_NOISE_STD,
-    .distanceDiff = distanceDiff
-  };
+  tdoa->stdDev = MEASUREMENT_NOISE_STD;
+  tdoa->distanceDiff = distanceDiff;
 
-  if (tdoaStorageGetAnchorPosition(anchorACtx, &tdoa.anchorPosition[0]) && tdoaStorageGetAnchorPosition(anchorBCtx, &tdoa.anchorPosition[1])) {
+  if (tdoaStorageGetAnchorPosition(anchorACtx, &tdoa->anchorPosition[0]) && tdoaStorageGetAnchorPosition(anchorBCtx, &tdoa->anchorPosition[1])) {
       STATS_CNT_RATE_EVENT(&stats->packetsToEstimator);
-      engineState->sendTdoaToEstimator(&tdoa);
 
       uint8_t idA = tdoaStorageGetId(anchorACtx);
       uint8_t idB = tdoaStorageGetId(anchorBCtx);
@@ -87,7 +113,11 @@ static void enqueueTDOA(const tdoaAnchorContext_t* anchorACtx, const tdoaAnchorC
       if (idB == stats->anchorId && idA == stats->remoteAnchorId) {
         stats->tdoa = -distanceDiff;
       }
+
+      return true;
   }
+
+  return false;
 }
 
 static bool updateClockCorrection(tdoaAnchorContext_t* anchorCtx, const int64_t txAn_in_cl_An, const int64_t rxAn_by_T_in_cl_T, tdoaStats_t* stats) {
@@ -97,12 +127,24 @@ static bool updateClockCorrection(tdoaAnchorContext_t* anchorCtx, const int64_t
   const int64_t latest_txAn_in_cl_An = tdoaStorageGetTxTime(anchorCtx);
 
   if (latest_rxAn_by_T_in_cl_T != 0 && latest_txAn_in_cl_An != 0) {
+    clockCorrectionStorage_t* clockCorrectionStorage = tdoaStorageGetClockCorrectionStorage(anchorCtx);
+#ifdef TDOA_ENGINE_USE_DOUBLE_PRECISION
     double clockCorrectionCandidate = clockCorrectionEngineCalculate(rxAn_by_T_in_cl_T, latest_rxAn_by_T_in_cl_T, txAn_in_cl_An, latest_txAn_in_cl_An, TRUNCATE_TO_ANCHOR_TS_BITMAP);
-    sampleIsReliable = clockCorrectionEngineUpdate(tdoaStorageGetClockCorrectionStorage(anchorCtx), clockCorrectionCandidate);
+    sampleIsReliable = clockCorrectionEngineUpdate(clockCorrectionStorage, clockCorrectionCandidate);
+#else
+    float clockCorrectionDeviationCandidate = clockCorrectionEngineCalculateDeviation(rxAn_by_T_in_cl_T, latest_rxAn_by_T_in_cl_T, txAn_in_cl_An, latest_txAn_in_cl_An, TRUNCATE_TO_ANCHOR_TS_BITMAP);
+    sampleIsReliable = clockCorrectionEngineUpdateDeviation(clockCorrectionStorage, clockCorrectionDeviationCandidate);
+#endif
 
     if (sampleIsReliable){
       if (tdoaStorageGetId(anchorCtx) == stats->anchorId) {
+#ifdef TDOA_ENGINE_USE_DOUBLE_PRECISION
         stats->clockCorrection = tdoaStorageGetClockCorrection(anchorCtx);
+#else
+        float clockCorrectionDeviation;
+        clockCorrectionEngineGetDeviation(clockCorrectionStorage, &clockCorrectionDeviation);
+        stats->clockCorrection = 1.0f + clockCorrectionDeviation;
+#endif
         STATS_CNT_RATE_EVENT(&stats->clockCorrectionCount);
       }
     }
@@ -111,24 +153,51 @@ static bool updateClockCorrection(tdoaAnchorContext_t* anchorCtx, const int64_t
   return sampleIsReliable;
 }
 
-static int64_t calcTDoA(const tdoaAnchorContext_t* otherAnchorCtx, const tdoaAnchorContext_t* anchorCtx, const int64_t txAn_in_cl_An, const int64_t rxAn_by_T_in_cl_T) {
+#if defined(TDOA_ENGINE_USE_DOUBLE_PRECISION) || defined(UNIT_TEST_MODE)
+// The original implementation, where the clock correction and the conversion to meters are done in double precision
+TESTABLE_STATIC double calcDistanceDiffDouble(const int64_t rxAn_by_T_in_cl_T, const int64_t rxAr_by_T_in_cl_T, const int64_t delta_txAr_to_txAn_in_cl_An, const double clockCorrection, const double locodeckTsFreq) {
+  const int64_t timeDiffOfArrival_in_cl_T =  truncateToAnchorTimeStamp(rxAn_by_T_in_cl_T - rxAr_by_T_in_cl_T) - delta_txAr_to_txAn_in_cl_An  * clockCorrection;
+  return SPEED_OF_LIGHT * timeDiffOfArrival_in_cl_T / locodeckTsFreq;
+}
+#endif
+
+#if !defined(TDOA_ENGINE_USE_DOUBLE_PRECISION) || defined(UNIT_TEST_MODE)
+// delta * clockCorrection is split into delta + delta * deviation. The uncorrected time difference of arrival is
+// calculated exactly with integers and is small enough to be converted to a float without loss, the correction term
+// only needs a few significant digits.
+TESTABLE_STATIC float calcDistanceDiffSingle(const int64_t rxAn_by_T_in_cl_T, const int64_t rxAr_by_T_in_cl_T, const int64_t delta_txAr_to_txAn_in_cl_An, const float clockCorrectionDeviation, const float metersPerTick) {
+  const int64_t uncorrectedTimeDiffOfArrival = (int64_t)truncateToAnchorTimeStamp(rxAn_by_T_in_cl_T - rxAr_by_T_in_cl_T) - delta_txAr_to_txAn_in_cl_An;
+  const float timeDiffOfArrival_in_cl_T = (float)uncorrectedTimeDiffOfArrival - (float)delta_txAr_to_txAn_in_cl_An * clockCorrectionDeviation;
+  return timeDiffOfArrival_in_cl_T * metersPerTick;
+}
+#endif
+
+static float calcDistanceDiff(const tdoaAnchorContext_t* otherAnchorCtx, const tdoaAnchorContext_t* anchorCtx, const int64_t txAn_in_cl_An, const int64_t rxAn_by_T_in_cl_T, const tdoaEngineState_t* engineState) {
   const uint8_t otherAnchorId = tdoaStorageGetId(otherAnchorCtx);
 
   const int64_t tof_Ar_to_An_in_cl_An = tdoaStorageGetTimeOfFlight(anchorCtx, otherAnchorId);
   const int64_t rxAr_by_An_in_cl_An = tdoaStorageGetRemoteRxTime(anchorCtx, otherAnchorId);
-  const double clockCorrection = tdoaStorageGetClockCorrection(anchorCtx);
-
   const int64_t rxAr_by_T_in_cl_T = tdoaStorageGetRxTime(otherAnchorCtx);
 
   const int64_t delta_txAr_to_txAn_in_cl_An = (tof_Ar_to_An_in_cl_An + truncateToAnchorTimeStamp(txAn_in_cl_An - rxAr_by_An_in_cl_An));
-  const int64_t timeDiffOfArrival_in_cl_T =  truncateToAnchorTimeStamp(rxAn_by_T_in_cl_T - rxAr_by_T_in_cl_T) - delta_txAr_to_txAn_in_cl_An  * clockCorrection;
 
-  return timeDiffOfArrival_in_cl_T;
+#ifdef TDOA_ENGINE_USE_DOUBLE_PRECISION
+  const double clockCorrection = tdoaStorageGetClockCorrection(anchorCtx);
+  return calcDistanceDiffDouble(rxAn_by_T_in_cl_T, rxAr_by_T_in_cl_T, delta_txAr_to_txAn_in_cl_An, clockCorrection, engineState->locodeckTsFreq);
+#else
+  float clockCorrectionDeviation;
+  clockCorrectionEngineGetDeviation(tdoaStorageGetClockCorrectionStorage(anchorCtx), &clockCorrectionDeviation);
+  return calcDistanceDiffSingle(rxAn_by_T_in_cl_T, rxAr_by_T_in_cl_T, delta_txAr_to_txAn_in_cl_An, clockCorrectionDeviation, engineState->metersPerTick);
+#endif
 }
 
-static double calcDistanceDiff(const tdoaAnchorContext_t* otherAnchorCtx, const tdoaAnchorContext_t* anchorCtx, const int64_t txAn_in_cl_An, const int64_t rxAn_by_T_in_cl_T, const double locodeckTsFreq) {
-  const int64_t tdoa = calcTDoA(otherAnchorCtx, anchorCtx, txAn_in_cl_An, rxAn_by_T_in_cl_T);
-  return SPEED_OF_LIGHT * tdoa / locodeckTsFreq;
+static bool hasClockCorrection(const tdoaAnchorContext_t* anchorCtx) {
+#ifdef TDOA_ENGINE_USE_DOUBLE_PRECISION
+  return tdoaStorageGetClockCorrection(anchorCtx) > 0.0;
+#else
+  float clockCorrectionDeviation;
+  return clockCorrectionEngineGetDeviation(tdoaStorageGetClockCorrectionStorage(anchorCtx), &clockCorrectionDeviation);
+#endif
 }
 
 static bool findSuitableAnchor(tdoaEngineState_t* engineState, tdoaAnchorContext_t* otherAnchorCtx, const tdoaAnchorContext_t* anchorCtx) {
@@ -136,7 +205,7 @@ static bool findSuitableAnchor(tdoaEngineState_t* engineState, tdoaAnchorContext
   static uint8_t id[REMOTE_ANCHOR_DATA_COUNT];
   static uint8_t offset = 0;
 
-  if (tdoaStorageGetClockCorrection(anchorCtx) <= 0.0) {
+  if (! hasClockCorrection(anchorCtx)) {
     return false;
   }
 
@@ -163,6 +232,69 @@ static bool findSuitableAnchor(tdoaEngineState_t* engineState, tdoaAnchorContext
   return false;
 }
 
+// Find the remote anchors with the most recent data, youngest first. The error from the clock correction grows with
+// the time between the packets from the two anchors.
+static int findYoungestSuitableAnchors(tdoaEngineState_t* engineState, tdoaAnchorContext_t otherAnchorCtxs[], const int maxCount, const tdoaAnchorContext_t* anchorCtx, const int64_t rxAn_by_T_in_cl_T) {
+  static uint8_t seqNr[REMOTE_ANCHOR_DATA_COUNT];
+  static uint8_t id[REMOTE_ANCHOR_DATA_COUNT];
+  int64_t age[TDOA_ENGINE_MAX_PAIRS_PER_PACKET];
+  int count = 0;
+
+  if (! hasClockCorrection(anchorCtx)) {
+    return 0;
+  }
+
+  int remoteCount = 0;
+  tdoaStorageGetRemoteSeqNrList(anchorCtx, &remoteCount, seqNr, id);
+
+  uint32_t now_ms = anchorCtx->currentTime_ms;
+
+  for (int i = 0; i < remoteCount; i++) {
+    // Unknown anchors are not added to the storage here, that could re-use the slot of an anchor already picked
+    tdoaAnchorContext_t candidateCtx;
+    if (tdoaStorageGetAnchorCtx(engineState->anchorInfoArray, id[i], now_ms, &candidateCtx)) {
+      if (seqNr[i] == tdoaStorageGetSeqNr(&candidateCtx) && tdoaStorageGetTimeOfFlight(anchorCtx, id[i])) {
+        const int64_t candidateAge = truncateToTagTimeStamp(rxAn_by_T_in_cl_T - tdoaStorageGetRxTime(&candidateCtx));
+
+        // Insert in age order, the oldest candidate falls out when the list is full
+        int pos = count;
+        while (pos > 0 && age[pos - 1] > candidateAge) {
+          pos--;
+        }
+
+        if (pos < maxCount) {
+          if (count < maxCount) {
+            count++;
+          }
+
+          for (int j = count - 1; j > pos; j--) {
+            age[j] = age[j - 1];
+            otherAnchorCtxs[j] = otherAnchorCtxs[j - 1];
+          }
+
+          age[pos] = candidateAge;
+          otherAnchorCtxs[pos] = candidateCtx;
+        }
+      }
+    }
+  }
+
+  return count;
+}
+
+static int findSuitableAnchors(tdoaEngineState_t* engineState, tdoaAnchorContext_t otherAnchorCtxs[], const tdoaAnchorContext_t* anchorCtx, const int64_t rxAn_by_T_in_cl_T) {
+  int maxCount = engineState->pairsPerPacket;
+  if (maxCount > TDOA_ENGINE_MAX_PAIRS_PER_PACKET) {
+    maxCount = TDOA_ENGINE_MAX_PAIRS_PER_PACKET;
+  }
+
+  if (maxCount <= 1) {
+    return findSuitableAnchor(engineState, &otherAnchorCtxs[0], anchorCtx) ? 1 : 0;
+  }
+
+  return findYoungestSuitableAnchors(engineState, otherAnchorCtxs, maxCount, anchorCtx, rxAn_by_T_in_cl_T);
+}
+
 void tdoaEngineGetAnchorCtxForPacketProcessing(tdoaEngineState_t* engineState, const uint8_t anchorId, const uint32_t currentTime_ms, tdoaAnchorContext_t* anchorCtx) {
   if (tdoaStorageGetCreateAnchorCtx(engineState->anchorInfoArray, anchorId, currentTime_ms, anchorCtx)) {
     STATS_CNT_RATE_EVENT(&engineState->stats.contextHitCount);
@@ -176,11 +308,28 @@ void tdoaEngineProcessPacket(tdoaEngineState_t* engineState, tdoaAnchorContext_t
   if (timeIsGood) {
     STATS_CNT_RATE_EVENT(&engineState->stats.timeIsGood);
 
-    tdoaAnchorContext_t otherAnchorCtx;
-    if (findSuitableAnchor(engineState, &otherAnchorCtx, anchorCtx)) {
+    tdoaAnchorContext_t otherAnchorCtxs[TDOA_ENGINE_MAX_PAIRS_PER_PACKET];
+    int otherAnchorCount = findSuitableAnchors(engineState, otherAnchorCtxs, anchorCtx, rxAn_by_T_in_cl_T);
+    if (otherAnchorCount > 0) {
       STATS_CNT_RATE_EVENT(&engineState->stats.suitableDataFound);
-      double tdoaDistDiff = calcDistanceDiff(&otherAnchorCtx, anchorCtx, txAn_in_cl_An, rxAn_by_T_in_cl_T, engineState->locodeckTsFreq);
-      enqueueTDOA(&otherAnchorCtx, anchorCtx, tdoaDistDiff, engineState);
+
+      tdoaMeasurement_t tdoaMeasurements[TDOA_ENGINE_MAX_PAIRS_PER_PACKET];
+      int measurementCount = 0;
+      for (int i = 0; i < otherAnchorCount; i++) {
+        float tdoaDistDiff = calcDistanceDiff(&otherAnchorCtxs[i], anchorCtx, txAn_in_cl_An, rxAn_by_T_in_cl_T, engineState);
+        if (createTdoaMeasurement(&otherAnchorCtxs[i], anchorCtx, tdoaDistDiff, engineState, &tdoaMeasurements[measurementCount])) {
+          measurementCount++;
+        }
+      }
+
+      if (measurementCount > 0) {
+        // The errors of the measurements in a batch are correlated, see the top of the file
+        const float stdDev = MEASUREMENT_NOISE_STD * sqrtf(measurementCount);
+        for (int i = 0; i < measurementCount; i++) {
+          tdoaMeasurements[i].stdDev = stdDev;
+        }
+        engineState->sendTdoaToEstimator(tdoaMeasurements, measurementCount);
+      }
     }
   }
 }
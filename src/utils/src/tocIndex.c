@@ -0,0 +1,141 @@
+/**
+ * ,---------,       ____  _ __
+ * |  ,-^-,  |      / __ )(_) /_______________ _____  ___
+ * | (  O  ) |     / __  / / __/ ___/ ___/ __ `/_  / / _ \
+ * | / ,--´  |    / /_/ / / /_/ /__/ /  / /_/ / / /_/  __/
+ *    +------`   /_____/_/\__/\___/_/   \__,_/ /___/\___/
+ *
+ * Crazyflie control firmware
+ *
+ * Copyright (C) 2020 Bitcraze AB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, in version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *
+ * tocIndex.c - Index of a log or param TOC, for lookups by id and by name
+ * without scanning the TOC.
+ *
+ * A sorted table of name hashes is used rather than a perfect hash, it is
+ * simple to build at boot and lookups are O(log n) with one or two string
+ * compares.
+ */
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+
+#include "tocIndex.h"
+#include "cfassert.h"
+
+void tocIndexInit(tocIndex_t* index, tocIndexGetEntry_t getEntry, const int tocLength, const int varCount)
+{
+  char* group = "";
+  int n = 0;
+
+  index->getEntry = getEntry;
+  index->varCount = varCount;
+  index->varIndex = pvPortMalloc(varCount * sizeof(uint16_t));
+  index->nameHashes = pvPortMalloc(varCount * sizeof(uint32_t));
+  index->nameIndex = pvPortMalloc(varCount * sizeof(uint16_t));
+  ASSERT(index->varIndex && index->nameHashes && index->nameIndex);
+
+  for (int i=0; i<tocLength; i++)
+  {
+    char* name;
+    tocIndexEntryType_t type = getEntry(i, &name);
+
+    if (type == tocIndexEntryGroupStart) {
+      group = name;
+    } else if (type == tocIndexEntryVariable) {
+      ASSERT(n < varCount);
+      uint32_t hash = tocIndexHashName(group, name);
+
+      // Insertion sort on the hash, variables with the same hash stay in TOC order
+      int j = n;
+      while (j > 0 && index->nameHashes[j-1] > hash) {
+        index->nameHashes[j] = index->nameHashes[j-1];
+        index->nameIndex[j] = index->nameIndex[j-1];
+        j--;
+      }
+      index->nameHashes[j] = hash;
+      index->nameIndex[j] = i;
+
+      index->varIndex[n] = i;
+      n++;
+    }
+  }
+}
+
+int tocIndexGetTocIndex(const tocIndex_t* index, const int id)
+{
+  if (id < 0 || id >= index->varCount)
+    return -1;
+
+  return index->varIndex[id];
+}
+
+char* tocIndexGetGroupName(const tocIndex_t* index, const int tocIndex)
+{
+  for (int i=tocIndex; i>=0; i--)
+  {
+    char* name;
+    if (index->getEntry(i, &name) == tocIndexEntryGroupStart)
+      return name;
+  }
+
+  return "";
+}
+
+// Binary search for the hash, then compare the names of the (usually single) match
+int tocIndexFindByName(const tocIndex_t* index, const char* group, const char* name)
+{
+  uint32_t hash = tocIndexHashName(group, name);
+  int low = 0;
+  int high = index->varCount;
+
+  while (low < high)
+  {
+    int mid = (low + high) / 2;
+    if (index->nameHashes[mid] < hash)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  for (int i=low; i<index->varCount && index->nameHashes[i] == hash; i++)
+  {
+    int tocIndex = index->nameIndex[i];
+    char* candidateName;
+    index->getEntry(tocIndex, &candidateName);
+    if (!strcmp(name, candidateName) && !strcmp(group, tocIndexGetGroupName(index, tocIndex)))
+      return tocIndex;
+  }
+
+  return -1;
+}
+
+uint32_t tocIndexHashName(const char* group, const char* name)
+{
+  uint32_t hash = 2166136261u;
+
+  for (const char* c = group; *c; c++)
+    hash = (hash ^ (uint8_t)*c) * 16777619u;
+
+  hash = (hash ^ (uint8_t)'.') * 16777619u;
+
+  for (const char* c = name; *c; c++)
+    hash = (hash ^ (uint8_t)*c) * 16777619u;
+
+  return hash;
+}
@@ -13,6 +13,7 @@
 #include "dw1000Mocks.h"
 #include "freertosMocks.h"
 #include "physicalConstants.h"
+#include "clockCorrectionEngine.h"
 
 // The local clock uses 40 bits
 #define TIMER_TAG_MAX_VALUE 0x000000FFFFFFFFFFul
@@ -0,0 +1,200 @@
+// File under test usddeck_buffers.c
+#include "usddeck_buffers.h"
+
+#include <string.h>
+#include "unity.h"
+
+// Room for 4 records of RECORD_SIZE per buffer
+#define RECORD_SIZE 10
+#define BUFFER_SIZE (USD_BUFFER_HEADER_SIZE + 4 * RECORD_SIZE + USD_BUFFER_CRC_SIZE)
+
+static uint8_t data0[BUFFER_SIZE];
+static uint8_t data1[BUFFER_SIZE];
+static usdSectorBufferPair_t pair;
+
+static uint8_t nextRecord;
+static int handOvers;
+static int drops;
+
+// Sequence numbers of the records in the order the buffers are written
+static uint8_t writtenRecords[64];
+static int writtenCount;
+
+static void logRecords(const int count);
+static void writeFullBuffers();
+
+void setUp(void) {
+  usdSectorBufferPairInit(&pair, data0, data1, BUFFER_SIZE);
+  nextRecord = 0;
+  handOvers = 0;
+  drops = 0;
+  writtenCount = 0;
+}
+
+void tearDown(void) {
+  // Empty
+}
+
+void testThatNoBufferIsFullBeforeTheFirstOneOverflows() {
+  // Fixture
+  logRecords(4);
+
+  // Test
+  usdSectorBuffer_t* actual = usdSectorBufferPairGetFull(&pair);
+
+  // Assert
+  TEST_ASSERT_NULL(actual);
+  TEST_ASSERT_EQUAL_INT(0, handOvers);
+}
+
+void testThatTheFirstBufferIsWrittenFirstWhenTheWriterWakesUp() {
+  // Fixture
+  // The fifth record does not fit, the first buffer is handed over and the active buffer is the second one
+  logRecords(5);
+
+  // Test
+  writeFullBuffers();
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(1, handOvers);
+  TEST_ASSERT_EQUAL_INT(4, writtenCount);
+  uint8_t expected[] = {0, 1, 2, 3};
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, writtenRecords, 4);
+}
+
+void testThatBuffersAreWrittenInTheOrderTheyWereFilled() {
+  // Fixture
+
+  // Test
+  for (int i = 0; i < 5; i++) {
+    logRecords(4);
+    writeFullBuffers();
+  }
+
+  // Assert
+  // The last 4 records are still in the active buffer
+  TEST_ASSERT_EQUAL_INT(0, drops);
+  TEST_ASSERT_EQUAL_INT(16, writtenCount);
+  for (int i = 0; i < writtenCount; i++) {
+    TEST_ASSERT_EQUAL_UINT8(i, writtenRecords[i]);
+  }
+}
+
+void testThatBothFullBuffersAreWrittenOldestFirst() {
+  // Fixture
+  // Both buffers full, the ninth record is dropped
+  logRecords(9);
+
+  // Test
+  writeFullBuffers();
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(1, drops);
+  TEST_ASSERT_EQUAL_INT(8, writtenCount);
+  for (int i = 0; i < writtenCount; i++) {
+    TEST_ASSERT_EQUAL_UINT8(i, writtenRecords[i]);
+  }
+}
+
+void testThatRecordsAreDroppedWhileBothBuffersAreFull() {
+  // Fixture
+  logRecords(8);
+
+  // Test
+  uint8_t* actual[3];
+  bool isHandedOver;
+  for (int i = 0; i < 3; i++) {
+    actual[i] = usdSectorBufferPairReserve(&pair, RECORD_SIZE, &isHandedOver);
+  }
+
+  // Assert
+  TEST_ASSERT_NULL(actual[0]);
+  TEST_ASSERT_NULL(actual[1]);
+  TEST_ASSERT_NULL(actual[2]);
+}
+
+void testThatLoggingContinuesInTheWrittenBufferWhenBothWereFull() {
+  // Fixture
+  logRecords(9);
+  usdSectorBufferPairGetFull(&pair);
+  usdSectorBufferPairWritten(&pair);
+
+  // Test
+  bool isHandedOver;
+  uint8_t* actual = usdSectorBufferPairReserve(&pair, RECORD_SIZE, &isHandedOver);
+
+  // Assert
+  TEST_ASSERT_EQUAL_PTR(data0 + USD_BUFFER_HEADER_SIZE, actual);
+}
+
+void testThatTheActiveBufferIsWrittenLastWhenLoggingStops() {
+  // Fixture
+  // The first buffer is full and 2 records are in the active buffer
+  logRecords(6);
+
+  // Test
+  usdSectorBufferPairCloseActive(&pair);
+  writeFullBuffers();
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(6, writtenCount);
+  for (int i = 0; i < writtenCount; i++) {
+    TEST_ASSERT_EQUAL_UINT8(i, writtenRecords[i]);
+  }
+}
+
+void testThatAnEmptyActiveBufferIsNotWrittenWhenLoggingStops() {
+  // Fixture
+
+  // Test
+  usdSectorBufferPairCloseActive(&pair);
+
+  // Assert
+  TEST_ASSERT_NULL(usdSectorBufferPairGetFull(&pair));
+}
+
+void testThatResetStartsTheNextSessionWithEmptyBuffers() {
+  // Fixture
+  logRecords(6);
+
+  // Test
+  usdSectorBufferPairReset(&pair);
+  logRecords(5);
+  writeFullBuffers();
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(4, writtenCount);
+  uint8_t expected[] = {6, 7, 8, 9};
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, writtenRecords, 4);
+}
+
+// Helpers ////////////////////////////////////////////////////////////////////
+
+// Logs records holding their sequence number, as usddeck.c reserveRecord() does
+static void logRecords(const int count) {
+  for (int i = 0; i < count; i++) {
+    bool isHandedOver;
+    uint8_t* record = usdSectorBufferPairReserve(&pair, RECORD_SIZE, &isHandedOver);
+    if (isHandedOver) {
+      handOvers++;
+    }
+
+    if (record) {
+      memset(record, nextRecord, RECORD_SIZE);
+    } else {
+      drops++;
+    }
+    nextRecord++;
+  }
+}
+
+// Writes the full buffers as usdWriteTask does, collecting the records in file order
+static void writeFullBuffers() {
+  usdSectorBuffer_t* buffer;
+  while ((buffer = usdSectorBufferPairGetFull(&pair))) {
+    for (int i = 0; i < buffer->records; i++) {
+      writtenRecords[writtenCount++] = buffer->data[USD_BUFFER_HEADER_SIZE + i * RECORD_SIZE];
+    }
+    usdSectorBufferPairWritten(&pair);
+  }
+}
@@ -0,0 +1,422 @@
+// File under test kalman_core.c
+#include "kalman_core.h"
+
+#include <math.h>
+#include <string.h>
+#include "unity.h"
+#include "math3d.h"
+
+#include "mock_cfassert.h"
+#include "mock_outlierFilter.h"
+
+// Build the arm dsp math lib and use the "real thing" instead of mocking calls to it
+// @BUILD_LIB ARM_DSP_MATH
+
+// Functions under test
+void scalarUpdateDense(kalmanCoreData_t* this, arm_matrix_instance_f32 *Hm, float error, float stdMeasNoise);
+void scalarUpdateSparse(kalmanCoreData_t* this, arm_matrix_instance_f32 *Hm, float error, float stdMeasNoise);
+void predictCovarianceDense(kalmanCoreData_t* this, arm_matrix_instance_f32 *Am);
+void predictCovarianceBlock(kalmanCoreData_t* this, const float A[][KC_STATE_DIM]);
+
+static void initCorrelatedCoreData(kalmanCoreData_t* coreData);
+static void initDynamicsMatrix(float A[KC_STATE_DIM][KC_STATE_DIM], float scale);
+static void updateWithPositionUsingScalarUpdates(kalmanCoreData_t* coreData, const positionMeasurement_t* xyz);
+static void updateWithPoseUsingScalarUpdates(kalmanCoreData_t* coreData, const poseMeasurement_t* pose);
+static void updateWithSweepAnglesUsingScalarUpdates(kalmanCoreData_t* coreData, const sweepAngleMeasurement_t angles[], const int count);
+static void updateWithRowsUsingScalarUpdates(kalmanCoreData_t* coreData, float h[][KC_STATE_DIM], const float error[], const float stdDev[], const int count);
+static void initBaseStationGeometry(baseStationGeometry_t* geometry, float x, float y, float z, float yaw);
+static void initLocalizedCoreData(void);
+static void copyCoreData(kalmanCoreData_t* dst, const kalmanCoreData_t* src);
+static void assertCoreDataWithin(const kalmanCoreData_t* expected, const kalmanCoreData_t* actual);
+
+static kalmanCoreData_t denseData;
+static kalmanCoreData_t sparseData;
+
+void setUp(void) {
+  initCorrelatedCoreData(&denseData);
+  copyCoreData(&sparseData, &denseData);
+}
+
+void tearDown(void) {
+  // Empty
+}
+
+
+void testThatSparseUpdateMatchesDenseUpdateForSingleStateMeasurement() {
+  // Fixture
+  float h[KC_STATE_DIM] = {0};
+  arm_matrix_instance_f32 H = {1, KC_STATE_DIM, h};
+  h[KC_STATE_Z] = 1;
+
+  // Test
+  scalarUpdateDense(&denseData, &H, 0.2f, 0.05f);
+  scalarUpdateSparse(&sparseData, &H, 0.2f, 0.05f);
+
+  // Assert
+  assertCoreDataWithin(&denseData, &sparseData);
+}
+
+void testThatSparseUpdateMatchesDenseUpdateForDistanceMeasurement() {
+  // Fixture
+  float h[KC_STATE_DIM] = {0};
+  arm_matrix_instance_f32 H = {1, KC_STATE_DIM, h};
+  h[KC_STATE_X] = 0.48f;
+  h[KC_STATE_Y] = -0.6f;
+  h[KC_STATE_Z] = 0.64f;
+
+  // Test
+  scalarUpdateDense(&denseData, &H, -0.15f, 0.25f);
+  scalarUpdateSparse(&sparseData, &H, -0.15f, 0.25f);
+
+  // Assert
+  assertCoreDataWithin(&denseData, &sparseData);
+}
+
+void testThatSparseUpdateMatchesDenseUpdateForFlowMeasurement() {
+  // Fixture
+  float h[KC_STATE_DIM] = {0};
+  arm_matrix_instance_f32 H = {1, KC_STATE_DIM, h};
+  h[KC_STATE_Z] = -2.3f;
+  h[KC_STATE_PX] = 4.1f;
+
+  // Test
+  scalarUpdateDense(&denseData, &H, 1.5f, 2.0f);
+  scalarUpdateSparse(&sparseData, &H, 1.5f, 2.0f);
+
+  // Assert
+  assertCoreDataWithin(&denseData, &sparseData);
+}
+
+void testThatSparseUpdateMatchesDenseUpdateForFullMeasurement() {
+  // Fixture
+  float h[KC_STATE_DIM] = {0};
+  arm_matrix_instance_f32 H = {1, KC_STATE_DIM, h};
+  for (int i = 0; i < KC_STATE_DIM; i++) {
+    h[i] = 0.1f * (i + 1) * ((i % 2) ? -1.0f : 1.0f);
+  }
+
+  // Test
+  scalarUpdateDense(&denseData, &H, 0.05f, 0.1f);
+  scalarUpdateSparse(&sparseData, &H, 0.05f, 0.1f);
+
+  // Assert
+  assertCoreDataWithin(&denseData, &sparseData);
+}
+
+void testThatSparseUpdateMatchesDenseUpdateOverASequenceOfUpdates() {
+  // Fixture
+  Axis3f acc = {.x = 0.1f, .y = -0.05f, .z = 1.0f};
+  Axis3f gyro = {.x = 0.2f, .y = -0.1f, .z = 0.3f};
+  float dt = 0.01f;
+
+  // Test
+  for (int i = 0; i < 50; i++) {
+    float h[KC_STATE_DIM] = {0};
+    arm_matrix_instance_f32 H = {1, KC_STATE_DIM, h};
+    h[KC_STATE_X + (i % 3)] = 1;
+    h[KC_STATE_D0 + (i % 3)] = 0.5f;
+    float error = 0.01f * (i % 7) - 0.03f;
+
+    scalarUpdateDense(&denseData, &H, error, 0.1f);
+    scalarUpdateSparse(&sparseData, &H, error, 0.1f);
+
+    kalmanCoreFinalize(&denseData, i);
+    kalmanCoreFinalize(&sparseData, i);
+    kalmanCorePredict(&denseData, 0.0f, &acc, &gyro, dt, true);
+    kalmanCorePredict(&sparseData, 0.0f, &acc, &gyro, dt, true);
+    kalmanCoreAddProcessNoise(&denseData, dt);
+    kalmanCoreAddProcessNoise(&sparseData, dt);
+  }
+
+  // Assert
+  assertCoreDataWithin(&denseData, &sparseData);
+}
+
+void testThatBlockPredictionMatchesDensePrediction() {
+  // Fixture
+  float A[KC_STATE_DIM][KC_STATE_DIM];
+  arm_matrix_instance_f32 Am = {KC_STATE_DIM, KC_STATE_DIM, (float*)A};
+  initDynamicsMatrix(A, 0.01f);
+
+  // Test
+  predictCovarianceDense(&denseData, &Am);
+  predictCovarianceBlock(&sparseData, A);
+
+  // Assert
+  assertCoreDataWithin(&denseData, &sparseData);
+}
+
+void testThatBlockPredictionMatchesDensePredictionForLargeTimeSteps() {
+  // Fixture
+  float A[KC_STATE_DIM][KC_STATE_DIM];
+  arm_matrix_instance_f32 Am = {KC_STATE_DIM, KC_STATE_DIM, (float*)A};
+  initDynamicsMatrix(A, 0.5f);
+
+  // Test
+  for (int i = 0; i < 10; i++) {
+    predictCovarianceDense(&denseData, &Am);
+    predictCovarianceBlock(&sparseData, A);
+  }
+
+  // Assert
+  assertCoreDataWithin(&denseData, &sparseData);
+}
+
+void testThatPositionUpdateMatchesSequentialScalarUpdates() {
+  // Fixture
+  positionMeasurement_t xyz = {.x = 0.3f, .y = -0.2f, .z = 1.1f, .stdDev = 0.01f};
+  initLocalizedCoreData();
+
+  // Test
+  updateWithPositionUsingScalarUpdates(&denseData, &xyz);
+  kalmanCoreUpdateWithPosition(&sparseData, &xyz);
+
+  // Assert
+  assertCoreDataWithin(&denseData, &sparseData);
+}
+
+void testThatBatchedPositionUpdatesMatchSequentialScalarUpdates() {
+  // Fixture
+  positionMeasurement_t xyz[] = {
+    {.x = 0.3f, .y = -0.2f, .z = 1.1f, .stdDev = 0.01f},
+    {.x = 0.31f, .y = -0.22f, .z = 1.08f, .stdDev = 0.02f},
+    {.x = 0.29f, .y = -0.19f, .z = 1.12f, .stdDev = 0.05f},
+  };
+  const int count = sizeof(xyz) / sizeof(xyz[0]);
+  initLocalizedCoreData();
+
+  // Test
+  for (int i = 0; i < count; i++) {
+    updateWithPositionUsingScalarUpdates(&denseData, &xyz[i]);
+  }
+  kalmanCoreUpdateWithPositionBatch(&sparseData, xyz, count);
+
+  // Assert
+  assertCoreDataWithin(&denseData, &sparseData);
+}
+
+void testThatPoseUpdateMatchesSequentialScalarUpdates() {
+  // Fixture
+  poseMeasurement_t pose = {
+    .x = 0.3f, .y = -0.2f, .z = 1.1f,
+    .quat = {.x = 0.02f, .y = -0.01f, .z = 0.05f, .w = 0.9985f},
+    .stdDevPos = 0.01f,
+    .stdDevQuat = 0.02f,
+  };
+  initLocalizedCoreData();
+
+  // Test
+  updateWithPoseUsingScalarUpdates(&denseData, &pose);
+  kalmanCoreUpdateWithPose(&sparseData, &pose);
+
+  // Assert
+  assertCoreDataWithin(&denseData, &sparseData);
+}
+
+void testThatBatchedSweepAngleUpdatesMatchSequentialScalarUpdates() {
+  // Fixture
+  sweepAngleMeasurement_t angles[3] = {
+    {.angleX = -0.12f, .angleY = -0.49f, .stdDevX = 0.01f, .stdDevY = 0.01f},
+    {.angleX = 0.01f, .angleY = -0.46f, .stdDevX = 0.01f, .stdDevY = 0.02f},
+    {.angleX = -0.13f, .angleY = -0.48f, .stdDevX = 0.02f, .stdDevY = 0.01f},
+  };
+  initBaseStationGeometry(&angles[0].geometry, -2.0f, -2.0f, 2.5f, (float)M_PI / 4);
+  initBaseStationGeometry(&angles[1].geometry, 2.5f, 2.0f, 2.6f, -3 * (float)M_PI / 4);
+  initBaseStationGeometry(&angles[2].geometry, -2.0f, -2.0f, 2.5f, (float)M_PI / 4);
+  const int count = sizeof(angles) / sizeof(angles[0]);
+  initLocalizedCoreData();
+
+  // Test
+  updateWithSweepAnglesUsingScalarUpdates(&denseData, angles, count);
+  kalmanCoreUpdateWithSweepAnglesBatch(&sparseData, angles, count);
+
+  // Assert
+  assertCoreDataWithin(&denseData, &sparseData);
+}
+
+
+// Helpers ///////////////////////////////////////////////////////////
+
+static void initCorrelatedCoreData(kalmanCoreData_t* coreData) {
+  Axis3f acc = {.x = 0.0f, .y = 0.0f, .z = 1.0f};
+  Axis3f gyro = {.x = 0.5f, .y = -0.3f, .z = 0.2f};
+  float dt = 0.01f;
+
+  kalmanCoreInit(coreData);
+  coreData->S[KC_STATE_PX] = 0.5f;
+  coreData->S[KC_STATE_PY] = -0.2f;
+  coreData->S[KC_STATE_PZ] = 0.1f;
+
+  // Propagate for a while to get a covariance matrix with cross correlations
+  for (int i = 0; i < 20; i++) {
+    kalmanCorePredict(coreData, 0.0f, &acc, &gyro, dt, true);
+    kalmanCoreAddProcessNoise(coreData, dt);
+    kalmanCoreFinalize(coreData, i);
+  }
+}
+
+// Fills A with the block structure of the linearized dynamics, see kalmanCorePredict()
+static void initDynamicsMatrix(float A[KC_STATE_DIM][KC_STATE_DIM], float scale) {
+  memset(A, 0, sizeof(float) * KC_STATE_DIM * KC_STATE_DIM);
+
+  for (int i = 0; i < KC_STATE_DIM; i++) {
+    A[i][i] = 1.0f;
+  }
+
+  // Position from velocity and attitude error, velocity from velocity and attitude error, attitude error from
+  // attitude error. Values are arbitrary but non-symmetric.
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      float v = scale * (1.0f + i - 0.7f * j);
+      A[KC_STATE_X + i][KC_STATE_PX + j] += v;
+      A[KC_STATE_X + i][KC_STATE_D0 + j] += 0.3f * v * v;
+      A[KC_STATE_PX + i][KC_STATE_PX + j] += -0.5f * v;
+      A[KC_STATE_PX + i][KC_STATE_D0 + j] += 9.81f * v;
+      A[KC_STATE_D0 + i][KC_STATE_D0 + j] += 0.2f * v;
+    }
+  }
+}
+
+// Reference implementation of a position update, one axis at a time
+static void updateWithPositionUsingScalarUpdates(kalmanCoreData_t* coreData, const positionMeasurement_t* xyz) {
+  for (int i = 0; i < 3; i++) {
+    float h[KC_STATE_DIM] = {0};
+    arm_matrix_instance_f32 H = {1, KC_STATE_DIM, h};
+    h[KC_STATE_X + i] = 1;
+    scalarUpdateDense(coreData, &H, xyz->pos[i] - coreData->S[KC_STATE_X + i], xyz->stdDev);
+  }
+}
+
+// Reference implementation of a pose update, one position axis and one attitude error axis at a time
+static void updateWithPoseUsingScalarUpdates(kalmanCoreData_t* coreData, const poseMeasurement_t* pose) {
+  float h[6][KC_STATE_DIM] = {0};
+  float error[6];
+  float stdDev[6];
+
+  struct quat const q_ekf = mkquat(coreData->q[1], coreData->q[2], coreData->q[3], coreData->q[0]);
+  struct quat const q_measured = mkquat(pose->quat.x, pose->quat.y, pose->quat.z, pose->quat.w);
+  struct quat const q_residual = qqmul(qinv(q_ekf), q_measured);
+  struct vec const err_quat = vscl(2.0f / q_residual.w, quatimagpart(q_residual));
+  const float attitudeError[3] = {err_quat.x, err_quat.y, err_quat.z};
+
+  for (int i = 0; i < 3; i++) {
+    h[i][KC_STATE_X + i] = 1;
+    error[i] = pose->pos[i] - coreData->S[KC_STATE_X + i];
+    stdDev[i] = pose->stdDevPos;
+
+    h[3 + i][KC_STATE_D0 + i] = 1;
+    error[3 + i] = attitudeError[i];
+    stdDev[3 + i] = pose->stdDevQuat;
+  }
+
+  updateWithRowsUsingScalarUpdates(coreData, h, error, stdDev, 6);
+}
+
+// Reference implementation of sweep angle updates, one angle at a time. The sensor is at the center of the
+// Crazyflie and the base station rotation matrices are orthonormal, the inverse is the transpose.
+static void updateWithSweepAnglesUsingScalarUpdates(kalmanCoreData_t* coreData, const sweepAngleMeasurement_t angles[], const int count) {
+  float h[KC_MAX_BATCH_SIZE][KC_STATE_DIM] = {0};
+  float error[KC_MAX_BATCH_SIZE];
+  float stdDev[KC_MAX_BATCH_SIZE];
+  int rows = 0;
+
+  for (int i = 0; i < count; i++) {
+    const baseStationGeometry_t* geometry = &angles[i].geometry;
+
+    float d[3];
+    float dRot[3] = {0};
+    for (int j = 0; j < 3; j++) {
+      d[j] = coreData->S[KC_STATE_X + j] - geometry->origin[j];
+    }
+    for (int j = 0; j < 3; j++) {
+      for (int k = 0; k < 3; k++) {
+        dRot[j] += geometry->mat[k][j] * d[k];
+      }
+    }
+
+    const float measured[2] = {angles[i].angleX, angles[i].angleY};
+    const float measurementStdDev[2] = {angles[i].stdDevX, angles[i].stdDevY};
+    for (int axis = 0; axis < 2; axis++) {
+      const float dx = dRot[0];
+      const float dp = dRot[1 + axis];
+      const float n = dx * dx + dp * dp;
+
+      // Jacobian in the base station frame, rotated to the global frame
+      float hRot[3] = {-dp / n, 0, 0};
+      hRot[1 + axis] = dx / n;
+      for (int j = 0; j < 3; j++) {
+        for (int k = 0; k < 3; k++) {
+          h[rows][KC_STATE_X + j] += geometry->mat[j][k] * hRot[k];
+        }
+      }
+
+      error[rows] = measured[axis] - atan2f(dp, dx);
+      stdDev[rows] = measurementStdDev[axis];
+      rows++;
+    }
+  }
+
+  updateWithRowsUsingScalarUpdates(coreData, h, error, stdDev, rows);
+}
+
+// Applies the rows one scalar update at a time. All rows are linearized around the state before the update, as in
+// a vector update, so the innovation of each row is corrected for the change of the state from the earlier rows.
+static void updateWithRowsUsingScalarUpdates(kalmanCoreData_t* coreData, float h[][KC_STATE_DIM], const float error[], const float stdDev[], const int count) {
+  float initialState[KC_STATE_DIM];
+  memcpy(initialState, coreData->S, sizeof(initialState));
+
+  for (int r = 0; r < count; r++) {
+    float correctedError = error[r];
+    for (int i = 0; i < KC_STATE_DIM; i++) {
+      correctedError -= h[r][i] * (coreData->S[i] - initialState[i]);
+    }
+
+    arm_matrix_instance_f32 H = {1, KC_STATE_DIM, h[r]};
+    scalarUpdateDense(coreData, &H, correctedError, stdDev[r]);
+  }
+}
+
+// Base station rotated around the z-axis only
+static void initBaseStationGeometry(baseStationGeometry_t* geometry, float x, float y, float z, float yaw) {
+  const float c = cosf(yaw);
+  const float s = sinf(yaw);
+
+  *geometry = (baseStationGeometry_t){
+    .origin = {x, y, z},
+    .mat = {
+      {c, -s, 0},
+      {s, c, 0},
+      {0, 0, 1},
+    },
+  };
+}
+
+// Brings the position variance down from its initial (bounded) value to a realistic level, using the reference implementation
+static void initLocalizedCoreData(void) {
+  positionMeasurement_t xyz = {.x = 0.25f, .y = -0.25f, .z = 1.0f, .stdDev = 0.5f};
+  updateWithPositionUsingScalarUpdates(&denseData, &xyz);
+  copyCoreData(&sparseData, &denseData);
+}
+
+static void copyCoreData(kalmanCoreData_t* dst, const kalmanCoreData_t* src) {
+  memcpy(dst, src, sizeof(kalmanCoreData_t));
+  dst->Pm.pData = (float*)dst->P;
+}
+
+static void assertCoreDataWithin(const kalmanCoreData_t* expected, const kalmanCoreData_t* actual) {
+  const float relativeTolerance = 1e-4f;
+  const float absoluteTolerance = 1e-7f;
+
+  for (int i = 0; i < KC_STATE_DIM; i++) {
+    float delta = absoluteTolerance + relativeTolerance * fabsf(expected->S[i]);
+    TEST_ASSERT_FLOAT_WITHIN(delta, expected->S[i], actual->S[i]);
+  }
+
+  for (int i = 0; i < KC_STATE_DIM; i++) {
+    for (int j = 0; j < KC_STATE_DIM; j++) {
+      float delta = absoluteTolerance + relativeTolerance * fabsf(expected->P[i][j]);
+      TEST_ASSERT_FLOAT_WITHIN(delta, expected->P[i][j], actual->P[i][j]);
+      TEST_ASSERT_EQUAL_FLOAT(actual->P[i][j], actual->P[j][i]);
+    }
+  }
+}
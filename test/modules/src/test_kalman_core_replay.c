@@ -0,0 +1,176 @@
+// File under test kalman_core.c, replayed with recorded or simulated data.
+//
+// Compare timings and the trajectory checksum before and after a change of the estimator with
+//   rake unit "DEFINES=SHOW_OUTPUT" "FILES=test/modules/src/test_kalman_core_replay.c"
+// Set KALMAN_REPLAY_FILE to also replay a recording, see kalmanCoreReplay.h for the file format.
+#include "kalman_core.h"
+#include "kalmanCoreReplay.h"
+#include "hostTime.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+
+#include "mock_cfassert.h"
+#include "outlierFilter.h"
+
+// Build the arm dsp math lib and use the "real thing" instead of mocking calls to it
+// @BUILD_LIB ARM_DSP_MATH
+
+#define MAX_EVENT_COUNT 100000
+#define FLIGHT_DURATION_MS 5000
+
+static kalmanCoreReplayEvent_t events[MAX_EVENT_COUNT];
+static kalmanCoreData_t coreData;
+static kalmanCoreReplayResult_t result;
+
+void setUp(void) {
+  memset(&result, 0, sizeof(result));
+}
+
+void tearDown(void) {
+  // Empty
+}
+
+
+void testThatReplayOfSimulatedFlightIsDeterministic() {
+  // Fixture
+  int count = kalmanCoreReplayGenerateFlight(events, MAX_EVENT_COUNT, FLIGHT_DURATION_MS);
+  kalmanCoreReplayRun(&coreData, events, count, &result);
+  uint32_t expected = result.checksum;
+
+  // Test
+  kalmanCoreReplayRun(&coreData, events, count, &result);
+
+  // Assert
+  TEST_ASSERT_EQUAL_HEX32(expected, result.checksum);
+}
+
+void testThatReplayOfSimulatedFlightTracksTheTrajectory() {
+  // Fixture
+  int count = kalmanCoreReplayGenerateFlight(events, MAX_EVENT_COUNT, FLIGHT_DURATION_MS);
+  point_t expected;
+  kalmanCoreReplayGetFlightPosition(events[count - 1].tick, &expected);
+
+  // Test
+  kalmanCoreReplayRun(&coreData, events, count, &result);
+
+  // Assert
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, expected.x, coreData.S[KC_STATE_X]);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, expected.y, coreData.S[KC_STATE_Y]);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, expected.z, coreData.S[KC_STATE_Z]);
+}
+
+void testThatReplayOfSimulatedFlightTimesAllCalls() {
+  // Fixture
+  int count = kalmanCoreReplayGenerateFlight(events, MAX_EVENT_COUNT, FLIGHT_DURATION_MS);
+
+  // Test
+  kalmanCoreReplayRun(&coreData, events, count, &result);
+
+  // Assert
+#ifdef SHOW_OUTPUT
+  printf("Simulated flight, %d events\n", count);
+  kalmanCoreReplayPrintReport(&result);
+#endif
+
+  // One prediction every 10 ms, the first one after 10 ms
+  TEST_ASSERT_EQUAL_UINT32(FLIGHT_DURATION_MS / 10 - 1, result.predict.calls);
+  TEST_ASSERT_TRUE(result.processNoise.calls > 0);
+  TEST_ASSERT_TRUE(result.finalize.calls > 0);
+  for (int i = 0; i < MeasurementTypeCount; i++) {
+    TEST_ASSERT_TRUE(result.update[i].calls > 0);
+  }
+}
+
+void testThatImuLineIsParsed() {
+  // Fixture
+  kalmanCoreReplayEvent_t event;
+
+  // Test
+  bool actual = kalmanCoreReplayParseLine("imu 1234 0.1 0.2 1.0 3 4 5 9.81", &event);
+
+  // Assert
+  TEST_ASSERT_TRUE(actual);
+  TEST_ASSERT_TRUE(event.isImu);
+  TEST_ASSERT_EQUAL_UINT32(1234, event.tick);
+  TEST_ASSERT_EQUAL_FLOAT(0.1f, event.imu.acc.x);
+  TEST_ASSERT_EQUAL_FLOAT(1.0f, event.imu.acc.z);
+  TEST_ASSERT_EQUAL_FLOAT(5.0f, event.imu.gyro.z);
+  TEST_ASSERT_EQUAL_FLOAT(9.81f, event.imu.thrust);
+}
+
+void testThatTdoaLineIsParsed() {
+  // Fixture
+  kalmanCoreReplayEvent_t event;
+
+  // Test
+  bool actual = kalmanCoreReplayParseLine("tdoa 17 1 2 3 4 5 6 0.5 0.15", &event);
+
+  // Assert
+  TEST_ASSERT_TRUE(actual);
+  TEST_ASSERT_FALSE(event.isImu);
+  TEST_ASSERT_EQUAL_UINT32(17, event.tick);
+  TEST_ASSERT_EQUAL(MeasurementTypeTDOA, event.measurement.type);
+  TEST_ASSERT_EQUAL_FLOAT(3.0f, event.measurement.data.tdoa.anchorPosition[0].z);
+  TEST_ASSERT_EQUAL_FLOAT(4.0f, event.measurement.data.tdoa.anchorPosition[1].x);
+  TEST_ASSERT_EQUAL_FLOAT(0.5f, event.measurement.data.tdoa.distanceDiff);
+  TEST_ASSERT_EQUAL_FLOAT(0.15f, event.measurement.data.tdoa.stdDev);
+}
+
+void testThatSweepLineIsParsed() {
+  // Fixture
+  kalmanCoreReplayEvent_t event;
+
+  // Test
+  bool actual = kalmanCoreReplayParseLine("sweep 3 -2 0 2.5 1 0 0 0 1 0 0 0 1 0.1 -0.2 0.001 0.002 0.01 0.02 0.03", &event);
+
+  // Assert
+  TEST_ASSERT_TRUE(actual);
+  TEST_ASSERT_EQUAL(MeasurementTypeSweepAngle, event.measurement.type);
+  TEST_ASSERT_EQUAL_FLOAT(-2.0f, event.measurement.data.sweepAngle.geometry.origin[0]);
+  TEST_ASSERT_EQUAL_FLOAT(1.0f, event.measurement.data.sweepAngle.geometry.mat[2][2]);
+  TEST_ASSERT_EQUAL_FLOAT(-0.2f, event.measurement.data.sweepAngle.angleY);
+  TEST_ASSERT_EQUAL_FLOAT(0.03f, event.measurement.data.sweepAngle.sensorPos[2]);
+}
+
+void testThatLineWithMissingValuesIsRejected() {
+  // Fixture
+  kalmanCoreReplayEvent_t event;
+
+  // Test
+  bool actual = kalmanCoreReplayParseLine("pos 10 1.0 2.0 3.0", &event);
+
+  // Assert
+  TEST_ASSERT_FALSE(actual);
+}
+
+void testThatLineWithUnknownTypeIsRejected() {
+  // Fixture
+  kalmanCoreReplayEvent_t event;
+
+  // Test
+  bool actual = kalmanCoreReplayParseLine("baro 10 1013.0", &event);
+
+  // Assert
+  TEST_ASSERT_FALSE(actual);
+}
+
+void testReplayOfRecordedFile() {
+  // Fixture
+  const char* fileName = getenv("KALMAN_REPLAY_FILE");
+  if (!fileName) {
+    TEST_IGNORE_MESSAGE("Set KALMAN_REPLAY_FILE to replay a recording");
+  }
+
+  int count = kalmanCoreReplayLoad(fileName, events, MAX_EVENT_COUNT);
+  TEST_ASSERT_TRUE_MESSAGE(count > 0, "Could not load recording");
+
+  // Test
+  kalmanCoreReplayRun(&coreData, events, count, &result);
+
+  // Assert
+  printf("%s, %d events\n", fileName, count);
+  kalmanCoreReplayPrintReport(&result);
+}
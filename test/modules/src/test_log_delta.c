@@ -0,0 +1,110 @@
+// File under test log_delta.c
+#include "log_delta.h"
+
+#include <string.h>
+#include "unity.h"
+
+// Same as in log.c
+#define LOG_MAX_DELTA_SLOTS 32
+// Space for values in a packet, after block id, time stamp and the mask of a full delta block
+#define VALUE_SPACE (26 - 4)
+#define ALL_SLOTS 0xFFFFFFFFul
+
+static uint8_t lengths[LOG_MAX_DELTA_SLOTS];
+static uint8_t nextSlot;
+
+void setUp(void) {
+  memset(lengths, 4, sizeof(lengths));
+  nextSlot = 0;
+}
+
+void tearDown(void) {
+  // Empty
+}
+
+
+void testThatAllPendingSlotsAreSelectedWhenTheyFit() {
+  // Fixture
+  const uint32_t pendingSlots = 0x0000012Eul;
+
+  // Test
+  uint32_t actual = logDeltaSelectSlots(pendingSlots, lengths, LOG_MAX_DELTA_SLOTS, VALUE_SPACE, &nextSlot);
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT32(pendingSlots, actual);
+  TEST_ASSERT_EQUAL_UINT8(0, nextSlot);
+}
+
+void testThatSlotsThatDoNotFitAreSelectedFirstInTheNextRun() {
+  // Fixture
+  // 5 floats fit in the packet
+  uint32_t first = logDeltaSelectSlots(ALL_SLOTS, lengths, LOG_MAX_DELTA_SLOTS, VALUE_SPACE, &nextSlot);
+
+  // Test
+  uint32_t actual = logDeltaSelectSlots(ALL_SLOTS & ~first, lengths, LOG_MAX_DELTA_SLOTS, VALUE_SPACE, &nextSlot);
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT32(0x0000001Ful, first);
+  TEST_ASSERT_EQUAL_UINT32(0x000003E0ul, actual);
+  TEST_ASSERT_EQUAL_UINT8(10, nextSlot);
+}
+
+void testThatSmallerSlotsAreSelectedAfterALargeSlotThatDoesNotFit() {
+  // Fixture
+  lengths[5] = 1;
+  const uint32_t pendingSlots = 0x0000003Ful;
+
+  // Test
+  uint32_t actual = logDeltaSelectSlots(pendingSlots, lengths, 7, 17, &nextSlot);
+
+  // Assert
+  // Slot 4 does not fit, slot 5 does
+  TEST_ASSERT_EQUAL_UINT32(0x0000002Ful, actual);
+  TEST_ASSERT_EQUAL_UINT8(4, nextSlot);
+}
+
+void testThatSelectionStartsFromTheFirstSlotIfTheBlockHasShrunk() {
+  // Fixture
+  nextSlot = 20;
+
+  // Test
+  uint32_t actual = logDeltaSelectSlots(ALL_SLOTS, lengths, 8, VALUE_SPACE, &nextSlot);
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT32(0x0000001Ful, actual);
+  TEST_ASSERT_EQUAL_UINT8(5, nextSlot);
+}
+
+void testThatAllSlotsAreSentWhenAllValuesChangeOnEveryRun() {
+  // Fixture
+  // A block larger than a packet, with floats that all change on every run
+  const int runs = 100;
+  const int valuesPerPacket = VALUE_SPACE / 4;
+  const int maxRunsBetweenUpdates = (LOG_MAX_DELTA_SLOTS + valuesPerPacket - 1) / valuesPerPacket;
+  int lastSentRun[LOG_MAX_DELTA_SLOTS];
+  int maxRunsBetween = 0;
+  for (int slot = 0; slot < LOG_MAX_DELTA_SLOTS; slot++) {
+    lastSentRun[slot] = -1;
+  }
+
+  // Test
+  for (int run = 0; run < runs; run++) {
+    uint32_t selected = logDeltaSelectSlots(ALL_SLOTS, lengths, LOG_MAX_DELTA_SLOTS, VALUE_SPACE, &nextSlot);
+
+    for (int slot = 0; slot < LOG_MAX_DELTA_SLOTS; slot++) {
+      if (selected & (1ul << slot)) {
+        int runsBetween = run - lastSentRun[slot];
+        if (runsBetween > maxRunsBetween) {
+          maxRunsBetween = runsBetween;
+        }
+        lastSentRun[slot] = run;
+      }
+    }
+  }
+
+  // Assert
+  for (int slot = 0; slot < LOG_MAX_DELTA_SLOTS; slot++) {
+    TEST_ASSERT_TRUE(lastSentRun[slot] >= runs - maxRunsBetweenUpdates);
+  }
+  TEST_ASSERT_TRUE(maxRunsBetween <= maxRunsBetweenUpdates);
+}
@@ -0,0 +1,194 @@
+// File under test measurement_ring.c
+#include "measurement_ring.h"
+
+#include <string.h>
+#include "unity.h"
+
+static measurementRing_t ring;
+
+static measurement_t createMeasurement(measurementType_t type, float value);
+
+void setUp(void) {
+  measurementRingInit(&ring);
+}
+
+void tearDown(void) {
+  // Empty
+}
+
+
+void testThatNewRingIsEmpty() {
+  // Fixture
+  measurement_t measurement;
+
+  // Test
+  bool actual = measurementRingGet(&ring, &measurement);
+
+  // Assert
+  TEST_ASSERT_FALSE(actual);
+  TEST_ASSERT_TRUE(measurementRingIsEmpty(&ring));
+}
+
+void testThatRingIsNotEmptyAfterPut() {
+  // Fixture
+  measurement_t measurement = createMeasurement(MeasurementTypeTOF, 1.0f);
+
+  // Test
+  measurementRingPut(&ring, &measurement);
+
+  // Assert
+  TEST_ASSERT_FALSE(measurementRingIsEmpty(&ring));
+}
+
+void testThatMeasurementsOfDifferentTypesAreReadInArrivalOrder() {
+  // Fixture
+  measurement_t tof = createMeasurement(MeasurementTypeTOF, 1.0f);
+  measurement_t position = createMeasurement(MeasurementTypePosition, 2.0f);
+  measurement_t flow = createMeasurement(MeasurementTypeFlow, 3.0f);
+  measurement_t actual;
+
+  measurementRingPut(&ring, &tof);
+  measurementRingPut(&ring, &position);
+  measurementRingPut(&ring, &flow);
+
+  // Test
+  // Assert
+  TEST_ASSERT_TRUE(measurementRingGet(&ring, &actual));
+  TEST_ASSERT_EQUAL(MeasurementTypeTOF, actual.type);
+  TEST_ASSERT_EQUAL_FLOAT(1.0f, actual.data.tof.distance);
+
+  TEST_ASSERT_TRUE(measurementRingGet(&ring, &actual));
+  TEST_ASSERT_EQUAL(MeasurementTypePosition, actual.type);
+  TEST_ASSERT_EQUAL_FLOAT(2.0f, actual.data.position.x);
+
+  TEST_ASSERT_TRUE(measurementRingGet(&ring, &actual));
+  TEST_ASSERT_EQUAL(MeasurementTypeFlow, actual.type);
+  TEST_ASSERT_EQUAL_FLOAT(3.0f, actual.data.flow.dpixelx);
+
+  TEST_ASSERT_FALSE(measurementRingGet(&ring, &actual));
+}
+
+void testThatPutFailsWhenRingIsFull() {
+  // Fixture
+  measurement_t measurement = createMeasurement(MeasurementTypeTOF, 1.0f);
+  for (int i = 0; i < MEASUREMENT_RING_SIZE; i++) {
+    TEST_ASSERT_TRUE(measurementRingPut(&ring, &measurement));
+  }
+
+  // Test
+  bool actual = measurementRingPut(&ring, &measurement);
+
+  // Assert
+  TEST_ASSERT_FALSE(actual);
+}
+
+void testThatDroppedMeasurementsAreCountedPerType() {
+  // Fixture
+  measurement_t tof = createMeasurement(MeasurementTypeTOF, 1.0f);
+  measurement_t yawError = createMeasurement(MeasurementTypeYawError, 2.0f);
+  for (int i = 0; i < MEASUREMENT_RING_SIZE; i++) {
+    measurementRingPut(&ring, &tof);
+  }
+
+  // Test
+  measurementRingPut(&ring, &tof);
+  measurementRingPut(&ring, &yawError);
+  measurementRingPut(&ring, &yawError);
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT32(1, ring.dropCount[MeasurementTypeTOF]);
+  TEST_ASSERT_EQUAL_UINT32(2, ring.dropCount[MeasurementTypeYawError]);
+  TEST_ASSERT_EQUAL_UINT32(0, ring.dropCount[MeasurementTypePosition]);
+}
+
+void testThatOldestMeasurementIsKeptWhenRingIsFull() {
+  // Fixture
+  measurement_t actual;
+  for (int i = 0; i < MEASUREMENT_RING_SIZE + 1; i++) {
+    measurement_t measurement = createMeasurement(MeasurementTypeTOF, i);
+    measurementRingPut(&ring, &measurement);
+  }
+
+  // Test
+  measurementRingGet(&ring, &actual);
+
+  // Assert
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, actual.data.tof.distance);
+}
+
+void testThatRingWrapsAround() {
+  // Fixture
+  measurement_t actual;
+  const int count = 3 * MEASUREMENT_RING_SIZE + 5;
+
+  // Test
+  // Assert
+  for (int i = 0; i < count; i++) {
+    measurement_t measurement = createMeasurement(MeasurementTypeAbsoluteHeight, i);
+    TEST_ASSERT_TRUE(measurementRingPut(&ring, &measurement));
+    TEST_ASSERT_TRUE(measurementRingGet(&ring, &actual));
+    TEST_ASSERT_EQUAL_FLOAT((float)i, actual.data.height.height);
+  }
+
+  TEST_ASSERT_TRUE(measurementRingIsEmpty(&ring));
+}
+
+void testThatFlushEmptiesTheRing() {
+  // Fixture
+  measurement_t measurement = createMeasurement(MeasurementTypeTOF, 1.0f);
+  for (int i = 0; i < 5; i++) {
+    measurementRingPut(&ring, &measurement);
+  }
+
+  // Test
+  measurementRingFlush(&ring);
+
+  // Assert
+  TEST_ASSERT_TRUE(measurementRingIsEmpty(&ring));
+}
+
+void testThatRingCanBeFilledAgainAfterFlush() {
+  // Fixture
+  measurement_t measurement = createMeasurement(MeasurementTypeTOF, 1.0f);
+  for (int i = 0; i < MEASUREMENT_RING_SIZE; i++) {
+    measurementRingPut(&ring, &measurement);
+  }
+  measurementRingFlush(&ring);
+
+  // Test
+  // Assert
+  for (int i = 0; i < MEASUREMENT_RING_SIZE; i++) {
+    TEST_ASSERT_TRUE(measurementRingPut(&ring, &measurement));
+  }
+}
+
+
+// Helpers ///////////////////////////////////////////////////////////
+
+static measurement_t createMeasurement(measurementType_t type, float value) {
+  measurement_t measurement;
+  memset(&measurement, 0, sizeof(measurement));
+  measurement.type = type;
+
+  switch (type) {
+    case MeasurementTypeTOF:
+      measurement.data.tof.distance = value;
+      break;
+    case MeasurementTypePosition:
+      measurement.data.position.x = value;
+      break;
+    case MeasurementTypeFlow:
+      measurement.data.flow.dpixelx = value;
+      break;
+    case MeasurementTypeAbsoluteHeight:
+      measurement.data.height.height = value;
+      break;
+    case MeasurementTypeYawError:
+      measurement.data.yawError.yawError = value;
+      break;
+    default:
+      break;
+  }
+
+  return measurement;
+}
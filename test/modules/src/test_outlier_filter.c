@@ -6,6 +6,8 @@
 #include "mock_cfassert.h"
 
 static tdoaMeasurement_t tdoa;
+static const vector_t jacobian = {.x = 1.0, .y = 0.0, .z = 0.0};
+static const point_t estPos = {.x = 0.0, .y = 0.0, .z = 0.0};
 
 void setUp(void) {
   outlierFilterReset();
@@ -63,3 +65,34 @@ void testThatSamplesAreRejectedWhenTdoaIsGreaterButNegativeThanDistanceBetweenAn
   // Assert
   TEST_ASSERT_EQUAL(actual, expected);
 }
+
+
+void testThatStepsFilterRejectsLargeErrorsAfterReset() {
+  // Fixture
+  float error = 3.0;
+  bool expected = false;
+
+  // Test
+  bool actual = outlierFilterValidateTdoaSteps(&tdoa, error, &jacobian, &estPos);
+
+  // Assert
+  TEST_ASSERT_EQUAL(actual, expected);
+}
+
+
+void testThatResetClosesAStepsFilterThatHasOpenedUp() {
+  // Fixture
+  float error = 3.0;
+  for (int i = 0; i < 20; i++) {
+    outlierFilterValidateTdoaSteps(&tdoa, error, &jacobian, &estPos);
+  }
+  TEST_ASSERT_TRUE(outlierFilterValidateTdoaSteps(&tdoa, error, &jacobian, &estPos));
+  bool expected = false;
+
+  // Test
+  outlierFilterReset();
+
+  // Assert
+  bool actual = outlierFilterValidateTdoaSteps(&tdoa, error, &jacobian, &estPos);
+  TEST_ASSERT_EQUAL(actual, expected);
+}
@@ -1,4 +1,8 @@
 // File under test pptraj.h and pptraj_compressed.h
+//
+// Print the evaluation benchmark with
+//   rake unit "DEFINES=SHOW_OUTPUT" "FILES=test/modules/src/test_pptraj.c"
+
 #include "pptraj.h"
 #include "pptraj_compressed.h"
 
@@ -6,6 +10,7 @@
 #include <string.h>
 
 #include "unity.h"
+#include "hostTime.h"
 
 // #define SHOW_OUTPUT
 
@@ -231,6 +236,12 @@ const uint8_t frame_compressed_pieces[] = {
   0x46, 0x00, 0x15, 0xf4, 0x01, 0xb8, 0x0b, 0x58, 0x1b, 0x00, 0x00, 0x00, 0x00, 0x00,
 };
 
+// Fits in the trajectory memory of the Crazyflie
+#define TEST_LONG_TRAJECTORY_PIECES 400
+#define TEST_TRAJECTORY_MEMORY_SIZE 4096
+
+static void generateLongCompressedTrajectory(uint8_t* data, int pieces);
+
 void setUp(void) {
   // Empty
 }
@@ -431,3 +442,133 @@ void testCompressedFigure8RandomOrderQueries(void) {
   printf("Maximum difference = %.4f\n", maxdiff);
 #endif
 }
+
+void testCompressedRandomOrderQueriesMatchSequentialPlayback(void) {
+  // Fixture
+  struct piecewise_traj_compressed sequential, random;
+  struct traj_eval expected[200];
+  float t[200];
+  int count = sizeof(t) / sizeof(t[0]);
+
+  piecewise_compressed_load(&sequential, frame_compressed_pieces);
+  piecewise_compressed_load(&random, frame_compressed_pieces);
+  float duration = piecewise_compressed_duration(&sequential);
+  for (int i = 0; i < count; i++) {
+    t[i] = (duration + 1) * i / count - 0.5f;
+    expected[i] = piecewise_compressed_eval(&sequential, t[i]);
+  }
+
+  // Test
+  // Assert
+  TEST_ASSERT_TRUE(random.index.stride > 1);
+  for (int j = 0; j < count; j++) {
+    int i = rand() % count;
+    struct traj_eval actual = piecewise_compressed_eval(&random, t[i]);
+
+    TEST_ASSERT_EQUAL_FLOAT(expected[i].pos.x, actual.pos.x);
+    TEST_ASSERT_EQUAL_FLOAT(expected[i].pos.y, actual.pos.y);
+    TEST_ASSERT_EQUAL_FLOAT(expected[i].pos.z, actual.pos.z);
+    TEST_ASSERT_EQUAL_FLOAT(expected[i].yaw, actual.yaw);
+    TEST_ASSERT_EQUAL_FLOAT(expected[i].vel.x, actual.vel.x);
+  }
+}
+
+void testCompressedIndexCoversAllPieces(void) {
+  // Fixture
+  static uint8_t data[TEST_TRAJECTORY_MEMORY_SIZE];
+  struct piecewise_traj_compressed traj;
+  generateLongCompressedTrajectory(data, TEST_LONG_TRAJECTORY_PIECES);
+
+  // Test
+  piecewise_compressed_load(&traj, data);
+
+  // Assert
+  // The pieces, plus the terminating empty piece
+  int pieces = TEST_LONG_TRAJECTORY_PIECES + 1;
+  TEST_ASSERT_EQUAL_UINT16((pieces + PPTRAJ_COMPRESSED_INDEX_SIZE - 1) / PPTRAJ_COMPRESSED_INDEX_SIZE, traj.index.stride);
+  TEST_ASSERT_TRUE(traj.index.count <= PPTRAJ_COMPRESSED_INDEX_SIZE);
+  TEST_ASSERT_TRUE((traj.index.count - 1) * traj.index.stride < pieces);
+  TEST_ASSERT_TRUE(traj.index.count * traj.index.stride >= pieces);
+  for (int i = 1; i < traj.index.count; i++) {
+    TEST_ASSERT_TRUE(traj.index.entries[i].t_begin_relative > traj.index.entries[i - 1].t_begin_relative);
+  }
+}
+
+void testCompressedLongTrajectoryEvaluationBenchmark(void) {
+  // Fixture
+  static uint8_t data[TEST_TRAJECTORY_MEMORY_SIZE];
+  struct piecewise_traj_compressed sequential, random;
+  const int count = 10000;
+  generateLongCompressedTrajectory(data, TEST_LONG_TRAJECTORY_PIECES);
+  piecewise_compressed_load(&sequential, data);
+  piecewise_compressed_load(&random, data);
+  float duration = piecewise_compressed_duration(&sequential);
+
+  // Test
+  uint64_t sequentialNs = 0, sequentialMaxNs = 0;
+  for (int i = 0; i < count; i++) {
+    float t = duration * i / count;
+    uint64_t start = nowNs();
+    piecewise_compressed_eval(&sequential, t);
+    uint64_t elapsed = nowNs() - start;
+    sequentialNs += elapsed;
+    sequentialMaxNs = MAX(sequentialMaxNs, elapsed);
+  }
+
+  uint64_t randomNs = 0, randomMaxNs = 0;
+  float maxdiff = 0;
+  for (int i = 0; i < count; i++) {
+    float t = duration * (rand() % count) / count;
+    uint64_t start = nowNs();
+    struct traj_eval actual = piecewise_compressed_eval(&random, t);
+    uint64_t elapsed = nowNs() - start;
+    randomNs += elapsed;
+    randomMaxNs = MAX(randomMaxNs, elapsed);
+
+    struct traj_eval expected = piecewise_compressed_eval(&sequential, t);
+    maxdiff = MAX(maxdiff, fabs(actual.pos.x - expected.pos.x));
+    maxdiff = MAX(maxdiff, fabs(actual.pos.y - expected.pos.y));
+    maxdiff = MAX(maxdiff, fabs(actual.pos.z - expected.pos.z));
+  }
+
+  // Assert
+#ifdef SHOW_OUTPUT
+  printf("%d pieces, index stride %d\n", TEST_LONG_TRAJECTORY_PIECES, random.index.stride);
+  printf("sequential: %.0f ns/call, max %llu ns\n", (double)sequentialNs / count, (unsigned long long)sequentialMaxNs);
+  printf("random:     %.0f ns/call, max %llu ns\n", (double)randomNs / count, (unsigned long long)randomMaxNs);
+#endif
+
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, maxdiff);
+}
+
+
+// Helpers ///////////////////////////////////////////////////////////
+
+// Fills the buffer with a zig-zag of linear x, y, z pieces of 100 ms each
+static void generateLongCompressedTrajectory(uint8_t* data, int pieces) {
+  uint8_t* ptr = data;
+
+  // Initial position
+  memset(ptr, 0, 8);
+  ptr += 8;
+
+  for (int i = 0; i < pieces; i++) {
+    int16_t coordinates[3] = {
+      (int16_t)((i % 2) ? 500 : -500),
+      (int16_t)(i * 5),
+      (int16_t)(1000 + (i % 7) * 20),
+    };
+
+    // Linear x, y and z, constant yaw
+    *ptr++ = 0x15;
+    *ptr++ = 100;
+    *ptr++ = 0;
+    for (int j = 0; j < 3; j++) {
+      *ptr++ = coordinates[j] & 0xff;
+      *ptr++ = (coordinates[j] >> 8) & 0xff;
+    }
+  }
+
+  // End of trajectory
+  memset(ptr, 0, 3);
+}
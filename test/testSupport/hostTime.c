@@ -0,0 +1,12 @@
+// clock_gettime() is a POSIX function
+#define _POSIX_C_SOURCE 199309L
+
+#include "hostTime.h"
+
+#include <time.h>
+
+uint64_t nowNs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+/**
+ * Time measurements on the host, for comparing the speed of implementations in unit tests.
+ * Timings on the host only give a rough idea of the relation, the firmware runs on a Cortex-M4.
+ */
+
+#include <stdint.h>
+
+/**
+ * @return monotonic time in nano seconds, from an arbitrary starting point
+ */
+uint64_t nowNs();
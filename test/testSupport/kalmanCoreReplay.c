@@ -0,0 +1,510 @@
+#include "kalmanCoreReplay.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "physicalConstants.h"
+#include "outlierFilter.h"
+#include "hostTime.h"
+
+// Same rates and thresholds as the kalman estimator task
+#define PREDICT_INTERVAL_MS 10
+#define IN_FLIGHT_THRUST_THRESHOLD (GRAVITY_MAGNITUDE * 0.1f)
+#define IN_FLIGHT_TIME_THRESHOLD 500
+
+#define LINE_LENGTH 512
+
+// Simulated flight
+#define FLIGHT_RADIUS 0.5f
+#define FLIGHT_HEIGHT 1.0f
+#define FLIGHT_ANGULAR_VELOCITY 0.5f
+
+// Camera model of the flow deck, see kalmanCoreUpdateWithFlow()
+#define FLOW_NPIX 30.0f
+#define FLOW_THETAPIX (DEG_TO_RAD * 4.2f)
+
+static const point_t anchors[] = {
+  {.x = -2.0f, .y = -2.0f, .z = 0.2f},
+  {.x = 2.0f, .y = -2.0f, .z = 2.5f},
+  {.x = 2.0f, .y = 2.0f, .z = 0.2f},
+  {.x = -2.0f, .y = 2.0f, .z = 2.5f},
+};
+#define ANCHOR_COUNT (sizeof(anchors) / sizeof(anchors[0]))
+
+static const baseStationGeometry_t baseStation = {
+  .origin = {-2.0f, 0.0f, 2.5f},
+  .mat = {{1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+};
+
+static void addTiming(kalmanCoreReplayTiming_t* timing, uint64_t start) {
+  uint64_t duration = nowNs() - start;
+
+  timing->calls++;
+  timing->totalNs += duration;
+  if (duration > timing->maxNs) {
+    timing->maxNs = duration;
+  }
+}
+
+// FNV-1a
+static uint32_t addToChecksum(uint32_t checksum, const void* data, size_t length) {
+  const uint8_t* bytes = data;
+  for (size_t i = 0; i < length; i++) {
+    checksum ^= bytes[i];
+    checksum *= 16777619u;
+  }
+
+  return checksum;
+}
+
+static const char* measurementTypeName(measurementType_t type) {
+  switch (type) {
+    case MeasurementTypeTDOA: return "tdoa";
+    case MeasurementTypePosition: return "pos";
+    case MeasurementTypePose: return "pose";
+    case MeasurementTypeDistance: return "dist";
+    case MeasurementTypeTOF: return "tof";
+    case MeasurementTypeAbsoluteHeight: return "height";
+    case MeasurementTypeFlow: return "flow";
+    case MeasurementTypeYawError: return "yaw";
+    case MeasurementTypeSweepAngle: return "sweep";
+    default: return "?";
+  }
+}
+
+bool kalmanCoreReplayParseLine(const char* line, kalmanCoreReplayEvent_t* event) {
+  char name[16];
+  unsigned int tick;
+  int offset = 0;
+  if (sscanf(line, "%15s %u%n", name, &tick, &offset) != 2) {
+    return false;
+  }
+
+  const char* values = line + offset;
+  int expected = 0;
+  int actual = -1;
+  memset(event, 0, sizeof(kalmanCoreReplayEvent_t));
+  event->tick = tick;
+
+  if (strcmp(name, "imu") == 0) {
+    event->isImu = true;
+    expected = 7;
+    actual = sscanf(values, "%f %f %f %f %f %f %f",
+      &event->imu.acc.x, &event->imu.acc.y, &event->imu.acc.z,
+      &event->imu.gyro.x, &event->imu.gyro.y, &event->imu.gyro.z, &event->imu.thrust);
+    return actual == expected;
+  }
+
+  measurement_t* m = &event->measurement;
+  if (strcmp(name, "pos") == 0) {
+    m->type = MeasurementTypePosition;
+    positionMeasurement_t* pos = &m->data.position;
+    expected = 4;
+    actual = sscanf(values, "%f %f %f %f", &pos->x, &pos->y, &pos->z, &pos->stdDev);
+  } else if (strcmp(name, "pose") == 0) {
+    m->type = MeasurementTypePose;
+    poseMeasurement_t* pose = &m->data.pose;
+    expected = 9;
+    actual = sscanf(values, "%f %f %f %f %f %f %f %f %f", &pose->x, &pose->y, &pose->z,
+      &pose->quat.x, &pose->quat.y, &pose->quat.z, &pose->quat.w, &pose->stdDevPos, &pose->stdDevQuat);
+  } else if (strcmp(name, "dist") == 0) {
+    m->type = MeasurementTypeDistance;
+    distanceMeasurement_t* dist = &m->data.distance;
+    expected = 5;
+    actual = sscanf(values, "%f %f %f %f %f", &dist->x, &dist->y, &dist->z, &dist->distance, &dist->stdDev);
+  } else if (strcmp(name, "tdoa") == 0) {
+    m->type = MeasurementTypeTDOA;
+    tdoaMeasurement_t* tdoa = &m->data.tdoa;
+    expected = 8;
+    actual = sscanf(values, "%f %f %f %f %f %f %f %f",
+      &tdoa->anchorPosition[0].x, &tdoa->anchorPosition[0].y, &tdoa->anchorPosition[0].z,
+      &tdoa->anchorPosition[1].x, &tdoa->anchorPosition[1].y, &tdoa->anchorPosition[1].z,
+      &tdoa->distanceDiff, &tdoa->stdDev);
+  } else if (strcmp(name, "tof") == 0) {
+    m->type = MeasurementTypeTOF;
+    expected = 2;
+    actual = sscanf(values, "%f %f", &m->data.tof.distance, &m->data.tof.stdDev);
+  } else if (strcmp(name, "height") == 0) {
+    m->type = MeasurementTypeAbsoluteHeight;
+    expected = 2;
+    actual = sscanf(values, "%f %f", &m->data.height.height, &m->data.height.stdDev);
+  } else if (strcmp(name, "flow") == 0) {
+    m->type = MeasurementTypeFlow;
+    flowMeasurement_t* flow = &m->data.flow;
+    expected = 5;
+    actual = sscanf(values, "%f %f %f %f %f", &flow->dpixelx, &flow->dpixely, &flow->stdDevX, &flow->stdDevY, &flow->dt);
+  } else if (strcmp(name, "yaw") == 0) {
+    m->type = MeasurementTypeYawError;
+    expected = 2;
+    actual = sscanf(values, "%f %f", &m->data.yawError.yawError, &m->data.yawError.stdDev);
+  } else if (strcmp(name, "sweep") == 0) {
+    m->type = MeasurementTypeSweepAngle;
+    sweepAngleMeasurement_t* sweep = &m->data.sweepAngle;
+    float origin[3];
+    float mat[3][3];
+    expected = 19;
+    actual = sscanf(values, "%f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f",
+      &origin[0], &origin[1], &origin[2],
+      &mat[0][0], &mat[0][1], &mat[0][2], &mat[1][0], &mat[1][1], &mat[1][2], &mat[2][0], &mat[2][1], &mat[2][2],
+      &sweep->angleX, &sweep->angleY, &sweep->stdDevX, &sweep->stdDevY,
+      &sweep->sensorPos[0], &sweep->sensorPos[1], &sweep->sensorPos[2]);
+
+    // The geometry is packed, copy instead of scanning into it
+    memcpy(sweep->geometry.origin, origin, sizeof(origin));
+    memcpy(sweep->geometry.mat, mat, sizeof(mat));
+  }
+
+  return actual == expected;
+}
+
+int kalmanCoreReplayLoad(const char* fileName, kalmanCoreReplayEvent_t* events, int maxCount) {
+  FILE* file = fopen(fileName, "r");
+  if (!file) {
+    return -1;
+  }
+
+  int count = 0;
+  char line[LINE_LENGTH];
+  while (fgets(line, sizeof(line), file)) {
+    const char* start = line + strspn(line, " \t");
+    if (*start == '#' || *start == '\n' || *start == '\r' || *start == '\0') {
+      continue;
+    }
+
+    if (count >= maxCount || !kalmanCoreReplayParseLine(start, &events[count])) {
+      count = -1;
+      break;
+    }
+
+    count++;
+  }
+
+  fclose(file);
+  return count;
+}
+
+// Deterministic pseudo random noise in [-amplitude, amplitude]
+static float noise(uint32_t* seed, float amplitude) {
+  *seed = *seed * 1664525u + 1013904223u;
+  return amplitude * (2.0f * (float)(*seed >> 8) / (float)(1u << 24) - 1.0f);
+}
+
+void kalmanCoreReplayGetFlightPosition(uint32_t tick, point_t* position) {
+  float t = tick / 1000.0f;
+  position->x = FLIGHT_RADIUS * cosf(FLIGHT_ANGULAR_VELOCITY * t);
+  position->y = FLIGHT_RADIUS * sinf(FLIGHT_ANGULAR_VELOCITY * t);
+  position->z = FLIGHT_HEIGHT;
+}
+
+static float distance(const point_t* a, const point_t* b) {
+  float dx = a->x - b->x;
+  float dy = a->y - b->y;
+  float dz = a->z - b->z;
+  return sqrtf(dx * dx + dy * dy + dz * dz);
+}
+
+static measurement_t* addMeasurement(kalmanCoreReplayEvent_t* events, int* count, uint32_t tick, measurementType_t type) {
+  kalmanCoreReplayEvent_t* event = &events[*count];
+  (*count)++;
+
+  memset(event, 0, sizeof(kalmanCoreReplayEvent_t));
+  event->tick = tick;
+  event->measurement.type = type;
+  return &event->measurement;
+}
+
+int kalmanCoreReplayGenerateFlight(kalmanCoreReplayEvent_t* events, int maxCount, uint32_t durationMs) {
+  const float w = FLIGHT_ANGULAR_VELOCITY;
+  uint32_t seed = 1;
+  int count = 0;
+
+  for (uint32_t tick = 0; tick < durationMs; tick++) {
+    float t = tick / 1000.0f;
+    point_t p;
+    kalmanCoreReplayGetFlightPosition(tick, &p);
+    float vx = -FLIGHT_RADIUS * w * sinf(w * t);
+    float vy = FLIGHT_RADIUS * w * cosf(w * t);
+    float ax = -w * w * p.x;
+    float ay = -w * w * p.y;
+
+    // Sensors at different rates, with offsets to spread them over ticks
+    bool imu = (tick % 2) == 0;
+    bool pos = (tick % 33) == 1;
+    bool pose = (tick % 100) == 3;
+    bool dist = (tick % 20) == 5;
+    bool tdoa = (tick % 20) == 15;
+    bool tof = (tick % 25) == 7;
+    bool height = (tick % 100) == 9;
+    bool flow = (tick % 10) == 3;
+    bool yaw = (tick % 100) == 53;
+    bool sweep = (tick % 17) == 11;
+    int needed = imu + pos + pose + dist + tdoa + tof + height + flow + yaw + sweep;
+    if (count + needed > maxCount) {
+      break;
+    }
+
+    if (imu) {
+      kalmanCoreReplayEvent_t* event = &events[count++];
+      memset(event, 0, sizeof(*event));
+      event->tick = tick;
+      event->isImu = true;
+      event->imu.acc.x = ax / GRAVITY_MAGNITUDE + noise(&seed, 0.01f);
+      event->imu.acc.y = ay / GRAVITY_MAGNITUDE + noise(&seed, 0.01f);
+      event->imu.acc.z = 1.0f + noise(&seed, 0.01f);
+      event->imu.gyro.x = noise(&seed, 0.2f);
+      event->imu.gyro.y = noise(&seed, 0.2f);
+      event->imu.gyro.z = noise(&seed, 0.2f);
+      event->imu.thrust = GRAVITY_MAGNITUDE;
+    }
+
+    measurement_t* m;
+
+    if (pos) {
+      m = addMeasurement(events, &count, tick, MeasurementTypePosition);
+      m->data.position.x = p.x + noise(&seed, 0.01f);
+      m->data.position.y = p.y + noise(&seed, 0.01f);
+      m->data.position.z = p.z + noise(&seed, 0.01f);
+      m->data.position.stdDev = 0.01f;
+    }
+
+    if (pose) {
+      m = addMeasurement(events, &count, tick, MeasurementTypePose);
+      m->data.pose.x = p.x + noise(&seed, 0.01f);
+      m->data.pose.y = p.y + noise(&seed, 0.01f);
+      m->data.pose.z = p.z + noise(&seed, 0.01f);
+      m->data.pose.quat.w = 1.0f;
+      m->data.pose.stdDevPos = 0.01f;
+      m->data.pose.stdDevQuat = 0.05f;
+    }
+
+    if (dist) {
+      m = addMeasurement(events, &count, tick, MeasurementTypeDistance);
+      const point_t* anchor = &anchors[(tick / 20) % ANCHOR_COUNT];
+      m->data.distance.x = anchor->x;
+      m->data.distance.y = anchor->y;
+      m->data.distance.z = anchor->z;
+      m->data.distance.distance = distance(&p, anchor) + noise(&seed, 0.05f);
+      m->data.distance.stdDev = 0.25f;
+    }
+
+    if (tdoa) {
+      m = addMeasurement(events, &count, tick, MeasurementTypeTDOA);
+      int i = (tick / 20) % ANCHOR_COUNT;
+      const point_t* anchor0 = &anchors[i];
+      const point_t* anchor1 = &anchors[(i + 1) % ANCHOR_COUNT];
+      m->data.tdoa.anchorPosition[0] = *anchor0;
+      m->data.tdoa.anchorPosition[1] = *anchor1;
+      m->data.tdoa.distanceDiff = distance(&p, anchor1) - distance(&p, anchor0) + noise(&seed, 0.05f);
+      m->data.tdoa.stdDev = 0.15f;
+    }
+
+    if (tof) {
+      m = addMeasurement(events, &count, tick, MeasurementTypeTOF);
+      m->data.tof.distance = p.z + noise(&seed, 0.01f);
+      m->data.tof.stdDev = 0.0025f;
+    }
+
+    if (height) {
+      m = addMeasurement(events, &count, tick, MeasurementTypeAbsoluteHeight);
+      m->data.height.height = p.z + noise(&seed, 0.02f);
+      m->data.height.stdDev = 0.05f;
+    }
+
+    if (flow) {
+      m = addMeasurement(events, &count, tick, MeasurementTypeFlow);
+      const float dt = 0.01f;
+      m->data.flow.dt = dt;
+      m->data.flow.dpixelx = (dt * FLOW_NPIX / FLOW_THETAPIX) * (vx / p.z) + noise(&seed, 0.5f);
+      m->data.flow.dpixely = (dt * FLOW_NPIX / FLOW_THETAPIX) * (vy / p.z) + noise(&seed, 0.5f);
+      m->data.flow.stdDevX = 2.0f;
+      m->data.flow.stdDevY = 2.0f;
+    }
+
+    if (yaw) {
+      m = addMeasurement(events, &count, tick, MeasurementTypeYawError);
+      m->data.yawError.yawError = noise(&seed, 0.01f);
+      m->data.yawError.stdDev = 0.01f;
+    }
+
+    if (sweep) {
+      m = addMeasurement(events, &count, tick, MeasurementTypeSweepAngle);
+      sweepAngleMeasurement_t* angles = &m->data.sweepAngle;
+      memcpy(&angles->geometry, &baseStation, sizeof(baseStation));
+      float dx = p.x - baseStation.origin[0];
+      float dy = p.y - baseStation.origin[1];
+      float dz = p.z - baseStation.origin[2];
+      angles->angleX = atan2f(dy, dx) + noise(&seed, 0.001f);
+      angles->angleY = atan2f(dz, dx) + noise(&seed, 0.001f);
+      angles->stdDevX = 0.001f;
+      angles->stdDevY = 0.001f;
+    }
+  }
+
+  return count;
+}
+
+static bool update(kalmanCoreData_t* coreData, measurement_t* m, const Axis3f* gyro, kalmanCoreReplayResult_t* result) {
+  uint64_t start = nowNs();
+
+  switch (m->type) {
+    case MeasurementTypeTDOA:
+      kalmanCoreUpdateWithTDOA(coreData, &m->data.tdoa);
+      break;
+    case MeasurementTypePosition:
+      kalmanCoreUpdateWithPosition(coreData, &m->data.position);
+      break;
+    case MeasurementTypePose:
+      kalmanCoreUpdateWithPose(coreData, &m->data.pose);
+      break;
+    case MeasurementTypeDistance:
+      kalmanCoreUpdateWithDistance(coreData, &m->data.distance);
+      break;
+    case MeasurementTypeTOF:
+      kalmanCoreUpdateWithTof(coreData, &m->data.tof);
+      break;
+    case MeasurementTypeAbsoluteHeight:
+      kalmanCoreUpdateWithAbsoluteHeight(coreData, &m->data.height);
+      break;
+    case MeasurementTypeFlow:
+      kalmanCoreUpdateWithFlow(coreData, &m->data.flow, gyro);
+      break;
+    case MeasurementTypeYawError:
+      kalmanCoreUpdateWithYawError(coreData, &m->data.yawError);
+      break;
+    case MeasurementTypeSweepAngle:
+      kalmanCoreUpdateWithSweepAngles(coreData, &m->data.sweepAngle);
+      break;
+    default:
+      return false;
+  }
+
+  addTiming(&result->update[m->type], start);
+  return true;
+}
+
+void kalmanCoreReplayRun(kalmanCoreData_t* coreData, const kalmanCoreReplayEvent_t* events, int count, kalmanCoreReplayResult_t* result) {
+  memset(result, 0, sizeof(kalmanCoreReplayResult_t));
+  result->checksum = 2166136261u;
+
+  kalmanCoreInit(coreData);
+  outlierFilterReset();
+  if (count <= 0) {
+    return;
+  }
+
+  Axis3f accAccumulator = {.axis = {0}};
+  Axis3f gyroAccumulator = {.axis = {0}};
+  float thrustAccumulator = 0;
+  uint32_t imuAccumulatorCount = 0;
+  Axis3f gyroSnapshot = {.axis = {0}};
+
+  bool quadIsFlying = false;
+  uint32_t lastFlightCmd = 0;
+
+  uint32_t tick = events[0].tick;
+  uint32_t lastPrediction = tick;
+  uint32_t nextPrediction = tick + PREDICT_INTERVAL_MS;
+  uint32_t lastPNUpdate = tick;
+
+  int first = 0;
+  while (first < count) {
+    bool doneUpdate = false;
+
+    int end = first;
+    while (end < count && events[end].tick <= tick) {
+      end++;
+    }
+
+    // IMU data is accumulated by the stabilizer loop
+    for (int i = first; i < end; i++) {
+      if (events[i].isImu) {
+        accAccumulator.x += events[i].imu.acc.x;
+        accAccumulator.y += events[i].imu.acc.y;
+        accAccumulator.z += events[i].imu.acc.z;
+        gyroAccumulator.x += events[i].imu.gyro.x;
+        gyroAccumulator.y += events[i].imu.gyro.y;
+        gyroAccumulator.z += events[i].imu.gyro.z;
+        thrustAccumulator += events[i].imu.thrust;
+        imuAccumulatorCount++;
+        gyroSnapshot = events[i].imu.gyro;
+      }
+    }
+
+    if (tick >= nextPrediction) {
+      if (imuAccumulatorCount > 0) {
+        Axis3f acc;
+        Axis3f gyro;
+        for (int i = 0; i < 3; i++) {
+          acc.axis[i] = accAccumulator.axis[i] * GRAVITY_MAGNITUDE / imuAccumulatorCount;
+          gyro.axis[i] = gyroAccumulator.axis[i] * DEG_TO_RAD / imuAccumulatorCount;
+        }
+        float thrust = thrustAccumulator / imuAccumulatorCount;
+
+        accAccumulator = (Axis3f){.axis = {0}};
+        gyroAccumulator = (Axis3f){.axis = {0}};
+        thrustAccumulator = 0;
+        imuAccumulatorCount = 0;
+
+        if (thrust > IN_FLIGHT_THRUST_THRESHOLD) {
+          lastFlightCmd = tick;
+        }
+        quadIsFlying = (tick - lastFlightCmd) < IN_FLIGHT_TIME_THRESHOLD;
+
+        uint64_t start = nowNs();
+        kalmanCorePredict(coreData, thrust, &acc, &gyro, (tick - lastPrediction) / 1000.0f, quadIsFlying);
+        addTiming(&result->predict, start);
+
+        lastPrediction = tick;
+        doneUpdate = true;
+      }
+
+      nextPrediction = tick + PREDICT_INTERVAL_MS;
+    }
+
+    if (tick > lastPNUpdate) {
+      uint64_t start = nowNs();
+      kalmanCoreAddProcessNoise(coreData, (tick - lastPNUpdate) / 1000.0f);
+      addTiming(&result->processNoise, start);
+      lastPNUpdate = tick;
+    }
+
+    for (int i = first; i < end; i++) {
+      if (!events[i].isImu) {
+        measurement_t m = events[i].measurement;
+        Axis3f gyro = gyroSnapshot;
+        doneUpdate = update(coreData, &m, &gyro, result) || doneUpdate;
+      }
+    }
+
+    if (doneUpdate) {
+      uint64_t start = nowNs();
+      kalmanCoreFinalize(coreData, tick);
+      addTiming(&result->finalize, start);
+
+      result->checksum = addToChecksum(result->checksum, coreData->S, sizeof(coreData->S));
+      result->checksum = addToChecksum(result->checksum, coreData->q, sizeof(coreData->q));
+    }
+
+    first = end;
+    tick++;
+  }
+}
+
+static void printTiming(const char* name, const kalmanCoreReplayTiming_t* timing) {
+  uint64_t mean = timing->calls > 0 ? timing->totalNs / timing->calls : 0;
+  printf("  %-14s %8u %10llu %10llu\n", name, (unsigned int)timing->calls, (unsigned long long)mean, (unsigned long long)timing->maxNs);
+}
+
+void kalmanCoreReplayPrintReport(const kalmanCoreReplayResult_t* result) {
+  printf("  %-14s %8s %10s %10s\n", "call", "count", "mean [ns]", "max [ns]");
+  printTiming("predict", &result->predict);
+  printTiming("processNoise", &result->processNoise);
+  printTiming("finalize", &result->finalize);
+  for (int i = 0; i < MeasurementTypeCount; i++) {
+    char name[16];
+    snprintf(name, sizeof(name), "update %s", measurementTypeName(i));
+    printTiming(name, &result->update[i]);
+  }
+  printf("  trajectory checksum 0x%08x\n", (unsigned int)result->checksum);
+}
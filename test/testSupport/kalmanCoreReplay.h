@@ -0,0 +1,93 @@
+#pragma once
+
+/**
+ * Host side replay of recorded IMU and measurement streams through the kalman core.
+ *
+ * The replay runs the same sequence of calls as the kalman estimator task (predict, process noise, measurement
+ * updates and finalize) in 1 ms steps, and reports the time spent in each call as well as a checksum of the state
+ * trajectory. The checksum changes if any finalized state differs by as little as one bit, it is used to verify that
+ * a change in the estimator does not modify its output. Timings and checksums are only comparable between runs built
+ * with the same compiler and options.
+ *
+ * Recordings are text files with one event per line, in tick (ms) order. Empty lines and lines starting with # are
+ * ignored. Accelerations are in Gs, angular rates in deg/s, thrust in m/s^2, distances in m and angles in rad.
+ *
+ *   imu    tick accX accY accZ gyroX gyroY gyroZ thrust
+ *   pos    tick x y z stdDev
+ *   pose   tick x y z qx qy qz qw stdDevPos stdDevQuat
+ *   dist   tick anchorX anchorY anchorZ distance stdDev
+ *   tdoa   tick anchor0X anchor0Y anchor0Z anchor1X anchor1Y anchor1Z distanceDiff stdDev
+ *   tof    tick distance stdDev
+ *   height tick height stdDev
+ *   flow   tick dpixelx dpixely stdDevX stdDevY dt
+ *   yaw    tick yawError stdDev
+ *   sweep  tick originX originY originZ mat00 mat01 mat02 mat10 mat11 mat12 mat20 mat21 mat22 angleX angleY stdDevX stdDevY sensorX sensorY sensorZ
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "kalman_core.h"
+#include "stabilizer_types.h"
+
+typedef struct {
+  uint32_t tick;
+  bool isImu;
+  union {
+    struct {
+      Axis3f acc;
+      Axis3f gyro;
+      float thrust;
+    } imu;
+    measurement_t measurement;
+  };
+} kalmanCoreReplayEvent_t;
+
+typedef struct {
+  uint32_t calls;
+  uint64_t totalNs;
+  uint64_t maxNs;
+} kalmanCoreReplayTiming_t;
+
+typedef struct {
+  kalmanCoreReplayTiming_t predict;
+  kalmanCoreReplayTiming_t processNoise;
+  kalmanCoreReplayTiming_t finalize;
+  kalmanCoreReplayTiming_t update[MeasurementTypeCount];
+
+  // Checksum of the state and attitude after each finalize
+  uint32_t checksum;
+} kalmanCoreReplayResult_t;
+
+/**
+ * Parse one line of a recording.
+ *
+ * @return true if the line holds a valid event, false otherwise
+ */
+bool kalmanCoreReplayParseLine(const char* line, kalmanCoreReplayEvent_t* event);
+
+/**
+ * Load a recording from a file.
+ *
+ * @return the number of events read, or -1 if the file could not be read or contains malformed lines
+ */
+int kalmanCoreReplayLoad(const char* fileName, kalmanCoreReplayEvent_t* events, int maxCount);
+
+/**
+ * Generate a recording of a simulated flight, along a horizontal circle at 1 m, with all types of measurements.
+ * The noise is pseudo random but deterministic, the same recording is generated every time.
+ *
+ * @return the number of events generated
+ */
+int kalmanCoreReplayGenerateFlight(kalmanCoreReplayEvent_t* events, int maxCount, uint32_t durationMs);
+
+/**
+ * The true position at a time in the simulated flight
+ */
+void kalmanCoreReplayGetFlightPosition(uint32_t tick, point_t* position);
+
+/**
+ * Initialize the core, reset the TDoA outlier filter and replay a recording through it. Events must be sorted by tick.
+ */
+void kalmanCoreReplayRun(kalmanCoreData_t* coreData, const kalmanCoreReplayEvent_t* events, int count, kalmanCoreReplayResult_t* result);
+
+void kalmanCoreReplayPrintReport(const kalmanCoreReplayResult_t* result);
@@ -0,0 +1,205 @@
+// File under test lighthouse_calibration.c
+//
+// Compare the time spent in the converged correction to the original fixed iteration implementation with
+//   rake unit "DEFINES=SHOW_OUTPUT" "FILES=test/utils/src/lighthouse/test_lighthouse_calibration.c"
+// Timings on the host only give a rough idea of the relation, the CMSIS-DSP functions are optimized for the Cortex-M4.
+
+#include "lighthouse_calibration.h"
+
+#include <math.h>
+#include <stdio.h>
+#include "unity.h"
+#include "hostTime.h"
+
+// Build the arm dsp math lib and use the "real thing" instead of mocking calls to it
+// @BUILD_LIB ARM_DSP_MATH
+
+// Functions under test
+void correctFixedIterations(const lighthouseCalibration_t* calib, const float * angle, float * corrected);
+void correctUntilConverged(const lighthouseCalibration_t* calib, const float * angle, float * corrected);
+
+#define MAX_ANGLE 1.0f
+#define GRID_STEPS 41
+#define BENCHMARK_ROUNDS 20
+
+// The sweep angle noise is around 1e-4 rad
+#define MAX_ERROR 1e-5f
+
+static void initTypicalCalibration(lighthouseCalibration_t* calib);
+static void initLargeCalibration(lighthouseCalibration_t* calib);
+static float maxErrorOverGrid(const lighthouseCalibration_t* calib);
+static float gridAngle(int step);
+
+static lighthouseCalibration_t calib;
+
+void setUp(void) {
+  initTypicalCalibration(&calib);
+}
+
+void tearDown(void) {
+  // Empty
+}
+
+
+void testThatUncalibratedAnglesAreNotChanged() {
+  // Fixture
+  calib.valid = false;
+  float raw[2] = {0.3f, -0.4f};
+  float actual[2];
+
+  // Test
+  lighthouseCalibrationApply(&calib, raw, actual);
+
+  // Assert
+  TEST_ASSERT_EQUAL_FLOAT(0.3f, actual[0]);
+  TEST_ASSERT_EQUAL_FLOAT(-0.4f, actual[1]);
+}
+
+void testThatZeroCalibrationDoesNotChangeAngles() {
+  // Fixture
+  lighthouseCalibration_t zeroCalib = {.valid = true};
+  float raw[2] = {0.3f, -0.4f};
+  float actual[2];
+
+  // Test
+  lighthouseCalibrationApply(&zeroCalib, raw, actual);
+
+  // Assert
+  TEST_ASSERT_FLOAT_WITHIN(MAX_ERROR, 0.3f, actual[0]);
+  TEST_ASSERT_FLOAT_WITHIN(MAX_ERROR, -0.4f, actual[1]);
+}
+
+void testThatConvergedCorrectionMatchesFixedIterationsForTypicalCalibration() {
+  // Fixture
+  // Test
+  float actual = maxErrorOverGrid(&calib);
+
+  // Assert
+#ifdef SHOW_OUTPUT
+  printf("Typical calibration, max error %e rad\n", (double)actual);
+#endif
+  TEST_ASSERT_TRUE(actual < MAX_ERROR);
+}
+
+void testThatConvergedCorrectionMatchesFixedIterationsForLargeCalibration() {
+  // Fixture
+  initLargeCalibration(&calib);
+
+  // Test
+  float actual = maxErrorOverGrid(&calib);
+
+  // Assert
+#ifdef SHOW_OUTPUT
+  printf("Large calibration, max error %e rad\n", (double)actual);
+#endif
+  TEST_ASSERT_TRUE(actual < MAX_ERROR);
+}
+
+void testThatAppliedCalibrationUsesConvergedCorrection() {
+  // Fixture
+  float raw[2] = {0.5f, 0.2f};
+  float expected[2];
+  float actual[2];
+  correctUntilConverged(&calib, raw, expected);
+
+  // Test
+  lighthouseCalibrationApply(&calib, raw, actual);
+
+  // Assert
+  TEST_ASSERT_EQUAL_FLOAT(expected[0], actual[0]);
+  TEST_ASSERT_EQUAL_FLOAT(expected[1], actual[1]);
+}
+
+void testTimeOfConvergedCorrectionComparedToFixedIterations() {
+  // Fixture
+  float sum = 0.0f;
+  float corrected[2];
+
+  // Test
+  uint64_t start = nowNs();
+  for (int round = 0; round < BENCHMARK_ROUNDS; round++) {
+    for (int i = 0; i < GRID_STEPS; i++) {
+      for (int j = 0; j < GRID_STEPS; j++) {
+        float angle[2] = {gridAngle(i), gridAngle(j)};
+        correctFixedIterations(&calib, angle, corrected);
+        sum += corrected[0];
+      }
+    }
+  }
+  uint64_t fixedNs = nowNs() - start;
+
+  start = nowNs();
+  for (int round = 0; round < BENCHMARK_ROUNDS; round++) {
+    for (int i = 0; i < GRID_STEPS; i++) {
+      for (int j = 0; j < GRID_STEPS; j++) {
+        float angle[2] = {gridAngle(i), gridAngle(j)};
+        correctUntilConverged(&calib, angle, corrected);
+        sum += corrected[0];
+      }
+    }
+  }
+  uint64_t convergedNs = nowNs() - start;
+
+  // Assert
+  const int calls = BENCHMARK_ROUNDS * GRID_STEPS * GRID_STEPS;
+#ifdef SHOW_OUTPUT
+  printf("%d calls\n", calls);
+  printf("  fixed iterations %8.1f ns/call\n", (double)fixedNs / calls);
+  printf("  converged        %8.1f ns/call\n", (double)convergedNs / calls);
+#else
+  (void)calls;
+  (void)fixedNs;
+  (void)convergedNs;
+#endif
+
+  TEST_ASSERT_TRUE(isfinite(sum));
+}
+
+
+// Helpers ///////////////////////////////////////////////////////////
+
+// Values in the range of what is received from base stations in the OOTX frame
+static void initTypicalCalibration(lighthouseCalibration_t* calib) {
+  *calib = (lighthouseCalibration_t){
+    .valid = true,
+    .axis = {
+      {.phase = -0.0057f, .tilt = -0.0046f, .curve = 0.0018f, .gibmag = 0.0047f, .gibphase = 1.31f},
+      {.phase = -0.0042f, .tilt = 0.0035f, .curve = -0.0021f, .gibmag = -0.0034f, .gibphase = 2.01f},
+    },
+  };
+}
+
+// Ten times the typical distortion, large enough for the atan() fallback of the small angle correction to be used
+static void initLargeCalibration(lighthouseCalibration_t* calib) {
+  *calib = (lighthouseCalibration_t){
+    .valid = true,
+    .axis = {
+      {.phase = 0.05f, .tilt = -0.05f, .curve = 0.02f, .gibmag = 0.02f, .gibphase = -0.7f},
+      {.phase = -0.04f, .tilt = 0.04f, .curve = -0.03f, .gibmag = -0.015f, .gibphase = 2.5f},
+    },
+  };
+}
+
+static float maxErrorOverGrid(const lighthouseCalibration_t* calib) {
+  float maxError = 0.0f;
+
+  for (int i = 0; i < GRID_STEPS; i++) {
+    for (int j = 0; j < GRID_STEPS; j++) {
+      float angle[2] = {gridAngle(i), gridAngle(j)};
+      float expected[2];
+      float actual[2];
+
+      correctFixedIterations(calib, angle, expected);
+      correctUntilConverged(calib, angle, actual);
+
+      maxError = fmaxf(maxError, fabsf(expected[0] - actual[0]));
+      maxError = fmaxf(maxError, fabsf(expected[1] - actual[1]));
+    }
+  }
+
+  return maxError;
+}
+
+static float gridAngle(int step) {
+  return -MAX_ANGLE + (2.0f * MAX_ANGLE * step) / (GRID_STEPS - 1);
+}
@@ -7,6 +7,18 @@
 // Build the arm dsp math lib and use the "real thing" instead of mocking calls to it
 // @BUILD_LIB ARM_DSP_MATH
 
+#define SWEEP_TEST_SENSORS 4
+
+static void initBaseStationLookingAt(baseStationGeometry_t* bs, const vec3d origin, const vec3d target);
+static void initBaseStationsForSweepPairs(baseStationGeometry_t bs[2]);
+static void initSweepPair(lighthouseGeometrySweepPair_t* sweepPair, const baseStationGeometry_t* bs, const vec3d cfPos, const vec3d sensorOffset);
+static void assertVec3dWithin(const float delta, const vec3d expected, const vec3d actual);
+
+// Sensor positions on the lighthouse deck, not rotated
+static const vec3d sweepTestSensorOffsets[SWEEP_TEST_SENSORS] = {
+  {-0.015, 0.0075, 0}, {-0.015, -0.0075, 0}, {0.015, 0.0075, 0}, {0.015, -0.0075, 0},
+};
+
 void setUp(void) {
 }
 
@@ -253,3 +265,196 @@ void testThatYawDeltaIsNotCalculatedForSmallIntersectionPointVector() {
   // Assert
   TEST_ASSERT_FALSE(actualResult);
 }
+
+void testThatPositionIsFoundFromSweepPairsOfTwoBaseStations() {
+  // Fixture
+  vec3d cfPos = {0.3, -0.2, 0.8};
+  baseStationGeometry_t bs[2];
+  initBaseStationsForSweepPairs(bs);
+
+  lighthouseGeometrySweepPair_t sweepPairs[2 * SWEEP_TEST_SENSORS];
+  int count = 0;
+  for (int sensor = 0; sensor < SWEEP_TEST_SENSORS; sensor++) {
+    for (int b = 0; b < 2; b++) {
+      initSweepPair(&sweepPairs[count++], &bs[b], cfPos, sweepTestSensorOffsets[sensor]);
+    }
+  }
+
+  vec3d actual;
+  float actualDelta;
+
+  // Test
+  bool actualResult = lighthouseGeometryGetPositionFromSweepPairs(sweepPairs, count, actual, &actualDelta);
+
+  // Assert
+  TEST_ASSERT_TRUE(actualResult);
+  assertVec3dWithin(0.001, cfPos, actual);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 0.0, actualDelta);
+}
+
+void testThatPositionIsFoundWhenEachSensorOnlySeesOneBaseStation() {
+  // Fixture
+  vec3d cfPos = {-0.5, 0.4, 1.2};
+  baseStationGeometry_t bs[2];
+  initBaseStationsForSweepPairs(bs);
+
+  // Sensors 0 and 1 are occluded from base station 1 and sensors 2 and 3 from base station 0
+  lighthouseGeometrySweepPair_t sweepPairs[SWEEP_TEST_SENSORS];
+  for (int sensor = 0; sensor < SWEEP_TEST_SENSORS; sensor++) {
+    initSweepPair(&sweepPairs[sensor], &bs[sensor / 2], cfPos, sweepTestSensorOffsets[sensor]);
+  }
+
+  vec3d actual;
+  float actualDelta;
+
+  // Test
+  bool actualResult = lighthouseGeometryGetPositionFromSweepPairs(sweepPairs, SWEEP_TEST_SENSORS, actual, &actualDelta);
+
+  // Assert
+  TEST_ASSERT_TRUE(actualResult);
+  assertVec3dWithin(0.001, cfPos, actual);
+}
+
+void testThatPositionIsFoundFromSweepPairsOfThreeBaseStations() {
+  // Fixture
+  vec3d cfPos = {0.1, 0.6, 0.3};
+  baseStationGeometry_t bs[3];
+  initBaseStationsForSweepPairs(bs);
+  initBaseStationLookingAt(&bs[2], (vec3d){2.0, -2.0, 2.5}, (vec3d){0.0, 0.0, 0.5});
+
+  lighthouseGeometrySweepPair_t sweepPairs[3];
+  for (int b = 0; b < 3; b++) {
+    initSweepPair(&sweepPairs[b], &bs[b], cfPos, sweepTestSensorOffsets[b]);
+  }
+
+  vec3d actual;
+  float actualDelta;
+
+  // Test
+  bool actualResult = lighthouseGeometryGetPositionFromSweepPairs(sweepPairs, 3, actual, &actualDelta);
+
+  // Assert
+  TEST_ASSERT_TRUE(actualResult);
+  assertVec3dWithin(0.001, cfPos, actual);
+}
+
+void testThatSweepPairPositionMatchesRayIntersectionForOneSensor() {
+  // Fixture
+  vec3d cfPos = {0.3, -0.2, 0.8};
+  baseStationGeometry_t bs[2];
+  initBaseStationsForSweepPairs(bs);
+
+  lighthouseGeometrySweepPair_t sweepPairs[2];
+  vec3d noOffset = {0, 0, 0};
+  initSweepPair(&sweepPairs[0], &bs[0], cfPos, noOffset);
+  initSweepPair(&sweepPairs[1], &bs[1], cfPos, noOffset);
+
+  // Perturb the angles to get rays that do not intersect
+  sweepPairs[0].angles[0] += 0.002f;
+  sweepPairs[1].angles[1] -= 0.003f;
+
+  vec3d expected;
+  float expectedDelta;
+  lighthouseGeometryGetPositionFromRayIntersection(bs, sweepPairs[0].angles, sweepPairs[1].angles, expected, &expectedDelta);
+
+  vec3d actual;
+  float actualDelta;
+
+  // Test
+  bool actualResult = lighthouseGeometryGetPositionFromSweepPairs(sweepPairs, 2, actual, &actualDelta);
+
+  // Assert
+  TEST_ASSERT_TRUE(actualResult);
+  assertVec3dWithin(0.01, expected, actual);
+  TEST_ASSERT_TRUE(actualDelta > 0.0f);
+}
+
+void testThatPositionIsNotFoundFromOneBaseStation() {
+  // Fixture
+  vec3d cfPos = {0.3, -0.2, 0.8};
+  baseStationGeometry_t bs[2];
+  initBaseStationsForSweepPairs(bs);
+
+  lighthouseGeometrySweepPair_t sweepPairs[SWEEP_TEST_SENSORS];
+  for (int sensor = 0; sensor < SWEEP_TEST_SENSORS; sensor++) {
+    initSweepPair(&sweepPairs[sensor], &bs[0], cfPos, sweepTestSensorOffsets[sensor]);
+  }
+
+  vec3d actual;
+  float actualDelta;
+
+  // Test
+  bool actualResult = lighthouseGeometryGetPositionFromSweepPairs(sweepPairs, SWEEP_TEST_SENSORS, actual, &actualDelta);
+
+  // Assert
+  TEST_ASSERT_FALSE(actualResult);
+}
+
+void testThatPositionIsNotFoundWithoutSweepPairs() {
+  // Fixture
+  vec3d actual;
+  float actualDelta;
+
+  // Test
+  bool actualResult = lighthouseGeometryGetPositionFromSweepPairs(NULL, 0, actual, &actualDelta);
+
+  // Assert
+  TEST_ASSERT_FALSE(actualResult);
+}
+
+
+// Helpers ///////////////////////////////////////////////////////////
+
+// Base station at origin, rotated so that the ray for the angles (0, 0) points at target
+static void initBaseStationLookingAt(baseStationGeometry_t* bs, const vec3d origin, const vec3d target) {
+  vec3d x = {target[0] - origin[0], target[1] - origin[1], target[2] - origin[2]};
+  float xLen = sqrtf(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
+  for (int i = 0; i < 3; i++) {
+    x[i] /= xLen;
+  }
+
+  // y = (0, 0, 1) x x, z = x x y
+  vec3d y = {-x[1], x[0], 0};
+  float yLen = sqrtf(y[0] * y[0] + y[1] * y[1]);
+  for (int i = 0; i < 3; i++) {
+    y[i] /= yLen;
+  }
+  vec3d z = {x[1] * y[2] - x[2] * y[1], x[2] * y[0] - x[0] * y[2], x[0] * y[1] - x[1] * y[0]};
+
+  for (int i = 0; i < 3; i++) {
+    bs->origin[i] = origin[i];
+    bs->mat[i][0] = x[i];
+    bs->mat[i][1] = y[i];
+    bs->mat[i][2] = z[i];
+  }
+}
+
+static void initBaseStationsForSweepPairs(baseStationGeometry_t bs[2]) {
+  initBaseStationLookingAt(&bs[0], (vec3d){-2.0, -2.0, 2.5}, (vec3d){0.0, 0.0, 0.5});
+  initBaseStationLookingAt(&bs[1], (vec3d){2.0, 2.0, 2.5}, (vec3d){0.0, 0.0, 0.5});
+}
+
+// The sweep angles of a sensor at cfPos + sensorOffset, see lighthouseGeometryGetRay()
+static void initSweepPair(lighthouseGeometrySweepPair_t* sweepPair, const baseStationGeometry_t* bs, const vec3d cfPos, const vec3d sensorOffset) {
+  vec3d world;
+  for (int i = 0; i < 3; i++) {
+    world[i] = cfPos[i] + sensorOffset[i] - bs->origin[i];
+  }
+
+  // Rotate to the base station reference frame with the transpose of the rotation matrix
+  vec3d local;
+  for (int i = 0; i < 3; i++) {
+    local[i] = bs->mat[0][i] * world[0] + bs->mat[1][i] * world[1] + bs->mat[2][i] * world[2];
+  }
+
+  sweepPair->baseStation = bs;
+  sweepPair->angles[0] = atan2f(local[1], local[0]);
+  sweepPair->angles[1] = atan2f(local[2], local[0]);
+  memcpy(sweepPair->sensorOffset, sensorOffset, sizeof(vec3d));
+}
+
+static void assertVec3dWithin(const float delta, const vec3d expected, const vec3d actual) {
+  for (int i = 0; i < vec3d_size; i++) {
+    TEST_ASSERT_FLOAT_WITHIN(delta, expected[i], actual[i]);
+  }
+}
@@ -0,0 +1,467 @@
+// File under test tdoaEngine.c
+//
+// Replays a simulated TDoA3 packet stream, with drifting anchor clocks and time stamps that wrap around, and compares
+// the single precision distance difference calculations with the original double precision implementation. Also
+// checks the number of measurements generated per packet, with one and with multiple anchor pairs per packet, the
+// order of the remote anchors and the measurement noise of a batch.
+//   rake unit "DEFINES=SHOW_OUTPUT" "FILES=test/utils/src/tdoa/test_tdoa_engine.c"
+#include "tdoaEngine.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+
+#include "tdoaStorage.h"
+#include "tdoaStats.h"
+#include "clockCorrectionEngine.h"
+#include "statsCnt.h"
+#include "physicalConstants.h"
+
+// Functions under test
+double calcDistanceDiffDouble(const int64_t rxAn_by_T_in_cl_T, const int64_t rxAr_by_T_in_cl_T, const int64_t delta_txAr_to_txAn_in_cl_An, const double clockCorrection, const double locodeckTsFreq);
+float calcDistanceDiffSingle(const int64_t rxAn_by_T_in_cl_T, const int64_t rxAr_by_T_in_cl_T, const int64_t delta_txAr_to_txAn_in_cl_An, const float clockCorrectionDeviation, const float metersPerTick);
+
+// Same as in locodeck.h
+#define LOCODECK_TS_FREQ (499.2e6 * 128)
+// The time stamps of the anchors are 32 bits in the TDoA3 packet, the tag time stamps are 40 bits
+#define ANCHOR_TIMESTAMP_MASK 0x00FFFFFFFFull
+#define TAG_TIMESTAMP_MASK 0xFFFFFFFFFFull
+
+#define ANCHOR_COUNT 8
+#define FIRST_ANCHOR_ID 10
+#define PACKET_COUNT 10000
+#define PACKET_INTERVAL 0.001
+#define TIMESTAMP_NOISE_TICKS 2
+#define REMOTE_DATA_MAX_AGE 0.03
+
+// Sub-centimeter, one tick is 4.7 mm
+#define MAX_DIFF_TO_DOUBLE_PRECISION 0.01f
+// The clock correction is estimated from noisy time stamps, the error grows with the time between the anchor packets
+#define MEAN_ERROR_TO_GEOMETRY 0.03f
+#define MAX_ERROR_TO_GEOMETRY 0.5f
+
+typedef struct {
+  uint8_t id;
+  uint8_t seqNr;
+  int64_t rxTime;
+  int64_t tof;
+} remoteAnchorData_t;
+
+typedef struct {
+  uint8_t anchorId;
+  uint32_t now_ms;
+  uint8_t seqNr;
+  int64_t txAn_in_cl_An;
+  int64_t rxAn_by_T_in_cl_T;
+  int remoteCount;
+  remoteAnchorData_t remote[ANCHOR_COUNT];
+} simulatedPacket_t;
+
+static void generatePacketStream(simulatedPacket_t packets[], const int count);
+static void sendTdoaToEstimator(const tdoaMeasurement_t tdoaMeasurements[], const int count);
+static void processPacketInEngine(const simulatedPacket_t* packet);
+static void processPacketStreamInEngine();
+static int findPacketWithRemoteData(const int remoteCount);
+static void setTagRxTimeAge(const uint8_t anchorId, const int64_t rxTime, const double age, const uint32_t now_ms);
+static float distanceToTag(const point_t* position);
+static int64_t clockTicks(const int anchor, const double time);
+static double anchorDistance(const int anchorA, const int anchorB);
+static int64_t noise();
+static uint32_t randomInt(const uint32_t max);
+
+static const double anchorPositions[ANCHOR_COUNT][3] = {
+  {-3.0, -3.0, 0.2}, {3.0, -3.0, 0.2}, {3.0, 3.0, 0.2}, {-3.0, 3.0, 0.2},
+  {-3.0, -3.0, 2.8}, {3.0, -3.0, 2.8}, {3.0, 3.0, 2.8}, {-3.0, 3.0, 2.8},
+};
+
+// Clock correction of each anchor clock, the last one is the tag
+static const double clockDrift[ANCHOR_COUNT + 1] = {4.1e-6, -7.3e-6, 1.2e-6, 9.6e-6, -2.5e-6, -9.8e-6, 6.6e-6, 0.3e-6, -5.2e-6};
+
+// Start time of each clock, the anchor time stamps wrap around every 67 ms and the tag time stamps every 17.2 s
+static const double clockOffset[ANCHOR_COUNT + 1] = {17.1, 3.4, 16.9, 11.0, 17.18, 8.2, 0.0, 14.5, 17.15};
+
+static const double tagPosition[3] = {0.7, -1.2, 1.1};
+
+static simulatedPacket_t packets[PACKET_COUNT];
+static tdoaEngineState_t engineState;
+static uint32_t randomState;
+
+static int batchCount;
+static tdoaMeasurement_t lastBatch[TDOA_ENGINE_MAX_PAIRS_PER_PACKET];
+static int lastBatchSize;
+static bool hasWrongStdDevInBatch;
+static int maxBatchSize;
+static bool hasDuplicatePairInBatch;
+static int measurementCount;
+static float sumOfErrorToGeometry;
+static float maxErrorToGeometry;
+
+void setUp(void) {
+  randomState = 1234;
+  generatePacketStream(packets, PACKET_COUNT);
+
+  tdoaEngineInit(&engineState, 0, sendTdoaToEstimator, LOCODECK_TS_FREQ);
+  batchCount = 0;
+  maxBatchSize = 0;
+  hasDuplicatePairInBatch = false;
+  lastBatchSize = 0;
+  hasWrongStdDevInBatch = false;
+  measurementCount = 0;
+  sumOfErrorToGeometry = 0.0f;
+  maxErrorToGeometry = 0.0f;
+}
+
+void tearDown(void) {
+  // Empty
+}
+
+
+void testThatDistanceDiffIsConvertedFromTicksToMeters() {
+  // Fixture
+  const int64_t rxAr_by_T_in_cl_T = 1000;
+  const int64_t rxAn_by_T_in_cl_T = 1000 + 50000 + 2131;
+  const int64_t delta_txAr_to_txAn_in_cl_An = 50000;
+  const float metersPerTick = (float)(SPEED_OF_LIGHT / LOCODECK_TS_FREQ);
+
+  // Test
+  float actual = calcDistanceDiffSingle(rxAn_by_T_in_cl_T, rxAr_by_T_in_cl_T, delta_txAr_to_txAn_in_cl_An, 0.0f, metersPerTick);
+
+  // Assert
+  const float expected = 2131 * SPEED_OF_LIGHT / LOCODECK_TS_FREQ;
+  TEST_ASSERT_FLOAT_WITHIN(0.0001f, expected, actual);
+}
+
+void testThatDistanceDiffIsClockCorrected() {
+  // Fixture
+  const int64_t delta_txAr_to_txAn_in_cl_An = 500000000;
+  const float clockCorrectionDeviation = 10e-6f;
+  const int64_t rxAr_by_T_in_cl_T = TAG_TIMESTAMP_MASK - 1000; // Wraps around
+  const int64_t rxAn_by_T_in_cl_T = (rxAr_by_T_in_cl_T + delta_txAr_to_txAn_in_cl_An + 5000 + 2131) & TAG_TIMESTAMP_MASK;
+  const float metersPerTick = (float)(SPEED_OF_LIGHT / LOCODECK_TS_FREQ);
+
+  // Test
+  float actual = calcDistanceDiffSingle(rxAn_by_T_in_cl_T, rxAr_by_T_in_cl_T, delta_txAr_to_txAn_in_cl_An, clockCorrectionDeviation, metersPerTick);
+
+  // Assert
+  float expected = (float)calcDistanceDiffDouble(rxAn_by_T_in_cl_T, rxAr_by_T_in_cl_T, delta_txAr_to_txAn_in_cl_An, 1.0 + clockCorrectionDeviation, LOCODECK_TS_FREQ);
+  TEST_ASSERT_FLOAT_WITHIN(MAX_DIFF_TO_DOUBLE_PRECISION, expected, actual);
+}
+
+void testThatSingleAndDoublePrecisionMatchOnPacketStream() {
+  // Fixture
+  clockCorrectionStorage_t doubleStorage[ANCHOR_COUNT];
+  clockCorrectionStorage_t singleStorage[ANCHOR_COUNT];
+  const simulatedPacket_t* latestPacket[ANCHOR_COUNT];
+  memset(doubleStorage, 0, sizeof(doubleStorage));
+  memset(singleStorage, 0, sizeof(singleStorage));
+  memset(latestPacket, 0, sizeof(latestPacket));
+
+  const float metersPerTick = (float)(SPEED_OF_LIGHT / LOCODECK_TS_FREQ);
+  int comparedCount = 0;
+  float maxDiff = 0.0f;
+
+  // Test
+  for (int i = 0; i < PACKET_COUNT; i++) {
+    const simulatedPacket_t* packet = &packets[i];
+    const int anchor = packet->anchorId - FIRST_ANCHOR_ID;
+    const simulatedPacket_t* previous = latestPacket[anchor];
+
+    if (previous) {
+      double candidate = clockCorrectionEngineCalculate(packet->rxAn_by_T_in_cl_T, previous->rxAn_by_T_in_cl_T, packet->txAn_in_cl_An, previous->txAn_in_cl_An, ANCHOR_TIMESTAMP_MASK);
+      bool doubleIsReliable = clockCorrectionEngineUpdate(&doubleStorage[anchor], candidate);
+      float deviationCandidate = clockCorrectionEngineCalculateDeviation(packet->rxAn_by_T_in_cl_T, previous->rxAn_by_T_in_cl_T, packet->txAn_in_cl_An, previous->txAn_in_cl_An, ANCHOR_TIMESTAMP_MASK);
+      bool singleIsReliable = clockCorrectionEngineUpdateDeviation(&singleStorage[anchor], deviationCandidate);
+      TEST_ASSERT_EQUAL(doubleIsReliable, singleIsReliable);
+
+      if (doubleIsReliable) {
+        float clockCorrectionDeviation;
+        clockCorrectionEngineGetDeviation(&singleStorage[anchor], &clockCorrectionDeviation);
+
+        for (int r = 0; r < packet->remoteCount; r++) {
+          const remoteAnchorData_t* remote = &packet->remote[r];
+          const simulatedPacket_t* remotePacket = latestPacket[remote->id - FIRST_ANCHOR_ID];
+          if (remotePacket && remotePacket->seqNr == remote->seqNr) {
+            const int64_t delta = remote->tof + ((packet->txAn_in_cl_An - remote->rxTime) & ANCHOR_TIMESTAMP_MASK);
+
+            double expected = calcDistanceDiffDouble(packet->rxAn_by_T_in_cl_T, remotePacket->rxAn_by_T_in_cl_T, delta, clockCorrectionEngineGet(&doubleStorage[anchor]), LOCODECK_TS_FREQ);
+            float actual = calcDistanceDiffSingle(packet->rxAn_by_T_in_cl_T, remotePacket->rxAn_by_T_in_cl_T, delta, clockCorrectionDeviation, metersPerTick);
+
+            maxDiff = fmaxf(maxDiff, fabsf((float)expected - actual));
+            comparedCount++;
+          }
+        }
+      }
+    }
+
+    latestPacket[anchor] = packet;
+  }
+
+  // Assert
+#ifdef SHOW_OUTPUT
+  printf("%d distance differences compared, max diff to double precision %f m\n", comparedCount, (double)maxDiff);
+#endif
+  TEST_ASSERT_TRUE(comparedCount > PACKET_COUNT);
+  TEST_ASSERT_TRUE(maxDiff < MAX_DIFF_TO_DOUBLE_PRECISION);
+}
+
+void testThatEngineMeasurementsOnPacketStreamMatchTheGeometry() {
+  // Fixture
+  // Test
+  processPacketStreamInEngine();
+
+  // Assert
+  const float meanError = sumOfErrorToGeometry / measurementCount;
+#ifdef SHOW_OUTPUT
+  printf("%d measurements from the engine, mean error %f m, max error %f m\n", measurementCount, (double)meanError, (double)maxErrorToGeometry);
+#endif
+  TEST_ASSERT_TRUE(measurementCount > PACKET_COUNT / 2);
+  TEST_ASSERT_TRUE(meanError < MEAN_ERROR_TO_GEOMETRY);
+  TEST_ASSERT_TRUE(maxErrorToGeometry < MAX_ERROR_TO_GEOMETRY);
+}
+
+void testThatOneMeasurementIsGeneratedPerPacketByDefault() {
+  // Fixture
+  // Test
+  processPacketStreamInEngine();
+
+  // Assert
+  TEST_ASSERT_EQUAL(1, engineState.pairsPerPacket);
+  TEST_ASSERT_EQUAL(1, maxBatchSize);
+  TEST_ASSERT_EQUAL(batchCount, measurementCount);
+}
+
+void testThatMultiplePairsPerPacketAreSentInOneBatch() {
+  // Fixture
+  engineState.pairsPerPacket = TDOA_ENGINE_MAX_PAIRS_PER_PACKET;
+
+  // Test
+  processPacketStreamInEngine();
+
+  // Assert
+#ifdef SHOW_OUTPUT
+  printf("%d measurements from %d packets with up to %d pairs per packet\n", measurementCount, batchCount, TDOA_ENGINE_MAX_PAIRS_PER_PACKET);
+#endif
+  TEST_ASSERT_EQUAL(TDOA_ENGINE_MAX_PAIRS_PER_PACKET, maxBatchSize);
+  TEST_ASSERT_TRUE(measurementCount > 2 * batchCount);
+  TEST_ASSERT_FALSE(hasDuplicatePairInBatch);
+}
+
+void testThatMultiplePairsPerPacketMatchTheGeometry() {
+  // Fixture
+  engineState.pairsPerPacket = TDOA_ENGINE_MAX_PAIRS_PER_PACKET;
+
+  // Test
+  processPacketStreamInEngine();
+
+  // Assert
+  const float meanError = sumOfErrorToGeometry / measurementCount;
+#ifdef SHOW_OUTPUT
+  printf("%d measurements from the engine, mean error %f m, max error %f m\n", measurementCount, (double)meanError, (double)maxErrorToGeometry);
+#endif
+  TEST_ASSERT_TRUE(meanError < MEAN_ERROR_TO_GEOMETRY);
+  TEST_ASSERT_TRUE(maxErrorToGeometry < MAX_ERROR_TO_GEOMETRY);
+}
+
+void testThatPairsPerPacketIsLimitedToTheMax() {
+  // Fixture
+  engineState.pairsPerPacket = TDOA_ENGINE_MAX_PAIRS_PER_PACKET + 3;
+
+  // Test
+  processPacketStreamInEngine();
+
+  // Assert
+  TEST_ASSERT_EQUAL(TDOA_ENGINE_MAX_PAIRS_PER_PACKET, maxBatchSize);
+}
+
+void testThatTheNoiseOfABatchIsScaledWithTheSquareRootOfTheBatchSize() {
+  // Fixture
+  engineState.pairsPerPacket = TDOA_ENGINE_MAX_PAIRS_PER_PACKET;
+
+  // Test
+  processPacketStreamInEngine();
+
+  // Assert
+  TEST_ASSERT_EQUAL(TDOA_ENGINE_MAX_PAIRS_PER_PACKET, maxBatchSize);
+  TEST_ASSERT_FALSE(hasWrongStdDevInBatch);
+}
+
+void testThatTheRemoteAnchorsWithTheYoungestDataAreUsedYoungestFirst() {
+  // Fixture
+  engineState.pairsPerPacket = 3;
+  const int packetIndex = findPacketWithRemoteData(ANCHOR_COUNT - 1);
+  TEST_ASSERT_TRUE(packetIndex > 0);
+  for (int i = 0; i < packetIndex; i++) {
+    processPacketInEngine(&packets[i]);
+  }
+
+  // Data from the tag for all remote anchors of the packet, with known ages. The first one is older than the 67 ms
+  // the anchor time stamps wrap around at, it must not be mistaken for young data.
+  const simulatedPacket_t* packet = &packets[packetIndex];
+  const double ages[ANCHOR_COUNT - 1] = {0.0685, 0.012, 0.003, 0.020, 0.006, 0.025, 0.030};
+  for (int r = 0; r < packet->remoteCount; r++) {
+    setTagRxTimeAge(packet->remote[r].id, packet->rxAn_by_T_in_cl_T, ages[r], packet->now_ms);
+  }
+
+  // Test
+  processPacketInEngine(packet);
+
+  // Assert
+  TEST_ASSERT_EQUAL(3, lastBatchSize);
+  const int expectedRemotes[] = {2, 4, 1};
+  for (int i = 0; i < 3; i++) {
+    const int anchor = packet->remote[expectedRemotes[i]].id - FIRST_ANCHOR_ID;
+    TEST_ASSERT_EQUAL_FLOAT(anchorPositions[anchor][0], lastBatch[i].anchorPosition[0].x);
+    TEST_ASSERT_EQUAL_FLOAT(anchorPositions[anchor][1], lastBatch[i].anchorPosition[0].y);
+    TEST_ASSERT_EQUAL_FLOAT(anchorPositions[anchor][2], lastBatch[i].anchorPosition[0].z);
+  }
+}
+
+
+// Helpers ///////////////////////////////////////////////////////////
+
+// Anchors transmit in random order with random intervals. All anchors receive all packets from the other anchors and
+// include the latest receive time, sequence number and time of flight for the anchors they have heard from recently.
+// The tag is static.
+static void generatePacketStream(simulatedPacket_t packets[], const int count) {
+  const int tag = ANCHOR_COUNT;
+  uint8_t seqNr[ANCHOR_COUNT] = {0};
+  remoteAnchorData_t received[ANCHOR_COUNT][ANCHOR_COUNT];
+  double receivedTime[ANCHOR_COUNT] = {0};
+  memset(received, 0, sizeof(received));
+
+  double time = 0.1;
+  for (int i = 0; i < count; i++) {
+    const int anchor = randomInt(ANCHOR_COUNT);
+    simulatedPacket_t* packet = &packets[i];
+
+    seqNr[anchor] = (seqNr[anchor] + 1) & 0x7f;
+    const double tagDistance = sqrt(pow(anchorPositions[anchor][0] - tagPosition[0], 2) + pow(anchorPositions[anchor][1] - tagPosition[1], 2) + pow(anchorPositions[anchor][2] - tagPosition[2], 2));
+
+    packet->anchorId = FIRST_ANCHOR_ID + anchor;
+    packet->now_ms = (uint32_t)(time * 1000);
+    packet->seqNr = seqNr[anchor];
+    packet->txAn_in_cl_An = clockTicks(anchor, time) & ANCHOR_TIMESTAMP_MASK;
+    packet->rxAn_by_T_in_cl_T = (clockTicks(tag, time + tagDistance / SPEED_OF_LIGHT) + noise()) & TAG_TIMESTAMP_MASK;
+
+    packet->remoteCount = 0;
+    for (int other = 0; other < ANCHOR_COUNT; other++) {
+      if (received[anchor][other].id != 0 && time - receivedTime[other] < REMOTE_DATA_MAX_AGE) {
+        packet->remote[packet->remoteCount] = received[anchor][other];
+        packet->remoteCount++;
+      }
+    }
+
+    for (int other = 0; other < ANCHOR_COUNT; other++) {
+      if (other != anchor) {
+        const double distance = anchorDistance(anchor, other);
+        received[other][anchor] = (remoteAnchorData_t){
+          .id = FIRST_ANCHOR_ID + anchor,
+          .seqNr = seqNr[anchor],
+          .rxTime = (clockTicks(other, time + distance / SPEED_OF_LIGHT) + noise()) & ANCHOR_TIMESTAMP_MASK,
+          .tof = llround(distance / SPEED_OF_LIGHT * LOCODECK_TS_FREQ),
+        };
+      }
+    }
+    receivedTime[anchor] = time;
+
+    time += PACKET_INTERVAL * (1.0 + randomInt(100) / 100.0);
+  }
+}
+
+// Same order as in the TDoA3 tag
+static void processPacketInEngine(const simulatedPacket_t* packet) {
+  const int anchor = packet->anchorId - FIRST_ANCHOR_ID;
+  tdoaAnchorContext_t anchorCtx;
+
+  tdoaEngineGetAnchorCtxForPacketProcessing(&engineState, packet->anchorId, packet->now_ms, &anchorCtx);
+  for (int r = 0; r < packet->remoteCount; r++) {
+    const remoteAnchorData_t* remote = &packet->remote[r];
+    tdoaStorageSetRemoteRxTime(&anchorCtx, remote->id, remote->rxTime, remote->seqNr);
+    tdoaStorageSetTimeOfFlight(&anchorCtx, remote->id, remote->tof);
+  }
+  tdoaEngineProcessPacket(&engineState, &anchorCtx, packet->txAn_in_cl_An, packet->rxAn_by_T_in_cl_T);
+  tdoaStorageSetRxTxData(&anchorCtx, packet->rxAn_by_T_in_cl_T, packet->txAn_in_cl_An, packet->seqNr);
+  tdoaStorageSetAnchorPosition(&anchorCtx, anchorPositions[anchor][0], anchorPositions[anchor][1], anchorPositions[anchor][2]);
+}
+
+static void processPacketStreamInEngine() {
+  for (int i = 0; i < PACKET_COUNT; i++) {
+    processPacketInEngine(&packets[i]);
+  }
+}
+
+// Returns the index of the last packet with data for at least remoteCount remote anchors, or -1 if none
+static int findPacketWithRemoteData(const int remoteCount) {
+  for (int i = PACKET_COUNT - 1; i > 0; i--) {
+    if (packets[i].remoteCount >= remoteCount) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+// Moves the latest reception time at the tag of an anchor packet, to age seconds before rxTime
+static void setTagRxTimeAge(const uint8_t anchorId, const int64_t rxTime, const double age, const uint32_t now_ms) {
+  tdoaAnchorContext_t anchorCtx;
+  TEST_ASSERT_TRUE(tdoaStorageGetCreateAnchorCtx(engineState.anchorInfoArray, anchorId, now_ms, &anchorCtx));
+
+  const int64_t agedRxTime = (rxTime - llround(age * LOCODECK_TS_FREQ)) & TAG_TIMESTAMP_MASK;
+  tdoaStorageSetRxTxData(&anchorCtx, agedRxTime, tdoaStorageGetTxTime(&anchorCtx), tdoaStorageGetSeqNr(&anchorCtx));
+}
+
+static void sendTdoaToEstimator(const tdoaMeasurement_t tdoaMeasurements[], const int count) {
+  memcpy(lastBatch, tdoaMeasurements, count * sizeof(tdoaMeasurement_t));
+  lastBatchSize = count;
+
+  for (int i = 0; i < count; i++) {
+    const tdoaMeasurement_t* tdoaMeasurement = &tdoaMeasurements[i];
+    if (fabsf(tdoaMeasurement->stdDev - 0.15f * sqrtf(count)) > 1e-6f) {
+      hasWrongStdDevInBatch = true;
+    }
+
+    const float expected = distanceToTag(&tdoaMeasurement->anchorPosition[1]) - distanceToTag(&tdoaMeasurement->anchorPosition[0]);
+    const float error = fabsf(expected - tdoaMeasurement->distanceDiff);
+    sumOfErrorToGeometry += error;
+    maxErrorToGeometry = fmaxf(maxErrorToGeometry, error);
+    measurementCount++;
+
+    // All measurements in a batch are from the same packet and must use different remote anchors
+    for (int j = 0; j < i; j++) {
+      if (memcmp(&tdoaMeasurements[j].anchorPosition[0], &tdoaMeasurement->anchorPosition[0], sizeof(point_t)) == 0) {
+        hasDuplicatePairInBatch = true;
+      }
+    }
+  }
+
+  batchCount++;
+  if (count > maxBatchSize) {
+    maxBatchSize = count;
+  }
+}
+
+static float distanceToTag(const point_t* position) {
+  return sqrtf(powf(position->x - (float)tagPosition[0], 2) + powf(position->y - (float)tagPosition[1], 2) + powf(position->z - (float)tagPosition[2], 2));
+}
+
+static int64_t clockTicks(const int clock, const double time) {
+  const double ticks = (clockOffset[clock] + time) * LOCODECK_TS_FREQ * (1.0 + clockDrift[clock]);
+  return (int64_t)ticks & TAG_TIMESTAMP_MASK;
+}
+
+static double anchorDistance(const int anchorA, const int anchorB) {
+  const double* a = anchorPositions[anchorA];
+  const double* b = anchorPositions[anchorB];
+  return sqrt(pow(a[0] - b[0], 2) + pow(a[1] - b[1], 2) + pow(a[2] - b[2], 2));
+}
+
+// Deterministic noise in the range [-TIMESTAMP_NOISE_TICKS, TIMESTAMP_NOISE_TICKS]
+static int64_t noise() {
+  return (int64_t)randomInt(2 * TIMESTAMP_NOISE_TICKS + 1) - TIMESTAMP_NOISE_TICKS;
+}
+
+static uint32_t randomInt(const uint32_t max) {
+  randomState = randomState * 1103515245 + 12345;
+  return (randomState >> 16) % max;
+}
@@ -200,3 +200,90 @@ void testUpdateClockCorrectionWithSampleInTheInnerLimitOfTheAcceptableNoise() {
   TEST_ASSERT_EQUAL_DOUBLE(expectedClockCorrection, clockCorrectionStorage.clockCorrection);
   TEST_ASSERT_EQUAL_UINT(expectedClockCorrectionBucket, clockCorrectionStorage.clockCorrectionBucket);
 }
+
+void testCalculateClockCorrectionDeviationWithValidInputDataWithWrapAround() {
+  // Fixture
+  const uint64_t mask = 0xFFFFFFFFFF; // 40 bits
+  const uint64_t difference_in_cl_x = 500000000; // Around 8 ms
+  const uint64_t difference_in_cl_reference = difference_in_cl_x + 6000; // 12 ppm faster
+
+  const uint64_t old_t_in_cl_x = mask - difference_in_cl_x / 2;
+  const uint64_t new_t_in_cl_x = (old_t_in_cl_x + difference_in_cl_x) & mask; // Wraps around
+  const uint64_t old_t_in_cl_reference = 56789;
+  const uint64_t new_t_in_cl_reference = old_t_in_cl_reference + difference_in_cl_reference; // Does not wrap around
+
+  // Test
+  const float result = clockCorrectionEngineCalculateDeviation(new_t_in_cl_reference, old_t_in_cl_reference, new_t_in_cl_x, old_t_in_cl_x, mask);
+
+  // Assert
+  const float expectedClockCorrectionDeviation = 12e-6f;
+  TEST_ASSERT_FLOAT_WITHIN(1e-11f, expectedClockCorrectionDeviation, result);
+}
+
+void testCalculateClockCorrectionDeviationWithInvalidInputData() {
+  // Fixture
+  const uint64_t mask = 0xFFFFFFFFFF; // 40 bits
+
+  const uint64_t old_t_in_cl_x = 1000;
+  const uint64_t new_t_in_cl_x = 1000;
+  const uint64_t old_t_in_cl_reference = 56789;
+  const uint64_t new_t_in_cl_reference = 56789;
+
+  // Test
+  const float result = clockCorrectionEngineCalculateDeviation(new_t_in_cl_reference, old_t_in_cl_reference, new_t_in_cl_x, old_t_in_cl_x, mask);
+
+  // Assert
+  TEST_ASSERT_EQUAL_FLOAT(-1.0f, result);
+}
+
+void testUpdateClockCorrectionDeviationAcceptsFirstSampleInTheSpecsAsNotReliable() {
+  // Fixture
+  const float clockCorrectionDeviationCandidate = 0.0f; // Within the noise of the initial value, but not accepted yet
+  clockCorrectionStorage_t clockCorrectionStorage = {0};
+  float actualDeviation = 0.0f;
+
+  // Test
+  const bool sampleIsReliable = clockCorrectionEngineUpdateDeviation(&clockCorrectionStorage, clockCorrectionDeviationCandidate);
+
+  // Assert
+  TEST_ASSERT_FALSE(sampleIsReliable);
+  TEST_ASSERT_TRUE(clockCorrectionEngineGetDeviation(&clockCorrectionStorage, &actualDeviation));
+  TEST_ASSERT_EQUAL_FLOAT(clockCorrectionDeviationCandidate, actualDeviation);
+}
+
+void testUpdateClockCorrectionDeviationWithSampleOutOfTheSpecs() {
+  // Fixture
+  const float clockCorrectionDeviationCandidate = (float)(CLOCK_CORRECTION_SPEC_MAX - 1.0);
+  clockCorrectionStorage_t clockCorrectionStorage = {0};
+  float actualDeviation = 0.0f;
+
+  // Test
+  const bool sampleIsReliable = clockCorrectionEngineUpdateDeviation(&clockCorrectionStorage, clockCorrectionDeviationCandidate);
+
+  // Assert
+  TEST_ASSERT_FALSE(sampleIsReliable);
+  TEST_ASSERT_FALSE(clockCorrectionEngineGetDeviation(&clockCorrectionStorage, &actualDeviation));
+}
+
+void testUpdateClockCorrectionDeviationWithSampleInTheAcceptableNoise() {
+  // Fixture
+  const float clockCorrectionDeviation = 10e-6f; // A value inside the clock specs
+  const unsigned int clockCorrectionBucket = 2;
+  const float clockCorrectionDeviationCandidate = clockCorrectionDeviation + 0.02e-6f;
+
+  clockCorrectionStorage_t clockCorrectionStorage = {
+    .clockCorrectionBucket = clockCorrectionBucket,
+    .clockCorrectionDeviation = clockCorrectionDeviation,
+    .hasClockCorrectionDeviation = true
+  };
+
+  // Test
+  const bool sampleIsReliable = clockCorrectionEngineUpdateDeviation(&clockCorrectionStorage, clockCorrectionDeviationCandidate);
+
+  // Assert
+  const float expectedClockCorrectionDeviation = clockCorrectionDeviation * (float)CLOCK_CORRECTION_FILTER + clockCorrectionDeviationCandidate * (1.0f - (float)CLOCK_CORRECTION_FILTER);
+  const unsigned int expectedClockCorrectionBucket = clockCorrectionBucket + 1;
+  TEST_ASSERT_TRUE(sampleIsReliable);
+  TEST_ASSERT_EQUAL_FLOAT(expectedClockCorrectionDeviation, clockCorrectionStorage.clockCorrectionDeviation);
+  TEST_ASSERT_EQUAL_UINT(expectedClockCorrectionBucket, clockCorrectionStorage.clockCorrectionBucket);
+}
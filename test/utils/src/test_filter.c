@@ -0,0 +1,96 @@
+// File under test filter.c
+#include "filter.h"
+
+#include <math.h>
+#include "unity.h"
+
+static float decimateTone(float inputRate, float frequency);
+
+static decimator2Data decimator;
+
+void setUp(void) {
+  decimator2Init(&decimator);
+}
+
+void tearDown(void) {
+  // Empty
+}
+
+
+void testThatDecimatorHasUnityGainAtDc() {
+  // Fixture
+  float actual = 0.0f;
+
+  // Test
+  for (int i = 0; i < DECIMATOR2_TAPS; i++) {
+    actual = decimator2Apply(&decimator, 123.0f, 123.0f);
+  }
+
+  // Assert
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 123.0f, actual);
+}
+
+void testThatDecimatorIsZeroAfterInit() {
+  // Fixture
+  // Test
+  float actual = decimator2Apply(&decimator, 0.0f, 0.0f);
+
+  // Assert
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, actual);
+}
+
+void testThatDecimatorPassesLowFrequencies() {
+  // Fixture
+  // 100 Hz at 2 kHz in
+
+  // Test
+  float actual = decimateTone(2000.0f, 100.0f);
+
+  // Assert
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 1.0f, actual);
+}
+
+void testThatDecimatorAttenuatesFrequenciesThatAlias() {
+  // Fixture
+  // 850 Hz at 2 kHz in would alias to 150 Hz at 1 kHz out
+
+  // Test
+  float actual = decimateTone(2000.0f, 850.0f);
+
+  // Assert
+  // At least 40 dB
+  TEST_ASSERT_TRUE(actual < 0.01f);
+}
+
+void testThatDecimatorAttenuatesTonesCloseToTheInputNyquistFrequency() {
+  // Fixture
+  // 950 Hz at 2 kHz in would alias to 50 Hz at 1 kHz out
+
+  // Test
+  float actual = decimateTone(2000.0f, 950.0f);
+
+  // Assert
+  TEST_ASSERT_TRUE(actual < 0.01f);
+}
+
+
+// Helpers ///////////////////////////////////////////////////////////
+
+// Feeds a unit amplitude sine through the decimator and returns the amplitude of the output, from its RMS value after
+// the filter has settled
+static float decimateTone(float inputRate, float frequency) {
+  const int settledSamples = 200;
+  float sumOfSquares = 0.0f;
+
+  for (int i = 0; i < DECIMATOR2_TAPS + settledSamples; i++) {
+    float t0 = (2 * i) / inputRate;
+    float t1 = (2 * i + 1) / inputRate;
+    float out = decimator2Apply(&decimator, sinf(2.0f * (float)M_PI * frequency * t0), sinf(2.0f * (float)M_PI * frequency * t1));
+
+    if (i >= DECIMATOR2_TAPS) {
+      sumOfSquares += out * out;
+    }
+  }
+
+  return sqrtf(2.0f * sumOfSquares / settledSamples);
+}
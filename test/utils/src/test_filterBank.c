@@ -0,0 +1,251 @@
+// File under test filterBank.c
+//
+// Compare the time spent in the filter bank to the lpf2p filters it replaces with
+//   rake unit "DEFINES=SHOW_OUTPUT" "FILES=test/utils/src/test_filterBank.c"
+// Timings on the host only give a rough idea of the relation, the CMSIS-DSP functions are optimized for the Cortex-M4.
+
+#include "filterBank.h"
+
+#include <math.h>
+#include <stdio.h>
+#include "unity.h"
+#include "filter.h"
+#include "hostTime.h"
+
+// Build the arm dsp math lib and use the "real thing" instead of mocking calls to it
+// @BUILD_LIB ARM_DSP_MATH
+
+#define SAMPLE_FREQ 1000.0f
+#define BENCHMARK_SAMPLES 100000
+#define SIGNAL_SAMPLES 1000
+
+static float filterTone(const filterBankStage_t* stages, int count, float frequency);
+static float testSignal(int i);
+
+static filterBankData bank;
+
+void setUp(void) {
+  filterBankInit(&bank, SAMPLE_FREQ);
+}
+
+void tearDown(void) {
+  // Empty
+}
+
+
+void testThatEmptyBankPassesSamplesThrough() {
+  // Fixture
+  float samples[FILTER_BANK_AXES] = {1.0f, -2.0f, 3.0f};
+
+  // Test
+  filterBankApply(&bank, samples);
+
+  // Assert
+  TEST_ASSERT_EQUAL_FLOAT(1.0f, samples[0]);
+  TEST_ASSERT_EQUAL_FLOAT(-2.0f, samples[1]);
+  TEST_ASSERT_EQUAL_FLOAT(3.0f, samples[2]);
+}
+
+void testThatLowpassStageMatchesLpf2p() {
+  // Fixture
+  filterBankStage_t stages[] = {{.type = filterBankStageLowpass, .frequency = 80.0f}};
+  filterBankConfigure(&bank, stages, 1);
+
+  lpf2pData lpf[FILTER_BANK_AXES];
+  for (int axis = 0; axis < FILTER_BANK_AXES; axis++) {
+    lpf2pInit(&lpf[axis], SAMPLE_FREQ, 80.0f);
+  }
+
+  for (int i = 0; i < 1000; i++) {
+    float samples[FILTER_BANK_AXES];
+    float expected[FILTER_BANK_AXES];
+    for (int axis = 0; axis < FILTER_BANK_AXES; axis++) {
+      samples[axis] = testSignal(i + 100 * axis);
+      expected[axis] = lpf2pApply(&lpf[axis], samples[axis]);
+    }
+
+    // Test
+    filterBankApply(&bank, samples);
+
+    // Assert
+    for (int axis = 0; axis < FILTER_BANK_AXES; axis++) {
+      TEST_ASSERT_FLOAT_WITHIN(1e-4f, expected[axis], samples[axis]);
+    }
+  }
+}
+
+void testThatNotchStageRemovesTheCenterFrequency() {
+  // Fixture
+  filterBankStage_t stages[] = {{.type = filterBankStageNotch, .frequency = 200.0f, .q = 3.0f}};
+
+  // Test
+  float actual = filterTone(stages, 1, 200.0f);
+
+  // Assert
+  TEST_ASSERT_TRUE(actual < 0.01f);
+}
+
+void testThatNotchStagePassesOtherFrequencies() {
+  // Fixture
+  filterBankStage_t stages[] = {{.type = filterBankStageNotch, .frequency = 200.0f, .q = 3.0f}};
+
+  // Test
+  float actual = filterTone(stages, 1, 20.0f);
+
+  // Assert
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 1.0f, actual);
+}
+
+void testThatCascadedStagesAreAllApplied() {
+  // Fixture
+  filterBankStage_t stages[] = {
+    {.type = filterBankStageLowpass, .frequency = 300.0f},
+    {.type = filterBankStageNotch, .frequency = 150.0f, .q = 3.0f},
+    {.type = filterBankStageNotch, .frequency = 200.0f, .q = 3.0f},
+  };
+
+  // Test
+  float actual150 = filterTone(stages, 3, 150.0f);
+  float actual200 = filterTone(stages, 3, 200.0f);
+
+  // Assert
+  TEST_ASSERT_TRUE(actual150 < 0.01f);
+  TEST_ASSERT_TRUE(actual200 < 0.01f);
+}
+
+void testThatStagesAboveTheNyquistFrequencyAreSkipped() {
+  // Fixture
+  filterBankStage_t stages[] = {
+    {.type = filterBankStageNone, .frequency = 100.0f},
+    {.type = filterBankStageNotch, .frequency = 600.0f, .q = 3.0f},
+    {.type = filterBankStageLowpass, .frequency = 80.0f},
+  };
+
+  // Test
+  filterBankConfigure(&bank, stages, 3);
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT8(1, bank.activeStages);
+}
+
+void testThatNonFiniteOutputIsNotPropagated() {
+  // Fixture
+  filterBankStage_t stages[] = {{.type = filterBankStageLowpass, .frequency = 80.0f}};
+  filterBankConfigure(&bank, stages, 1);
+  float samples[FILTER_BANK_AXES] = {INFINITY, 0.0f, 0.0f};
+  filterBankApply(&bank, samples);
+
+  // Test
+  samples[0] = 1.0f;
+  filterBankApply(&bank, samples);
+
+  // Assert
+  TEST_ASSERT_TRUE(isfinite(samples[0]));
+}
+
+void testThatFilterBankIsTimedAgainstLpf2p() {
+  // Fixture
+  lpf2pData lpf[FILTER_BANK_AXES];
+  for (int axis = 0; axis < FILTER_BANK_AXES; axis++) {
+    lpf2pInit(&lpf[axis], SAMPLE_FREQ, 80.0f);
+  }
+
+  filterBankData lowpassBank;
+  filterBankInit(&lowpassBank, SAMPLE_FREQ);
+  filterBankStage_t lowpass[] = {{.type = filterBankStageLowpass, .frequency = 80.0f}};
+  filterBankConfigure(&lowpassBank, lowpass, 1);
+
+  filterBankData fullBank;
+  filterBankInit(&fullBank, SAMPLE_FREQ);
+  filterBankStage_t full[] = {
+    {.type = filterBankStageLowpass, .frequency = 80.0f},
+    {.type = filterBankStageNotch, .frequency = 150.0f, .q = 3.0f},
+    {.type = filterBankStageNotch, .frequency = 300.0f, .q = 3.0f},
+    {.type = filterBankStageNotch, .frequency = 450.0f, .q = 3.0f},
+  };
+  filterBankConfigure(&fullBank, full, 4);
+
+  static float signal[SIGNAL_SAMPLES];
+  for (int i = 0; i < SIGNAL_SAMPLES; i++) {
+    signal[i] = testSignal(i);
+  }
+
+  float lpfSamples[FILTER_BANK_AXES] = {0};
+  float lowpassSamples[FILTER_BANK_AXES] = {0};
+  float fullSamples[FILTER_BANK_AXES] = {0};
+
+  // Test
+  uint64_t start = nowNs();
+  for (int i = 0; i < BENCHMARK_SAMPLES; i++) {
+    for (int axis = 0; axis < FILTER_BANK_AXES; axis++) {
+      lpfSamples[axis] = lpf2pApply(&lpf[axis], signal[(i + axis) % SIGNAL_SAMPLES]);
+    }
+  }
+  uint64_t lpfNs = nowNs() - start;
+
+  start = nowNs();
+  for (int i = 0; i < BENCHMARK_SAMPLES; i++) {
+    for (int axis = 0; axis < FILTER_BANK_AXES; axis++) {
+      lowpassSamples[axis] = signal[(i + axis) % SIGNAL_SAMPLES];
+    }
+    filterBankApply(&lowpassBank, lowpassSamples);
+  }
+  uint64_t lowpassNs = nowNs() - start;
+
+  start = nowNs();
+  for (int i = 0; i < BENCHMARK_SAMPLES; i++) {
+    for (int axis = 0; axis < FILTER_BANK_AXES; axis++) {
+      fullSamples[axis] = signal[(i + axis) % SIGNAL_SAMPLES];
+    }
+    filterBankApply(&fullBank, fullSamples);
+  }
+  uint64_t fullNs = nowNs() - start;
+
+  // Assert
+#ifdef SHOW_OUTPUT
+  printf("3 axes, %d samples\n", BENCHMARK_SAMPLES);
+  printf("  lpf2p                            %8.1f ns/sample\n", (double)lpfNs / BENCHMARK_SAMPLES);
+  printf("  filter bank, lowpass             %8.1f ns/sample\n", (double)lowpassNs / BENCHMARK_SAMPLES);
+  printf("  filter bank, lowpass + 3 notches %8.1f ns/sample\n", (double)fullNs / BENCHMARK_SAMPLES);
+#else
+  (void)lpfNs;
+  (void)lowpassNs;
+  (void)fullNs;
+#endif
+
+  for (int axis = 0; axis < FILTER_BANK_AXES; axis++) {
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, lpfSamples[axis], lowpassSamples[axis]);
+    TEST_ASSERT_TRUE(isfinite(fullSamples[axis]));
+  }
+}
+
+
+// Helpers ///////////////////////////////////////////////////////////
+
+// Runs a unit amplitude sine through a bank with the stages and returns the amplitude of the output, from its RMS
+// value after the filter has settled
+static float filterTone(const filterBankStage_t* stages, int count, float frequency) {
+  const int settleSamples = 500;
+  const int measureSamples = 1000;
+  float sumOfSquares = 0.0f;
+
+  filterBankConfigure(&bank, stages, count);
+
+  for (int i = 0; i < settleSamples + measureSamples; i++) {
+    float value = sinf(2.0f * PI * frequency * i / SAMPLE_FREQ);
+    float samples[FILTER_BANK_AXES] = {value, value, value};
+    filterBankApply(&bank, samples);
+
+    if (i >= settleSamples) {
+      sumOfSquares += samples[0] * samples[0];
+    }
+  }
+
+  return sqrtf(2.0f * sumOfSquares / measureSamples);
+}
+
+// A mix of a low frequency signal and high frequency vibrations
+static float testSignal(int i) {
+  float t = i / SAMPLE_FREQ;
+  return 10.0f * sinf(2.0f * PI * 3.0f * t) + 2.0f * sinf(2.0f * PI * 170.0f * t) + 0.5f * sinf(2.0f * PI * 410.0f * t);
+}
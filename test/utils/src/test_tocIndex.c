@@ -0,0 +1,158 @@
+// File under test tocIndex.c
+#include "tocIndex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+
+#include "mock_cfassert.h"
+#include "FreeRTOS.h"
+
+#define GROUP_COUNT 20
+#define VARIABLES_PER_GROUP 10
+#define TOC_LENGTH (GROUP_COUNT * (VARIABLES_PER_GROUP + 2))
+#define VAR_COUNT (GROUP_COUNT * VARIABLES_PER_GROUP)
+
+typedef struct {
+  tocIndexEntryType_t type;
+  char name[16];
+} tocEntry_t;
+
+static tocIndexEntryType_t getTocEntry(const int index, char** name);
+static void initToc();
+
+static tocEntry_t toc[TOC_LENGTH];
+static tocIndex_t tocIndex;
+
+void setUp(void) {
+  initToc();
+  tocIndexInit(&tocIndex, getTocEntry, TOC_LENGTH, VAR_COUNT);
+}
+
+void tearDown(void) {
+  free(tocIndex.varIndex);
+  free(tocIndex.nameHashes);
+  free(tocIndex.nameIndex);
+}
+
+
+void testThatVariableIsFoundByName() {
+  // Fixture
+  // Group 3 starts at 3 * 12, the variable is the 6:th in the group
+  const int expected = 3 * (VARIABLES_PER_GROUP + 2) + 1 + 5;
+
+  // Test
+  int actual = tocIndexFindByName(&tocIndex, "group3", "var5");
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(expected, actual);
+}
+
+void testThatAllVariablesAreFoundByName() {
+  // Fixture
+  char group[16];
+  char name[16];
+
+  for (int g = 0; g < GROUP_COUNT; g++) {
+    for (int v = 0; v < VARIABLES_PER_GROUP; v++) {
+      sprintf(group, "group%d", g);
+      sprintf(name, "var%d", v);
+
+      // Test
+      int actual = tocIndexFindByName(&tocIndex, group, name);
+
+      // Assert
+      TEST_ASSERT_EQUAL_INT(g * (VARIABLES_PER_GROUP + 2) + 1 + v, actual);
+    }
+  }
+}
+
+void testThatUnknownNameIsNotFound() {
+  // Fixture
+  // Test
+  int actualUnknownGroup = tocIndexFindByName(&tocIndex, "group99", "var1");
+  int actualUnknownName = tocIndexFindByName(&tocIndex, "group1", "var99");
+  int actualGroupAsName = tocIndexFindByName(&tocIndex, "group1", "group1");
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(-1, actualUnknownGroup);
+  TEST_ASSERT_EQUAL_INT(-1, actualUnknownName);
+  TEST_ASSERT_EQUAL_INT(-1, actualGroupAsName);
+}
+
+void testThatIdIsMappedToTocIndex() {
+  // Fixture
+  // Id 13 is the 4:th variable in the second group
+  const int expected = (VARIABLES_PER_GROUP + 2) + 1 + 3;
+
+  // Test
+  int actual = tocIndexGetTocIndex(&tocIndex, 13);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(expected, actual);
+}
+
+void testThatIdOutOfRangeIsRejected() {
+  // Fixture
+  // Test
+  int actualNegative = tocIndexGetTocIndex(&tocIndex, -1);
+  int actualTooLarge = tocIndexGetTocIndex(&tocIndex, VAR_COUNT);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(-1, actualNegative);
+  TEST_ASSERT_EQUAL_INT(-1, actualTooLarge);
+}
+
+void testThatGroupNameOfVariableIsFound() {
+  // Fixture
+  int index = tocIndexFindByName(&tocIndex, "group7", "var9");
+
+  // Test
+  char* actual = tocIndexGetGroupName(&tocIndex, index);
+
+  // Assert
+  TEST_ASSERT_EQUAL_STRING("group7", actual);
+}
+
+void testThatHashIncludesTheSeparator() {
+  // Fixture
+  // Test
+  uint32_t actual1 = tocIndexHashName("ab", "c");
+  uint32_t actual2 = tocIndexHashName("a", "bc");
+
+  // Assert
+  TEST_ASSERT_NOT_EQUAL(actual1, actual2);
+}
+
+
+// Helpers ///////////////////////////////////////////////////////////
+
+void* pvPortMalloc(size_t xSize) {
+  return malloc(xSize);
+}
+
+static tocIndexEntryType_t getTocEntry(const int index, char** name) {
+  *name = toc[index].name;
+  return toc[index].type;
+}
+
+// Groups of variables in the same layout as the log and param TOCs, a group start, the variables and a group stop
+static void initToc() {
+  int i = 0;
+  for (int g = 0; g < GROUP_COUNT; g++) {
+    toc[i].type = tocIndexEntryGroupStart;
+    sprintf(toc[i].name, "group%d", g);
+    i++;
+
+    for (int v = 0; v < VARIABLES_PER_GROUP; v++) {
+      toc[i].type = tocIndexEntryVariable;
+      sprintf(toc[i].name, "var%d", v);
+      i++;
+    }
+
+    toc[i].type = tocIndexEntryGroupStop;
+    sprintf(toc[i].name, "group%d", g);
+    i++;
+  }
+}
@@ -1,6 +1,7 @@
 # -*- coding: utf-8 -*-
 """
 decode: decodes binary logged sensor data from crazyflie2 with uSD-Card-Deck
+decodeGrouped: decodes files logged with rate= or event= groups in config.txt
 createConfig: create config file which has to placed on µSD-Card
 @author: jsschell
 """
@@ -10,12 +11,18 @@ import numpy as np
 import os
 
 
-def decode(filName):
+def decode(filName, sectorBuffered=False):
+    # sectorBuffered: the file was logged in mode 3 or 4, data sets are
+    # stored in sector aligned buffers with a 16 bit set count
     # read file as binary
     filObj = open(filName, 'rb')
     filCon = filObj.read()
     filObj.close()
     
+    # files with groups start with a 0
+    if filCon[0] == 0:
+        raise ValueError(filName + " was logged with groups, use decodeGrouped")
+
     # get file size to forecast output array
     statinfo = os.stat(filName)
     
@@ -41,6 +48,9 @@ def decode(filName):
         print("\tERROR\t["+hex(crcVal)+"]")
         crcErrors += 1
     offset = idx + 4
+    sectorSize = 512
+    if sectorBuffered:
+        offset = -(-offset // sectorSize) * sectorSize
     
     # process data sets
     setCon = np.zeros(statinfo.st_size) # upper bound...
@@ -49,14 +59,16 @@ def decode(filName):
     for setName in setNames:
         fmtStr += chr(setName[-2])
     setBytes = struct.calcsize(fmtStr)
+    countFmt = '<H' if sectorBuffered else 'B'
+    countBytes = struct.calcsize(countFmt)
     while(offset < len(filCon)):
-        setNumber = struct.unpack('B', filCon[offset:offset+1])
-        offset += 1
+        setNumber = struct.unpack(countFmt, filCon[offset:offset+countBytes])
+        offset += countBytes
         for ii in range(setNumber[0]):
             setCon[idx:idx+setWidth[0]] = np.array(struct.unpack(fmtStr, filCon[offset:setBytes+offset]))
             offset += setBytes
             idx += setWidth[0]
-        crcVal = crc32(filCon[offset-setBytes*setNumber[0]-1:offset+4]) & 0xffffffff
+        crcVal = crc32(filCon[offset-setBytes*setNumber[0]-countBytes:offset+4]) & 0xffffffff
         print("[CRC] of data set:", end="")
         if ( crcVal == 0xffffffff):
             print("\tOK\t["+hex(crcVal)+"]")
@@ -64,6 +76,9 @@ def decode(filName):
             print("\tERROR\t["+hex(crcVal)+"]")
             crcErrors += 1
         offset += 4
+        if sectorBuffered:
+            # skip the zero padding up to the next buffer
+            offset = -(-offset // sectorSize) * sectorSize
     if (not crcErrors):
         print("[CRC] no errors occurred:\tOK")
     else:
@@ -77,3 +92,84 @@ def decode(filName):
     for ii in range(setWidth[0]):
         output[setNames[ii][0:-3].decode("utf-8").strip()] = setCon[ii]
     return output
+
+
+def decodeGrouped(filName):
+    # returns a list with one dictionary of variables per group, and the
+    # ticks and types (0: emergency stop, 1: tumbled, 2: estimator reset) of
+    # the events
+    # read file as binary
+    filObj = open(filName, 'rb')
+    filCon = filObj.read()
+    filObj.close()
+
+    if filCon[0] != 0:
+        raise ValueError(filName + " was logged without groups, use decode")
+    sectorSize = 512
+    eventRecord = 0xff
+
+    # process file header
+    groupCount = filCon[1]
+    idx = 2
+    groupNames = []
+    groupFmts = []
+    for gg in range(groupCount):
+        setWidth = filCon[idx]
+        idx += 1
+        setNames = []
+        for ii in range(setWidth):
+            endIdx = filCon.index(b',', idx)
+            setNames.append(filCon[idx:endIdx])
+            idx = endIdx + 1
+        groupNames.append(setNames)
+        groupFmts.append("<" + "".join(chr(name[-2]) for name in setNames))
+    print("[CRC] of file header:", end="")
+    crcVal = crc32(filCon[0:idx+4]) & 0xffffffff
+    crcErrors = 0
+    if (crcVal == 0xffffffff):
+        print("\tOK\t["+hex(crcVal)+"]")
+    else:
+        print("\tERROR\t["+hex(crcVal)+"]")
+        crcErrors += 1
+    offset = -(-(idx + 4) // sectorSize) * sectorSize
+
+    # process buffers, they are stored in the order they were filled. The
+    # pre-trigger ring of the event group is stored as a buffer of its own,
+    # after the buffers that were full when the event happened, so its
+    # records come after records that are younger. Records and events are
+    # sorted by tick below
+    groupSets = [[] for gg in range(groupCount)]
+    events = []
+    while(offset < len(filCon)):
+        start = offset
+        setNumber = struct.unpack('<H', filCon[offset:offset+2])[0]
+        offset += 2
+        for ii in range(setNumber):
+            group = filCon[offset]
+            offset += 1
+            if group == eventRecord:
+                events.append(struct.unpack('<IB', filCon[offset:offset+5]))
+                offset += 5
+            else:
+                setBytes = struct.calcsize(groupFmts[group])
+                groupSets[group].append(struct.unpack(groupFmts[group], filCon[offset:offset+setBytes]))
+                offset += setBytes
+        crcVal = crc32(filCon[start:offset+4]) & 0xffffffff
+        if (crcVal != 0xffffffff):
+            print("[CRC] of data set:\tERROR\t["+hex(crcVal)+"]")
+            crcErrors += 1
+        offset = -(-(offset + 4) // sectorSize) * sectorSize
+    if (not crcErrors):
+        print("[CRC] no errors occurred:\tOK")
+    else:
+        print("[CRC] {0} errors occurred:\tERROR".format(crcErrors))
+
+    # create output dictionaries, sorted by tick
+    output = []
+    for gg in range(groupCount):
+        sets = np.array(sorted(groupSets[gg]), dtype=float).reshape(-1, len(groupNames[gg]))
+        groupOutput = {}
+        for ii, name in enumerate(groupNames[gg]):
+            groupOutput[name[0:-3].decode("utf-8").strip()] = sets[:, ii]
+        output.append(groupOutput)
+    return output, sorted(events)